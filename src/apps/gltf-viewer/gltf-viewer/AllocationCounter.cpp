@@ -0,0 +1,135 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+
+namespace {
+
+    std::atomic<std::size_t> gAllocationCount{0};
+
+    void * countedAllocation(std::size_t aSize)
+    {
+        gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+        // malloc(0) might return a null pointer, which operator new is not allowed to do.
+        if (void * result = std::malloc(aSize == 0 ? 1 : aSize))
+        {
+            return result;
+        }
+        throw std::bad_alloc{};
+    }
+
+    void * countedAlignedAllocation(std::size_t aSize, std::align_val_t aAlignment)
+    {
+        gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+        std::size_t alignment = static_cast<std::size_t>(aAlignment);
+        // aligned_alloc requires the size to be a multiple of the alignment.
+        std::size_t size = (aSize + alignment - 1) / alignment * alignment;
+#if defined(_WIN32)
+        if (void * result = _aligned_malloc(size == 0 ? alignment : size, alignment))
+#else
+        if (void * result = std::aligned_alloc(alignment, size == 0 ? alignment : size))
+#endif
+        {
+            return result;
+        }
+        throw std::bad_alloc{};
+    }
+
+    void alignedFree(void * aPointer)
+    {
+#if defined(_WIN32)
+        _aligned_free(aPointer);
+#else
+        std::free(aPointer);
+#endif
+    }
+
+} // anonymous namespace
+
+
+void * operator new(std::size_t aSize)
+{
+    return countedAllocation(aSize);
+}
+
+
+void * operator new[](std::size_t aSize)
+{
+    return countedAllocation(aSize);
+}
+
+
+void * operator new(std::size_t aSize, std::align_val_t aAlignment)
+{
+    return countedAlignedAllocation(aSize, aAlignment);
+}
+
+
+void * operator new[](std::size_t aSize, std::align_val_t aAlignment)
+{
+    return countedAlignedAllocation(aSize, aAlignment);
+}
+
+
+void operator delete(void * aPointer) noexcept
+{
+    std::free(aPointer);
+}
+
+
+void operator delete[](void * aPointer) noexcept
+{
+    std::free(aPointer);
+}
+
+
+void operator delete(void * aPointer, std::size_t) noexcept
+{
+    std::free(aPointer);
+}
+
+
+void operator delete[](void * aPointer, std::size_t) noexcept
+{
+    std::free(aPointer);
+}
+
+
+void operator delete(void * aPointer, std::align_val_t) noexcept
+{
+    alignedFree(aPointer);
+}
+
+
+void operator delete[](void * aPointer, std::align_val_t) noexcept
+{
+    alignedFree(aPointer);
+}
+
+
+void operator delete(void * aPointer, std::size_t, std::align_val_t) noexcept
+{
+    alignedFree(aPointer);
+}
+
+
+void operator delete[](void * aPointer, std::size_t, std::align_val_t) noexcept
+{
+    alignedFree(aPointer);
+}
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+std::size_t getAllocationCount()
+{
+    return gAllocationCount.load(std::memory_order_relaxed);
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,19 @@
+#pragma once
+
+
+#include <cstddef>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Number of calls to the global operator new since program start.
+///
+/// The count is maintained by the replacement allocation functions in AllocationCounter.cpp,
+/// which makes it cover the whole program (including dependencies using operator new).
+std::size_t getAllocationCount();
+
+
+} // namespace gltfviewer
+} // namespace ad
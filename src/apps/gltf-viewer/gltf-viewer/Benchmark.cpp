@@ -0,0 +1,95 @@
+#include "Benchmark.h"
+
+#include "AllocationCounter.h"
+#include "Logging.h"
+
+#include <algorithm>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+Benchmark::Benchmark(std::size_t aFrameCount, std::size_t aPassCount, std::size_t aWarmupFrames) :
+    mFrameCount{aFrameCount},
+    mWarmupFrames{aWarmupFrames},
+    mPasses(std::max<std::size_t>(aPassCount, 1))
+{}
+
+
+void Benchmark::beginFrame(double aTime)
+{
+    mFrameStart = aTime;
+    mFrameStartAllocations = getAllocationCount();
+}
+
+
+void Benchmark::endFrame(double aTime)
+{
+    if (!isComplete() && isMeasuring())
+    {
+        double duration = aTime - mFrameStart;
+        std::size_t allocations = getAllocationCount() - mFrameStartAllocations;
+
+        Pass & pass = mPasses[getPass()];
+        ++pass.measured;
+        pass.totalDuration += duration;
+        pass.maxDuration = std::max(pass.maxDuration, duration);
+        pass.totalAllocations += allocations;
+        pass.maxAllocations = std::max(pass.maxAllocations, allocations);
+
+        if (allocations != 0)
+        {
+            ADLOG(gBenchmarkLogger, debug)
+                 ("Frame #{} performed {} heap allocation(s).", mFrameId, allocations);
+        }
+    }
+    ++mFrameId;
+}
+
+
+void Benchmark::report(const IndexOrderStatistics & aIndexOrders) const
+{
+    if (aIndexOrders.optimizedPrimitives != 0)
+    {
+        ADLOG(gBenchmarkLogger, info)
+             ("Index order of {} primitive(s) optimized ({} loaded from cache): "
+              "ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}.",
+              aIndexOrders.optimizedPrimitives, aIndexOrders.cachedPrimitives,
+              aIndexOrders.exported.getAcmr(), aIndexOrders.optimized.getAcmr(),
+              aIndexOrders.exported.getAtvr(), aIndexOrders.optimized.getAtvr());
+    }
+
+    for (std::size_t passId = 0; passId != mPasses.size(); ++passId)
+    {
+        const Pass & pass = mPasses[passId];
+        if (pass.measured == 0)
+        {
+            ADLOG(gBenchmarkLogger, warn)
+                 ("Pass #{}: no frame was measured (warmup is {} frames).", passId, mWarmupFrames);
+            continue;
+        }
+
+        const double average = pass.totalDuration / pass.measured;
+        ADLOG(gBenchmarkLogger, info)
+             ("Pass #{}: measured {} frames after {} warmup frames: average {:.3f}ms, max {:.3f}ms.",
+              passId, pass.measured, mWarmupFrames, average * 1000., pass.maxDuration * 1000.);
+        ADLOG(gBenchmarkLogger, info)
+             ("Pass #{}: heap allocations in steady state: {} total, {:.2f} per frame on average, {} at most.",
+              passId, pass.totalAllocations,
+              static_cast<double>(pass.totalAllocations) / pass.measured, pass.maxAllocations);
+
+        const Pass & first = mPasses.front();
+        if (passId != 0 && first.measured != 0)
+        {
+            const double firstAverage = first.totalDuration / first.measured;
+            ADLOG(gBenchmarkLogger, info)
+                 ("Pass #{}: average frame time changed by {:+.1f}% relative to pass #0.",
+                  passId, (average - firstAverage) / firstAverage * 100.);
+        }
+    }
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
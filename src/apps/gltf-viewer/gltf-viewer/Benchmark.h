@@ -0,0 +1,73 @@
+#pragma once
+
+
+#include "VertexCache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Measures a fixed number of frames, then reports their statistics.
+///
+/// The first frames are considered warmup (lazy GPU loading, containers reaching their
+/// steady capacity, ...), and are excluded from the statistics.
+///
+/// Several passes can be measured in turn, each with its warmup, so the caller can compare
+/// configurations within a run (see getPass()). Their average frame times are then compared
+/// to the first pass.
+class Benchmark
+{
+public:
+    Benchmark(std::size_t aFrameCount,
+              std::size_t aPassCount = 1,
+              std::size_t aWarmupFrames = gDefaultWarmupFrames);
+
+    void beginFrame(double aTime);
+    void endFrame(double aTime);
+
+    bool isComplete() const
+    { return mFrameId >= mPasses.size() * getPassFrames(); }
+
+    /// \brief The pass of the current frame.
+    std::size_t getPass() const
+    { return std::min(mFrameId / getPassFrames(), mPasses.size() - 1); }
+
+    /// \brief Log the statistics of the measured frames, and of the index reordering done at load time.
+    void report(const IndexOrderStatistics & aIndexOrders) const;
+
+    static constexpr std::size_t gDefaultWarmupFrames = 10;
+
+private:
+    struct Pass
+    {
+        std::size_t measured{0};
+        double totalDuration{0.};
+        double maxDuration{0.};
+        std::size_t totalAllocations{0};
+        std::size_t maxAllocations{0};
+    };
+
+    std::size_t getPassFrames() const
+    { return mWarmupFrames + mFrameCount; }
+
+    bool isMeasuring() const
+    { return mFrameId % getPassFrames() >= mWarmupFrames; }
+
+    std::size_t mFrameCount;
+    std::size_t mWarmupFrames;
+    std::size_t mFrameId{0};
+
+    double mFrameStart{0.};
+    std::size_t mFrameStartAllocations{0};
+
+    std::vector<Pass> mPasses;
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
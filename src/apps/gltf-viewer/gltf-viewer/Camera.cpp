@@ -319,9 +319,8 @@ void CameraSystem::appendCameraControls()
 
 void UserCamera::appendProjectionControls()
 {
-    std::string distance{"Camera distance: "};
-    distance += std::to_string(mPosition.r);
-    ImGui::Text(distance.c_str());
+    // Formatted by ImGui, to avoid a string allocation each frame.
+    ImGui::Text("Camera distance: %f", mPosition.r);
 
     auto nameProjection = [&]()
     {
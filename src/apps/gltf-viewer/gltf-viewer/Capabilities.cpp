@@ -0,0 +1,52 @@
+#include "Capabilities.h"
+
+#include "Logging.h"
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    std::string getGlString(GLenum aName)
+    {
+        const GLubyte * value = glGetString(aName);
+        return value ? reinterpret_cast<const char *>(value) : "";
+    }
+
+    GpuCapabilities queryCapabilities()
+    {
+        GpuCapabilities result;
+        glGetIntegerv(GL_MAJOR_VERSION, &result.major);
+        glGetIntegerv(GL_MINOR_VERSION, &result.minor);
+        result.vendor = getGlString(GL_VENDOR);
+        result.renderer = getGlString(GL_RENDERER);
+        result.version = getGlString(GL_VERSION);
+
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint extensionId = 0; extensionId != extensionCount; ++extensionId)
+        {
+            result.extensions.emplace(
+                reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, extensionId)));
+        }
+
+        ADLOG(gPrepareLogger, info)
+             ("OpenGL {}.{} context on '{}' ({}), {} extensions.",
+              result.major, result.minor, result.renderer, result.vendor, result.extensions.size());
+        return result;
+    }
+
+} // anonymous namespace
+
+
+const GpuCapabilities & getGpuCapabilities()
+{
+    static const GpuCapabilities capabilities = queryCapabilities();
+    return capabilities;
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,55 @@
+#pragma once
+
+
+#include <renderer/GL_Loader.h>
+
+#include <set>
+#include <string>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Features of the current OpenGL context, for the rendering paths beyond the baseline.
+struct GpuCapabilities
+{
+    bool hasVersion(GLint aMajor, GLint aMinor) const
+    { return major > aMajor || (major == aMajor && minor >= aMinor); }
+
+    bool hasExtension(const std::string & aExtension) const
+    { return extensions.contains(aExtension); }
+
+    /// \brief Compute shaders, shader storage buffers and indirect draws from buffer objects.
+    bool supportsGpuCulling() const
+    { return hasVersion(4, 3); }
+
+    /// \brief Buffers with immutable storage, persistently mapped (see StreamBuffer).
+    bool supportsPersistentMapping() const
+    { return hasVersion(4, 4); }
+
+    /// \brief Multi-draw indirect, with the draw index available to the vertex shader.
+    bool supportsMultiDrawIndirect() const
+    { return hasVersion(4, 3) && hasExtension("GL_ARB_shader_draw_parameters"); }
+
+    /// \brief The BC1 to BC3 block compressed formats (see TextureCompression.h).
+    bool supportsS3tc() const
+    { return hasExtension("GL_EXT_texture_compression_s3tc"); }
+
+    GLint major{0};
+    GLint minor{0};
+    std::string vendor;
+    std::string renderer;
+    // The full GL_VERSION string, which usually includes the driver version.
+    std::string version;
+    std::set<std::string> extensions;
+};
+
+
+/// \brief Query the capabilities on first call, then return the cached value.
+/// \attention Requires a current OpenGL context.
+const GpuCapabilities & getGpuCapabilities();
+
+
+} // namespace gltfviewer
+} // namespace ad
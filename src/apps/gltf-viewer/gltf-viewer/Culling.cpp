@@ -0,0 +1,241 @@
+#include "Culling.h"
+
+#include "Logging.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+FrustumTest testFrustum(const math::Box<GLfloat> & aBox,
+                        const math::Matrix<4, 4, GLfloat> & aViewProjection)
+{
+    const math::Position<3, GLfloat> center = aBox.center();
+    const math::Vec<3, GLfloat> halfExtent{aBox.width() / 2.f, aBox.height() / 2.f, aBox.depth() / 2.f};
+
+    // For each of the 6 clipping planes, the number of corners on its outer side.
+    std::array<int, 6> outsideCount{0, 0, 0, 0, 0, 0};
+    bool allInside = true;
+
+    for (int corner = 0; corner != 8; ++corner)
+    {
+        math::Position<4, GLfloat> cornerWorld{
+            center.x() + ((corner & 1) ? halfExtent.x() : -halfExtent.x()),
+            center.y() + ((corner & 2) ? halfExtent.y() : -halfExtent.y()),
+            center.z() + ((corner & 4) ? halfExtent.z() : -halfExtent.z()),
+            1.f,
+        };
+        math::Position<4, GLfloat> clip = cornerWorld * aViewProjection;
+
+        // A point is inside the view volume iff -w <= x, y, z <= w.
+        const GLfloat w = clip.w();
+        const std::array<bool, 6> outside{
+            clip.x() < -w, clip.x() > w,
+            clip.y() < -w, clip.y() > w,
+            clip.z() < -w, clip.z() > w,
+        };
+        for (std::size_t plane = 0; plane != outside.size(); ++plane)
+        {
+            if (outside[plane])
+            {
+                ++outsideCount[plane];
+                allInside = false;
+            }
+        }
+    }
+
+    if (std::find(outsideCount.begin(), outsideCount.end(), 8) != outsideCount.end())
+    {
+        return FrustumTest::Outside;
+    }
+    return allInside ? FrustumTest::Inside : FrustumTest::Intersecting;
+}
+
+
+void InstanceHierarchy::beginUpdate()
+{
+    mUpdatedCount = 0;
+    mTopologyChanged = false;
+    mBoundsChanged = false;
+}
+
+
+void InstanceHierarchy::updateLeaf(MeshInstances & aMeshInstances,
+                                   const InstanceList::Instance & aInstance,
+                                   const math::Box<GLfloat> & aBoundingBox,
+                                   const math::AffineMatrix<4, GLfloat> & aModelTransform)
+{
+    if (mUpdatedCount == mLeaves.size())
+    {
+        mLeaves.push_back(Leaf{
+            .meshInstances = &aMeshInstances,
+            .instance = aInstance,
+            .worldBox = aBoundingBox * aModelTransform,
+        });
+        mTopologyChanged = true;
+    }
+    else
+    {
+        Leaf & leaf = mLeaves[mUpdatedCount];
+        if (leaf.meshInstances != &aMeshInstances)
+        {
+            leaf.meshInstances = &aMeshInstances;
+            mTopologyChanged = true;
+        }
+
+        // Only recompute the world bounds if the instance actually moved.
+        if (std::memcmp(&leaf.instance, &aInstance, sizeof(aInstance)) != 0)
+        {
+            leaf.instance = aInstance;
+            leaf.worldBox = aBoundingBox * aModelTransform;
+            if (!mTopologyChanged)
+            {
+                mNodes[mLeafToNode[mUpdatedCount]].dirty = true;
+                mBoundsChanged = true;
+            }
+        }
+    }
+    ++mUpdatedCount;
+}
+
+
+void InstanceHierarchy::endUpdate()
+{
+    if (mUpdatedCount != mLeaves.size())
+    {
+        mLeaves.erase(mLeaves.begin() + mUpdatedCount, mLeaves.end());
+        mTopologyChanged = true;
+    }
+
+    if (mTopologyChanged)
+    {
+        rebuild();
+    }
+    else if (mBoundsChanged)
+    {
+        refit();
+    }
+}
+
+
+void InstanceHierarchy::rebuild()
+{
+    mNodes.clear();
+    mOrderedLeaves.resize(mLeaves.size());
+    std::iota(mOrderedLeaves.begin(), mOrderedLeaves.end(), 0);
+    mLeafToNode.resize(mLeaves.size());
+
+    if (!mLeaves.empty())
+    {
+        mNodes.reserve(2 * (mLeaves.size() / gMaxLeavesPerNode + 1));
+        build(gNoParent, 0, static_cast<std::uint32_t>(mLeaves.size()));
+    }
+
+    ADLOG(gDrawLogger, debug)
+         ("Built instance hierarchy with {} nodes over {} instances.", mNodes.size(), mLeaves.size());
+}
+
+
+std::uint32_t InstanceHierarchy::build(std::uint32_t aParent, std::uint32_t aFirst, std::uint32_t aCount)
+{
+    const auto nodeIndex = static_cast<std::uint32_t>(mNodes.size());
+    mNodes.push_back(Node{
+        .box = mLeaves[mOrderedLeaves[aFirst]].worldBox,
+        .parent = aParent,
+        .firstLeaf = aFirst,
+        .leafCount = aCount,
+    });
+
+    math::Box<GLfloat> box = mLeaves[mOrderedLeaves[aFirst]].worldBox;
+    math::Position<3, GLfloat> centroidMin = box.center();
+    math::Position<3, GLfloat> centroidMax = box.center();
+    for (std::uint32_t id = aFirst; id != aFirst + aCount; ++id)
+    {
+        const math::Box<GLfloat> & leafBox = mLeaves[mOrderedLeaves[id]].worldBox;
+        box.uniteAssign(leafBox);
+        math::Position<3, GLfloat> centroid = leafBox.center();
+        for (std::size_t axis = 0; axis != 3; ++axis)
+        {
+            centroidMin[axis] = std::min(centroidMin[axis], centroid[axis]);
+            centroidMax[axis] = std::max(centroidMax[axis], centroid[axis]);
+        }
+    }
+    mNodes[nodeIndex].box = box;
+
+    if (aCount <= gMaxLeavesPerNode)
+    {
+        for (std::uint32_t id = aFirst; id != aFirst + aCount; ++id)
+        {
+            mLeafToNode[mOrderedLeaves[id]] = nodeIndex;
+        }
+        return nodeIndex;
+    }
+
+    // Median split along the axis where the centroids are the most spread.
+    std::size_t splitAxis = 0;
+    for (std::size_t axis = 1; axis != 3; ++axis)
+    {
+        if (centroidMax[axis] - centroidMin[axis] > centroidMax[splitAxis] - centroidMin[splitAxis])
+        {
+            splitAxis = axis;
+        }
+    }
+
+    const std::uint32_t leftCount = aCount / 2;
+    auto first = mOrderedLeaves.begin() + aFirst;
+    std::nth_element(first, first + leftCount, first + aCount,
+                     [this, splitAxis](std::uint32_t aLhs, std::uint32_t aRhs)
+                     {
+                         return mLeaves[aLhs].worldBox.center()[splitAxis]
+                                < mLeaves[aRhs].worldBox.center()[splitAxis];
+                     });
+
+    // Note: mNodes might be reallocated by the recursive calls, do not keep references.
+    build(nodeIndex, aFirst, leftCount);
+    mNodes[nodeIndex].rightChild = build(nodeIndex, aFirst + leftCount, aCount - leftCount);
+    return nodeIndex;
+}
+
+
+void InstanceHierarchy::refit()
+{
+    // Children are always stored after their parent, so a reverse traversal
+    // refits the children before the parents that depend on them.
+    for (auto nodeIt = mNodes.rbegin(); nodeIt != mNodes.rend(); ++nodeIt)
+    {
+        Node & node = *nodeIt;
+        if (!node.dirty)
+        {
+            continue;
+        }
+
+        if (node.isLeaf())
+        {
+            node.box = mLeaves[mOrderedLeaves[node.firstLeaf]].worldBox;
+            for (std::uint32_t id = node.firstLeaf + 1; id != node.firstLeaf + node.leafCount; ++id)
+            {
+                node.box.uniteAssign(mLeaves[mOrderedLeaves[id]].worldBox);
+            }
+        }
+        else
+        {
+            std::uint32_t nodeIndex = static_cast<std::uint32_t>(&node - mNodes.data());
+            node.box = mNodes[nodeIndex + 1].box;
+            node.box.uniteAssign(mNodes[node.rightChild].box);
+        }
+
+        node.dirty = false;
+        if (node.parent != gNoParent)
+        {
+            mNodes[node.parent].dirty = true;
+        }
+    }
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
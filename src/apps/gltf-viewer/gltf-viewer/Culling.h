@@ -0,0 +1,217 @@
+#pragma once
+
+
+#include "Mesh.h"
+
+#include <math/Box.h>
+#include <math/Homogeneous.h>
+
+#include <renderer/GL_Loader.h>
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+struct MeshInstances;
+
+
+enum class FrustumTest
+{
+    Outside,
+    Intersecting,
+    Inside,
+};
+
+
+/// \brief Classify an axis aligned box against the view frustum.
+///
+/// The test is done in clip space on the 8 corners of the box, so it is conservative:
+/// a box is only reported outside if all its corners are outside the same clipping plane.
+FrustumTest testFrustum(const math::Box<GLfloat> & aBox,
+                        const math::Matrix<4, 4, GLfloat> & aViewProjection);
+
+
+struct CullingStatistics
+{
+    std::size_t visibleInstances{0};
+    std::size_t culledInstances{0};
+    // Only reported by GpuCulling, when occlusion culling is enabled.
+    std::size_t occludedInstances{0};
+    std::size_t testedNodes{0};
+};
+
+
+/// \brief Bounding volume hierarchy over the world space bounds of the mesh instances.
+///
+/// The instances are provided each frame between beginUpdate() and endUpdate(), always in the
+/// same order (the scene traversal order). As long as the instance count does not change,
+/// the tree topology is kept and only the bounds of the instances whose transform changed
+/// are refitted.
+class InstanceHierarchy
+{
+public:
+    struct Leaf
+    {
+        MeshInstances * meshInstances;
+        InstanceList::Instance instance;
+        math::Box<GLfloat> worldBox{{0.f, 0.f, 0.f}, {0.f, 0.f, 0.f}};
+    };
+
+    void beginUpdate();
+
+    /// \param aInstance The instance data, its transformation including the positions dequantization.
+    /// \param aBoundingBox The bounds of the mesh, only transformed by `aModelTransform` if the instance moved.
+    void updateLeaf(MeshInstances & aMeshInstances,
+                    const InstanceList::Instance & aInstance,
+                    const math::Box<GLfloat> & aBoundingBox,
+                    const math::AffineMatrix<4, GLfloat> & aModelTransform);
+
+    /// \brief Rebuild the tree if the leaves changed, refit the modified bounds otherwise.
+    void endUpdate();
+
+    /// \brief Invoke `aVisitor` with each leaf intersecting the view frustum.
+    template <class F_visitor>
+    CullingStatistics forEachVisible(const math::Matrix<4, 4, GLfloat> & aViewProjection,
+                                     F_visitor && aVisitor) const;
+
+    template <class F_visitor>
+    void forEach(F_visitor && aVisitor) const;
+
+    std::size_t size() const
+    { return mLeaves.size(); }
+
+private:
+    static constexpr std::uint32_t gMaxLeavesPerNode = 4;
+    static constexpr std::uint32_t gNoParent = std::numeric_limits<std::uint32_t>::max();
+    // Enough for any tree built by median split over 32 bits of leaves.
+    static constexpr std::size_t gMaxDepth = 64;
+
+    // Nodes are stored in depth-first order: the left child immediately follows its parent.
+    struct Node
+    {
+        bool isLeaf() const
+        { return rightChild == 0; }
+
+        math::Box<GLfloat> box{{0.f, 0.f, 0.f}, {0.f, 0.f, 0.f}};
+        std::uint32_t parent{gNoParent};
+        std::uint32_t rightChild{0}; // The root cannot be a right child, so 0 marks leaf nodes.
+        // The leaves of the whole subtree are a contiguous range in mOrderedLeaves.
+        std::uint32_t firstLeaf{0};
+        std::uint32_t leafCount{0};
+        bool dirty{false};
+    };
+
+    void rebuild();
+    std::uint32_t build(std::uint32_t aParent, std::uint32_t aFirst, std::uint32_t aCount);
+    void refit();
+
+    template <class F_visitor>
+    void visitSubtree(const Node & aNode, F_visitor && aVisitor, CullingStatistics & aStatistics) const;
+
+    std::vector<Leaf> mLeaves;
+    // The leaf indices, permuted so each node references a contiguous range.
+    std::vector<std::uint32_t> mOrderedLeaves;
+    std::vector<std::uint32_t> mLeafToNode;
+    std::vector<Node> mNodes;
+
+    std::size_t mUpdatedCount{0};
+    bool mTopologyChanged{false};
+    bool mBoundsChanged{false};
+};
+
+
+//
+// Implementations
+//
+template <class F_visitor>
+void InstanceHierarchy::visitSubtree(const Node & aNode,
+                                     F_visitor && aVisitor,
+                                     CullingStatistics & aStatistics) const
+{
+    for (std::uint32_t id = aNode.firstLeaf; id != aNode.firstLeaf + aNode.leafCount; ++id)
+    {
+        aVisitor(mLeaves[mOrderedLeaves[id]]);
+        ++aStatistics.visibleInstances;
+    }
+}
+
+
+template <class F_visitor>
+CullingStatistics
+InstanceHierarchy::forEachVisible(const math::Matrix<4, 4, GLfloat> & aViewProjection,
+                                  F_visitor && aVisitor) const
+{
+    CullingStatistics statistics;
+    if (mNodes.empty())
+    {
+        return statistics;
+    }
+
+    // Explicit stack, so the traversal does not allocate.
+    std::array<std::uint32_t, gMaxDepth> stack;
+    std::size_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize != 0)
+    {
+        const Node & node = mNodes[stack[--stackSize]];
+        ++statistics.testedNodes;
+
+        switch (testFrustum(node.box, aViewProjection))
+        {
+        case FrustumTest::Outside:
+            statistics.culledInstances += node.leafCount;
+            break;
+        case FrustumTest::Inside:
+            // The whole subtree is visible, no need for further tests.
+            visitSubtree(node, aVisitor, statistics);
+            break;
+        case FrustumTest::Intersecting:
+            if (node.isLeaf())
+            {
+                for (std::uint32_t id = node.firstLeaf; id != node.firstLeaf + node.leafCount; ++id)
+                {
+                    const Leaf & leaf = mLeaves[mOrderedLeaves[id]];
+                    if (testFrustum(leaf.worldBox, aViewProjection) != FrustumTest::Outside)
+                    {
+                        aVisitor(leaf);
+                        ++statistics.visibleInstances;
+                    }
+                    else
+                    {
+                        ++statistics.culledInstances;
+                    }
+                }
+            }
+            else
+            {
+                std::uint32_t nodeIndex = static_cast<std::uint32_t>(&node - mNodes.data());
+                stack[stackSize++] = node.rightChild;
+                stack[stackSize++] = nodeIndex + 1;
+            }
+            break;
+        }
+    }
+
+    return statistics;
+}
+
+
+template <class F_visitor>
+void InstanceHierarchy::forEach(F_visitor && aVisitor) const
+{
+    for (const Leaf & leaf : mLeaves)
+    {
+        aVisitor(leaf);
+    }
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
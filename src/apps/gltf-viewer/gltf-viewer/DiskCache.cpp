@@ -0,0 +1,138 @@
+#include "DiskCache.h"
+
+#include "Logging.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+#include <fmt/format.h>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    /// \brief Follows the XDG base directory specification, falling back to the temporary directory.
+    std::filesystem::path getCacheRoot()
+    {
+        if (const char * cacheHome = std::getenv("XDG_CACHE_HOME"); cacheHome && *cacheHome)
+        {
+            return std::filesystem::path{cacheHome} / "gltf-viewer";
+        }
+        else if (const char * home = std::getenv("HOME"); home && *home)
+        {
+            return std::filesystem::path{home} / ".cache" / "gltf-viewer";
+        }
+
+        std::error_code error;
+        std::filesystem::path temporary = std::filesystem::temp_directory_path(error);
+        return error ? std::filesystem::path{} : temporary / "gltf-viewer";
+    }
+
+} // anonymous namespace
+
+
+std::uint64_t hashBytes(std::span<const std::byte> aBytes, std::uint64_t aSeed)
+{
+    constexpr std::uint64_t prime = 0x100000001b3;
+    std::uint64_t hash = aSeed;
+    for (std::byte byte : aBytes)
+    {
+        hash ^= static_cast<std::uint64_t>(byte);
+        hash *= prime;
+    }
+    return hash;
+}
+
+
+DiskCache::DiskCache(std::string_view aName)
+{
+    std::filesystem::path root = getCacheRoot();
+    if (root.empty())
+    {
+        ADLOG(gPrepareLogger, warn)("No cache directory available, the '{}' cache is disabled.", aName);
+        return;
+    }
+
+    std::filesystem::path directory = root / aName;
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+    {
+        ADLOG(gPrepareLogger, warn)
+             ("Cannot create cache directory '{}' ({}), the cache is disabled.", directory.string(), error.message());
+        return;
+    }
+    mDirectory = std::move(directory);
+}
+
+
+std::filesystem::path DiskCache::getPath(std::uint64_t aKey) const
+{
+    return mDirectory / fmt::format("{:016x}.bin", aKey);
+}
+
+
+std::optional<std::vector<std::byte>> DiskCache::load(std::uint64_t aKey) const
+{
+    if (!isEnabled())
+    {
+        return std::nullopt;
+    }
+
+    std::ifstream file{getPath(aKey), std::ios::binary};
+    if (!file)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<char> content{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    if (file.bad())
+    {
+        ADLOG(gPrepareLogger, warn)("Cannot read cache entry '{}'.", getPath(aKey).string());
+        return std::nullopt;
+    }
+
+    std::vector<std::byte> result(content.size());
+    std::ranges::transform(content, result.begin(), [](char aChar){ return static_cast<std::byte>(aChar); });
+    return result;
+}
+
+
+void DiskCache::store(std::uint64_t aKey, std::span<const std::byte> aBlob) const
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    // Written aside then renamed, so a concurrent or interrupted run never reads a partial entry.
+    const std::filesystem::path path = getPath(aKey);
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file{temporary, std::ios::binary | std::ios::trunc};
+        file.write(reinterpret_cast<const char *>(aBlob.data()), aBlob.size());
+        if (!file)
+        {
+            ADLOG(gPrepareLogger, warn)("Cannot write cache entry '{}'.", temporary.string());
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        ADLOG(gPrepareLogger, warn)
+             ("Cannot rename cache entry '{}' ({}).", temporary.string(), error.message());
+    }
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
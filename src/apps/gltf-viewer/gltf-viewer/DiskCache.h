@@ -0,0 +1,56 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+constexpr std::uint64_t gHashSeed = 0xcbf29ce484222325;
+
+
+/// \brief 64 bits FNV-1a hash of the bytes, chained from `aSeed` (so several values can be combined).
+std::uint64_t hashBytes(std::span<const std::byte> aBytes, std::uint64_t aSeed = gHashSeed);
+
+
+inline std::uint64_t hashString(std::string_view aString, std::uint64_t aSeed = gHashSeed)
+{
+    return hashBytes(std::as_bytes(std::span{aString.data(), aString.size()}), aSeed);
+}
+
+
+/// \brief Blobs persisted across runs, one file per key in the user cache directory.
+///
+/// The cache is an optimization: any failure to read or write it is logged and otherwise ignored.
+class DiskCache
+{
+public:
+    /// \param aName Subdirectory of the viewer cache directory, one per kind of blob.
+    explicit DiskCache(std::string_view aName);
+
+    std::optional<std::vector<std::byte>> load(std::uint64_t aKey) const;
+
+    void store(std::uint64_t aKey, std::span<const std::byte> aBlob) const;
+
+    bool isEnabled() const
+    { return !mDirectory.empty(); }
+
+private:
+    std::filesystem::path getPath(std::uint64_t aKey) const;
+
+    // Empty if the directory could not be created.
+    std::filesystem::path mDirectory;
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,54 @@
+#include "FrameArena.h"
+
+#include "Logging.h"
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+void * FrameArena::OverflowResource::do_allocate(std::size_t aBytes, std::size_t aAlignment)
+{
+    overflowBytes += aBytes;
+    return std::pmr::new_delete_resource()->allocate(aBytes, aAlignment);
+}
+
+
+void FrameArena::OverflowResource::do_deallocate(void * aPointer, std::size_t aBytes, std::size_t aAlignment)
+{
+    std::pmr::new_delete_resource()->deallocate(aPointer, aBytes, aAlignment);
+}
+
+
+FrameArena::FrameArena(std::size_t aInitialCapacity) :
+    mBlock(aInitialCapacity)
+{
+    mResource.emplace(mBlock.data(), mBlock.size(), &mOverflow);
+}
+
+
+void FrameArena::reset()
+{
+    if (mOverflow.overflowBytes == 0)
+    {
+        // Rewinds to the beginning of the block, without any allocation.
+        mResource->release();
+    }
+    else
+    {
+        std::size_t capacity = std::max(2 * mBlock.size(), mBlock.size() + mOverflow.overflowBytes);
+        ADLOG(gDrawLogger, debug)
+             ("Frame arena overflowed by {} bytes, growing from {} to {} bytes.",
+              mOverflow.overflowBytes, mBlock.size(), capacity);
+
+        // Releases the overflow chunks to the heap before the block is replaced.
+        mResource.reset();
+        mOverflow.overflowBytes = 0;
+        mBlock = std::vector<std::byte>(capacity);
+        mResource.emplace(mBlock.data(), mBlock.size(), &mOverflow);
+    }
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
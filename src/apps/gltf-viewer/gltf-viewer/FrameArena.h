@@ -0,0 +1,58 @@
+#pragma once
+
+
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Linear allocator for the transient data of a single frame.
+///
+/// Allocations are served from a preallocated block and are all released at once by reset().
+/// If a frame overflows the block, the excess is requested from the heap,
+/// and the block is grown on the next reset() so following frames do not overflow again.
+class FrameArena
+{
+public:
+    explicit FrameArena(std::size_t aInitialCapacity = gDefaultCapacity);
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena & operator=(const FrameArena &) = delete;
+
+    /// \attention Invalidates all the memory previously obtained from the arena.
+    void reset();
+
+    std::pmr::memory_resource * resource()
+    { return &*mResource; }
+
+    std::size_t capacity() const
+    { return mBlock.size(); }
+
+    static constexpr std::size_t gDefaultCapacity = 256 * 1024;
+
+private:
+    /// \brief Forward to the heap, while keeping track of the requested bytes.
+    class OverflowResource : public std::pmr::memory_resource
+    {
+    public:
+        std::size_t overflowBytes{0};
+
+    private:
+        void * do_allocate(std::size_t aBytes, std::size_t aAlignment) override;
+        void do_deallocate(void * aPointer, std::size_t aBytes, std::size_t aAlignment) override;
+        bool do_is_equal(const std::pmr::memory_resource & aOther) const noexcept override
+        { return this == &aOther; }
+    };
+
+    std::vector<std::byte> mBlock;
+    OverflowResource mOverflow;
+    std::optional<std::pmr::monotonic_buffer_resource> mResource;
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
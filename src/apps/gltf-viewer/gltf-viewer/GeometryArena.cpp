@@ -0,0 +1,755 @@
+#include "GeometryArena.h"
+
+#include "DataLayout.h"
+#include "LevelOfDetail.h"
+#include "LoadBuffer.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string_view>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    bool hasAttribute(VertexFormat aFormat, GLuint aAttributeIndex)
+    {
+        return (aFormat & (VertexFormat{1} << aAttributeIndex)) != 0;
+    }
+
+    /// \brief The vertex attributes by increasing index, which is their interleaving order.
+    const std::vector<VertexAttribute> & getAttributesByIndex()
+    {
+        static const std::vector<VertexAttribute> attributes = []()
+        {
+            std::vector<VertexAttribute> result;
+            for (const auto & [_semantic, attribute] : gSemanticToAttribute)
+            {
+                result.push_back(attribute);
+            }
+            std::sort(result.begin(), result.end(),
+                      [](const VertexAttribute & aLhs, const VertexAttribute & aRhs)
+                      {
+                          return aLhs.index < aRhs.index;
+                      });
+            return result;
+        }();
+        return attributes;
+    }
+
+
+    GLuint getAttributeIndex(const std::string & aSemantic)
+    {
+        return gSemanticToAttribute.at(aSemantic).index;
+    }
+
+
+    /// \brief How a vertex attribute is stored in the vertex buffer.
+    struct AttributeEncoding
+    {
+        GLenum type;
+        // The stored components, the shaders complete the missing ones.
+        GLint components;
+        GLboolean normalized;
+        // In bytes, a multiple of 4 to keep the attributes aligned.
+        GLsizei size;
+        // The components are skin weights, rounded so they still sum to 1.
+        bool weights{false};
+    };
+
+
+    AttributeEncoding getEncoding(const VertexAttribute & aAttribute, VertexFormat aFormat)
+    {
+        const bool quantized = (aFormat & gQuantizedFormat) != 0;
+        // The skinning shaders read float positions and normals.
+        const bool skinned = hasAttribute(aFormat, getAttributeIndex("JOINTS_0"));
+
+        if (quantized && !skinned && aAttribute.index == getAttributeIndex("POSITION"))
+        {
+            return {GL_UNSIGNED_SHORT, 4, GL_TRUE, 4 * sizeof(GLushort)};
+        }
+        else if (quantized && !skinned && aAttribute.index == getAttributeIndex("NORMAL"))
+        {
+            return {GL_SHORT, 2, GL_TRUE, 2 * sizeof(GLshort)};
+        }
+        else if (quantized && aAttribute.index == getAttributeIndex("TEXCOORD_0"))
+        {
+            return {GL_HALF_FLOAT, 2, GL_FALSE, 2 * sizeof(GLhalf)};
+        }
+        else if (quantized && aAttribute.index == getAttributeIndex("COLOR_0"))
+        {
+            return {GL_UNSIGNED_BYTE, 4, GL_TRUE, 4 * sizeof(GLubyte)};
+        }
+        else if (quantized && aAttribute.index == getAttributeIndex("WEIGHTS_0"))
+        {
+            return {GL_UNSIGNED_BYTE, 4, GL_TRUE, 4 * sizeof(GLubyte), true};
+        }
+        else if (quantized && aAttribute.index == getAttributeIndex("JOINTS_0"))
+        {
+            return {GL_UNSIGNED_SHORT, 4, GL_FALSE, 4 * sizeof(GLushort)};
+        }
+        return {GL_FLOAT,
+                aAttribute.components,
+                GL_FALSE,
+                static_cast<GLsizei>(aAttribute.components * sizeof(GLfloat))};
+    }
+
+
+    template <class T_component, std::size_t N_components>
+    std::byte * write(const std::array<T_component, N_components> & aComponents, std::byte * aDestination)
+    {
+        std::memcpy(aDestination, aComponents.data(), sizeof(aComponents));
+        return aDestination + sizeof(aComponents);
+    }
+
+
+    GLubyte toUnorm8(GLfloat aValue)
+    {
+        return static_cast<GLubyte>(std::lround(std::clamp(aValue, 0.f, 1.f) * 255.f));
+    }
+
+
+    std::array<GLubyte, 4> encodeWeights(std::span<const GLfloat> aWeights)
+    {
+        std::array<GLubyte, 4> result;
+        int sum = 0;
+        for (std::size_t weightId = 0; weightId != result.size(); ++weightId)
+        {
+            result[weightId] = toUnorm8(aWeights[weightId]);
+            sum += result[weightId];
+        }
+        // The rounding error goes to the largest weight, so the weights still sum to 1.
+        GLubyte & largest = *std::max_element(result.begin(), result.end());
+        largest = static_cast<GLubyte>(std::clamp(largest + 255 - sum, 0, 255));
+        return result;
+    }
+
+
+    /// \brief Write the components of one vertex attribute as stored by `aEncoding`.
+    /// \return The end of the written bytes.
+    std::byte * encode(const AttributeEncoding & aEncoding,
+                       std::span<const GLfloat> aValues,
+                       const PositionQuantization * aQuantization,
+                       std::byte * aDestination)
+    {
+        switch (aEncoding.type)
+        {
+        case GL_FLOAT:
+            std::memcpy(aDestination, aValues.data(), aValues.size_bytes());
+            return aDestination + aValues.size_bytes();
+        case GL_SHORT:
+            return write(encodeOctahedral(aValues), aDestination);
+        case GL_HALF_FLOAT:
+            return write(std::array<GLhalf, 2>{toHalf(aValues[0]), toHalf(aValues[1])}, aDestination);
+        case GL_UNSIGNED_BYTE:
+            if (aEncoding.weights)
+            {
+                return write(encodeWeights(aValues), aDestination);
+            }
+            return write(std::array<GLubyte, 4>{
+                    toUnorm8(aValues[0]), toUnorm8(aValues[1]), toUnorm8(aValues[2]), toUnorm8(aValues[3])},
+                aDestination);
+        case GL_UNSIGNED_SHORT:
+            if (aEncoding.normalized)
+            {
+                return write(aQuantization->quantize({aValues[0], aValues[1], aValues[2]}), aDestination);
+            }
+            return write(std::array<GLushort, 4>{
+                    static_cast<GLushort>(aValues[0]), static_cast<GLushort>(aValues[1]),
+                    static_cast<GLushort>(aValues[2]), static_cast<GLushort>(aValues[3])},
+                aDestination);
+        }
+        throw std::logic_error{"Unhandled vertex attribute encoding."};
+    }
+
+} // anonymous namespace
+
+
+GeometryArena::Pool::Pool(VertexFormat aFormat, GLuint aIndexBuffer) :
+    stride{getStride(aFormat)}
+{
+    graphics::bind_guard boundVao{vao};
+    graphics::bind_guard boundBuffer{vbo};
+
+    std::size_t offset = 0;
+    for (const VertexAttribute & attribute : getAttributesByIndex())
+    {
+        if (hasAttribute(aFormat, attribute.index))
+        {
+            const AttributeEncoding encoding = getEncoding(attribute, aFormat);
+            glEnableVertexAttribArray(attribute.index);
+            glVertexAttribPointer(attribute.index,
+                                  encoding.components,
+                                  encoding.type,
+                                  encoding.normalized,
+                                  stride,
+                                  reinterpret_cast<void *>(offset));
+            offset += encoding.size;
+        }
+    }
+
+    // The instance buffer differs by mesh, see InstanceList::pointAttributes().
+    for(GLuint attributeOffset = 0; attributeOffset != gInstanceAttributeCount; ++attributeOffset)
+    {
+        GLuint attributeIndex = gInstanceAttributeIndex + attributeOffset;
+        glEnableVertexAttribArray(attributeIndex);
+        glVertexAttribDivisor(attributeIndex, 1);
+    }
+
+    // The element array binding is part of the vertex array state.
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, aIndexBuffer);
+}
+
+
+GLsizei GeometryArena::getStride(VertexFormat aFormat)
+{
+    GLsizei stride = 0;
+    for (const VertexAttribute & attribute : getAttributesByIndex())
+    {
+        if (hasAttribute(aFormat, attribute.index))
+        {
+            stride += getEncoding(attribute, aFormat).size;
+        }
+    }
+    return stride;
+}
+
+
+bool GeometryArena::hasOctahedralNormals(VertexFormat aFormat)
+{
+    const VertexAttribute & normal = gSemanticToAttribute.at("NORMAL");
+    return hasAttribute(aFormat, normal.index) && getEncoding(normal, aFormat).type == GL_SHORT;
+}
+
+
+GeometryArena::Pool & GeometryArena::getPool(VertexFormat aFormat)
+{
+    if (auto found = mPools.find(aFormat); found != mPools.end())
+    {
+        return found->second;
+    }
+    return mPools.try_emplace(aFormat, aFormat, mIndexBuffer).first->second;
+}
+
+
+GeometryArena::PrimitiveRanges
+GeometryArena::insertPrimitive(arte::Const_Owned<arte::gltf::Primitive> aPrimitive,
+                               const PositionQuantization * aQuantization)
+{
+    VertexKey key{aPrimitive->attributes, {0.f, 0.f, 0.f, 0.f}};
+    if (aQuantization)
+    {
+        key.second = {aQuantization->origin.x(), aQuantization->origin.y(), aQuantization->origin.z(),
+                      aQuantization->extent};
+    }
+
+    if (!aPrimitive->indices && aPrimitive->mode == GL_TRIANGLES && mOptions.weldVertices)
+    {
+        if (auto found = mWeldedRanges.find(key); found != mWeldedRanges.end())
+        {
+            return found->second;
+        }
+        PrimitiveRanges ranges = insertWelded(aPrimitive, aQuantization);
+        // The indexed primitives with the same attributes can share the welded vertices, through their remap.
+        mVertexRanges.try_emplace(key, ranges.vertices);
+        mWeldedRanges.emplace(std::move(key), ranges);
+        return ranges;
+    }
+
+    auto foundVertices = mVertexRanges.find(key);
+    auto getRemap = [this](const VertexRange & aVertices) -> const std::vector<GLuint> *
+    {
+        auto found = mVertexRemaps.find({aVertices.format, aVertices.baseVertex});
+        return found != mVertexRemaps.end() ? &found->second : nullptr;
+    };
+
+    if (!aPrimitive->indices)
+    {
+        if (foundVertices != mVertexRanges.end() && getRemap(foundVertices->second) == nullptr)
+        {
+            return {.vertices = foundVertices->second};
+        }
+        // Non-indexed primitives draw the vertices in order, they cannot share a reordered range.
+        const LoadedVertices loaded = loadVertices(aPrimitive, aQuantization);
+        VertexRange vertices = insertVertices(loaded, aQuantization, {}, loaded.count);
+        if (foundVertices == mVertexRanges.end())
+        {
+            mVertexRanges.emplace(std::move(key), vertices);
+        }
+        return {.vertices = vertices};
+    }
+
+    auto indicesAccessor = aPrimitive.get(&arte::gltf::Primitive::indices);
+    if (foundVertices != mVertexRanges.end())
+    {
+        const VertexRange & vertices = foundVertices->second;
+        if (auto found = mIndexRanges.find({indicesAccessor.id(), vertices.format, vertices.baseVertex});
+            found != mIndexRanges.end())
+        {
+            return {
+                .vertices = vertices,
+                .indices = found->second.first,
+                .exportedIndices = found->second.second,
+            };
+        }
+    }
+
+    std::vector<GLuint> exported = loadIndices(indicesAccessor);
+    std::vector<GLuint> indices;
+    // The overdraw optimization requires the positions.
+    const bool optimize = mOptions.optimizeIndexOrder
+                          && aPrimitive->mode == GL_TRIANGLES
+                          && aPrimitive->attributes.contains("POSITION");
+    std::size_t vertexCount = 0;
+    if (optimize)
+    {
+        const std::vector<math::Position<3, GLfloat>> positions =
+            gltfviewer::loadPositions(aPrimitive.get(aPrimitive->attributes.at("POSITION")));
+        vertexCount = positions.size();
+        indices = optimizeIndexOrder(exported, positions, aPrimitive.id());
+    }
+    else
+    {
+        indices = std::move(exported);
+    }
+
+    PrimitiveRanges ranges;
+    if (foundVertices != mVertexRanges.end())
+    {
+        ranges.vertices = foundVertices->second;
+    }
+    else
+    {
+        // The first primitive indexing the range orders its vertices by first use.
+        std::vector<GLuint> remap;
+        if (optimize)
+        {
+            remap = getVertexFetchRemap(indices, vertexCount);
+        }
+        const LoadedVertices loaded = loadVertices(aPrimitive, aQuantization);
+        ranges.vertices = insertVertices(loaded, aQuantization, remap, loaded.count);
+        mVertexRanges.emplace(std::move(key), ranges.vertices);
+        if (!remap.empty())
+        {
+            mVertexRemaps.emplace(std::pair{ranges.vertices.format, ranges.vertices.baseVertex}, std::move(remap));
+        }
+    }
+
+    if (const std::vector<GLuint> * remap = getRemap(ranges.vertices))
+    {
+        auto applyRemap = [remap](std::vector<GLuint> & aIndices)
+        {
+            std::ranges::transform(aIndices, aIndices.begin(),
+                                   [remap](GLuint aIndex) { return (*remap)[aIndex]; });
+        };
+        applyRemap(indices);
+        if (optimize && mOptions.keepExportedIndexOrder)
+        {
+            applyRemap(exported);
+        }
+    }
+
+    ranges.indices = insertIndices(indices, ranges.vertices.count);
+    if (optimize && mOptions.keepExportedIndexOrder)
+    {
+        ranges.exportedIndices = insertIndices(exported, ranges.vertices.count);
+    }
+    mIndexRanges.emplace(IndexKey{indicesAccessor.id(), ranges.vertices.format, ranges.vertices.baseVertex},
+                         std::pair{*ranges.indices, ranges.exportedIndices});
+    return ranges;
+}
+
+
+GeometryArena::PrimitiveRanges
+GeometryArena::insertWelded(arte::Const_Owned<arte::gltf::Primitive> aPrimitive,
+                            const PositionQuantization * aQuantization)
+{
+    const LoadedVertices loaded = loadVertices(aPrimitive, aQuantization);
+
+    // Interleave the attributes, so each vertex is compared as a single sequence of bytes.
+    std::size_t components = 0;
+    for (const auto & [_attributeIndex, values] : loaded.attributes)
+    {
+        components += loaded.count != 0 ? values.size() / loaded.count : 0;
+    }
+    std::vector<GLfloat> interleaved;
+    interleaved.reserve(loaded.count * components);
+    for (std::size_t vertexId = 0; vertexId != loaded.count; ++vertexId)
+    {
+        for (const auto & [_attributeIndex, values] : loaded.attributes)
+        {
+            const std::size_t attributeComponents = values.size() / loaded.count;
+            auto first = values.begin() + vertexId * attributeComponents;
+            interleaved.insert(interleaved.end(), first, first + attributeComponents);
+        }
+    }
+
+    // The welded indices are sequential, they are also the exported order of the triangle list.
+    auto [welded, representatives] = weldVertices(interleaved, loaded.count);
+    const std::size_t vertexCount = representatives.size();
+
+    std::vector<GLuint> indices = welded;
+    const GLuint positionIndex = getAttributeIndex("POSITION");
+    const bool optimize = mOptions.optimizeIndexOrder && loaded.attributes.contains(positionIndex);
+    if (optimize)
+    {
+        const std::vector<GLfloat> & values = loaded.attributes.at(positionIndex);
+        std::vector<math::Position<3, GLfloat>> positions;
+        positions.reserve(vertexCount);
+        for (std::size_t vertexId : representatives)
+        {
+            positions.push_back({values[vertexId * 3], values[vertexId * 3 + 1], values[vertexId * 3 + 2]});
+        }
+        indices = optimizeIndexOrder(welded, positions, aPrimitive.id());
+
+        const std::vector<GLuint> remap = getVertexFetchRemap(indices, vertexCount);
+        for (std::vector<GLuint> * remapped : {&indices, &welded})
+        {
+            std::ranges::transform(*remapped, remapped->begin(),
+                                   [&remap](GLuint aIndex) { return remap[aIndex]; });
+        }
+    }
+
+    // `welded` now maps each loaded vertex to its position in the range.
+    PrimitiveRanges ranges{.vertices = insertVertices(loaded, aQuantization, welded, vertexCount)};
+    ranges.indices = insertIndices(indices, vertexCount);
+    if (optimize && mOptions.keepExportedIndexOrder)
+    {
+        ranges.exportedIndices = insertIndices(welded, vertexCount);
+    }
+
+    ADLOG(gPrepareLogger, debug)
+         ("Welded the {} vertices of non-indexed primitive #{} into {} indexed vertices.",
+          loaded.count, aPrimitive.id(), vertexCount);
+
+    mVertexRemaps.emplace(std::pair{ranges.vertices.format, ranges.vertices.baseVertex}, std::move(welded));
+    return ranges;
+}
+
+
+std::vector<GLuint> GeometryArena::optimizeIndexOrder(std::span<const GLuint> aIndices,
+                                                      std::span<const math::Position<3, GLfloat>> aPositions,
+                                                      arte::gltf::Index<arte::gltf::Primitive> aPrimitiveIndex)
+{
+    // Bump the version when the optimization changes, so the saved orders are not reused.
+    constexpr std::string_view version = "index-order-1";
+    const std::size_t vertexCount = aPositions.size();
+
+    std::uint64_t key = hashString(version);
+    key = hashBytes(std::as_bytes(aIndices), key);
+    key = hashBytes(std::as_bytes(aPositions), key);
+
+    std::vector<GLuint> result;
+    if (std::optional<std::vector<std::byte>> saved = mIndexOrderCache.load(key);
+        saved && saved->size() == aIndices.size_bytes())
+    {
+        result.resize(aIndices.size());
+        std::memcpy(result.data(), saved->data(), saved->size());
+        ++mIndexOrderStatistics.cachedPrimitives;
+    }
+    else
+    {
+        result = optimizeOverdraw(optimizeVertexCache(aIndices, vertexCount), aPositions);
+        mIndexOrderCache.store(key, std::as_bytes(std::span{result}));
+    }
+
+    const VertexCacheStatistics exported = analyzeVertexCache(aIndices, vertexCount);
+    const VertexCacheStatistics optimized = analyzeVertexCache(result, vertexCount);
+    mIndexOrderStatistics.exported += exported;
+    mIndexOrderStatistics.optimized += optimized;
+    ++mIndexOrderStatistics.optimizedPrimitives;
+
+    ADLOG(gPrepareLogger, debug)
+         ("Reordered the {} triangles of primitive #{}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}.",
+          optimized.triangles, aPrimitiveIndex,
+          exported.getAcmr(), optimized.getAcmr(), exported.getAtvr(), optimized.getAtvr());
+    return result;
+}
+
+
+std::vector<math::Position<3, GLfloat>>
+GeometryArena::loadPositions(arte::Const_Owned<arte::gltf::Primitive> aPrimitive,
+                             const VertexRange & aVertices) const
+{
+    std::vector<math::Position<3, GLfloat>> positions =
+        gltfviewer::loadPositions(aPrimitive.get(aPrimitive->attributes.at("POSITION")));
+
+    auto found = mVertexRemaps.find({aVertices.format, aVertices.baseVertex});
+    if (found == mVertexRemaps.end())
+    {
+        return positions;
+    }
+
+    // Welded vertices are written several times, with the same position.
+    std::vector<math::Position<3, GLfloat>> result(static_cast<std::size_t>(aVertices.count));
+    for (std::size_t vertexId = 0; vertexId != positions.size(); ++vertexId)
+    {
+        result[found->second[vertexId]] = positions[vertexId];
+    }
+    return result;
+}
+
+
+GeometryArena::LoadedVertices
+GeometryArena::loadVertices(arte::Const_Owned<arte::gltf::Primitive> aPrimitive,
+                            const PositionQuantization * aQuantization) const
+{
+    // Load each supported attribute, to know the format before interleaving.
+    LoadedVertices result;
+    if (aQuantization)
+    {
+        result.format |= gQuantizedFormat;
+    }
+    for (const auto & [semantic, accessorIndex] : aPrimitive->attributes)
+    {
+        arte::Const_Owned<arte::gltf::Accessor> accessor = aPrimitive.get(accessorIndex);
+
+        auto found = gSemanticToAttribute.find(semantic);
+        if (found == gSemanticToAttribute.end())
+        {
+            ADLOG(gPrepareLogger, warn)("Semantic '{}' is ignored.", semantic);
+            continue;
+        }
+        if (!accessor->bufferView)
+        {
+            // TODO Handle no buffer view (accessor initialized to zeros)
+            ADLOG(gPrepareLogger, error)
+                 ("Unsupported: accessor #{} does not have a buffer view.", accessorIndex);
+            continue;
+        }
+        if (gElementTypeToLayout.at(accessor->type).occupiedAttributes != 1)
+        {
+            throw std::logic_error{"Matrix attributes not implemented yet."};
+        }
+
+        const VertexAttribute & attribute = found->second;
+        // All accessors for a given primitive must have the same count.
+        result.count = accessor->count;
+        result.attributes.emplace(attribute.index, loadAsFloat(accessor, attribute.components));
+        result.format |= VertexFormat{1} << attribute.index;
+    }
+    return result;
+}
+
+
+GeometryArena::VertexRange GeometryArena::insertVertices(const LoadedVertices & aVertices,
+                                                        const PositionQuantization * aQuantization,
+                                                        std::span<const GLuint> aRemap,
+                                                        std::size_t aRangeCount)
+{
+    Pool & pool = getPool(aVertices.format);
+    VertexRange range{
+        .format = aVertices.format,
+        .vertexArray = pool.vao,
+        .baseVertex = static_cast<GLint>(pool.vertices.size() / pool.stride),
+        .count = static_cast<GLsizei>(aRangeCount),
+    };
+
+    // The map iterates the attributes by increasing index, which is the interleaving order.
+    struct Source
+    {
+        VertexAttribute attribute;
+        AttributeEncoding encoding;
+        std::span<const GLfloat> values;
+    };
+    std::vector<Source> sources;
+    for (const auto & [attributeIndex, values] : aVertices.attributes)
+    {
+        const VertexAttribute attribute{attributeIndex, static_cast<GLint>(values.size() / aVertices.count)};
+        sources.push_back({attribute, getEncoding(attribute, aVertices.format), values});
+    }
+
+    pool.vertices.resize(pool.vertices.size() + aRangeCount * pool.stride);
+    std::byte * const first = pool.vertices.data() + range.baseVertex * pool.stride;
+    for (std::size_t vertexId = 0; vertexId != aVertices.count; ++vertexId)
+    {
+        std::byte * destination = first + (aRemap.empty() ? vertexId : aRemap[vertexId]) * pool.stride;
+        for (const Source & source : sources)
+        {
+            const std::size_t components = source.attribute.components;
+            destination = encode(source.encoding,
+                                 source.values.subspan(vertexId * components, components),
+                                 aQuantization,
+                                 destination);
+        }
+    }
+
+    ADLOG(gPrepareLogger, debug)
+         ("Inserted {} vertices with {} attribute(s) in format {:#x} ({} bytes per vertex), base vertex is {}.",
+          aRangeCount, aVertices.attributes.size(), aVertices.format, pool.stride, range.baseVertex);
+
+    return range;
+}
+
+
+GeometryArena::IndexRange GeometryArena::insertIndices(std::span<const GLuint> aIndices, std::size_t aVertexCount)
+{
+    const GLenum type = getIndexType(aVertexCount);
+    const std::size_t indexSize = getIndexSize(type);
+    // The draw calls require the offset to be a multiple of the index size.
+    const std::size_t offset = (mIndices.size() + indexSize - 1) / indexSize * indexSize;
+    mIndices.resize(offset + aIndices.size() * indexSize);
+
+    if (type == GL_UNSIGNED_SHORT)
+    {
+        std::byte * destination = mIndices.data() + offset;
+        for (GLuint index : aIndices)
+        {
+            const auto narrowed = static_cast<GLushort>(index);
+            std::memcpy(destination, &narrowed, sizeof(narrowed));
+            destination += sizeof(narrowed);
+        }
+    }
+    else
+    {
+        std::memcpy(mIndices.data() + offset, aIndices.data(), aIndices.size_bytes());
+    }
+
+    return IndexRange{
+        .type = type,
+        .firstIndex = static_cast<GLuint>(offset / indexSize),
+        .count = static_cast<GLsizei>(aIndices.size()),
+    };
+}
+
+
+std::vector<GLuint> GeometryArena::getIndices(const IndexRange & aRange) const
+{
+    const std::size_t indexSize = getIndexSize(aRange.type);
+    const std::byte * source = mIndices.data() + aRange.firstIndex * indexSize;
+
+    std::vector<GLuint> result(aRange.count);
+    for (GLuint & index : result)
+    {
+        if (aRange.type == GL_UNSIGNED_SHORT)
+        {
+            GLushort narrowed;
+            std::memcpy(&narrowed, source, sizeof(narrowed));
+            index = narrowed;
+        }
+        else
+        {
+            std::memcpy(&index, source, sizeof(index));
+        }
+        source += indexSize;
+    }
+    return result;
+}
+
+
+std::vector<std::vector<GLuint>>
+GeometryArena::getLevelsOfDetail(std::span<const math::Position<3, GLfloat>> aPositions,
+                                 std::span<const GLuint> aIndices,
+                                 const math::Box<GLfloat> & aBoundingBox) const
+{
+    // Bump the version when the simplification changes, so the saved levels are not reused.
+    constexpr std::string_view version = "levels-of-detail-1";
+
+    std::uint64_t key = hashString(version);
+    key = hashBytes(std::as_bytes(aIndices), key);
+    key = hashBytes(std::as_bytes(aPositions), key);
+    key = hashBytes(std::as_bytes(std::span{&aBoundingBox, 1}), key);
+
+    // The blob is the index count of each level, followed by its indices.
+    std::vector<std::vector<GLuint>> result;
+    if (std::optional<std::vector<std::byte>> saved = mLevelOfDetailCache.load(key))
+    {
+        const std::byte * cursor = saved->data();
+        const std::byte * const end = saved->data() + saved->size();
+        bool valid = true;
+        while (valid && cursor != end)
+        {
+            std::uint32_t count;
+            valid = static_cast<std::size_t>(end - cursor) >= sizeof(count);
+            if (valid)
+            {
+                std::memcpy(&count, cursor, sizeof(count));
+                cursor += sizeof(count);
+                valid = static_cast<std::size_t>(end - cursor) / sizeof(GLuint) >= count;
+            }
+            if (valid)
+            {
+                std::vector<GLuint> & level = result.emplace_back(count);
+                std::memcpy(level.data(), cursor, count * sizeof(GLuint));
+                cursor += count * sizeof(GLuint);
+                valid = std::ranges::all_of(level, [&](GLuint aIndex){ return aIndex < aPositions.size(); });
+            }
+        }
+        if (valid)
+        {
+            return result;
+        }
+        result.clear();
+    }
+
+    result = generateLevelsOfDetail(aPositions, aIndices, aBoundingBox);
+
+    std::vector<std::byte> blob;
+    for (const std::vector<GLuint> & level : result)
+    {
+        const auto count = static_cast<std::uint32_t>(level.size());
+        const std::span<const std::byte> countBytes = std::as_bytes(std::span{&count, 1});
+        blob.insert(blob.end(), countBytes.begin(), countBytes.end());
+        const std::span<const std::byte> indexBytes = std::as_bytes(std::span{level});
+        blob.insert(blob.end(), indexBytes.begin(), indexBytes.end());
+    }
+    mLevelOfDetailCache.store(key, blob);
+    return result;
+}
+
+
+GLenum GeometryArena::getIndexType(std::size_t aVertexCount)
+{
+    // The largest value of each type is left unused, it is the restart index when primitive restart is enabled.
+    return aVertexCount <= std::numeric_limits<GLushort>::max() ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+
+GLsizei GeometryArena::getIndexSize(GLenum aIndexType)
+{
+    switch (aIndexType)
+    {
+    case GL_UNSIGNED_SHORT:
+        return sizeof(GLushort);
+    case GL_UNSIGNED_INT:
+        return sizeof(GLuint);
+    }
+    throw std::logic_error{"Unhandled index type."};
+}
+
+
+void GeometryArena::upload()
+{
+    std::size_t vertexBytes = 0;
+    for (auto & [_format, pool] : mPools)
+    {
+        graphics::bind_guard boundBuffer{pool.vbo};
+        glBufferData(GL_ARRAY_BUFFER,
+                     pool.vertices.size(),
+                     pool.vertices.data(),
+                     GL_STATIC_DRAW);
+        vertexBytes += pool.vertices.size();
+    }
+
+    // Note: binding the element array buffer outside of any vertex array is not allowed by the core profile.
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mIndexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER,
+                 mIndices.size(),
+                 mIndices.data(),
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    ADLOG(gPrepareLogger, info)
+         ("Uploaded geometry: {} vertex format(s) for {} bytes, indices for {} bytes.",
+          mPools.size(), vertexBytes, mIndices.size());
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
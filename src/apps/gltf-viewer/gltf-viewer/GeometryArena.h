@@ -0,0 +1,240 @@
+#pragma once
+
+
+#include "DiskCache.h"
+#include "VertexCache.h"
+#include "VertexQuantization.h"
+
+#include <arte/gltf/Gltf.h>
+
+#include <math/Box.h>
+#include <math/Homogeneous.h>
+
+#include <renderer/GL_Loader.h>
+#include <renderer/VertexSpecification.h>
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Vertex attribute of the viewer shaders, sourced as floats unless quantized (see gQuantizedFormat).
+struct VertexAttribute
+{
+    GLuint index;
+    GLint components;
+};
+
+
+/// \brief Maps semantic to the vertex attributes that will be used in shaders.
+inline const std::map<std::string /*semantic*/, VertexAttribute> gSemanticToAttribute{
+    {"POSITION",   {0, 3}},
+    {"NORMAL",     {1, 3}},
+    {"TEXCOORD_0", {2, 2}}, // TODO Use the texCoord from TextureInfo
+    {"COLOR_0",    {3, 4}},
+    {"JOINTS_0",   {4, 4}},
+    {"WEIGHTS_0",  {5, 4}},
+};
+
+
+/// \brief First attribute index available for per-instance attributes.
+constexpr GLuint gInstanceAttributeIndex = 8;
+/// \brief Count of attribute indices taken by an instance: the model rows, the normal transformation,
+/// then the instance ID (see InstanceList::Instance).
+constexpr GLuint gInstanceAttributeCount = 3 + 3 + 1;
+
+
+/// \brief The set of attributes provided by a vertex, each bit is a vertex attribute index.
+using VertexFormat = std::uint32_t;
+
+/// \brief Flags the formats whose vertices are quantized and packed, instead of interleaved floats.
+///
+/// The attributes are then stored as:
+/// * positions: 16 bits unsigned normalized, over the cube of a PositionQuantization.
+/// * normals: octahedral encoding on 2 x 16 bits signed normalized, see gFeatureOctahedralNormals.
+/// * texture coordinates: half floats.
+/// * colors and weights: 8 bits unsigned normalized.
+/// * joints: 16 bits unsigned integers.
+///
+/// Skinned vertices keep float positions and normals, which are read by the skinning shaders.
+constexpr VertexFormat gQuantizedFormat = VertexFormat{1} << 31;
+
+
+/// \brief Vertex and index data of all primitives, suballocated from shared buffers.
+///
+/// The vertices are repacked as interleaved floats, or quantized (see gQuantizedFormat),
+/// in one buffer per vertex format, each with a vertex array object already specifying this layout.
+/// The indices are narrowed to the smallest type addressing their vertex range (see getIndexType()),
+/// in a single index buffer bound to all vertex array objects.
+/// Primitives sharing the same accessors share the same ranges.
+///
+/// The non-indexed triangle lists are welded into indexed triangle lists: identical vertices are merged.
+///
+/// The indexed triangle lists can be reordered for the post-transform cache and for overdraw,
+/// then their vertices for fetch locality (see Options). A vertex range is only reordered
+/// by the first primitive indexing it, the later primitives have their indices remapped.
+///
+/// The data is accumulated in main memory while loading, then sent at once by upload().
+class GeometryArena
+{
+public:
+    struct Options
+    {
+        // Reorder the triangles and vertices of the indexed triangle lists, see VertexCache.h.
+        bool optimizeIndexOrder{true};
+        // Also keep the exported order of the indices, to compare both orders, see Mesh::setIndexOrder().
+        bool keepExportedIndexOrder{false};
+        // Merge the identical vertices of the non-indexed triangle lists, which are then indexed.
+        bool weldVertices{true};
+    };
+
+    struct VertexRange
+    {
+        VertexFormat format;
+        // The vertex array of the format, the instance attributes are enabled but not pointed.
+        GLuint vertexArray;
+        GLint baseVertex;
+        GLsizei count;
+    };
+
+    struct IndexRange
+    {
+        // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+        GLenum type;
+        // In elements of `type`.
+        GLuint firstIndex;
+        GLsizei count;
+    };
+
+    struct PrimitiveRanges
+    {
+        VertexRange vertices;
+        // Only for indexed primitives.
+        std::optional<IndexRange> indices;
+        // Only if the indices were reordered and Options::keepExportedIndexOrder is set.
+        std::optional<IndexRange> exportedIndices;
+    };
+
+    /// \pre No primitive was inserted yet.
+    void setOptions(const Options & aOptions)
+    { mOptions = aOptions; }
+
+    const Options & getOptions() const
+    { return mOptions; }
+
+    /// \brief Return the vertices and indices of the primitive, inserting them on first request.
+    /// \param aQuantization If provided, the vertices are quantized, their positions over this grid.
+    PrimitiveRanges insertPrimitive(arte::Const_Owned<arte::gltf::Primitive> aPrimitive,
+                                    const PositionQuantization * aQuantization = nullptr);
+
+    /// \brief Append generated indices, which are never shared.
+    /// \param aVertexCount The count of vertices in the indexed range, which selects the index type.
+    IndexRange insertIndices(std::span<const GLuint> aIndices, std::size_t aVertexCount);
+
+    /// \brief The inserted indices, widened back to GLuint, only available until upload().
+    std::vector<GLuint> getIndices(const IndexRange & aRange) const;
+
+    /// \brief Load the positions of the primitive, in the order of its vertices in `aVertices`.
+    std::vector<math::Position<3, GLfloat>> loadPositions(arte::Const_Owned<arte::gltf::Primitive> aPrimitive,
+                                                          const VertexRange & aVertices) const;
+
+    /// \brief Generate the simplified levels of a triangle list, or load the saved ones.
+    /// \see generateLevelsOfDetail()
+    std::vector<std::vector<GLuint>> getLevelsOfDetail(std::span<const math::Position<3, GLfloat>> aPositions,
+                                                       std::span<const GLuint> aIndices,
+                                                       const math::Box<GLfloat> & aBoundingBox) const;
+
+    const IndexOrderStatistics & getIndexOrderStatistics() const
+    { return mIndexOrderStatistics; }
+
+    /// \brief Send all inserted data to the buffers, to be called once loading is complete.
+    void upload();
+
+    static GLsizei getStride(VertexFormat aFormat);
+
+    /// \brief The narrowest index type able to address `aVertexCount` vertices.
+    static GLenum getIndexType(std::size_t aVertexCount);
+
+    static GLsizei getIndexSize(GLenum aIndexType);
+
+    /// \brief Whether the normals of the format must be decoded by the shaders, see gFeatureOctahedralNormals.
+    static bool hasOctahedralNormals(VertexFormat aFormat);
+
+private:
+    struct Pool
+    {
+        explicit Pool(VertexFormat aFormat, GLuint aIndexBuffer);
+
+        GLsizei stride;
+        graphics::VertexBufferObject vbo;
+        graphics::VertexArrayObject vao;
+        std::vector<std::byte> vertices;
+    };
+
+    /// \brief The supported attributes of a primitive, as floats.
+    struct LoadedVertices
+    {
+        VertexFormat format{0};
+        std::size_t count{0};
+        // By attribute index, which is the interleaving order.
+        std::map<GLuint, std::vector<GLfloat>> attributes;
+    };
+
+    Pool & getPool(VertexFormat aFormat);
+
+    LoadedVertices loadVertices(arte::Const_Owned<arte::gltf::Primitive> aPrimitive,
+                                const PositionQuantization * aQuantization) const;
+
+    /// \param aRemap The position of each loaded vertex in the range, or empty to keep their order.
+    /// Welded vertices share a position.
+    /// \param aRangeCount The count of vertices in the range, which is less than the loaded count when welded.
+    VertexRange insertVertices(const LoadedVertices & aVertices,
+                               const PositionQuantization * aQuantization,
+                               std::span<const GLuint> aRemap,
+                               std::size_t aRangeCount);
+
+    /// \brief Insert a non-indexed triangle list as an indexed one, merging its identical vertices.
+    PrimitiveRanges insertWelded(arte::Const_Owned<arte::gltf::Primitive> aPrimitive,
+                                 const PositionQuantization * aQuantization);
+
+    /// \brief Reorder the triangles for the post-transform cache then overdraw, or load the saved order.
+    /// \param aPositions The positions of the indexed vertices.
+    std::vector<GLuint> optimizeIndexOrder(std::span<const GLuint> aIndices,
+                                           std::span<const math::Position<3, GLfloat>> aPositions,
+                                           arte::gltf::Index<arte::gltf::Primitive> aPrimitiveIndex);
+
+    graphics::IndexBufferObject mIndexBuffer;
+    // Indices of different types, each range aligned on its index size.
+    std::vector<std::byte> mIndices;
+    std::map<VertexFormat, Pool> mPools;
+    // The same attributes are inserted again for each different quantization grid (origin and extent).
+    using VertexKey = std::pair<std::map<std::string, arte::gltf::Index<arte::gltf::Accessor>>,
+                                std::array<GLfloat, 4>>;
+    std::map<VertexKey, VertexRange> mVertexRanges;
+    // The welded triangle lists, which share their vertex and index ranges.
+    std::map<VertexKey, PrimitiveRanges> mWeldedRanges;
+    // The position of each vertex of the accessors in the vertex ranges reordered for fetch locality
+    // or welded, by format and base vertex.
+    std::map<std::pair<VertexFormat, GLint>, std::vector<GLuint>> mVertexRemaps;
+    // The indices depend on the remapping of the vertex range, identified by format and base vertex.
+    using IndexKey = std::tuple<arte::gltf::Index<arte::gltf::Accessor>, VertexFormat, GLint>;
+    std::map<IndexKey, std::pair<IndexRange, std::optional<IndexRange>>> mIndexRanges;
+
+    Options mOptions;
+    IndexOrderStatistics mIndexOrderStatistics;
+    DiskCache mIndexOrderCache{"indices"};
+    DiskCache mLevelOfDetailCache{"levels"};
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
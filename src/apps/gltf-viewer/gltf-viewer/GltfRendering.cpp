@@ -1,5 +1,6 @@
 #include "GltfRendering.h"
 
+#include "Capabilities.h"
 #include "ImguiUi.h"
 #include "Logging.h"
 #include "Shaders.h"
@@ -12,6 +13,14 @@
 
 #include <renderer/GL_Loader.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <optional>
+#include <span>
+#include <utility>
+#include <variant>
+
 
 namespace ad {
 
@@ -79,20 +88,28 @@ math::AffineMatrix<4, float> getLocalTransform(const arte::gltf::Node & aNode)
 }
 
 
+/// \brief Byte offset in the arena index buffer of the index at `aFirstIndex`, in the primitive index type.
+void * getIndexOffset(const MeshPrimitive & aMeshPrimitive, GLuint aFirstIndex)
+{
+    return reinterpret_cast<void *>(
+        std::size_t{aFirstIndex} * GeometryArena::getIndexSize(aMeshPrimitive.indexType));
+}
+
+
 /// \brief A single (non-instanted) draw of the mesh primitive.
+/// \note The arena index buffer is bound by the vertex array of the primitive.
 void drawCall(const MeshPrimitive & aMeshPrimitive)
 {
-    if (aMeshPrimitive.indices)
+    if (aMeshPrimitive.firstIndex)
     {
         ADLOG(gDrawLogger, trace)
              ("Indexed rendering of {} vertices with mode {}.", aMeshPrimitive.count, aMeshPrimitive.drawMode);
 
-        const Indices & indices = *aMeshPrimitive.indices;
-        graphics::bind_guard boundIndexBuffer{indices.ibo};
-        glDrawElements(aMeshPrimitive.drawMode, 
-                       aMeshPrimitive.count,
-                       indices.componentType,
-                       reinterpret_cast<void *>(indices.byteOffset));
+        glDrawElementsBaseVertex(aMeshPrimitive.drawMode, 
+                                 aMeshPrimitive.count,
+                                 aMeshPrimitive.indexType,
+                                 getIndexOffset(aMeshPrimitive, *aMeshPrimitive.firstIndex),
+                                 aMeshPrimitive.baseVertex);
     }
     else
     {
@@ -100,7 +117,7 @@ void drawCall(const MeshPrimitive & aMeshPrimitive)
              ("Array rendering of {} vertices with mode {}.", aMeshPrimitive.count, aMeshPrimitive.drawMode);
 
         glDrawArrays(aMeshPrimitive.drawMode,  
-                     0, // Start at the beginning of enable arrays, all byte offsets are aleady applied.
+                     aMeshPrimitive.baseVertex,
                      aMeshPrimitive.count);
     }
 }
@@ -109,20 +126,19 @@ void drawCall(const MeshPrimitive & aMeshPrimitive)
 /// \brief Instanced draw of the mesh primitive.
 void drawCall(const MeshPrimitive & aMeshPrimitive, GLsizei aInstanceCount)
 {
-    if (aMeshPrimitive.indices)
+    if (aMeshPrimitive.firstIndex)
     {
         ADLOG(gDrawLogger, trace)
              ("Indexed rendering of {} instance(s) of {} vertices with mode {}.",
               aMeshPrimitive.count, aInstanceCount, aMeshPrimitive.drawMode);
 
-        const Indices & indices = *aMeshPrimitive.indices;
-        graphics::bind_guard boundIndexBuffer{indices.ibo};
-        glDrawElementsInstanced(
+        glDrawElementsInstancedBaseVertex(
             aMeshPrimitive.drawMode, 
             aMeshPrimitive.count,
-            indices.componentType,
-            reinterpret_cast<void *>(indices.byteOffset),
-            aInstanceCount);
+            aMeshPrimitive.indexType,
+            getIndexOffset(aMeshPrimitive, *aMeshPrimitive.firstIndex),
+            aInstanceCount,
+            aMeshPrimitive.baseVertex);
     }
     else
     {
@@ -132,181 +148,905 @@ void drawCall(const MeshPrimitive & aMeshPrimitive, GLsizei aInstanceCount)
 
         glDrawArraysInstanced(
             aMeshPrimitive.drawMode,  
-            0, // Start at the beginning of enable arrays, all byte offsets are aleady applied.
+            aMeshPrimitive.baseVertex,
             aMeshPrimitive.count,
             aInstanceCount);
     }
 }
 
 
-template <class ... VT_extraParams>
-void render(const MeshPrimitive & aMeshPrimitive, VT_extraParams ... aExtraDrawParams)
+/// \brief The indices of an indexed primitive at the requested level of detail.
+MeshPrimitive::LevelOfDetail getLevelOfDetail(const MeshPrimitive & aMeshPrimitive, std::size_t aLevel)
 {
-    graphics::bind_guard boundVao{aMeshPrimitive.vao};
+    if (aLevel == 0 || aMeshPrimitive.levelsOfDetail.empty())
+    {
+        return {.count = aMeshPrimitive.count, .firstIndex = *aMeshPrimitive.firstIndex};
+    }
+    // Primitives might have less levels than requested, use their coarsest.
+    return aMeshPrimitive.levelsOfDetail[std::min(aLevel, aMeshPrimitive.levelsOfDetail.size()) - 1];
+}
 
-    const auto & material = aMeshPrimitive.material;
 
-    // Culling
-    if (material.doubleSided) glDisable(GL_CULL_FACE);
-    else glEnable(GL_CULL_FACE);
+/// \pre The instance attributes are pointed at the first instance of the range.
+void drawCall(const MeshPrimitive & aMeshPrimitive, const LevelOfDetailDraw & aDraw)
+{
+    if (aDraw.level == 0 || aMeshPrimitive.levelsOfDetail.empty())
+    {
+        drawCall(aMeshPrimitive, aDraw.range.count);
+    }
+    else
+    {
+        const MeshPrimitive::LevelOfDetail lod = getLevelOfDetail(aMeshPrimitive, aDraw.level);
+
+        ADLOG(gDrawLogger, trace)
+             ("Indexed rendering of {} instance(s) at level of detail {}, {} vertices with mode {}.",
+              aDraw.range.count, aDraw.level, lod.count, aMeshPrimitive.drawMode);
+
+        glDrawElementsInstancedBaseVertex(
+            aMeshPrimitive.drawMode,
+            lod.count,
+            aMeshPrimitive.indexType,
+            getIndexOffset(aMeshPrimitive, lod.firstIndex),
+            aDraw.range.count,
+            aMeshPrimitive.baseVertex);
+    }
+}
+
 
-    // Alpha mode
-    switch(material.alphaMode)
+/// \brief Instanced draw of the mesh primitive, the instance count being provided by the GPU.
+/// \pre The mesh indirect commands are bound to GL_DRAW_INDIRECT_BUFFER.
+void drawCall(const MeshPrimitive & aMeshPrimitive, const IndirectDraw &)
+{
+    if (aMeshPrimitive.firstIndex)
     {
-    case gltf::Material::AlphaMode::Opaque:
-        glDisable(GL_BLEND);
-        break;
-    case gltf::Material::AlphaMode::Blend:
-        glEnable(GL_BLEND);
-        break;
-    case gltf::Material::AlphaMode::Mask:
-        ADLOG(gDrawLogger, critical)("Not supported: mask alpha mode.");
-        throw std::logic_error{"Mask alpha mode not implemented."};
+        ADLOG(gDrawLogger, trace)
+             ("Indirect indexed rendering of {} vertices with mode {}.",
+              aMeshPrimitive.count, aMeshPrimitive.drawMode);
+
+        glDrawElementsIndirect(
+            aMeshPrimitive.drawMode,
+            aMeshPrimitive.indexType,
+            reinterpret_cast<void *>(aMeshPrimitive.indirectCommandOffset));
     }
+    else
+    {
+        ADLOG(gDrawLogger, trace)
+             ("Indirect array rendering of {} vertices with mode {}.",
+              aMeshPrimitive.count, aMeshPrimitive.drawMode);
 
-    glActiveTexture(GL_TEXTURE0 + Renderer::gColorTextureUnit);
-    glBindTexture(GL_TEXTURE_2D, *material.baseColorTexture);
+        glDrawArraysIndirect(
+            aMeshPrimitive.drawMode,
+            reinterpret_cast<void *>(aMeshPrimitive.indirectCommandOffset));
+    }
+}
 
-    glActiveTexture(GL_TEXTURE0 + Renderer::gMetallicRoughnessTextureUnit);
-    glBindTexture(GL_TEXTURE_2D, *material.metallicRoughnessTexture);
 
-    drawCall(aMeshPrimitive, std::forward<VT_extraParams>(aExtraDrawParams)...);
+/// \brief Instanced draw of the skinned primitive, one instance per palette.
+/// \pre The palette buffer is bound, and the program palette uniforms are set.
+void drawCall(const MeshPrimitive & aMeshPrimitive, const SkinnedDraw & aDraw)
+{
+    drawCall(aMeshPrimitive, aDraw.palettes.count);
+}
+
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+/// \pre The skinned vertices are bound, and the program skinned vertex uniforms are set.
+void drawCall(const MeshPrimitive & aMeshPrimitive, const PreSkinnedDraw & aDraw)
+{
+    drawCall(aMeshPrimitive, aDraw.vertices->instanceCount);
 }
 
 
+/// \brief Batched draws are emitted by runs, see Renderer::flush().
+void drawCall(const MeshPrimitive &, const BatchedDraw &)
+{
+    throw std::logic_error{"Batched draws must be emitted as multi-draw calls."};
+}
 
-Renderer::Renderer()
+
+/// \brief The first instance of the instance buffer to be drawn, only level of detail draws have an offset.
+/// \note Batched draws offset their instances via the command base instance.
+GLsizei getFirstInstance(const DrawParameters & aParameters)
 {
-    initializePrograms();
+    if (auto levelOfDetail = std::get_if<LevelOfDetailDraw>(&aParameters))
+    {
+        return levelOfDetail->range.first;
+    }
+    return 0;
 }
 
 
-const Renderer::ShadingPrograms & Renderer::activePrograms() const
+const math::hdr::Rgba_f * getBaseColorTint(const DrawParameters & aParameters)
 {
-    return mPrograms.at(mShadingModel);
+    static const math::hdr::Rgba_f gNoTint = math::hdr::gWhite<GLfloat>;
+
+    if (auto levelOfDetail = std::get_if<LevelOfDetailDraw>(&aParameters);
+        levelOfDetail && levelOfDetail->tint)
+    {
+        return levelOfDetail->tint;
+    }
+    else if (auto batched = std::get_if<BatchedDraw>(&aParameters);
+             batched && batched->tint)
+    {
+        return batched->tint;
+    }
+    return &gNoTint;
 }
 
 
-template <class ... VT_extraParams>
-void Renderer::renderImpl(const Mesh & aMesh,
-                          graphics::Program & aProgram,
-                          VT_extraParams ... aExtraParams) const
+/// \brief Colors distinguishing the levels of detail, from full resolution to the coarsest.
+const math::hdr::Rgba_f * getLevelTint(std::size_t aLevel)
 {
-    // Not enabled by default OpenGL context.
-    glEnable(GL_DEPTH_TEST);
+    static const std::array<math::hdr::Rgba_f, gMaxLevelsOfDetail> gLevelTints{
+        math::hdr::Rgba_f{0.2f, 0.9f, 0.2f, 1.f},
+        math::hdr::Rgba_f{0.9f, 0.9f, 0.2f, 1.f},
+        math::hdr::Rgba_f{0.9f, 0.5f, 0.1f, 1.f},
+        math::hdr::Rgba_f{0.9f, 0.1f, 0.1f, 1.f},
+    };
+    return &gLevelTints[aLevel];
+}
+
+
+ShaderFeatures getScaleFeatures(bool aNonUniformScale)
+{
+    return aNonUniformScale ? gFeatureNonUniformScale : 0;
+}
+
+
+/// \brief Whether the packet requires the same state as `aFirst`, except for the material index.
+bool isSameMultiDrawState(const DrawPacket & aFirst, const DrawPacket & aPacket)
+{
+    const MeshPrimitive & first = *aFirst.primitive;
+    const MeshPrimitive & primitive = *aPacket.primitive;
+    return aPacket.program == aFirst.program
+        && aPacket.instances == aFirst.instances
+        && primitive.drawMode == first.drawMode
+        && primitive.firstIndex.has_value() == first.firstIndex.has_value()
+        && primitive.indexType == first.indexType
+        && primitive.vertexArray == first.vertexArray
+        && primitive.materialSlot.page == first.materialSlot.page
+        && primitive.material.alphaMode == first.material.alphaMode
+        && primitive.material.doubleSided == first.material.doubleSided
+        && primitive.material.baseColorTexture.array == first.material.baseColorTexture.array
+        && primitive.material.metallicRoughnessTexture.array == first.material.metallicRoughnessTexture.array
+        ;
+}
+
 
-    graphics::bind_guard boundProgram{aProgram};
+/// \brief Whether the packet can be drawn by the multi-draw call started by the batched packet `aFirst`.
+bool isSameBatch(const DrawPacket & aFirst, const DrawPacket & aPacket)
+{
+    auto batched = std::get_if<BatchedDraw>(&aPacket.parameters);
+    return batched
+        && batched->tint == std::get<BatchedDraw>(aFirst.parameters).tint
+        && isSameMultiDrawState(aFirst, aPacket);
+}
 
-    setUniformInt(aProgram, "u_debugOutput", static_cast<int>(mColorOutput)); 
 
-    setUniformInt(aProgram, "u_baseColorTex", gColorTextureUnit); 
-    setUniformInt(aProgram, "u_metallicRoughnessTex", gMetallicRoughnessTextureUnit); 
+/// \brief Whether the packet can be drawn by the multi-draw call of the indirect packets ending with `aLast`.
+///
+/// The packet must draw the primitive following the one of `aLast`, so the commands are consecutive.
+bool isSameIndirectRun(const DrawPacket & aLast, const DrawPacket & aPacket)
+{
+    auto indirect = std::get_if<IndirectDraw>(&aPacket.parameters);
+    return indirect
+        && indirect->multiDraw
+        && aPacket.mesh == aLast.mesh
+        && aPacket.primitive == aLast.primitive + 1
+        && isSameMultiDrawState(aLast, aPacket);
+}
 
-    for (const auto & primitive : aMesh.primitives)
+
+void Renderer::queue(GpuProgram aProgram, ShaderFeatures aInstanceFeatures, GLfloat aViewDepth, DrawPacket aPacket)
+{
+    ShaderFeatures features = aPacket.primitive->features | aInstanceFeatures;
+    // Only the learnopengl shading has debug outputs, do not multiply the other permutations.
+    if (mShadingModel == ShadingModel::PbrLearn)
+    {
+        features |= static_cast<ShaderFeatures>(mColorOutput) << gFeatureDebugOutputShift;
+    }
+
+    Permutation * permutation = &getPermutation(aProgram, mShadingModel, features);
+    if (permutation->pendingBuild && mProgramCache.isAsynchronous() && mShadingModel != ShadingModel::Phong
+        && !mProgramCache.isReady(permutation->program->program, *permutation->pendingBuild))
+    {
+        // Draw with Phong shading until the requested permutation is linked, instead of waiting for it.
+        // The permutations restored from the binary cache are ready at once, they are completed before drawing.
+        // The fallback is awaited if it is pending as well, but it is shared by all shading models.
+        permutation = &getPermutation(aProgram, ShadingModel::Phong, features & ~gFeatureDebugOutputMask);
+        ++mFallbackPackets;
+    }
+    if (permutation->pendingBuild)
+    {
+        permutation->awaited = true;
+    }
+    const GLuint programId = permutation->queueId;
+    aPacket.program = permutation->program.get();
+
+    switch(aPacket.primitive->material.alphaMode)
+    {
+    case gltf::Material::AlphaMode::Opaque:
+        mQueue.pushOpaque(programId, aPacket);
+        break;
+    case gltf::Material::AlphaMode::Blend:
+        mQueue.pushTransparent(programId, aViewDepth, aPacket);
+        break;
+    case gltf::Material::AlphaMode::Mask:
+        ADLOG(gDrawLogger, critical)("Not supported: mask alpha mode.");
+        throw std::logic_error{"Mask alpha mode not implemented."};
+    }
+}
+
+
+void Renderer::submitImpl(const Mesh & aMesh,
+                          GpuProgram aProgram,
+                          ShaderFeatures aInstanceFeatures,
+                          GLfloat aViewDepth,
+                          const DrawParameters & aParameters)
+{
+    for (const MeshPrimitive & primitive : aMesh.primitives)
+    {
+        queue(aProgram,
+              aInstanceFeatures,
+              aViewDepth,
+              DrawPacket{
+                  .mesh = &aMesh,
+                  .primitive = &primitive,
+                  .instances = &aMesh.gpuInstances,
+                  .parameters = aParameters,
+              });
+    }
+}
+
+
+void Renderer::submit(const Mesh & aMesh, GLfloat aViewDepth, bool aNonUniformScale)
+{
+    std::span<const InstanceList::Range> levelRanges = aMesh.gpuInstances.getLevelRanges();
+    for (std::size_t level = 0; level != levelRanges.size(); ++level)
+    {
+        if (levelRanges[level].count != 0)
+        {
+            submitImpl(aMesh,
+                       GpuProgram::InstancedNoAnimation,
+                       getScaleFeatures(aNonUniformScale),
+                       aViewDepth,
+                       LevelOfDetailDraw{
+                           .level = level,
+                           .range = levelRanges[level],
+                           .tint = mShowLevelsOfDetail ? getLevelTint(level) : nullptr,
+                       });
+        }
+    }
+}
+
+
+void Renderer::submitBatched(const Mesh & aMesh,
+                             const InstanceList & aInstances,
+                             std::span<const InstanceList::Range> aLevelRanges,
+                             std::span<const std::vector<GeometryArena::IndexRange>> aVisibleMeshlets,
+                             GLfloat aViewDepth,
+                             bool aNonUniformScale)
+{
+    for (std::size_t level = 0; level != aLevelRanges.size(); ++level)
     {
-        setUniform(aProgram, "u_baseColorFactor", primitive.material.baseColorFactor); 
-        setUniformFloat(aProgram, "u_metallicFactor", primitive.material.metallicFactor); 
-        setUniformFloat(aProgram, "u_roughnessFactor", primitive.material.roughnessFactor); 
+        const InstanceList::Range range = aLevelRanges[level];
+        if (range.count == 0)
+        {
+            continue;
+        }
 
-        // If the vertex color are not provided for the primitive, the default value (black)
-        // will be used in the shaders. It must be offset to white.
-        auto vertexColorOffset = primitive.providesColor() ?
-            math::hdr::Rgba_f{0.f, 0.f, 0.f, 0.f} : math::hdr::Rgba_f{1.f, 1.f, 1.f, 0.f};
-        setUniform(aProgram, "u_vertexColorOffset", vertexColorOffset); 
+        const math::hdr::Rgba_f * tint = mShowLevelsOfDetail ? getLevelTint(level) : nullptr;
+        for (std::size_t primitiveId = 0; primitiveId != aMesh.primitives.size(); ++primitiveId)
+        {
+            const MeshPrimitive & primitive = aMesh.primitives[primitiveId];
+            DrawPacket packet{
+                .mesh = &aMesh,
+                .primitive = &primitive,
+                .instances = &aInstances,
+            };
+
+            std::span<const GeometryArena::IndexRange> meshlets;
+            if (level == 0 && !aVisibleMeshlets.empty() && !primitive.meshlets.empty())
+            {
+                meshlets = aVisibleMeshlets[primitiveId];
+                if (meshlets.empty())
+                {
+                    // All meshlets were culled.
+                    continue;
+                }
+            }
 
-        gltfviewer::render(primitive, std::forward<VT_extraParams>(aExtraParams)...);
+            // Only indexed primitives are batched, the others are drawn by the static program
+            // from the same instance list.
+            if (primitive.firstIndex)
+            {
+                packet.parameters = BatchedDraw{.level = level, .range = range, .tint = tint, .meshlets = meshlets};
+                queue(GpuProgram::InstancedBatched, getScaleFeatures(aNonUniformScale), aViewDepth, packet);
+            }
+            else
+            {
+                packet.parameters = LevelOfDetailDraw{.level = level, .range = range, .tint = tint};
+                queue(GpuProgram::InstancedNoAnimation, getScaleFeatures(aNonUniformScale), aViewDepth, packet);
+            }
+        }
     }
 }
 
 
-void Renderer::render(const Mesh & aMesh) const
+void Renderer::submitIndirect(const Mesh & aMesh, GLfloat aViewDepth, bool aNonUniformScale)
+{
+    // The batched program reads the material of each draw of a multi-draw call.
+    const bool multiDraw = getGpuCapabilities().supportsMultiDrawIndirect();
+    submitImpl(aMesh,
+               multiDraw ? GpuProgram::InstancedBatched : GpuProgram::InstancedNoAnimation,
+               getScaleFeatures(aNonUniformScale),
+               aViewDepth,
+               IndirectDraw{.multiDraw = multiDraw});
+}
+
+
+void Renderer::submit(const Mesh & aMesh, const PaletteRange & aPalettes, GLfloat aViewDepth, bool aNonUniformScale)
 {
-    renderImpl(aMesh, *activePrograms().at(GpuProgram::InstancedNoAnimation), aMesh.gpuInstances.size());
+    submitImpl(aMesh,
+               GpuProgram::Skinning,
+               getScaleFeatures(aNonUniformScale),
+               aViewDepth,
+               SkinnedDraw{aPalettes});
 }
 
 
-void Renderer::render(const Mesh & aMesh, const Skeleton & aSkeleton) const
+void Renderer::submit(const Mesh & aMesh, const SkinnedVertices & aVertices, GLfloat aViewDepth)
 {
-    bind(aSkeleton);
-    renderImpl(aMesh, *activePrograms().at(GpuProgram::Skinning));
+    for (std::size_t primitiveId = 0; primitiveId != aMesh.primitives.size(); ++primitiveId)
+    {
+        // The skinned vertices are in world space, the camera transformation is rigid.
+        queue(GpuProgram::PreSkinned,
+              0,
+              aViewDepth,
+              DrawPacket{
+                  .mesh = &aMesh,
+                  .primitive = &aMesh.primitives[primitiveId],
+                  .instances = &aMesh.gpuInstances,
+                  .parameters = PreSkinnedDraw{
+                      .vertices = &aVertices,
+                      .first = aVertices.primitiveFirst.at(primitiveId),
+                  },
+              });
+    }
 }
 
 
-void Renderer::bind(const Skeleton & aSkeleton) const
+void Renderer::uploadBatches(std::span<const DrawPacket> aPackets)
 {
-    glBindBufferBase(GL_UNIFORM_BUFFER,
-        gPaletteBlockBinding,
-        aSkeleton.matrixPalette.uniformBuffer);
+    mBatchCommands.clear();
+    mDrawRecords.clear();
+    for (const DrawPacket & packet : aPackets)
+    {
+        if (auto batched = std::get_if<BatchedDraw>(&packet.parameters))
+        {
+            const MeshPrimitive & primitive = *packet.primitive;
+            auto pushCommand = [&](GLsizei aCount, GLuint aFirstIndex)
+            {
+                mBatchCommands.push_back({
+                    .count = static_cast<GLuint>(aCount),
+                    .instanceCount = static_cast<GLuint>(batched->range.count),
+                    .firstIndex = aFirstIndex,
+                    .baseVertex = primitive.baseVertex,
+                    .baseInstance = static_cast<GLuint>(batched->range.first),
+                });
+                mDrawRecords.push_back(primitive.materialSlot.index);
+            };
+
+            if (batched->meshlets.empty())
+            {
+                const MeshPrimitive::LevelOfDetail indices = getLevelOfDetail(primitive, batched->level);
+                pushCommand(indices.count, indices.firstIndex);
+            }
+            for (const GeometryArena::IndexRange & run : batched->meshlets)
+            {
+                pushCommand(run.count, run.firstIndex);
+            }
+        }
+        else if (auto indirect = std::get_if<IndirectDraw>(&packet.parameters);
+                 indirect && indirect->multiDraw)
+        {
+            // The command is in the mesh indirect buffer, only its record is required.
+            mDrawRecords.push_back(packet.primitive->materialSlot.index);
+        }
+    }
+
+    if (mDrawRecords.empty())
+    {
+        return;
+    }
+
+    if (!mBatchCommands.empty())
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mBatchCommandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                     mBatchCommands.size() * sizeof(DrawElementsIndirectCommand),
+                     mBatchCommands.data(),
+                     GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mDrawRecordBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 mDrawRecords.size() * sizeof(GLuint),
+                 mDrawRecords.data(),
+                 GL_STREAM_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gDrawRecordBinding, mDrawRecordBuffer);
+
+    ADLOG(gDrawLogger, trace)
+         ("Uploaded {} batched command(s), {} draw record(s).", mBatchCommands.size(), mDrawRecords.size());
 }
 
 
-void Renderer::initializePrograms()
+Renderer::Renderer()
 {
-    auto setLights = [](graphics::Program & aProgram)
+    if (getGpuCapabilities().supportsPersistentMapping())
     {
-        setUniform(aProgram, "u_light.position_world", math::Vec<4, GLfloat>{-100.f, 100.f, 1000.f, 1.f}); 
-        setUniform(aProgram, "u_light.color", math::hdr::gWhite<GLfloat>);
-        setUniformInt(aProgram, "u_light.specularExponent", 100);
-        // Ideally, I suspect the sum should be 1
-        setUniformFloat(aProgram, "u_light.diffuse", 0.3f);
-        setUniformFloat(aProgram, "u_light.specular", 0.35f);
-        setUniformFloat(aProgram, "u_light.ambient", 0.45f);
+        mStream.emplace();
+    }
+}
+
+
+RenderStatistics Renderer::flush()
+{
+    updatePermutations();
+
+    const ProgramCacheStatistics & programStatistics = mProgramCache.getStatistics();
+    RenderStatistics statistics{
+        .packets = mQueue.getPackets().size(),
+        .programPermutations = mPermutations.size(),
+        .cachedPermutations = programStatistics.cachedPrograms,
+        .permutationTimeSavedMs =
+            std::chrono::duration<double, std::milli>{programStatistics.savedTime}.count(),
+        .pendingPermutations = mPendingPermutations.size(),
+        .fallbackPackets = mFallbackPackets,
     };
+    mFallbackPackets = 0;
+    mQueue.sort();
+
+    const std::span<const DrawPacket> packets = mQueue.getPackets();
+    uploadBatches(packets);
+    // The batched commands and the draw records are consumed in upload order, by contiguous runs.
+    GLsizei nextCommand = 0;
+    GLsizei nextRecord = 0;
+
+    // Not enabled by default OpenGL context.
+    glEnable(GL_DEPTH_TEST);
+
+    // All skinned packets source the same palette buffer.
+    mPalettes.bind(gPaletteTextureUnit);
 
-    auto insertPrograms = [&](ShadingModel aShadingModel, const char * aFragmentSource)
+    // The state left by the previous packet, a change is only emitted if it differs.
+    struct
+    {
+        const ViewerProgram * program{nullptr};
+        const math::hdr::Rgba_f * tint{nullptr};
+        std::optional<bool> blend;
+        std::optional<bool> doubleSided;
+        GLuint baseColorTexture{0};
+        GLuint metallicRoughnessTexture{0};
+        GLuint vertexArray{0};
+        const InstanceList * instances{nullptr};
+        GLsizei firstInstance{0};
+        std::optional<GLuint> materialPage;
+        std::optional<std::pair<GLint, GLsizei>> palettes;
+        GLuint skinnedVertices{0};
+        GLuint indirectBuffer{0};
+    } current;
+
+    // Not a range-for: a batched packet consumes all the following packets of its run.
+    for (std::size_t packetId = 0; packetId != packets.size();)
     {
+        const DrawPacket & packet = packets[packetId];
+        const MeshPrimitive & primitive = *packet.primitive;
+        const Material & material = primitive.material;
+
+        if (packet.program != current.program)
         {
-            auto phong = std::make_shared<graphics::Program>(
-                graphics::makeLinkedProgram({
-                    {GL_VERTEX_SHADER,   gltfviewer::gStaticVertexShader},
-                    {GL_FRAGMENT_SHADER, aFragmentSource},
-            }));
-            setLights(*phong);
-            mPrograms[aShadingModel].emplace(GpuProgram::InstancedNoAnimation, std::move(phong));
+            glUseProgram(packet.program->program);
+            current.program = packet.program;
+            // The tint and palettes are uniforms of the program, they must be set again.
+            current.tint = nullptr;
+            current.palettes.reset();
+            ++statistics.programChanges;
+        }
+
+        if (const math::hdr::Rgba_f * tint = getBaseColorTint(packet.parameters);
+            tint != current.tint)
+        {
+            setUniform(packet.program->program, packet.program->locations.baseColorTint, *tint); 
+            current.tint = tint;
+        }
+
+        if (bool blend = (material.alphaMode == gltf::Material::AlphaMode::Blend);
+            blend != current.blend)
+        {
+            if (blend) glEnable(GL_BLEND);
+            else glDisable(GL_BLEND);
+            current.blend = blend;
+            ++statistics.blendChanges;
+        }
+
+        if (material.doubleSided != current.doubleSided)
+        {
+            if (material.doubleSided) glDisable(GL_CULL_FACE);
+            else glEnable(GL_CULL_FACE);
+            current.doubleSided = material.doubleSided;
+            ++statistics.cullFaceChanges;
+        }
+
+        // The layers are provided by the material entries, only the arrays are bound.
+        if (material.baseColorTexture.array != current.baseColorTexture)
+        {
+            glActiveTexture(GL_TEXTURE0 + gColorTextureUnit);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, material.baseColorTexture.array);
+            current.baseColorTexture = material.baseColorTexture.array;
+            ++statistics.textureChanges;
+        }
+
+        if (material.metallicRoughnessTexture.array != current.metallicRoughnessTexture)
+        {
+            glActiveTexture(GL_TEXTURE0 + gMetallicRoughnessTextureUnit);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, material.metallicRoughnessTexture.array);
+            current.metallicRoughnessTexture = material.metallicRoughnessTexture.array;
+            ++statistics.textureChanges;
+        }
+
+        if (primitive.vertexArray != current.vertexArray)
+        {
+            glBindVertexArray(primitive.vertexArray);
+            current.vertexArray = primitive.vertexArray;
+            // The instance attributes are part of the vertex array state.
+            current.instances = nullptr;
+            ++statistics.vertexArrayChanges;
+        }
+
+        // The vertex arrays are shared by all meshes of a vertex format,
+        // the instance attributes must source the instance buffer of the packet mesh.
+        const GLsizei firstInstance = getFirstInstance(packet.parameters);
+        if (packet.instances != current.instances || firstInstance != current.firstInstance)
+        {
+            packet.instances->pointAttributes(firstInstance);
+            current.instances = packet.instances;
+            current.firstInstance = firstInstance;
+        }
+
+        // The material factors are read from the material buffer, only its page binding
+        // and the constant material attribute might change between primitives.
+        if (primitive.materialSlot.page != current.materialPage)
+        {
+            mMaterials.bind(primitive.materialSlot.page);
+            current.materialPage = primitive.materialSlot.page;
+        }
+        glVertexAttribI1ui(MaterialRepository::gMaterialAttributeIndex, primitive.materialSlot.index);
+
+        if (auto skinned = std::get_if<SkinnedDraw>(&packet.parameters);
+            skinned && std::make_pair(skinned->palettes.first, skinned->palettes.stride) != current.palettes)
+        {
+            setUniformInt(packet.program->program, packet.program->locations.paletteFirst, skinned->palettes.first);
+            setUniformInt(packet.program->program, packet.program->locations.paletteStride, skinned->palettes.stride);
+            current.palettes = std::make_pair(skinned->palettes.first, skinned->palettes.stride);
+        }
+        else if (auto preSkinned = std::get_if<PreSkinnedDraw>(&packet.parameters))
+        {
+            if (preSkinned->vertices->texture != current.skinnedVertices)
+            {
+                glActiveTexture(GL_TEXTURE0 + gSkinnedVerticesTextureUnit);
+                glBindTexture(GL_TEXTURE_BUFFER, preSkinned->vertices->texture);
+                current.skinnedVertices = preSkinned->vertices->texture;
+                ++statistics.textureChanges;
+            }
+            const graphics::Program & program = packet.program->program;
+            setUniformInt(program, packet.program->locations.skinnedFirst, preSkinned->first);
+            setUniformInt(program, packet.program->locations.baseVertex, primitive.baseVertex);
+            setUniformInt(program, packet.program->locations.vertexCount, primitive.vertexCount);
+        }
+        else if (std::holds_alternative<IndirectDraw>(packet.parameters)
+                 && packet.mesh->indirectCommands != current.indirectBuffer)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, packet.mesh->indirectCommands);
+            current.indirectBuffer = packet.mesh->indirectCommands;
+        }
+        else if (std::holds_alternative<BatchedDraw>(packet.parameters)
+                 && mBatchCommandBuffer != current.indirectBuffer)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mBatchCommandBuffer);
+            current.indirectBuffer = mBatchCommandBuffer;
+        }
+
+        ++statistics.drawCalls;
+        if (std::holds_alternative<BatchedDraw>(packet.parameters))
+        {
+            // The packets drawing visible meshlets emit a command per run of meshlets.
+            auto getCommandCount = [](const DrawPacket & aPacket)
+            {
+                const BatchedDraw & batched = std::get<BatchedDraw>(aPacket.parameters);
+                return batched.meshlets.empty() ? GLsizei{1} : static_cast<GLsizei>(batched.meshlets.size());
+            };
+            GLsizei commandCount = getCommandCount(packet);
+            std::size_t runEnd = packetId + 1;
+            while (runEnd != packets.size() && isSameBatch(packet, packets[runEnd]))
+            {
+                commandCount += getCommandCount(packets[runEnd]);
+                ++runEnd;
             }
 
+            ADLOG(gDrawLogger, trace)
+                 ("Multi-draw indirect rendering of {} command(s) with mode {}.",
+                  commandCount, primitive.drawMode);
+
+            setUniformInt(packet.program->program, packet.program->locations.firstDrawRecord, nextRecord);
+            glMultiDrawElementsIndirect(
+                primitive.drawMode,
+                primitive.indexType,
+                reinterpret_cast<void *>(nextCommand * sizeof(DrawElementsIndirectCommand)),
+                commandCount,
+                0);
+
+            nextCommand += commandCount;
+            nextRecord += commandCount;
+            ++statistics.multiDraws;
+            statistics.multiDrawCommands += commandCount;
+            packetId = runEnd;
+        }
+        else if (auto indirect = std::get_if<IndirectDraw>(&packet.parameters);
+                 indirect && indirect->multiDraw)
         {
-            auto skinning = std::make_shared<graphics::Program>(
-                graphics::makeLinkedProgram({
-                    {GL_VERTEX_SHADER,   gltfviewer::gSkeletalVertexShader},
-                    {GL_FRAGMENT_SHADER, aFragmentSource},
-            }));
-            if(auto paletteBlockId = glGetUniformBlockIndex(*skinning, "MatrixPalette");
-               paletteBlockId != GL_INVALID_INDEX)
+            std::size_t runEnd = packetId + 1;
+            while (runEnd != packets.size() && isSameIndirectRun(packets[runEnd - 1], packets[runEnd]))
+            {
+                ++runEnd;
+            }
+            const auto commandCount = static_cast<GLsizei>(runEnd - packetId);
+
+            ADLOG(gDrawLogger, trace)
+                 ("Multi-draw indirect rendering of {} primitive(s) with mode {}.",
+                  commandCount, primitive.drawMode);
+
+            setUniformInt(packet.program->program, packet.program->locations.firstDrawRecord, nextRecord);
+            // The array commands are stored in slots the size of the element commands, see DrawArraysIndirectCommand.
+            if (primitive.firstIndex)
             {
-                glUniformBlockBinding(*skinning, paletteBlockId, gPaletteBlockBinding);
+                glMultiDrawElementsIndirect(
+                    primitive.drawMode,
+                    primitive.indexType,
+                    reinterpret_cast<void *>(primitive.indirectCommandOffset),
+                    commandCount,
+                    sizeof(DrawElementsIndirectCommand));
             }
             else
             {
-                throw std::logic_error{"Uniform block name could not be found."};
+                glMultiDrawArraysIndirect(
+                    primitive.drawMode,
+                    reinterpret_cast<void *>(primitive.indirectCommandOffset),
+                    commandCount,
+                    sizeof(DrawElementsIndirectCommand));
             }
-            setLights(*skinning);
-            mPrograms[aShadingModel].emplace(GpuProgram::Skinning, std::move(skinning));
+
+            nextRecord += commandCount;
+            ++statistics.multiDraws;
+            statistics.multiDrawCommands += commandCount;
+            packetId = runEnd;
         }
+        else
+        {
+            std::visit([&primitive](const auto & aParameters)
+                       {
+                           drawCall(primitive, aParameters);
+                       },
+                       packet.parameters);
+            ++packetId;
+        }
+    }
+
+    // Leave the default state to the other renderers (e.g. the DebugDrawer).
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    for (GLenum unit : {gColorTextureUnit, gMetallicRoughnessTextureUnit})
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+    for (GLenum unit : {gPaletteTextureUnit, gSkinnedVerticesTextureUnit})
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    mQueue.clear();
+    return statistics;
+}
+
+
+ProgramBuild Renderer::beginProgram(const PermutationKey & aKey, const ViewerProgram & aProgram)
+{
+    const auto [programId, shadingModel, features] = aKey;
+
+    const std::string * vertexSource = nullptr;
+    switch(programId)
+    {
+    case GpuProgram::InstancedNoAnimation:
+        vertexSource = &gStaticVertexShader;
+        break;
+    case GpuProgram::Skinning:
+        vertexSource = &gSkeletalVertexShader;
+        break;
+    case GpuProgram::InstancedBatched:
+        if (!getGpuCapabilities().supportsMultiDrawIndirect())
+        {
+            throw std::logic_error{"Batched program requires multi-draw indirect support."};
+        }
+        vertexSource = &gBatchedVertexShader;
+        break;
+    case GpuProgram::PreSkinned:
+        vertexSource = &gPreSkinnedVertexShader;
+        break;
+    }
+
+    const std::string * fragmentSource = nullptr;
+    switch(shadingModel)
+    {
+    case ShadingModel::Phong:
+        fragmentSource = &gPhongFragmentShader;
+        break;
+    case ShadingModel::PbrReference:
+        fragmentSource = &gPbrFragmentShader;
+        break;
+    case ShadingModel::PbrLearn:
+        fragmentSource = &gPbrLearnFragmentShader;
+        break;
+    default:
+        throw std::logic_error{"Invalid shading model."};
+    }
+
+    const std::string vertexPermutation = definePermutation(*vertexSource, features);
+    const std::string fragmentPermutation = definePermutation(*fragmentSource, features);
+    return mProgramCache.begin(aProgram.program, {
+        {GL_VERTEX_SHADER,   vertexPermutation.c_str()},
+        {GL_FRAGMENT_SHADER, fragmentPermutation.c_str()},
+    });
+}
+
+
+void Renderer::initializeProgram(const PermutationKey & aKey, ViewerProgram & aProgram) const
+{
+    aProgram.resolveLocations();
+    const graphics::Program & program = aProgram.program;
+    const UniformLocations & locations = aProgram.locations;
+
+    setUniform(program, "u_light.position_world", math::Vec<4, GLfloat>{-100.f, 100.f, 1000.f, 1.f}); 
+    setUniform(program, "u_light.color", math::hdr::gWhite<GLfloat>);
+    setUniformInt(program, "u_light.specularExponent", 100);
+    // Ideally, I suspect the sum should be 1
+    setUniformFloat(program, "u_light.diffuse", 0.3f);
+    setUniformFloat(program, "u_light.specular", 0.35f);
+    setUniformFloat(program, "u_light.ambient", 0.45f);
+
+    // The texture units never change, they are assigned once.
+    setUniformInt(program, locations.baseColorTex, gColorTextureUnit);
+    setUniformInt(program, locations.metallicRoughnessTex, gMetallicRoughnessTextureUnit);
+    setUniformInt(program, locations.jointMatrices, gPaletteTextureUnit);
+    setUniformInt(program, locations.skinnedVertices, gSkinnedVerticesTextureUnit);
+
+    setUniform(program, locations.camera, mCameraTransformation); 
+    setUniform(program, locations.projection, mProjectionTransformation); 
+
+    if(locations.materialBlock == GL_INVALID_INDEX)
+    {
+        throw std::logic_error{"Material block could not be found."};
+    }
+    glUniformBlockBinding(program, locations.materialBlock, MaterialRepository::gMaterialBlockBinding);
+
+    if (std::get<GpuProgram>(aKey) == GpuProgram::InstancedBatched)
+    {
+        GLuint drawRecords = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, "DrawRecords");
+        if (drawRecords == GL_INVALID_INDEX)
+        {
+            throw std::logic_error{"Draw records block could not be found."};
+        }
+        glShaderStorageBlockBinding(program, drawRecords, gDrawRecordBinding);
+    }
+}
+
+
+Renderer::Permutation & Renderer::getPermutation(GpuProgram aProgram,
+                                                 ShadingModel aShading,
+                                                 ShaderFeatures aFeatures)
+{
+    const PermutationKey key{aProgram, aShading, aFeatures};
+    if (auto found = mPermutations.find(key);
+        found != mPermutations.end())
+    {
+        return found->second;
+    }
+
+    ADLOG(gDrawLogger, debug)
+         ("Building permutation #{} of program {} for shading {} with features {:#x}.",
+          mPermutations.size(), static_cast<int>(aProgram), to_string(aShading), aFeatures);
+
+    auto program = std::make_unique<ViewerProgram>();
+    ProgramBuild build = beginProgram(key, *program);
+    Permutation permutation{
+        .program = std::move(program),
+        .queueId = static_cast<GLuint>(mPermutations.size()),
+        .pendingBuild = std::move(build),
     };
+    mPendingPermutations.push_back(key);
+    return mPermutations.emplace(key, std::move(permutation)).first->second;
+}
+
 
-    insertPrograms(ShadingModel::PbrReference, gltfviewer::gPbrFragmentShader.c_str());
-    insertPrograms(ShadingModel::PbrLearn, gltfviewer::gPbrLearnFragmentShader.c_str());
-    insertPrograms(ShadingModel::Phong, gltfviewer::gPhongFragmentShader);
+void Renderer::updatePermutations()
+{
+    if (mPendingPermutations.empty())
+    {
+        return;
+    }
+
+    const ProgramCacheStatistics before = mProgramCache.getStatistics();
+    const auto start = ProgramBuild::Clock::now();
+    std::size_t completed = 0;
+    // The permutations neither awaited nor ready are kept pending, in order.
+    auto stillPending = std::remove_if(
+        mPendingPermutations.begin(), mPendingPermutations.end(),
+        [&](const PermutationKey & aKey)
+        {
+            Permutation & permutation = mPermutations.at(aKey);
+            if (!permutation.awaited
+                && !mProgramCache.isReady(permutation.program->program, *permutation.pendingBuild))
+            {
+                return false;
+            }
+            mProgramCache.complete(permutation.program->program, std::move(*permutation.pendingBuild));
+            permutation.pendingBuild.reset();
+            permutation.awaited = false;
+            initializeProgram(aKey, *permutation.program);
+            ++completed;
+            return true;
+        });
+    mPendingPermutations.erase(stillPending, mPendingPermutations.end());
+
+    if (completed != 0)
+    {
+        const ProgramCacheStatistics & after = mProgramCache.getStatistics();
+        ADLOG(gDrawLogger, info)
+             ("Built {} program permutation(s) in {:.1f} ms, {} from the binary cache saving ~{:.1f} ms, {} pending.",
+              completed,
+              std::chrono::duration<double, std::milli>{ProgramBuild::Clock::now() - start}.count(),
+              after.cachedPrograms - before.cachedPrograms,
+              std::chrono::duration<double, std::milli>{after.savedTime - before.savedTime}.count(),
+              mPendingPermutations.size());
+    }
 }
 
 
 void Renderer::setCameraTransformation(const math::AffineMatrix<4, GLfloat> & aTransformation)
 {
-    for (auto & [_key, program] : activePrograms())
+    mCameraTransformation = aTransformation;
+    for (auto & [_key, permutation] : mPermutations)
     {
-        setUniform(*program, "u_camera", aTransformation); 
+        // A pending permutation gets the current transformation when it is initialized.
+        if (permutation.pendingBuild)
+        {
+            continue;
+        }
+        setUniform(permutation.program->program, permutation.program->locations.camera, aTransformation); 
     }
 }
 
 
 void Renderer::setProjectionTransformation(const math::Matrix<4, 4, GLfloat> & aTransformation)
 {
-    for (auto & [_key, program] : activePrograms())
+    mProjectionTransformation = aTransformation;
+    for (auto & [_key, permutation] : mPermutations)
     {
-        setUniform(*program, "u_projection", aTransformation); 
+        if (permutation.pendingBuild)
+        {
+            continue;
+        }
+        setUniform(permutation.program->program, permutation.program->locations.projection, aTransformation); 
     }
 }
 
@@ -335,6 +1075,8 @@ void Renderer::showRendererOptions()
         togglePolygonMode();
     }
 
+    ImGui::Checkbox("Show levels of detail", &mShowLevelsOfDetail);
+
     if (ImGui::BeginCombo("Shading", to_string(mShadingModel).c_str()))
     {
         for (int shadingId = 0; shadingId < static_cast<int>(ShadingModel::_End); ++shadingId)
@@ -354,6 +1096,10 @@ void Renderer::showRendererOptions()
         }
         ImGui::EndCombo();
     }
+    if (!mPendingPermutations.empty())
+    {
+        ImGui::Text("Building %zu program(s), drawn with Phong shading meanwhile.", mPendingPermutations.size());
+    }
 
     if (mShadingModel == ShadingModel::PbrLearn)
     {
@@ -1,13 +1,26 @@
 #pragma once
 
 
+#include "GeometryArena.h"
+#include "Materials.h"
 #include "Mesh.h"
+#include "ProgramCache.h"
+#include "RenderQueue.h"
+#include "ShaderFeatures.h"
 #include "SkeletalAnimation.h"
+#include "ViewerProgram.h"
 
 #include <arte/gltf/Gltf.h>
 
 #include <renderer/Shading.h>
 
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <tuple>
+#include <vector>
+
 
 namespace ad {
 namespace gltfviewer {
@@ -21,6 +34,10 @@ enum class GpuProgram
 {
     InstancedNoAnimation,
     Skinning,
+    // Static instances drawn by multi-draw indirect calls, only if supported by the context.
+    InstancedBatched,
+    // Skinned instances drawn from the vertices skinned by PreSkinning.
+    PreSkinned,
 };
 
 
@@ -72,11 +89,33 @@ enum class DebugColor
 std::string to_string(DebugColor aColor);
 
 
+/// \brief Draws the meshes with program permutations, compiled on first use.
+///
+/// A permutation is specialized by its vertex program, shading model, and the features
+/// of the drawn primitive (see ShaderFeatures), so the shaders do not branch on them.
+///
+/// The permutations requested while queueing are only built at flush(), so the driver
+/// can compile them in parallel, and they are loaded from the ProgramCache when possible.
+/// When the driver compiles asynchronously, a permutation still building is replaced by its
+/// Phong counterpart, so changing the shading model never stalls the frame.
 class Renderer
 {
-    using ShadingPrograms = std::map<GpuProgram, std::shared_ptr<graphics::Program>>;
+    // Vertex program, shading model (i.e. fragment program) and features.
+    using PermutationKey = std::tuple<GpuProgram, ShadingModel, ShaderFeatures>;
+
+    struct Permutation
+    {
+        std::unique_ptr<ViewerProgram> program;
+        // Small identifier ordering the packets in the RenderQueue, assigned in creation order.
+        GLuint queueId;
+        // Until the build is completed by updatePermutations().
+        std::optional<ProgramBuild> pendingBuild;
+        // Drawn by queued packets while pending, so the flush must wait for its build.
+        bool awaited{false};
+    };
 
 public:
+    /// \attention Requires a current OpenGL context.
     Renderer();
 
     void setCameraTransformation(const math::AffineMatrix<4, GLfloat> & aTransformation);
@@ -84,16 +123,60 @@ public:
 
     void togglePolygonMode();
 
-    void bind(const Skeleton & aSkeleton) const;
-
-    void render(const Mesh & aMesh) const;
-    void render(const Mesh & aMesh, const Skeleton & aSkeleton) const;
+    /// \brief The materials of the prepared meshes, to be uploaded once they are all inserted.
+    MaterialRepository & getMaterials()
+    { return mMaterials; }
+
+    /// \brief The geometry of the prepared meshes, to be uploaded once they are all inserted.
+    GeometryArena & getGeometry()
+    { return mGeometry; }
+
+    /// \brief The palettes of the skinned instances, to be uploaded each frame before flush().
+    PaletteBuffer & getPalettes()
+    { return mPalettes; }
+
+    /// \brief The buffer receiving the per-frame data in place, null if the context does not support it.
+    StreamBuffer * getStream()
+    { return mStream ? &*mStream : nullptr; }
+
+    /// \brief Queue the static instances of the mesh, by level of detail.
+    /// \param aViewDepth Orders the blended primitives of the mesh, farthest first.
+    /// \param aNonUniformScale Whether any of the instances has a non-uniform scale.
+    void submit(const Mesh & aMesh, GLfloat aViewDepth, bool aNonUniformScale);
+    /// \brief Queue the skinned instances of the mesh, each deformed by its palette.
+    /// \param aNonUniformScale Whether any of the joint matrices has a non-uniform scale.
+    void submit(const Mesh & aMesh, const PaletteRange & aPalettes, GLfloat aViewDepth, bool aNonUniformScale);
+    /// \brief Queue the skinned instances of the mesh, from their vertices already skinned.
+    void submit(const Mesh & aMesh, const SkinnedVertices & aVertices, GLfloat aViewDepth);
+    /// \brief Queue the static instances of the mesh, from a list shared by all batched meshes.
+    ///
+    /// The indexed primitives are drawn by multi-draw indirect calls, see BatchedDraw.
+    /// \param aLevelRanges The range of instances in `aInstances` for each level of detail.
+    /// \param aVisibleMeshlets The runs of visible meshlets of each primitive at full resolution,
+    /// empty if the meshlets were not culled (see MeshletCuller).
+    /// \pre The context supports multi-draw indirect, see GpuCapabilities::supportsMultiDrawIndirect().
+    void submitBatched(const Mesh & aMesh,
+                       const InstanceList & aInstances,
+                       std::span<const InstanceList::Range> aLevelRanges,
+                       std::span<const std::vector<GeometryArena::IndexRange>> aVisibleMeshlets,
+                       GLfloat aViewDepth,
+                       bool aNonUniformScale);
+    /// \brief Queue the instances selected by GpuCulling, drawn without reading back their count.
+    ///
+    /// When the context supports multi-draw indirect, consecutive primitives sharing their state
+    /// are drawn by a single call, see IndirectDraw.
+    void submitIndirect(const Mesh & aMesh, GLfloat aViewDepth, bool aNonUniformScale);
+
+    /// \brief Draw all queued packets sorted by state, see RenderQueue, then clear the queue.
+    RenderStatistics flush();
 
     void showRendererOptions();
 
     static constexpr GLsizei gColorTextureUnit{0};
     static constexpr GLsizei gMetallicRoughnessTextureUnit{1};
-    static constexpr GLuint gPaletteBlockBinding{3};
+    static constexpr GLsizei gPaletteTextureUnit{2};
+    static constexpr GLsizei gSkinnedVerticesTextureUnit{3};
+    static constexpr GLuint gDrawRecordBinding{4};
 
 private:
     enum class PolygonMode
@@ -102,15 +185,48 @@ private:
         Line,
     };
 
-    void initializePrograms();
-    template <class ... VT_extraParams>
-    void renderImpl(const Mesh & aMesh, graphics::Program & aProgram, VT_extraParams ... aExtraParams) const;
-    const ShadingPrograms & activePrograms() const;
-
-    std::map<ShadingModel, ShadingPrograms> mPrograms;
+    /// \brief Return the permutation, beginning its build if needed.
+    Permutation & getPermutation(GpuProgram aProgram, ShadingModel aShading, ShaderFeatures aFeatures);
+    ProgramBuild beginProgram(const PermutationKey & aKey, const ViewerProgram & aProgram);
+    /// \brief Set the uniforms and block bindings of a linked program, which never change afterward.
+    void initializeProgram(const PermutationKey & aKey, ViewerProgram & aProgram) const;
+    /// \brief Complete the pending permutations which are ready or awaited, to be called before drawing.
+    void updatePermutations();
+
+    void submitImpl(const Mesh & aMesh,
+                    GpuProgram aProgram,
+                    ShaderFeatures aInstanceFeatures,
+                    GLfloat aViewDepth,
+                    const DrawParameters & aParameters);
+    /// \brief Queue the packet in the opaque or transparent group, depending on its material.
+    /// \param aInstanceFeatures Features of the instances, completing those of the primitive.
+    void queue(GpuProgram aProgram, ShaderFeatures aInstanceFeatures, GLfloat aViewDepth, DrawPacket aPacket);
+    /// \brief Send the commands of the batched packets, and the draw records of all multi-draw packets, in emission order.
+    void uploadBatches(std::span<const DrawPacket> aPackets);
+
+    GeometryArena mGeometry;
+    MaterialRepository mMaterials;
+    PaletteBuffer mPalettes;
+    // Only constructed if the context supports persistent mapping.
+    std::optional<StreamBuffer> mStream;
+    RenderQueue mQueue;
+    std::vector<DrawElementsIndirectCommand> mBatchCommands;
+    // The material index of each multi-draw command, batched or indirect, read by the batched vertex shader.
+    std::vector<GLuint> mDrawRecords;
+    graphics::VertexBufferObject mBatchCommandBuffer;
+    graphics::VertexBufferObject mDrawRecordBuffer;
+    std::map<PermutationKey, Permutation> mPermutations;
+    std::vector<PermutationKey> mPendingPermutations;
+    // Packets queued with the fallback shading since the last flush.
+    std::size_t mFallbackPackets{0};
+    ProgramCache mProgramCache;
+    // Kept to initialize the permutations compiled later.
+    math::AffineMatrix<4, GLfloat> mCameraTransformation = math::AffineMatrix<4, GLfloat>::Identity();
+    math::Matrix<4, 4, GLfloat> mProjectionTransformation = math::Matrix<4, 4, GLfloat>::Identity();
     ShadingModel mShadingModel{ShadingModel::PbrReference};
     PolygonMode mPolygonMode{PolygonMode::Fill};
     DebugColor mColorOutput{DebugColor::Default};
+    bool mShowLevelsOfDetail{false};
 };
 
 } // namespace gltfviewer
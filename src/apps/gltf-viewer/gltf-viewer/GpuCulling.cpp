@@ -0,0 +1,156 @@
+#include "GpuCulling.h"
+
+#include "Logging.h"
+#include "ShadersCulling.h"
+#include "ViewerProgram.h"
+
+#include <renderer/Uniforms.h>
+
+#include <cstddef>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+GpuCulling::GpuCulling() :
+    mProgram{graphics::makeLinkedProgram({
+        {GL_COMPUTE_SHADER, gInstanceCullingComputeShader},
+    })},
+    mLocations{
+        .viewProjection = glGetUniformLocation(mProgram, "u_viewProjection"),
+        .boxCenter = glGetUniformLocation(mProgram, "u_boxCenter"),
+        .boxHalfExtent = glGetUniformLocation(mProgram, "u_boxHalfExtent"),
+        .candidateCount = glGetUniformLocation(mProgram, "u_candidateCount"),
+        .primitiveCount = glGetUniformLocation(mProgram, "u_primitiveCount"),
+        .frustumCulling = glGetUniformLocation(mProgram, "u_frustumCulling"),
+        .occlusionCulling = glGetUniformLocation(mProgram, "u_occlusionCulling"),
+    }
+{
+    Statistics zero;
+    for (const graphics::VertexBufferObject & buffer : mStatisticsBuffers)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Statistics), &zero, GL_DYNAMIC_READ);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    setUniformInt(mProgram, "u_hiZ", gHierarchicalDepthTextureUnit);
+}
+
+
+GpuCulling::~GpuCulling()
+{
+    for (GLsync fence : mStatisticsFences)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+        }
+    }
+}
+
+
+void GpuCulling::beginFrame()
+{
+    // Reading the counters of the previous frame would wait for its dispatches to complete,
+    // instead the frames rotate over several buffers, each read back once its fence is signaled.
+    mStatisticsFrame = (mStatisticsFrame + 1) % gStatisticsLatency;
+    GLsync & fence = mStatisticsFences[mStatisticsFrame];
+
+    Statistics zero;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, getStatisticsBuffer());
+    if (fence)
+    {
+        const GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        {
+            glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Statistics), &mPreviousStatistics);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Statistics), &zero);
+        }
+        else
+        {
+            // The GPU is still using the buffer: its counters are dropped, and the store orphaned.
+            ADLOG(gDrawLogger, debug)("GPU culling statistics not available yet, they are skipped.");
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Statistics), &zero, GL_DYNAMIC_READ);
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    mOcclusionReady = false;
+}
+
+
+void GpuCulling::cull(const Mesh & aMesh, const math::Matrix<4, 4, GLfloat> & aViewProjection, bool aFrustumCulling)
+{
+    const InstanceList & instances = aMesh.gpuInstances;
+
+    // The instance count of each command is accumulated by the compute shader.
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, aMesh.indirectCommands);
+    const GLuint zero = 0;
+    for (const MeshPrimitive & primitive : aMesh.primitives)
+    {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                        primitive.indirectCommandOffset + offsetof(DrawElementsIndirectCommand, instanceCount),
+                        sizeof(GLuint),
+                        &zero);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    if (instances.candidatesSize() == 0)
+    {
+        return;
+    }
+
+    graphics::bind_guard boundProgram{mProgram};
+
+    setUniform(mProgram, mLocations.viewProjection, aViewProjection);
+    // The candidates transform the stored positions, which may be quantized.
+    const math::Box<GLfloat> & box = aMesh.storedBoundingBox;
+    setUniform(mProgram, mLocations.boxCenter, box.center().as<math::Vec>());
+    setUniform(mProgram, mLocations.boxHalfExtent, math::Vec<3, GLfloat>{
+        box.width() / 2.f,
+        box.height() / 2.f,
+        box.depth() / 2.f,
+    });
+    setUniformInt(mProgram, mLocations.candidateCount, instances.candidatesSize());
+    setUniformInt(mProgram, mLocations.primitiveCount, static_cast<GLint>(aMesh.primitives.size()));
+    setUniformInt(mProgram, mLocations.frustumCulling, aFrustumCulling);
+    setUniformInt(mProgram, mLocations.occlusionCulling, mOcclusionReady);
+    if (mOcclusionReady)
+    {
+        glActiveTexture(GL_TEXTURE0 + gHierarchicalDepthTextureUnit);
+        glBindTexture(GL_TEXTURE_2D, mHierarchicalDepth.getPyramid());
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gCandidateBinding, instances.mCandidates);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gVisibleBinding, instances.mVbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gCommandBinding, aMesh.indirectCommands);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, gStatisticsBinding, getStatisticsBuffer());
+
+    glDispatchCompute((instances.candidatesSize() + gWorkgroupSize - 1) / gWorkgroupSize, 1, 1);
+
+    if (mOcclusionReady)
+    {
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    ADLOG(gDrawLogger, trace)
+         ("Dispatched GPU culling of {} candidate(s).", instances.candidatesSize());
+}
+
+
+void GpuCulling::endFrame()
+{
+    // The compacted instances are sourced as vertex attributes, the commands as indirect parameters,
+    // and the counters are read back once the fence is signaled.
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    mStatisticsFences[mStatisticsFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mHasPreviousFrame = true;
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,139 @@
+#pragma once
+
+
+#include "HierarchicalDepth.h"
+#include "Mesh.h"
+
+#include <math/Homogeneous.h>
+
+#include <renderer/Shading.h>
+#include <renderer/VertexSpecification.h>
+
+#include <array>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Culling of mesh instances by a compute shader.
+///
+/// For each mesh, the candidate instances are tested on the GPU. The visible ones are compacted
+/// into the mesh instance buffer, and the instance count of each primitive indirect command is set
+/// accordingly, so the draws do not require any read back.
+///
+/// Optionally, the candidates are also tested for occlusion against a HierarchicalDepth
+/// built from the instances that were visible during the previous frame.
+/// \note Requires OpenGL 4.3 (see GpuCapabilities::supportsGpuCulling()).
+class GpuCulling
+{
+public:
+    /// \brief Counters accumulated by the compute shader over a frame.
+    struct Statistics
+    {
+        GLuint visibleInstances{0};
+        GLuint frustumCulledInstances{0};
+        GLuint occlusionCulledInstances{0};
+    };
+
+    GpuCulling();
+    ~GpuCulling();
+
+    GpuCulling(const GpuCulling &) = delete;
+    GpuCulling & operator=(const GpuCulling &) = delete;
+
+    /// \brief Fetch the statistics of the oldest frame completed by the GPU, and reset its counters.
+    void beginFrame();
+
+    /// \brief Render the previous frame visible instances as occluders, see HierarchicalDepth.
+    ///
+    /// Must be called after beginFrame() and before any cull(), the following culls of the frame
+    /// then also test for occlusion.
+    template <class T_meshRange>
+    void prepareOcclusion(const T_meshRange & aMeshes,
+                          Size2<int> aFramebufferSize,
+                          const math::Matrix<4, 4, GLfloat> & aViewProjection);
+
+    /// \brief Signal a frame culled on the CPU, so the instance buffers do not hold GPU results anymore.
+    void invalidatePreviousFrame()
+    { mHasPreviousFrame = false; }
+
+    /// \brief Dispatch the culling of the candidates of `aMesh`.
+    /// \param aFrustumCulling If false, only the occlusion is tested (when prepared),
+    /// so the frustum culling option has the same effect as on the CPU path.
+    void cull(const Mesh & aMesh, const math::Matrix<4, 4, GLfloat> & aViewProjection, bool aFrustumCulling);
+
+    /// \brief Make the results of all dispatches visible to the following draw calls.
+    void endFrame();
+
+    /// \brief The statistics of the frame culled gStatisticsLatency frames before the current one.
+    ///
+    /// They might be older if the GPU lags further behind, the counters are never waited for.
+    const Statistics & getPreviousFrameStatistics() const
+    { return mPreviousStatistics; }
+
+    /// \brief Count of frames the statistics buffers rotate over.
+    static constexpr std::size_t gStatisticsLatency = 3;
+
+    static constexpr GLuint gCandidateBinding{0};
+    static constexpr GLuint gVisibleBinding{1};
+    static constexpr GLuint gCommandBinding{2};
+    static constexpr GLuint gStatisticsBinding{3};
+    static constexpr GLuint gWorkgroupSize{64};
+    static constexpr GLint gHierarchicalDepthTextureUnit{0};
+
+private:
+    // Resolved once, the uniforms are set for each culled mesh.
+    struct Locations
+    {
+        GLint viewProjection;
+        GLint boxCenter;
+        GLint boxHalfExtent;
+        GLint candidateCount;
+        GLint primitiveCount;
+        GLint frustumCulling;
+        GLint occlusionCulling;
+    };
+
+    GLuint getStatisticsBuffer() const
+    { return mStatisticsBuffers[mStatisticsFrame]; }
+
+    graphics::Program mProgram;
+    Locations mLocations;
+    // The counters of the last frames, each read back once the fence of its frame is signaled.
+    std::array<graphics::VertexBufferObject, gStatisticsLatency> mStatisticsBuffers;
+    std::array<GLsync, gStatisticsLatency> mStatisticsFences{};
+    std::size_t mStatisticsFrame{0};
+    Statistics mPreviousStatistics;
+    HierarchicalDepth mHierarchicalDepth;
+    bool mHasPreviousFrame{false};
+    bool mOcclusionReady{false};
+};
+
+
+//
+// Implementations
+//
+template <class T_meshRange>
+void GpuCulling::prepareOcclusion(const T_meshRange & aMeshes,
+                                  Size2<int> aFramebufferSize,
+                                  const math::Matrix<4, 4, GLfloat> & aViewProjection)
+{
+    // Without the results of a previous frame, there are no known occluders.
+    if (!mHasPreviousFrame)
+    {
+        return;
+    }
+
+    mHierarchicalDepth.beginOccluders(aFramebufferSize, aViewProjection);
+    for (const Mesh & mesh : aMeshes)
+    {
+        mHierarchicalDepth.renderOccluders(mesh);
+    }
+    mHierarchicalDepth.endOccluders();
+    mOcclusionReady = true;
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
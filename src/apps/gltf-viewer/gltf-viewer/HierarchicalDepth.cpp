@@ -0,0 +1,179 @@
+#include "HierarchicalDepth.h"
+
+#include "Logging.h"
+#include "ShadersCulling.h"
+
+#include <renderer/Uniforms.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    constexpr GLuint gReductionGroupSize = 8;
+    constexpr GLint gDestinationImageUnit = 0;
+    constexpr GLint gSourceTextureUnit = 0;
+
+} // anonymous namespace
+
+
+HierarchicalDepth::HierarchicalDepth() :
+    mDepthProgram{graphics::makeLinkedProgram({
+        {GL_VERTEX_SHADER,   gDepthOnlyVertexShader},
+        {GL_FRAGMENT_SHADER, gDepthOnlyFragmentShader},
+    })},
+    mReductionProgram{graphics::makeLinkedProgram({
+        {GL_COMPUTE_SHADER, gDepthReductionComputeShader},
+    })}
+{
+    glGenFramebuffers(1, &mFramebuffer);
+
+    setUniformInt(mReductionProgram, "u_source", gSourceTextureUnit);
+    setUniformInt(mReductionProgram, "u_destination", gDestinationImageUnit);
+}
+
+
+HierarchicalDepth::~HierarchicalDepth()
+{
+    glDeleteFramebuffers(1, &mFramebuffer);
+}
+
+
+void HierarchicalDepth::resize(Size2<int> aSize)
+{
+    mSize = aSize;
+    mLevels = static_cast<GLint>(std::floor(std::log2(std::max(aSize.width(), aSize.height())))) + 1;
+
+    glBindTexture(GL_TEXTURE_2D, mDepth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, aSize.width(), aSize.height(), 0,
+                 GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, mPyramid);
+    for (GLint level = 0; level != mLevels; ++level)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_R32F,
+                     std::max(1, aSize.width() >> level), std::max(1, aSize.height() >> level), 0,
+                     GL_RED, GL_FLOAT, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mLevels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepth, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        throw std::logic_error{"Hierarchical depth framebuffer is incomplete."};
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    ADLOG(gDrawLogger, debug)
+         ("Resized hierarchical depth to {}x{}, {} levels.", aSize.width(), aSize.height(), mLevels);
+}
+
+
+void HierarchicalDepth::beginOccluders(Size2<int> aFramebufferSize,
+                                       const math::Matrix<4, 4, GLfloat> & aViewProjection)
+{
+    if (aFramebufferSize.width() != mSize.width() || aFramebufferSize.height() != mSize.height())
+    {
+        resize(aFramebufferSize);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glViewport(0, 0, mSize.width(), mSize.height());
+    glEnable(GL_DEPTH_TEST);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    // Back faces are kept, they can only add occlusion from actual geometry.
+    glDisable(GL_CULL_FACE);
+
+    glUseProgram(mDepthProgram);
+    setUniform(mDepthProgram, "u_viewProjection", aViewProjection);
+}
+
+
+void HierarchicalDepth::renderOccluders(const Mesh & aMesh)
+{
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, aMesh.indirectCommands);
+    // The commands of consecutive primitives are consecutive, each run sharing a vertex array
+    // and an index type is drawn by a single multi-draw call.
+    const std::vector<MeshPrimitive> & primitives = aMesh.primitives;
+    for (std::size_t first = 0; first != primitives.size();)
+    {
+        const MeshPrimitive & primitive = primitives[first];
+        std::size_t end = first + 1;
+        while (end != primitives.size()
+               && primitives[end].vertexArray == primitive.vertexArray
+               && primitives[end].drawMode == primitive.drawMode
+               && primitives[end].firstIndex.has_value() == primitive.firstIndex.has_value()
+               && primitives[end].indexType == primitive.indexType)
+        {
+            ++end;
+        }
+        const auto drawCount = static_cast<GLsizei>(end - first);
+
+        graphics::bind_guard boundVao{primitive.vertexArray};
+        aMesh.gpuInstances.pointAttributes(0);
+        if (primitive.firstIndex)
+        {
+            glMultiDrawElementsIndirect(primitive.drawMode,
+                                        primitive.indexType,
+                                        reinterpret_cast<void *>(primitive.indirectCommandOffset),
+                                        drawCount,
+                                        sizeof(DrawElementsIndirectCommand));
+        }
+        else
+        {
+            // The array commands are stored in slots the size of the element commands, see DrawArraysIndirectCommand.
+            glMultiDrawArraysIndirect(primitive.drawMode,
+                                      reinterpret_cast<void *>(primitive.indirectCommandOffset),
+                                      drawCount,
+                                      sizeof(DrawElementsIndirectCommand));
+        }
+        first = end;
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+
+void HierarchicalDepth::endOccluders()
+{
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, mSize.width(), mSize.height());
+
+    graphics::bind_guard boundProgram{mReductionProgram};
+    glActiveTexture(GL_TEXTURE0 + gSourceTextureUnit);
+
+    // Level 0 is a copy of the depth buffer, each following level reduces the previous one.
+    for (GLint level = 0; level != mLevels; ++level)
+    {
+        glBindTexture(GL_TEXTURE_2D, level == 0 ? mDepth : mPyramid);
+        setUniformInt(mReductionProgram, "u_sourceLevel", level == 0 ? 0 : level - 1);
+        glBindImageTexture(gDestinationImageUnit, mPyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        GLuint width = std::max(1, mSize.width() >> level);
+        GLuint height = std::max(1, mSize.height() >> level);
+        glDispatchCompute((width + gReductionGroupSize - 1) / gReductionGroupSize,
+                          (height + gReductionGroupSize - 1) / gReductionGroupSize,
+                          1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,61 @@
+#pragma once
+
+
+#include "Mesh.h"
+
+#include <graphics/AppInterface.h>
+
+#include <math/Homogeneous.h>
+
+#include <renderer/Shading.h>
+#include <renderer/Texture.h>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Max-depth mip pyramid of the occluders (Hi-Z), used for occlusion culling.
+///
+/// The occluders are the instances found visible by GpuCulling during the previous frame,
+/// rendered depth-only with the current camera. Each texel of level `n` holds the farthest depth
+/// of the texels it covers in level `n - 1`, so a box nearer than the texels covering its screen
+/// rectangle is guaranteed to be hidden.
+/// \note Instances that moved since the previous frame are rendered at their previous position.
+/// \note Requires OpenGL 4.3.
+class HierarchicalDepth
+{
+public:
+    HierarchicalDepth();
+    ~HierarchicalDepth();
+
+    HierarchicalDepth(const HierarchicalDepth &) = delete;
+    HierarchicalDepth & operator=(const HierarchicalDepth &) = delete;
+
+    /// \brief Bind the depth framebuffer, resized to `aFramebufferSize`, and clear it.
+    void beginOccluders(Size2<int> aFramebufferSize, const math::Matrix<4, 4, GLfloat> & aViewProjection);
+
+    /// \brief Render the instances currently in the mesh instance buffer, with the counts of its indirect commands.
+    void renderOccluders(const Mesh & aMesh);
+
+    /// \brief Restore the default framebuffer, then reduce the occluders depth to the pyramid.
+    void endOccluders();
+
+    const graphics::Texture & getPyramid() const
+    { return mPyramid; }
+
+private:
+    void resize(Size2<int> aSize);
+
+    Size2<int> mSize{0, 0};
+    GLint mLevels{0};
+    GLuint mFramebuffer{0};
+    graphics::Texture mDepth{GL_TEXTURE_2D};
+    graphics::Texture mPyramid{GL_TEXTURE_2D};
+    graphics::Program mDepthProgram;
+    graphics::Program mReductionProgram;
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
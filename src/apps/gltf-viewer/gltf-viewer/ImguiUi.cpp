@@ -1,5 +1,8 @@
 #include "ImguiUi.h"
 
+#include "Capabilities.h"
+
+#include "Statistics.h"
 #include "UserOptions.h"
 
 #include <GLFW/glfw3.h>
@@ -84,10 +87,83 @@ void showUserOptionsWindow(UserOptions & aOptions)
 {
     ImGui::Begin("Rendering options");
     ImGui::Checkbox("Show skeletons", &aOptions.showSkeletons);
+    ImGui::Checkbox("Frustum culling", &aOptions.frustumCulling);
+    if (getGpuCapabilities().supportsGpuCulling())
+    {
+        ImGui::Checkbox("GPU culling", &aOptions.gpuCulling);
+        if (aOptions.gpuCulling)
+        {
+            ImGui::Checkbox("Occlusion culling (Hi-Z)", &aOptions.occlusionCulling);
+        }
+    }
+    if (getGpuCapabilities().supportsMultiDrawIndirect())
+    {
+        ImGui::Checkbox("Multi-draw indirect", &aOptions.multiDrawIndirect);
+        if (aOptions.multiDrawIndirect)
+        {
+            ImGui::Checkbox("Meshlet culling", &aOptions.meshletCulling);
+        }
+    }
+    ImGui::Checkbox("Pre-skinning", &aOptions.preSkinning);
+    if (getGpuCapabilities().supportsPersistentMapping())
+    {
+        ImGui::Checkbox("Persistent-mapped uploads", &aOptions.persistentMapping);
+    }
+    ImGui::Checkbox("Levels of detail", &aOptions.levelOfDetail);
+    if (aOptions.levelOfDetail)
+    {
+        ImGui::SliderFloat("Full detail coverage", &aOptions.levelOfDetailCoverage, 0.01f, 1.f);
+    }
     ImGui::Checkbox("Show Imgui demo window", &aOptions.showImguiDemo);
     ImGui::End();
 }
 
 
+void showStatisticsWindow(const FrameStatistics & aStatistics)
+{
+    ImGui::Begin("Statistics");
+    ImGui::Text("Static instances: %zu visible, %zu culled.",
+                aStatistics.culling.visibleInstances,
+                aStatistics.culling.culledInstances);
+    ImGui::Text("Static instances occluded: %zu.", aStatistics.culling.occludedInstances);
+    ImGui::Text("Hierarchy nodes tested: %zu.", aStatistics.culling.testedNodes);
+    ImGui::Text("Skinned instances: %zu.", aStatistics.skinnedInstances);
+    ImGui::Text("Pre-skinned meshes: %zu skinned, %zu cached.",
+                aStatistics.preSkinnedMeshes,
+                aStatistics.cachedSkinnedMeshes);
+    ImGui::Text("Streamed uploads: %.1f KiB, %zu stall(s) so far.",
+                aStatistics.streamedBytes / 1024.,
+                aStatistics.streamStalls);
+    for (std::size_t level = 0; level != aStatistics.levelOfDetailInstances.size(); ++level)
+    {
+        ImGui::Text("Instances at level of detail %zu: %zu.", level, aStatistics.levelOfDetailInstances[level]);
+    }
+    ImGui::Text("Meshlets: %zu visible, %zu outside the frustum, %zu back-facing.",
+                aStatistics.meshlets.visibleMeshlets,
+                aStatistics.meshlets.frustumCulledMeshlets,
+                aStatistics.meshlets.backFacingMeshlets);
+    const RenderStatistics & rendering = aStatistics.rendering;
+    ImGui::Text("Draw packets: %zu.", rendering.packets);
+    ImGui::Text("Program permutations: %zu built, %zu from the binary cache (~%.1f ms saved).",
+                rendering.programPermutations,
+                rendering.cachedPermutations,
+                rendering.permutationTimeSavedMs);
+    ImGui::Text("Program permutations pending: %zu (%zu packets with fallback shading).",
+                rendering.pendingPermutations,
+                rendering.fallbackPackets);
+    ImGui::Text("Draw calls: %zu (%zu multi-draw(s) of %zu commands).",
+                rendering.drawCalls,
+                rendering.multiDraws,
+                rendering.multiDrawCommands);
+    ImGui::Text("State changes: %zu program, %zu blend, %zu cull face, %zu texture, %zu vertex array.",
+                rendering.programChanges,
+                rendering.blendChanges,
+                rendering.cullFaceChanges,
+                rendering.textureChanges,
+                rendering.vertexArrayChanges);
+    ImGui::End();
+}
+
+
 } // namespace gltfviewer
 } // namespace ad
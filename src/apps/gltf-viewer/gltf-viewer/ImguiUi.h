@@ -10,6 +10,7 @@ namespace ad {
 namespace gltfviewer {
 
 
+struct FrameStatistics;
 struct UserOptions;
 
 
@@ -34,6 +35,8 @@ private:
 
 void showUserOptionsWindow(UserOptions & aOptions);
 
+void showStatisticsWindow(const FrameStatistics & aStatistics);
+
 
 } // namespace gltfviewer
 } // namespace ad
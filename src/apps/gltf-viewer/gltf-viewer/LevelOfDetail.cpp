@@ -0,0 +1,102 @@
+#include "LevelOfDetail.h"
+
+#include "Simplification.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    // Error allowed for level 1, as a fraction of the bounding box diagonal. It doubles with each level.
+    constexpr GLfloat gFirstLevelErrorRatio = 0.005f;
+    // A level keeping more than this ratio of the previous level indices is not worth it.
+    constexpr double gMinimalReduction = 0.75;
+
+} // anonymous namespace
+
+
+std::vector<std::vector<GLuint>>
+generateLevelsOfDetail(std::span<const math::Position<3, GLfloat>> aPositions,
+                       std::span<const GLuint> aIndices,
+                       const math::Box<GLfloat> & aBoundingBox)
+{
+    const GLfloat diagonal = std::sqrt(aBoundingBox.width() * aBoundingBox.width()
+                                       + aBoundingBox.height() * aBoundingBox.height()
+                                       + aBoundingBox.depth() * aBoundingBox.depth());
+
+    std::vector<std::vector<GLuint>> levels;
+    levels.reserve(gMaxLevelsOfDetail - 1);
+
+    std::span<const GLuint> previous = aIndices;
+    for (std::size_t level = 1; level != gMaxLevelsOfDetail; ++level)
+    {
+        const GLfloat maxDistance = gFirstLevelErrorRatio * static_cast<GLfloat>(1 << (level - 1)) * diagonal;
+        std::vector<GLuint> simplified =
+            simplify(aPositions, previous, previous.size() / 2, maxDistance * maxDistance);
+
+        if (simplified.empty() || simplified.size() > gMinimalReduction * previous.size())
+        {
+            break;
+        }
+        levels.push_back(std::move(simplified));
+        previous = levels.back();
+    }
+    return levels;
+}
+
+
+GLfloat getScreenCoverage(const math::Box<GLfloat> & aWorldBox,
+                          const math::AffineMatrix<4, GLfloat> & aView,
+                          const math::Matrix<4, 4, GLfloat> & aProjection)
+{
+    const GLfloat radius = std::sqrt(aWorldBox.width() * aWorldBox.width()
+                                     + aWorldBox.height() * aWorldBox.height()
+                                     + aWorldBox.depth() * aWorldBox.depth()) / 2.f;
+
+    const math::Position<3, GLfloat> center = aWorldBox.center();
+    const math::Position<4, GLfloat> centerView =
+        math::Position<4, GLfloat>{center.x(), center.y(), center.z(), 1.f} * aView;
+
+    // The camera is inside the bounding sphere.
+    const GLfloat distanceSquared = centerView.x() * centerView.x()
+                                    + centerView.y() * centerView.y()
+                                    + centerView.z() * centerView.z();
+    if (distanceSquared <= radius * radius)
+    {
+        return std::numeric_limits<GLfloat>::infinity();
+    }
+
+    // Project the center and a point one radius above it (in view space), so this handles
+    // both perspective and orthographic projections.
+    const math::Position<4, GLfloat> centerClip = centerView * aProjection;
+    const math::Position<4, GLfloat> topClip =
+        (centerView + math::Vec<4, GLfloat>{0.f, radius, 0.f, 0.f}) * aProjection;
+    if (centerClip.w() <= 0.f || topClip.w() <= 0.f)
+    {
+        return std::numeric_limits<GLfloat>::infinity();
+    }
+
+    // The NDC span 2 units on the viewport height, which is the radius to diameter factor.
+    return std::abs(topClip.y() / topClip.w() - centerClip.y() / centerClip.w());
+}
+
+
+std::uint8_t selectLevelOfDetail(GLfloat aCoverage, GLfloat aFullDetailCoverage)
+{
+    if (aCoverage >= aFullDetailCoverage)
+    {
+        return 0;
+    }
+    const GLfloat level = std::floor(std::log2(aFullDetailCoverage / aCoverage));
+    return static_cast<std::uint8_t>(std::min(level, static_cast<GLfloat>(gMaxLevelsOfDetail - 1)));
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,43 @@
+#pragma once
+
+
+#include <math/Box.h>
+#include <math/Homogeneous.h>
+
+#include <renderer/GL_Loader.h>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Count of levels, including the full resolution level 0.
+constexpr std::size_t gMaxLevelsOfDetail = 4;
+
+
+/// \brief Simplified index lists for the levels 1 and above, each about half the triangles of the previous.
+///
+/// Generation stops early when a level would not significantly reduce the previous one,
+/// so the result might contain less than `gMaxLevelsOfDetail - 1` levels.
+std::vector<std::vector<GLuint>>
+generateLevelsOfDetail(std::span<const math::Position<3, GLfloat>> aPositions,
+                       std::span<const GLuint> aIndices,
+                       const math::Box<GLfloat> & aBoundingBox);
+
+
+/// \brief Fraction of the viewport height covered by the bounding sphere of the box.
+GLfloat getScreenCoverage(const math::Box<GLfloat> & aWorldBox,
+                          const math::AffineMatrix<4, GLfloat> & aView,
+                          const math::Matrix<4, 4, GLfloat> & aProjection);
+
+
+/// \brief Level 0 above `aFullDetailCoverage`, then one more level each time the coverage halves.
+std::uint8_t selectLevelOfDetail(GLfloat aCoverage, GLfloat aFullDetailCoverage);
+
+
+} // namespace gltfviewer
+} // namespace ad
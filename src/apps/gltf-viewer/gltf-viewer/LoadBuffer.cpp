@@ -6,6 +6,8 @@
 
 #include <handy/Base64.h>
 
+#include <cstring>
+#include <limits>
 #include <span>
 #include <strstream>
 
@@ -172,6 +174,120 @@ loadBufferData(arte::Const_Owned<arte::gltf::Accessor> aAccessor)
 }
 
 
+std::vector<math::Position<3, GLfloat>>
+loadPositions(arte::Const_Owned<arte::gltf::Accessor> aAccessor)
+{
+    if (aAccessor->type != arte::gltf::Accessor::ElementType::Vec3
+        || aAccessor->componentType != GL_FLOAT)
+    {
+        throw std::logic_error{"Positions are expected to be VEC3 of float."};
+    }
+
+    auto bufferView = checkedBufferView(aAccessor);
+    std::vector<std::byte> bytes = loadBufferData(aAccessor);
+    const std::size_t stride = bufferView->byteStride ? *bufferView->byteStride : getElementByteSize(*aAccessor);
+    const std::byte * first = bytes.data() + bufferView->byteOffset + aAccessor->byteOffset;
+
+    std::vector<math::Position<3, GLfloat>> result(aAccessor->count);
+    for (std::size_t elementId = 0; elementId != result.size(); ++elementId)
+    {
+        std::memcpy(result[elementId].data(), first + elementId * stride, sizeof(GLfloat) * 3);
+    }
+    return result;
+}
+
+
+/// \brief Read a component, applying the normalization rules of the glTF specification.
+template <class T_component>
+GLfloat readComponent(const std::byte * aComponent, bool aNormalized)
+{
+    T_component value;
+    std::memcpy(&value, aComponent, sizeof(T_component));
+    if constexpr(std::is_integral_v<T_component>)
+    {
+        if (aNormalized)
+        {
+            return std::max(static_cast<GLfloat>(value) / std::numeric_limits<T_component>::max(), -1.f);
+        }
+    }
+    return static_cast<GLfloat>(value);
+}
+
+
+GLfloat readComponent(const std::byte * aComponent, GLenum aComponentType, bool aNormalized)
+{
+    switch(aComponentType)
+    {
+    case GL_BYTE:
+        return readComponent<GLbyte>(aComponent, aNormalized);
+    case GL_UNSIGNED_BYTE:
+        return readComponent<GLubyte>(aComponent, aNormalized);
+    case GL_SHORT:
+        return readComponent<GLshort>(aComponent, aNormalized);
+    case GL_UNSIGNED_SHORT:
+        return readComponent<GLushort>(aComponent, aNormalized);
+    case GL_UNSIGNED_INT:
+        return readComponent<GLuint>(aComponent, aNormalized);
+    case GL_FLOAT:
+        return readComponent<GLfloat>(aComponent, aNormalized);
+    }
+
+    throw std::logic_error{std::string{"In "} + __func__ 
+        + ", unhandled component type: " + std::to_string(aComponentType)};
+}
+
+
+std::vector<GLfloat>
+loadAsFloat(arte::Const_Owned<arte::gltf::Accessor> aAccessor,
+            std::size_t aComponents,
+            GLfloat aMissingValue)
+{
+    auto bufferView = checkedBufferView(aAccessor);
+    std::vector<std::byte> bytes = loadBufferData(aAccessor);
+    const std::size_t stride = bufferView->byteStride ? *bufferView->byteStride : getElementByteSize(*aAccessor);
+    const std::size_t componentSize = getComponentSize(aAccessor->componentType);
+    const std::size_t sourceComponents = gElementTypeToLayout.at(aAccessor->type).totalComponents();
+    const std::byte * first = bytes.data() + bufferView->byteOffset + aAccessor->byteOffset;
+
+    std::vector<GLfloat> result(aAccessor->count * aComponents, aMissingValue);
+    for (std::size_t elementId = 0; elementId != aAccessor->count; ++elementId)
+    {
+        const std::byte * element = first + elementId * stride;
+        for (std::size_t componentId = 0; componentId != std::min(aComponents, sourceComponents); ++componentId)
+        {
+            result[elementId * aComponents + componentId] = 
+                readComponent(element + componentId * componentSize,
+                              aAccessor->componentType,
+                              aAccessor->normalized);
+        }
+    }
+    return result;
+}
+
+
+std::vector<GLuint>
+loadIndices(arte::Const_Owned<arte::gltf::Accessor> aAccessor)
+{
+    auto bufferView = checkedBufferView(aAccessor);
+    std::vector<std::byte> bytes = loadBufferData(aAccessor);
+
+    // Note: indices accessors are tightly packed by the spec.
+    const std::byte * first = bytes.data() + bufferView->byteOffset + aAccessor->byteOffset;
+    switch(aAccessor->componentType)
+    {
+    case GL_UNSIGNED_BYTE:
+        return copyIndices<GLubyte>(first, aAccessor->count);
+    case GL_UNSIGNED_SHORT:
+        return copyIndices<GLushort>(first, aAccessor->count);
+    case GL_UNSIGNED_INT:
+        return copyIndices<GLuint>(first, aAccessor->count);
+    }
+
+    throw std::logic_error{std::string{"In "} + __func__ 
+        + ", unhandled component type: " + std::to_string(aAccessor->componentType)};
+}
+
+
 const std::map<arte::gltf::Image::MimeType, arte::ImageFormat> gMimeToFormat {
     {arte::gltf::Image::MimeType::ImageJpeg, arte::ImageFormat::Jpg},
     {arte::gltf::Image::MimeType::ImagePng, arte::ImageFormat::Png},
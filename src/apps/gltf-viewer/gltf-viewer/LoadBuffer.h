@@ -4,6 +4,10 @@
 #include <arte/Image.h>
 #include <arte/gltf/Gltf.h>
 
+#include <math/Vector.h>
+
+#include <renderer/GL_Loader.h>
+
 
 namespace ad {
 namespace gltfviewer {
@@ -28,6 +32,22 @@ loadBufferData(arte::Const_Owned<arte::gltf::Buffer> aBuffer);
 std::vector<std::byte> 
 loadBufferData(arte::Const_Owned<arte::gltf::Accessor> aAccessor);
 
+/// \brief Copy the positions of a VEC3 float accessor, honoring the buffer view stride.
+std::vector<math::Position<3, GLfloat>>
+loadPositions(arte::Const_Owned<arte::gltf::Accessor> aAccessor);
+
+/// \brief Copy the elements of an accessor converted to float, honoring normalization and stride.
+/// \param aComponents The number of components of each resulting element,
+/// components missing from the accessor elements are set to `aMissingValue`.
+std::vector<GLfloat>
+loadAsFloat(arte::Const_Owned<arte::gltf::Accessor> aAccessor,
+            std::size_t aComponents,
+            GLfloat aMissingValue = 1.f);
+
+/// \brief Copy the indices of an accessor, converted to the largest representation.
+std::vector<GLuint>
+loadIndices(arte::Const_Owned<arte::gltf::Accessor> aAccessor);
+
 arte::Image<math::sdr::Rgba>
 loadImageData(arte::Const_Owned<arte::gltf::Image> aImage);
 
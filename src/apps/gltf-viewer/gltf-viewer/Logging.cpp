@@ -18,6 +18,7 @@ namespace {
         {
             spdlog::stdout_color_mt(gPrepareLogger);
             spdlog::stdout_color_mt(gDrawLogger);
+            spdlog::stdout_color_mt(gBenchmarkLogger);
         }
     };
 
@@ -13,6 +13,7 @@ namespace gltfviewer {
 
 constexpr const char * gPrepareLogger = "gltfv-prep";
 constexpr const char * gDrawLogger = "gltfv-draw";
+constexpr const char * gBenchmarkLogger = "gltfv-bench";
 
 
 void initializeLogging();
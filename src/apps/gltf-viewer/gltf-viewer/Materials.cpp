@@ -0,0 +1,67 @@
+#include "Materials.h"
+
+#include "Logging.h"
+#include "Mesh.h"
+
+#include <algorithm>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+static_assert(sizeof(math::hdr::Rgba<GLfloat>) == 4 * sizeof(GLfloat));
+
+
+MaterialSlot MaterialRepository::insert(MaterialIndex aMaterialIndex,
+                                        const Material & aMaterial)
+{
+    if (auto found = mSlots.find(aMaterialIndex);
+        found != mSlots.end())
+    {
+        return found->second;
+    }
+
+    const auto entryIndex = static_cast<GLuint>(mEntries.size());
+    mEntries.push_back(Entry{
+        .baseColorFactor = aMaterial.baseColorFactor,
+        .metallicFactor = aMaterial.metallicFactor,
+        .roughnessFactor = aMaterial.roughnessFactor,
+        .baseColorLayer = aMaterial.baseColorTexture.layer,
+        .metallicRoughnessLayer = aMaterial.metallicRoughnessTexture.layer,
+    });
+
+    MaterialSlot slot{
+        .page = entryIndex / gMaterialsPerPage,
+        .index = entryIndex % gMaterialsPerPage,
+    };
+    mSlots.emplace(aMaterialIndex, slot);
+    return slot;
+}
+
+
+void MaterialRepository::upload()
+{
+    // Each bound range must hold a complete materials array, so the buffer is allocated by whole pages.
+    const GLsizeiptr pageCount = (mEntries.size() + gMaterialsPerPage - 1) / gMaterialsPerPage;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, std::max<GLsizeiptr>(pageCount, 1) * gPageSize, nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, mEntries.size() * sizeof(Entry), mEntries.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    ADLOG(gPrepareLogger, info)
+         ("Uploaded {} material(s) to {} page(s) of the material buffer.", mEntries.size(), pageCount);
+
+    mTextures.upload();
+}
+
+
+void MaterialRepository::bind(GLuint aPage) const
+{
+    glBindBufferRange(GL_UNIFORM_BUFFER, gMaterialBlockBinding, mBuffer, aPage * gPageSize, gPageSize);
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
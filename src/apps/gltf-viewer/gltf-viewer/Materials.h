@@ -0,0 +1,88 @@
+#pragma once
+
+
+#include "Textures.h"
+
+#include <arte/gltf/Gltf.h>
+
+#include <renderer/GL_Loader.h>
+#include <renderer/UniformBuffer.h>
+
+#include <map>
+#include <optional>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+struct Material;
+
+
+/// \brief Position of a material in the MaterialRepository buffer.
+struct MaterialSlot
+{
+    // The range of gMaterialsPerPage entries bound to the MaterialBlock.
+    GLuint page{0};
+    // Index of the material inside its page, provided to the shaders as a vertex attribute.
+    GLuint index{0};
+};
+
+
+/// \brief The factors of all materials, packed in a single std140 uniform buffer.
+///
+/// The shaders index the MaterialBlock with the constant material attribute, so drawing
+/// with a different material only requires to set this attribute.
+/// The entries also provide the layers of the material textures, see TextureRepository.
+class MaterialRepository
+{
+public:
+    using MaterialIndex = std::optional<arte::gltf::Index<arte::gltf::Material>>;
+
+    /// \brief Return the slot of the material, inserting it on first request.
+    /// \param aMaterialIndex Empty for the glTF default material.
+    MaterialSlot insert(MaterialIndex aMaterialIndex, const Material & aMaterial);
+
+    /// \brief Upload all inserted materials to the uniform buffer, and their textures,
+    /// to be called once loading is complete.
+    void upload();
+
+    /// \brief Bind the page range of the buffer to the MaterialBlock binding point.
+    void bind(GLuint aPage) const;
+
+    std::size_t size() const
+    { return mEntries.size(); }
+
+    /// \brief The textures of the materials, populated while the materials are constructed.
+    TextureRepository & getTextures()
+    { return mTextures; }
+
+    /// \attention Must match the size of the materials array in the MaterialBlock (see ShadersMaterial.h).
+    static constexpr GLuint gMaterialsPerPage{256};
+    static constexpr GLuint gMaterialBlockBinding{4};
+    /// \brief Generic vertex attribute providing the material index, never enabled as an array.
+    static constexpr GLuint gMaterialAttributeIndex{6};
+
+private:
+    // std140 layout of a MaterialData, see ShadersMaterial.h
+    struct Entry
+    {
+        math::hdr::Rgba<GLfloat> baseColorFactor;
+        GLfloat metallicFactor;
+        GLfloat roughnessFactor;
+        GLuint baseColorLayer;
+        GLuint metallicRoughnessLayer;
+    };
+
+    static constexpr GLsizeiptr gPageSize = sizeof(Entry) * gMaterialsPerPage;
+
+    std::map<MaterialIndex, MaterialSlot> mSlots;
+    std::vector<Entry> mEntries;
+    graphics::UniformBufferObject mBuffer;
+    TextureRepository mTextures;
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
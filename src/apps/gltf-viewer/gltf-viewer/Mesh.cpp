@@ -1,11 +1,18 @@
 #include "Mesh.h"
 
 #include "DataLayout.h"
+#include "LevelOfDetail.h"
 #include "LoadBuffer.h"
 #include "Logging.h"
+#include "VertexCache.h"
 
 #include <renderer/GL_Loader.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
 
 namespace ad {
 
@@ -16,80 +23,9 @@ using namespace arte;
 namespace gltfviewer {
 
 
-/// \brief Maps semantic to vertex attribute indices that will be used in shaders.
-const std::map<std::string /*semantic*/, GLuint /*vertex attribute index*/> gSemanticToAttribute{
-    {"POSITION", 0},
-    {"NORMAL", 1},
-    {"TEXCOORD_0", 2}, // TODO Use the texCoord from TextureInfo
-    {"COLOR_0", 3},
-    {"JOINTS_0", 4},
-    {"WEIGHTS_0", 5},
-};
-
-
-/// \brief First attribute index available for per-instance attributes.
-constexpr GLuint gInstanceAttributeIndex = 8;
-
 //
 // Helper functions
 //
-template <class T_buffer>
-constexpr GLenum associateTarget()
-{
-    if constexpr(std::is_same_v<T_buffer, graphics::VertexBufferObject>)
-    {
-        return(GL_ARRAY_BUFFER);
-    }
-    else if constexpr(std::is_same_v<T_buffer, graphics::IndexBufferObject>)
-    {
-        return(GL_ELEMENT_ARRAY_BUFFER);
-    }
-}
-
-
-template <class T_buffer>
-T_buffer prepareBuffer_impl(Const_Owned<gltf::Accessor> aAccessor)
-{
-    T_buffer buffer;
-    auto bufferView = checkedBufferView(aAccessor);
-
-    GLenum target = [&]()
-    {
-        if (!bufferView->target)
-        {
-            GLenum infered = associateTarget<T_buffer>();
-            ADLOG(gPrepareLogger, warn)
-                 ("Buffer view #{} does not have target defined. Infering {}.",
-                  bufferView.id(), infered);
-            return infered;
-        }
-        else
-        {
-            assert(*bufferView->target == associateTarget<T_buffer>());
-            return *bufferView->target;
-        }
-    }();
-
-    glBindBuffer(target, buffer);
-    glBufferData(target,
-                 bufferView->byteLength,
-                 // TODO might be even better to only load in main memory the part of the buffer starting
-                 // at bufferView->byteOffset (and also limit the length there, actually).
-                 loadBufferData(aAccessor).data() 
-                    + bufferView->byteOffset,
-                 GL_STATIC_DRAW);
-    glBindBuffer(target, 0);
-
-    ADLOG(gPrepareLogger, debug)
-         ("Loaded {} bytes in target {}, offset in source buffer is {} bytes.",
-          bufferView->byteLength,
-          target,
-          bufferView->byteOffset);
-
-    return buffer;
-}
-
-
 template <class T_component>
 void outputElements(std::ostream & aOut,
                     std::span<T_component> aData,
@@ -166,14 +102,132 @@ void analyzeAccessor(Const_Owned<gltf::Accessor> aAccessor)
     }
 }
 
+
+/// \brief The bounds of the primitive positions, from their accessor, if there are positions.
+std::optional<math::Box<GLfloat>> getPositionBounds(Const_Owned<gltf::Primitive> aPrimitive)
+{
+    auto position = aPrimitive->attributes.find("POSITION");
+    if (position == aPrimitive->attributes.end())
+    {
+        return std::nullopt;
+    }
+
+    Const_Owned<gltf::Accessor> accessor = aPrimitive.get(position->second);
+    if (!accessor->bounds)
+    {
+        throw std::logic_error{"Position's accessor MUST have bounds."};
+    }
+    // By the spec, position MUST be a VEC3 of float.
+    auto & bounds = std::get<gltf::Accessor::MinMax<float>>(*accessor->bounds);
+
+    math::Position<3, GLfloat> min{bounds.min[0], bounds.min[1], bounds.min[2]};
+    math::Position<3, GLfloat> max{bounds.max[0], bounds.max[1], bounds.max[2]};
+    return math::Box<GLfloat>{
+        min,
+        (max - min).as<math::Size>(),
+    };
+}
+
 //
 // Loaded buffers types
 //
-Indices::Indices(Const_Owned<gltf::Accessor> aAccessor) :
-    componentType{aAccessor->componentType},
-    byteOffset{aAccessor->byteOffset},
-    ibo{prepareBuffer_impl<graphics::IndexBufferObject>(aAccessor)}
-{}
+bool hasUniformScale(const math::AffineMatrix<4, GLfloat> & aTransformation)
+{
+    // Relative to the scale, so the test does not depend on the model units.
+    constexpr GLfloat tolerance = 1e-4f;
+
+    auto dot = [&](std::size_t aRow, std::size_t aOther)
+    {
+        GLfloat result = 0.f;
+        for (std::size_t column = 0; column != 3; ++column)
+        {
+            result += aTransformation.at(aRow, column) * aTransformation.at(aOther, column);
+        }
+        return result;
+    };
+
+    // The rows of the linear part are the transformed axes, they must be orthogonal with equal lengths.
+    const GLfloat scaleSquared = dot(0, 0);
+    const GLfloat margin = tolerance * scaleSquared;
+    return std::abs(dot(1, 1) - scaleSquared) <= margin
+        && std::abs(dot(2, 2) - scaleSquared) <= margin
+        && std::abs(dot(0, 1)) <= margin
+        && std::abs(dot(0, 2)) <= margin
+        && std::abs(dot(1, 2)) <= margin;
+}
+
+
+InstanceList::Instance::Instance(const math::AffineMatrix<4, GLfloat> & aModelTransform, GLuint aInstanceId) :
+    aInstanceId{aInstanceId},
+    aFlags{gltfviewer::hasUniformScale(aModelTransform) ? gUniformScaleFlag : 0}
+{
+    // The matrix memory is read as column-major by the shaders, so a row as seen by the shaders
+    // takes one element in each row of the matrix (see PaletteBuffer::pack()).
+    for (std::size_t row = 0; row != 3; ++row)
+    {
+        for (std::size_t column = 0; column != 4; ++column)
+        {
+            aModelRows[row][column] = aModelTransform.at(column, row);
+        }
+    }
+
+    // The rows of the linear part are the columns of the GLSL matrix.
+    // The normal transformation is their cofactor matrix, as computed by gCofactor (see ShadersSkinning.h).
+    auto column = [&](std::size_t aRow)
+    {
+        return math::Vec<3, GLfloat>{
+            aModelTransform.at(aRow, 0),
+            aModelTransform.at(aRow, 1),
+            aModelTransform.at(aRow, 2)};
+    };
+    const std::array<math::Vec<3, GLfloat>, 3> columns{column(0), column(1), column(2)};
+
+    std::array<math::Vec<3, GLfloat>, 3> cofactors;
+    GLfloat magnitude = 0.f;
+    for (std::size_t columnId = 0; columnId != 3; ++columnId)
+    {
+        cofactors[columnId] = columns[(columnId + 1) % 3].cross(columns[(columnId + 2) % 3]);
+        for (std::size_t row = 0; row != 3; ++row)
+        {
+            magnitude = std::max(magnitude, std::abs(cofactors[columnId][row]));
+        }
+    }
+
+    // The cofactors grow with the square of the scale, they are brought back to the half float range.
+    const GLfloat factor = (columns[0].dot(cofactors[0]) < 0.f ? -1.f : 1.f)
+                           / (magnitude > 0.f ? magnitude : 1.f);
+    for (std::size_t columnId = 0; columnId != 3; ++columnId)
+    {
+        for (std::size_t row = 0; row != 3; ++row)
+        {
+            aNormalTransform[columnId][row] = toHalf(factor * cofactors[columnId][row]);
+        }
+    }
+}
+
+
+math::Position<3, GLfloat>
+InstanceList::Instance::transformPosition(const math::Position<3, GLfloat> & aPosition) const
+{
+    auto transformed = [&](std::size_t aRow)
+    {
+        return aModelRows[aRow][0] * aPosition.x()
+             + aModelRows[aRow][1] * aPosition.y()
+             + aModelRows[aRow][2] * aPosition.z()
+             + aModelRows[aRow][3];
+    };
+    return {transformed(0), transformed(1), transformed(2)};
+}
+
+
+void InstanceList::setSource(GLuint aBuffer, GLintptr aOffset, GLsizei aInstanceCount)
+{
+    mSourceBuffer = aBuffer;
+    mSourceOffset = aOffset;
+    mInstanceCount = aInstanceCount;
+    mLevelRanges = {};
+    mLevelRanges[0] = Range{.first = 0, .count = mInstanceCount};
+}
 
 
 void InstanceList::update(std::span<Instance> aInstances)
@@ -185,76 +239,117 @@ void InstanceList::update(std::span<Instance> aInstances)
         // Copy value to new buffer
         glBufferSubData(GL_ARRAY_BUFFER, 0, aInstances.size_bytes(), aInstances.data());
     }
-    mInstanceCount = aInstances.size();
+    setSource(mVbo, 0, static_cast<GLsizei>(aInstances.size()));
+}
+
+
+void InstanceList::update(std::span<Instance> aInstances, std::span<const GLsizei> aLevelCounts)
+{
+    update(aInstances);
+    setLevelCounts(aLevelCounts);
+}
+
+
+std::optional<std::span<InstanceList::Instance>> InstanceList::stream(StreamBuffer & aStream, GLsizei aCount)
+{
+    // The attribute offsets only need the alignment of a float, the vec4 alignment is kept for the drivers.
+    if (auto allocation = aStream.allocate<Instance>(aCount, 4 * sizeof(GLfloat)))
+    {
+        setSource(aStream.getBuffer(), allocation->offset, aCount);
+        return allocation->values;
+    }
+    return std::nullopt;
+}
+
+
+void InstanceList::setLevelCounts(std::span<const GLsizei> aLevelCounts)
+{
+    GLsizei first = 0;
+    for (std::size_t level = 0; level != mLevelRanges.size(); ++level)
+    {
+        const GLsizei count = level < aLevelCounts.size() ? aLevelCounts[level] : 0;
+        mLevelRanges[level] = Range{.first = first, .count = count};
+        first += count;
+    }
 }
 
 
-std::shared_ptr<graphics::Texture> loadGlTexture(arte::Image<math::sdr::Rgba> aTextureData, GLint aMipMapLevels)
+void InstanceList::updateCandidates(std::span<Instance> aInstances)
 {
-    auto result = std::make_shared<graphics::Texture>(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, *result);
-
-    // Allocate texture storage
-    glTexStorage2D(
-        GL_TEXTURE_2D,
-        aMipMapLevels, 
-        GL_RGBA8, // TODO should it be SRGB8_ALPHA8?
-        aTextureData.width(),
-        aTextureData.height());
-
-    glTexSubImage2D(
-        GL_TEXTURE_2D,
-        0,
-        0, 0,
-        aTextureData.width(), aTextureData.height(),
-        GL_RGBA,
-        GL_UNSIGNED_BYTE,
-        aTextureData.data()
-    );
-
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    return result;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCandidates);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, aInstances.size_bytes(), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, aInstances.size_bytes(), aInstances.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    mCandidateCount = aInstances.size();
+
+    {
+        // Orphan the instance buffer, it must be able to receive all the candidates.
+        graphics::bind_guard boundBuffer{mVbo};
+        glBufferData(GL_ARRAY_BUFFER, aInstances.size_bytes(), NULL, GL_STREAM_COPY);
+    }
+    setSource(mVbo, 0, 0);
+    mLevelRanges = {};
 }
 
 
-std::shared_ptr<graphics::Texture> Material::DefaultTexture()
+void InstanceList::pointAttributes(GLsizei aFirstInstance) const
 {
-    static std::shared_ptr<graphics::Texture> defaultTexture = []()
+    glBindBuffer(GL_ARRAY_BUFFER, mSourceBuffer);
+
+    // Note: Offsetting the pointers does not require base instance support (OpenGL 4.2).
+    const std::size_t instanceOffset = mSourceOffset + sizeof(Instance) * aFirstInstance;
+    auto pointer = [instanceOffset](std::size_t aMemberOffset)
     {
-        arte::Image<math::sdr::Rgba> whitePixel{{1, 1}, math::sdr::gWhite};
-        return loadGlTexture(whitePixel, 1);
-    }();
-    return defaultTexture;
+        return reinterpret_cast<void *>(instanceOffset + aMemberOffset);
+    };
+
+    GLuint attributeIndex = gInstanceAttributeIndex;
+    // The vertex attributes in the shader are float, so use glVertexAttribPointer.
+    for (std::size_t row = 0; row != 3; ++row)
+    {
+        glVertexAttribPointer(attributeIndex++, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                              pointer(offsetof(Instance, aModelRows) + sizeof(GLfloat) * 4 * row));
+    }
+    // Only 3 of the 4 half components of each column are used.
+    for (std::size_t column = 0; column != 3; ++column)
+    {
+        glVertexAttribPointer(attributeIndex++, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(Instance),
+                              pointer(offsetof(Instance, aNormalTransform) + sizeof(GLhalf) * 4 * column));
+    }
+    glVertexAttribIPointer(attributeIndex++, 1, GL_UNSIGNED_INT, sizeof(Instance),
+                           pointer(offsetof(Instance, aInstanceId)));
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 
-Material::Material(arte::Const_Owned<arte::gltf::Material> aMaterial) :
+Material::Material(arte::Const_Owned<arte::gltf::Material> aMaterial, TextureRepository & aTextures) :
     baseColorFactor{GetPbr(aMaterial).baseColorFactor},
     alphaMode{aMaterial->alphaMode},
     doubleSided{aMaterial->doubleSided}
 {
-    auto textureDefault = [&aMaterial](std::optional<gltf::TextureInfo> aTextureInfo)
+    auto textureDefault = [&aMaterial, &aTextures](std::optional<gltf::TextureInfo> aTextureInfo,
+                                                   TextureRole aRole)
     {
         if(aTextureInfo)
         {
-            return prepare(aMaterial.get<gltf::Texture>(aTextureInfo->index));
+            return aTextures.insert(aMaterial.get<gltf::Texture>(aTextureInfo->index), aRole);
         }
         else
         {
-            return DefaultTexture();
+            return aTextures.insertDefault();
         }
     };
 
     gltf::material::PbrMetallicRoughness pbr = GetPbr(aMaterial);
 
-    baseColorTexture = textureDefault(pbr.baseColorTexture);
+    baseColorTexture = textureDefault(pbr.baseColorTexture, TextureRole::Color);
+    hasBaseColorTexture = pbr.baseColorTexture.has_value();
 
     metallicFactor = pbr.metallicFactor;
     roughnessFactor = pbr.roughnessFactor;
-    metallicRoughnessTexture = textureDefault(pbr.metallicRoughnessTexture);
+    metallicRoughnessTexture = textureDefault(pbr.metallicRoughnessTexture, TextureRole::Data);
+    hasMetallicRoughnessTexture = pbr.metallicRoughnessTexture.has_value();
 }
 
 
@@ -265,235 +360,294 @@ Material::GetPbr(arte::Const_Owned<arte::gltf::Material> aMaterial)
 }
 
 
-MeshPrimitive::BufferId::BufferId(arte::Const_Owned<arte::gltf::BufferView> aBufferView,
-                                  arte::Const_Owned<arte::gltf::Accessor> aAccessor) :
-    mBufferView{aBufferView.id()}
+MeshPrimitive::MeshPrimitive(Const_Owned<gltf::Primitive> aPrimitive,
+                             MaterialRepository & aMaterials,
+                             GeometryArena & aGeometry,
+                             const PositionQuantization * aQuantization) :
+    drawMode{aPrimitive->mode},
+    material{aPrimitive.value_or(&gltf::Primitive::material, gltf::gDefaultMaterial), aMaterials.getTextures()}
 {
-    // Only if the accessor is sparse should its index be used to differentiate buffers.
-    if(aAccessor->sparse)
+    if (gDumpBuffersContent)
     {
-        mAccessor = aAccessor.id();
+        for (const auto & [semantic, accessorIndex] : aPrimitive->attributes)
+        {
+            ADLOG(gPrepareLogger, debug)("Semantic '{}' is associated to accessor #{}", semantic, accessorIndex);
+            analyzeAccessor(aPrimitive.get(accessorIndex));
+        }
     }
-}
 
+    GeometryArena::PrimitiveRanges ranges = aGeometry.insertPrimitive(aPrimitive, aQuantization);
+    const GeometryArena::VertexRange & vertices = ranges.vertices;
+    vertexFormat = vertices.format;
+    vertexArray = vertices.vertexArray;
+    baseVertex = vertices.baseVertex;
+    count = vertices.count;
+    vertexCount = vertices.count;
 
-bool MeshPrimitive::BufferId::operator<(const BufferId & aRhs) const
-{
-    return mBufferView < aRhs.mBufferView
-        || (mBufferView == aRhs.mBufferView && mAccessor < aRhs.mAccessor);
-}
-
-
-const ViewerVertexBuffer & MeshPrimitive::prepareVertexBuffer(Const_Owned<gltf::Accessor> aAccessor)
-{
-    auto bufferView = checkedBufferView(aAccessor);
-    if (auto found = vbos.find(BufferId{bufferView, aAccessor});
-        found != vbos.end())
+    if (std::optional<math::Box<GLfloat>> bounds = getPositionBounds(aPrimitive))
     {
-        return found->second;
+        boundingBox = *bounds;
+        ADLOG(gPrepareLogger, debug)
+             ("Mesh primitive #{} has bounding box {}.", aPrimitive.id(), boundingBox);
     }
-    else
-    {
-        auto vertexBuffer = prepareBuffer_impl<graphics::VertexBufferObject>(aAccessor);
-        auto inserted = 
-            vbos.emplace(BufferId{bufferView, aAccessor},
-                         ViewerVertexBuffer{
-                            std::move(vertexBuffer), 
-                            bufferView->byteStride ? (GLsizei)*bufferView->byteStride : 0});
-        return inserted.first->second;
-    }
-}
 
-
-MeshPrimitive::MeshPrimitive(Const_Owned<gltf::Primitive> aPrimitive) :
-    drawMode{aPrimitive->mode},
-    material{aPrimitive.value_or(&gltf::Primitive::material, gltf::gDefaultMaterial)}
-{
-    graphics::bind_guard boundVao{vao};
-
-    for (const auto & [semantic, accessorIndex] : aPrimitive->attributes)
+    if (ranges.indices)
     {
-        ADLOG(gPrepareLogger, debug)("Semantic '{}' is associated to accessor #{}", semantic, accessorIndex);
-        Const_Owned<gltf::Accessor> accessor = aPrimitive.get(accessorIndex);
-
-        // All accessors for a given primitive must have the same count.
-        count = accessor->count;
-
-        if (!accessor->bufferView)
+        firstIndex = ranges.indices->firstIndex;
+        indexType = ranges.indices->type;
+        count = ranges.indices->count;
+        if (ranges.exportedIndices)
         {
-            // TODO Handle no buffer view (accessor initialized to zeros)
-            ADLOG(gPrepareLogger, error)
-                 ("Unsupported: accessor #{} does not have a buffer view.", accessorIndex);
-            continue;
+            indexOrders = IndexOrders{
+                .optimized = ranges.indices->firstIndex,
+                .exported = ranges.exportedIndices->firstIndex,
+            };
         }
 
-        const ViewerVertexBuffer & vertexBuffer = prepareVertexBuffer(accessor);
-
-        if (gDumpBuffersContent) analyzeAccessor(accessor);
-
-        if (auto found = gSemanticToAttribute.find(semantic);
-            found != gSemanticToAttribute.end())
-        {
-            VertexAttributeLayout layout = gElementTypeToLayout.at(accessor->type);
-            if (layout.occupiedAttributes != 1)
-            {
-                throw std::logic_error{"Matrix attributes not implemented yet."};
-            }
-
-            glEnableVertexAttribArray(found->second);
-
-            graphics::bind_guard boundBuffer{vertexBuffer.vbo};
-
-            // The vertex attributes in the shader are float, so use glVertexAttribPointer.
-            glVertexAttribPointer(found->second,
-                                  layout.componentsPerAttribute,
-                                  accessor->componentType,
-                                  accessor->normalized,
-                                  vertexBuffer.stride,
-                                  // Note: The buffer view byte offset is directly taken into account when loading data with glBufferData().
-                                  reinterpret_cast<void *>(accessor->byteOffset)
-                                  );
+        // Welded primitives have no index accessor.
+        if (gDumpBuffersContent && aPrimitive->indices) analyzeAccessor(aPrimitive.get(&gltf::Primitive::indices));
+    }
 
-            if (semantic == "POSITION")
-            {
-                if (!accessor->bounds)
-                {
-                    throw std::logic_error{"Position's accessor MUST have bounds."};
-                }
-                // By the spec, position MUST be a VEC3 of float.
-                auto & bounds = std::get<gltf::Accessor::MinMax<float>>(*accessor->bounds);
-
-                math::Position<3, GLfloat> min{bounds.min[0], bounds.min[1], bounds.min[2]};
-                math::Position<3, GLfloat> max{bounds.max[0], bounds.max[1], bounds.max[2]};
-                boundingBox = {
-                    min,
-                    (max - min).as<math::Size>(),
-                };
-
-                ADLOG(gPrepareLogger, debug)
-                     ("Mesh primitive #{} has bounding box {}.", aPrimitive.id(), boundingBox);
-            }
+    materialSlot = aMaterials.insert(aPrimitive->material, material);
+    features = getShaderFeatures();
 
-            providedAttributes.insert(found->second);
+    // Skinned primitives are deformed, neither their simplification nor their meshlet bounds
+    // would be controlled by the bind pose.
+    if ((gGenerateLevelsOfDetail || gBuildMeshlets)
+        && drawMode == GL_TRIANGLES && firstIndex && !aPrimitive->attributes.contains("JOINTS_0"))
+    {
+        // The vertices and indices as inserted in the arena, which may have reordered them.
+        std::vector<math::Position<3, GLfloat>> positions = aGeometry.loadPositions(aPrimitive, vertices);
+        std::vector<GLuint> fullIndices = aGeometry.getIndices(*ranges.indices);
 
-            ADLOG(gPrepareLogger, debug)
-                 ("Attached semantic '{}' to vertex attribute {}."
-                  " Source data elements have {} components of type {}."
-                  " OpenGL buffer #{}, stride is {}, offset is {}.",
-                  semantic, found->second,
-                  layout.componentsPerAttribute, accessor->componentType,
-                  vertexBuffer.vbo, vertexBuffer.stride, accessor->byteOffset);
+        if (gGenerateLevelsOfDetail)
+        {
+            prepareLevelsOfDetail(aPrimitive, positions, fullIndices, aGeometry);
         }
-        else
+        if (gBuildMeshlets)
         {
-            ADLOG(gPrepareLogger, warn)("Semantic '{}' is ignored.", semantic);
+            prepareMeshlets(positions, fullIndices, aQuantization);
         }
     }
+}
 
-    if (aPrimitive->indices)
-    {
-        auto indicesAccessor = aPrimitive.get(&gltf::Primitive::indices);
-        indices = Indices{indicesAccessor};
-        count = indicesAccessor->count;
 
-        if (gDumpBuffersContent) analyzeAccessor(indicesAccessor);
+void MeshPrimitive::prepareLevelsOfDetail(arte::Const_Owned<arte::gltf::Primitive> aPrimitive,
+                                          std::span<const math::Position<3, GLfloat>> aPositions,
+                                          std::span<const GLuint> aIndices,
+                                          GeometryArena & aGeometry)
+{
+    std::vector<std::vector<GLuint>> levels = aGeometry.getLevelsOfDetail(aPositions, aIndices, boundingBox);
+    if (levels.empty())
+    {
+        return;
     }
-}
 
+    for (std::vector<GLuint> & level : levels)
+    {
+        if (aGeometry.getOptions().optimizeIndexOrder)
+        {
+            level = optimizeVertexCache(level, aPositions.size());
+        }
+        // The levels index the same vertices, so they get the same index type.
+        GeometryArena::IndexRange range = aGeometry.insertIndices(level, aPositions.size());
+        levelsOfDetail.push_back(LevelOfDetail{
+            .count = range.count,
+            .firstIndex = range.firstIndex,
+        });
+    }
 
-MeshPrimitive::MeshPrimitive(arte::Const_Owned<arte::gltf::Primitive> aPrimitive,
-                             const InstanceList & aInstances) :
-    MeshPrimitive{aPrimitive}
-{
-    associateInstanceBuffer(aInstances);
+    ADLOG(gPrepareLogger, debug)
+         ("Mesh primitive #{} has {} level(s) of detail, from {} down to {} indices.",
+          aPrimitive.id(), levelsOfDetail.size() + 1, count, levelsOfDetail.back().count);
 }
 
 
-void MeshPrimitive::associateInstanceBuffer(const InstanceList & aInstances)
+void MeshPrimitive::prepareMeshlets(std::span<const math::Position<3, GLfloat>> aPositions,
+                                    std::span<const GLuint> aIndices,
+                                    const PositionQuantization * aQuantization)
 {
-    graphics::bind_guard boundVao{vao};
-    graphics::bind_guard boundBuffer{aInstances.mVbo};
-
-    for(GLuint attributeOffset = 0; attributeOffset != 4; ++attributeOffset)
+    if (aIndices.size() / 3 < gMinMeshletsPerPrimitive * gMeshletMaxTriangles)
     {
-        GLuint attributeIndex = gInstanceAttributeIndex + attributeOffset;
+        return;
+    }
 
-        glEnableVertexAttribArray(attributeIndex);
-        // The vertex attributes in the shader are float, so use glVertexAttribPointer.
-        glVertexAttribPointer(attributeIndex,
-                              4,
-                              GL_FLOAT,
-                              GL_FALSE, //normalized
-                              sizeof(decltype(InstanceList::Instance::aModelTransform)),
-                              reinterpret_cast<void *>(sizeof(GLfloat) * 4 * attributeOffset));
-        glVertexAttribDivisor(attributeIndex, 1);
+    meshlets = buildMeshlets(aIndices, aPositions);
+    // The quantization is a uniform scale, the cones are not affected.
+    if (aQuantization)
+    {
+        for (Meshlet & meshlet : meshlets)
+        {
+            meshlet.center = ((meshlet.center - aQuantization->origin) / aQuantization->extent)
+                .as<math::Position>();
+            meshlet.radius /= aQuantization->extent;
+        }
     }
+
+    ADLOG(gPrepareLogger, debug)
+         ("Mesh primitive split in {} meshlets, of {:.1f} triangles on average.",
+          meshlets.size(), static_cast<double>(count) / 3. / meshlets.size());
 }
 
 
 bool MeshPrimitive::providesColor() const
 {
-    return providedAttributes.contains(gSemanticToAttribute.at("COLOR_0"));
+    return (vertexFormat & (VertexFormat{1} << gSemanticToAttribute.at("COLOR_0").index)) != 0;
 };
 
 
-std::shared_ptr<graphics::Texture> prepare(arte::Const_Owned<arte::gltf::Texture> aTexture)
+ShaderFeatures MeshPrimitive::getShaderFeatures() const
 {
-    // TODO How should this value be decided?
-    constexpr GLint gMipMapLevels = 6;
+    ShaderFeatures features = 0;
+    if (providesColor())
+    {
+        features |= gFeatureVertexColors;
+    }
+    if (material.hasBaseColorTexture)
+    {
+        features |= gFeatureBaseColorTexture;
+    }
+    if (material.hasMetallicRoughnessTexture)
+    {
+        features |= gFeatureMetallicRoughnessTexture;
+    }
+    if (material.alphaMode == gltf::Material::AlphaMode::Blend)
+    {
+        features |= gFeatureAlphaBlend;
+    }
+    if (GeometryArena::hasOctahedralNormals(vertexFormat))
+    {
+        features |= gFeatureOctahedralNormals;
+    }
+    return features;
+}
 
-    auto image = aTexture.get(&gltf::Texture::source);
-    std::shared_ptr<graphics::Texture> result{loadGlTexture(loadImageData(image), gMipMapLevels)};
-    graphics::bind_guard boundTexture{*result};
 
-    // Sampling parameters
-    {
-        const gltf::texture::Sampler & sampler = aTexture->sampler ? 
-            aTexture.get(&gltf::Texture::sampler)
-            : gltf::texture::gDefaultSampler;
+Mesh prepare(arte::Const_Owned<arte::gltf::Mesh> aMesh,
+             MaterialRepository & aMaterials,
+             GeometryArena & aGeometry)
+{
+    Mesh mesh;
+
+    auto primitives = aMesh.iterate(&arte::gltf::Mesh::primitives);
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
-        if (sampler.magFilter)
+    // The quantization grid is common to all primitives, so the mesh instances can fold
+    // a single dequantization into their model transformation.
+    // Note: the bounds are united starting from the first primitive, not from the zero box.
+    std::optional<math::Box<GLfloat>> bounds;
+    bool skinned = false;
+    for (auto primitive : primitives)
+    {
+        if (std::optional<math::Box<GLfloat>> primitiveBounds = getPositionBounds(primitive))
         {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, *sampler.magFilter);
+            if (bounds)
+            {
+                bounds->uniteAssign(*primitiveBounds);
+            }
+            else
+            {
+                bounds = primitiveBounds;
+            }
         }
-        if (sampler.minFilter)
+        skinned |= primitive->attributes.contains("JOINTS_0");
+    }
+    if (bounds)
+    {
+        mesh.boundingBox = *bounds;
+    }
+    mesh.storedBoundingBox = mesh.boundingBox;
+
+    std::optional<PositionQuantization> quantization;
+    if (gQuantizeVertices && bounds)
+    {
+        quantization.emplace(*bounds);
+        // Skinned vertices keep float positions, see gQuantizedFormat.
+        if (!skinned)
         {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, *sampler.minFilter);
+            mesh.dequantization = quantization->getDequantization();
+            mesh.storedBoundingBox = quantization->quantize(mesh.boundingBox);
         }
     }
 
-    return result;
+    for (auto primitive : primitives)
+    {
+        // Without the dequantization of the mesh, only the skinned primitives (which keep float positions)
+        // have their other attributes quantized.
+        const bool quantized = quantization && (!skinned || primitive->attributes.contains("JOINTS_0"));
+        mesh.primitives.emplace_back(primitive, aMaterials, aGeometry, quantized ? &*quantization : nullptr);
+    }
+
+    mesh.prepareIndirectCommands();
+    return mesh;
 }
 
 
-Mesh prepare(arte::Const_Owned<arte::gltf::Mesh> aMesh)
+void Mesh::setIndexOrder(IndexOrder aOrder)
 {
-    Mesh mesh;
+    if (aOrder == indexOrder)
+    {
+        return;
+    }
+
+    indexOrder = aOrder;
+    for (MeshPrimitive & primitive : primitives)
+    {
+        if (primitive.indexOrders)
+        {
+            primitive.firstIndex = aOrder == IndexOrder::Optimized ?
+                primitive.indexOrders->optimized : primitive.indexOrders->exported;
+        }
+    }
+    // The indirect commands reference the first index.
+    prepareIndirectCommands();
+}
 
-    auto primitives = aMesh.iterate(&arte::gltf::Mesh::primitives);
-    auto primitiveIt = primitives.begin();
-    
-    // Note: the first iteration is taken out of the loop
-    // because we do not want to unite with the zero bounding box initially in mesh.
-    mesh.primitives.emplace_back(*primitiveIt, mesh.gpuInstances);
-    mesh.boundingBox = mesh.primitives.back().boundingBox;
 
-    for (++primitiveIt; primitiveIt != primitives.end(); ++primitiveIt)     
+void Mesh::prepareIndirectCommands()
+{
+    std::vector<DrawElementsIndirectCommand> commands;
+    commands.reserve(primitives.size());
+
+    for (MeshPrimitive & primitive : primitives)
     {
-        mesh.primitives.emplace_back(*primitiveIt, mesh.gpuInstances);
-        mesh.boundingBox.uniteAssign(mesh.primitives.back().boundingBox);
+        primitive.indirectCommandOffset = commands.size() * sizeof(DrawElementsIndirectCommand);
+        if (primitive.firstIndex)
+        {
+            commands.push_back({
+                .count = static_cast<GLuint>(primitive.count),
+                .instanceCount = 0,
+                .firstIndex = *primitive.firstIndex,
+                .baseVertex = primitive.baseVertex,
+                .baseInstance = 0,
+            });
+        }
+        else
+        {
+            DrawArraysIndirectCommand arrays{
+                .count = static_cast<GLuint>(primitive.count),
+                .instanceCount = 0,
+                .first = static_cast<GLuint>(primitive.baseVertex),
+                .baseInstance = 0,
+            };
+            commands.emplace_back();
+            std::memcpy(&commands.back(), &arrays, sizeof(arrays));
+        }
     }
-    return mesh;
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectCommands);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                 commands.size() * sizeof(DrawElementsIndirectCommand),
+                 commands.data(),
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 }
 
 
 std::ostream & operator<<(std::ostream & aOut, const MeshPrimitive & aPrimitive)
 {
     return aOut << "<gltfviewer::MeshPrimitive> " 
-                << (aPrimitive.indices ? "indexed" : "non-indexed")
-                << " with " << aPrimitive.vbos.size() << " vbos."
+                << (aPrimitive.firstIndex ? "indexed" : "non-indexed")
+                << " with " << aPrimitive.count << " elements from base vertex " << aPrimitive.baseVertex << "."
         ;
 }
 
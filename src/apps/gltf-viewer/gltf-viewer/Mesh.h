@@ -1,6 +1,13 @@
 #pragma once
 
 
+#include "GeometryArena.h"
+#include "LevelOfDetail.h"
+#include "Materials.h"
+#include "Meshlet.h"
+#include "ShaderFeatures.h"
+#include "StreamBuffer.h"
+
 #include <arte/gltf/Gltf.h>
 
 #include <renderer/VertexSpecification.h>
@@ -10,6 +17,8 @@
 
 #include <renderer/Texture.h>
 
+#include <array>
+#include <optional>
 #include <set>
 #include <span>
 
@@ -20,32 +29,64 @@ namespace gltfviewer {
 // TODO Ad 2022/03/29: Implement a better control on buffer dumping, accessible via UI.
 constexpr bool gDumpBuffersContent = false;
 
+// Simplified index buffers are generated for the static triangle primitives.
+constexpr bool gGenerateLevelsOfDetail = true;
 
-struct Indices
-{
-    Indices(arte::Const_Owned<arte::gltf::Accessor> aAccessor);
+// Vertices are quantized and packed at load time, see gQuantizedFormat.
+constexpr bool gQuantizeVertices = true;
 
-    graphics::IndexBufferObject ibo;
-    GLenum componentType;
-    std::size_t byteOffset;
-};
+// The dense static triangle primitives are split into meshlets, culled individually, see Meshlet.h.
+constexpr bool gBuildMeshlets = true;
 
 
-struct ViewerVertexBuffer
-{
-    graphics::VertexBufferObject vbo;
-    GLsizei stride;
-};
+/// \brief Whether the linear part of the transformation is a rotation scaling all axes equally.
+///
+/// The normals are then transformed by the transformation itself, without its inverse transpose.
+bool hasUniformScale(const math::AffineMatrix<4, GLfloat> & aTransformation);
 
 
 class InstanceList
 {
-    friend class MeshPrimitive;
+    friend class GpuCulling;
 
 public:
+    /// \brief The per-instance data as sourced by the shaders, 80 bytes.
+    ///
+    /// Also the element of the std430 instance arrays of the culling shader, which must match.
     struct Instance
     {
-         math::AffineMatrix<4, GLfloat> aModelTransform;
+        Instance() = default;
+
+        /// \brief Also computes the normal transformation from the model transformation.
+        /// \param aInstanceId Identifies the instance in the scene, for picking and per-instance overrides.
+        Instance(const math::AffineMatrix<4, GLfloat> & aModelTransform, GLuint aInstanceId = 0);
+
+        /// \brief Whether the model transformation scales all axes equally, so it can transform the normals.
+        bool hasUniformScale() const
+        { return (aFlags & gUniformScaleFlag) != 0; }
+
+        /// \brief Apply the model transformation to a position.
+        math::Position<3, GLfloat> transformPosition(const math::Position<3, GLfloat> & aPosition) const;
+
+        static constexpr GLuint gUniformScaleFlag = 1 << 0;
+
+        // The first 3 rows of the affine model transformation as applied by the shaders,
+        // the last row is always (0, 0, 0, 1).
+        GLfloat aModelRows[3][4]{};
+        // Transforms the normals to world space, as the 3 columns of a GLSL mat3 in half floats padded to 4.
+        // It is only proportional to the inverse transpose (the shaders normalize the normals),
+        // so it is scaled to unit magnitude, which half floats represent accurately.
+        GLhalf aNormalTransform[3][4]{};
+        GLuint aInstanceId{0};
+        // Only read on the CPU, also pads the size to a multiple of 16 bytes as required by std430.
+        GLuint aFlags{0};
+    };
+    static_assert(sizeof(Instance) == 80, "Must match the Instance struct of the culling shader.");
+
+    struct Range
+    {
+        GLsizei first{0};
+        GLsizei count{0};
     };
 
     InstanceList()
@@ -56,102 +97,209 @@ public:
         update(defaultInstance);
     }
 
+    /// \brief Update with instances all drawn at the full level of detail.
     void update(std::span<Instance> aInstances);
 
+    /// \brief Update with instances sorted by level of detail.
+    /// \param aLevelCounts The count of instances for each level, in order.
+    void update(std::span<Instance> aInstances, std::span<const GLsizei> aLevelCounts);
+
+    /// \brief Source `aCount` instances from the stream buffer for this frame, all at the full level of detail.
+    /// \return The instances, to be written by the caller before the draws are issued.
+    /// Empty if the stream buffer is exhausted, the list is then unchanged.
+    std::optional<std::span<Instance>> stream(StreamBuffer & aStream, GLsizei aCount);
+
+    /// \brief Assign the current instances, sorted by level of detail, to the levels.
+    /// \param aLevelCounts The count of instances for each level, in order.
+    void setLevelCounts(std::span<const GLsizei> aLevelCounts);
+
+    /// \brief Upload the instances as candidates for GPU culling.
+    ///
+    /// The visible candidates are later compacted into the instance buffer by GpuCulling,
+    /// so the actual instance count is only known by the GPU.
+    void updateCandidates(std::span<Instance> aInstances);
+
+    /// \brief Source the instance attributes from this list, starting at `aFirstInstance`.
+    /// \pre The target vertex array object is bound.
+    void pointAttributes(GLsizei aFirstInstance) const;
+
     GLsizei size() const
     { return mInstanceCount; }
 
+    GLsizei candidatesSize() const
+    { return mCandidateCount; }
+
+    /// \brief The contiguous range of instances for each level of detail.
+    std::span<const Range> getLevelRanges() const
+    { return mLevelRanges; }
+
 private:
+    void setSource(GLuint aBuffer, GLintptr aOffset, GLsizei aInstanceCount);
+
     graphics::VertexBufferObject mVbo;
+    // The buffer sourcing the instance attributes, mVbo unless the instances are streamed.
+    GLuint mSourceBuffer{0};
+    GLintptr mSourceOffset{0};
     GLsizei mInstanceCount{0};
+    std::array<Range, gMaxLevelsOfDetail> mLevelRanges;
+    // Note: Bound as a shader storage buffer, the graphics library has no dedicated type.
+    graphics::VertexBufferObject mCandidates;
+    GLsizei mCandidateCount{0};
+};
+
+
+/// \brief Layout of the commands sourced by glDrawElementsIndirect().
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+
+/// \brief Layout of the commands sourced by glDrawArraysIndirect().
+///
+/// It is stored in a slot the size of DrawElementsIndirectCommand, so all primitives of a mesh
+/// have a command at a regular stride. The instance count has the same offset in both layouts.
+struct DrawArraysIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
 };
 
 
 struct Material
 {
-    Material(arte::Const_Owned<arte::gltf::Material> aMaterial);
+    Material(arte::Const_Owned<arte::gltf::Material> aMaterial, TextureRepository & aTextures);
 
     static arte::gltf::material::PbrMetallicRoughness 
     GetPbr(arte::Const_Owned<arte::gltf::Material> aMaterial);
 
     math::hdr::Rgba<GLfloat> baseColorFactor;
-    std::shared_ptr<graphics::Texture> baseColorTexture;
+    // The slots of absent textures are a default white texel, they should not be sampled.
+    TextureSlot baseColorTexture;
+    bool hasBaseColorTexture;
     arte::gltf::Material::AlphaMode alphaMode;
     bool doubleSided;
     GLfloat metallicFactor;
     GLfloat roughnessFactor;
-    std::shared_ptr<graphics::Texture> metallicRoughnessTexture;
-
-
-    static std::shared_ptr<graphics::Texture> DefaultTexture();
+    TextureSlot metallicRoughnessTexture;
+    bool hasMetallicRoughnessTexture;
 };
 
 
 struct MeshPrimitive
 {
-    // Note: Handles caching of sparse accessors.
-    // If an accessor is sparse, we cannot reuse any existing buffer for the underlying buffer view.
-    // We treat a each sparse accessor as unique from the perspective of the buffer cache.
-    // Different non-sparse accessors pointing to the same BufferView will still share the same cached buffer.
-    class BufferId
-    {
-    public:
-        BufferId(arte::Const_Owned<arte::gltf::BufferView> aBufferView,
-                 arte::Const_Owned<arte::gltf::Accessor> aAccessor);
-
-        bool operator<(const BufferId & aRhs) const;
-
-    private:
-        arte::gltf::Index<arte::gltf::BufferView> mBufferView;
-        arte::gltf::Index<arte::gltf::Accessor> mAccessor{
-            std::numeric_limits<arte::gltf::Index<arte::gltf::Accessor>::Value_t>::max()};
-    };
-
-    MeshPrimitive(arte::Const_Owned<arte::gltf::Primitive> aPrimitive);
-    MeshPrimitive(arte::Const_Owned<arte::gltf::Primitive> aPrimitive, const InstanceList & aInstances);
-
-    const ViewerVertexBuffer & prepareVertexBuffer(arte::Const_Owned<arte::gltf::Accessor> aAccessor);
-
-    void associateInstanceBuffer(const InstanceList & aInstances);
+    /// \param aQuantization If provided, the vertices are quantized, their positions over this grid.
+    MeshPrimitive(arte::Const_Owned<arte::gltf::Primitive> aPrimitive,
+                  MaterialRepository & aMaterials,
+                  GeometryArena & aGeometry,
+                  const PositionQuantization * aQuantization = nullptr);
+
+    /// \brief Generate the simplified index ranges, see GeometryArena::getLevelsOfDetail().
+    /// \param aPositions, aIndices The vertices and indices as inserted in the arena.
+    void prepareLevelsOfDetail(arte::Const_Owned<arte::gltf::Primitive> aPrimitive,
+                               std::span<const math::Position<3, GLfloat>> aPositions,
+                               std::span<const GLuint> aIndices,
+                               GeometryArena & aGeometry);
+
+    /// \brief Split the full resolution indices into meshlets, if there are enough triangles.
+    void prepareMeshlets(std::span<const math::Position<3, GLfloat>> aPositions,
+                         std::span<const GLuint> aIndices,
+                         const PositionQuantization * aQuantization);
 
     /// \brief Returns true if this mesh primitive has vertex color provided.
     bool providesColor() const;
 
+    /// \brief The features provided by the primitive and its material, see `features`.
+    ShaderFeatures getShaderFeatures() const;
+
     // NOTE Ad 2022/03/04: I wanted to use this occasion to brush-up knowledge of OpenGL functions.
     // So instead of using the abstractions in render libraries, do most of the calls directly.
     //VertexSpecification vertexSpecification;
 
     GLenum drawMode;
+    // The count of indices for indexed primitives, of vertices otherwise.
     GLsizei count{0};
-    graphics::VertexArrayObject vao;
-    // Note: Decision that OpenGL buffers would map to glTF buffer views:
-    // * This should allow to respect the interleaving, as it usually seems achieved
-    //   via several accessors (with different offsets) on the same 
-    //   buffer view (with a stride), at least in the examples I've seen.
-    // * This should result in distinct GL buffers when the same buffer
-    //   contains vertex attributes and indices, accessed via different buffer views.
-    // This will not be foolproof, as I suspect interleaving can be achieved via
-    // several buffer views, for example.
-    std::map<BufferId, ViewerVertexBuffer> vbos;
-    std::optional<Indices> indices;
-    std::set<GLuint> providedAttributes;
+    GLsizei vertexCount{0};
+    // The geometry is suballocated in the GeometryArena, the vertex array is shared by its vertex format.
+    VertexFormat vertexFormat{0};
+    GLuint vertexArray{0};
+    GLint baseVertex{0};
+    // Only for indexed primitives, the first index of the range in the arena index buffer.
+    std::optional<GLuint> firstIndex;
+    // The type of all index ranges of the primitive, see GeometryArena::getIndexType().
+    GLenum indexType{GL_UNSIGNED_INT};
+
+    struct IndexOrders
+    {
+        GLuint optimized;
+        GLuint exported;
+    };
+    // Both orders of the full resolution indices, if the arena kept the exported order.
+    std::optional<IndexOrders> indexOrders;
 
     Material material;
+    // The material factors, in the MaterialRepository buffer.
+    MaterialSlot materialSlot;
+    // Specialize the programs drawing the primitive, computed once constructed.
+    ShaderFeatures features{0};
     math::Box<GLfloat> boundingBox{{0.f, 0.f, 0.f}, {0.f, 0.f, 0.f}};
+
+    // Byte offset of this primitive's command in the mesh indirect buffer.
+    GLintptr indirectCommandOffset{0};
+
+    struct LevelOfDetail
+    {
+        GLsizei count;
+        GLuint firstIndex;
+    };
+    // Levels 1 and above, their indices are also in the arena index buffer.
+    // They index the same vertices as the full resolution level.
+    std::vector<LevelOfDetail> levelsOfDetail;
+
+    // Partition the optimized order of the full resolution indices, empty if the primitive is not split.
+    std::vector<Meshlet> meshlets;
+};
+
+
+enum class IndexOrder
+{
+    Optimized,
+    Exported,
 };
 
 
 struct Mesh
 {
+    /// \brief Allocate one indirect command per primitive, with an instance count of zero.
+    void prepareIndirectCommands();
+
+    /// \brief Draw the full resolution indices in `aOrder`, if the arena kept both orders.
+    /// \see GeometryArena::Options::keepExportedIndexOrder
+    void setIndexOrder(IndexOrder aOrder);
+
     std::vector<MeshPrimitive> primitives;
     math::Box<GLfloat> boundingBox{{0.f, 0.f, 0.f}, {0.f, 0.f, 0.f}};
+    // The transformation from the positions as stored to the mesh space, identity unless quantized.
+    // It is folded into the instance model transformations.
+    math::AffineMatrix<4, GLfloat> dequantization = math::AffineMatrix<4, GLfloat>::Identity();
+    // The bounding box in the space of the stored positions, where the instance transformations apply.
+    math::Box<GLfloat> storedBoundingBox{{0.f, 0.f, 0.f}, {0.f, 0.f, 0.f}};
     InstanceList gpuInstances;
+    // The instance counts are written by GpuCulling.
+    graphics::VertexBufferObject indirectCommands;
+    IndexOrder indexOrder{IndexOrder::Optimized};
 };
 
 
-Mesh prepare(arte::Const_Owned<arte::gltf::Mesh> aMesh);
-
-std::shared_ptr<graphics::Texture> prepare(arte::Const_Owned<arte::gltf::Texture> aTexture);
+Mesh prepare(arte::Const_Owned<arte::gltf::Mesh> aMesh,
+             MaterialRepository & aMaterials,
+             GeometryArena & aGeometry);
 
 
 std::ostream & operator<<(std::ostream & aOut, const MeshPrimitive &);
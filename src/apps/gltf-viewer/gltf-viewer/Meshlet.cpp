@@ -0,0 +1,226 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    // Cones wider than this (the smallest dot product between the axis and a normal) are never culled.
+    constexpr GLfloat gMinConeDot = 0.1f;
+
+    constexpr std::size_t gNoMeshlet = std::numeric_limits<std::size_t>::max();
+
+
+    /// \param aIndices The indices of the meshlet.
+    /// \param aIndexOffset The offset of the meshlet indices in the primitive indices.
+    Meshlet computeBounds(std::span<const GLuint> aIndices,
+                          std::span<const math::Position<3, GLfloat>> aPositions,
+                          std::size_t aIndexOffset)
+    {
+        Meshlet meshlet{
+            .indexOffset = static_cast<GLuint>(aIndexOffset),
+            .indexCount = static_cast<GLsizei>(aIndices.size()),
+            .center = {0.f, 0.f, 0.f},
+            .radius = 0.f,
+            .coneAxis = {0.f, 0.f, 0.f},
+            .coneCutoff = 1.f,
+        };
+
+        // The sphere is centered on the bounding box, which is close enough to the optimal sphere.
+        std::array<GLfloat, 3> min;
+        std::array<GLfloat, 3> max;
+        min.fill(std::numeric_limits<GLfloat>::max());
+        max.fill(std::numeric_limits<GLfloat>::lowest());
+        for (GLuint index : aIndices)
+        {
+            for (std::size_t axis = 0; axis != 3; ++axis)
+            {
+                min[axis] = std::min(min[axis], aPositions[index][axis]);
+                max[axis] = std::max(max[axis], aPositions[index][axis]);
+            }
+        }
+        meshlet.center = {(min[0] + max[0]) / 2.f, (min[1] + max[1]) / 2.f, (min[2] + max[2]) / 2.f};
+        for (GLuint index : aIndices)
+        {
+            meshlet.radius = std::max(meshlet.radius, (aPositions[index] - meshlet.center).getNorm());
+        }
+
+        // The cone axis is the average of the unit normals, its aperture reaches the farthest normal.
+        std::vector<math::Vec<3, GLfloat>> normals;
+        normals.reserve(aIndices.size() / 3);
+        math::Vec<3, GLfloat> axis{0.f, 0.f, 0.f};
+        for (std::size_t corner = 0; corner + 2 < aIndices.size(); corner += 3)
+        {
+            const math::Position<3, GLfloat> & a = aPositions[aIndices[corner]];
+            const math::Vec<3, GLfloat> normal =
+                (aPositions[aIndices[corner + 1]] - a).cross(aPositions[aIndices[corner + 2]] - a);
+            // Degenerate triangles are not rasterized, they do not constrain the cone.
+            if (const GLfloat length = normal.getNorm(); length > 0.f)
+            {
+                normals.push_back(normal / length);
+                axis += normals.back();
+            }
+        }
+
+        const GLfloat axisLength = axis.getNorm();
+        if (axisLength == 0.f)
+        {
+            return meshlet;
+        }
+        meshlet.coneAxis = axis / axisLength;
+
+        GLfloat minDot = 1.f;
+        for (const math::Vec<3, GLfloat> & normal : normals)
+        {
+            minDot = std::min(minDot, normal.dot(meshlet.coneAxis));
+        }
+        if (minDot > gMinConeDot)
+        {
+            meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+        }
+        return meshlet;
+    }
+
+} // anonymous namespace
+
+
+std::vector<Meshlet> buildMeshlets(std::span<const GLuint> aIndices,
+                                   std::span<const math::Position<3, GLfloat>> aPositions)
+{
+    std::vector<Meshlet> result;
+    // The last meshlet in which each vertex was counted.
+    std::vector<std::size_t> vertexMeshlets(aPositions.size(), gNoMeshlet);
+
+    const std::size_t triangleCount = aIndices.size() / 3;
+    std::size_t firstTriangle = 0;
+    std::size_t vertexCount = 0;
+    auto close = [&](std::size_t aEndTriangle)
+    {
+        result.push_back(computeBounds(aIndices.subspan(firstTriangle * 3, (aEndTriangle - firstTriangle) * 3),
+                                       aPositions,
+                                       firstTriangle * 3));
+        firstTriangle = aEndTriangle;
+        vertexCount = 0;
+    };
+
+    for (std::size_t triangle = 0; triangle != triangleCount; ++triangle)
+    {
+        const GLuint * corners = aIndices.data() + triangle * 3;
+        std::size_t newVertices = 0;
+        for (std::size_t corner = 0; corner != 3; ++corner)
+        {
+            newVertices += vertexMeshlets[corners[corner]] != result.size() ? 1 : 0;
+        }
+        if (vertexCount + newVertices > gMeshletMaxVertices
+            || triangle - firstTriangle == gMeshletMaxTriangles)
+        {
+            close(triangle);
+        }
+
+        for (std::size_t corner = 0; corner != 3; ++corner)
+        {
+            if (vertexMeshlets[corners[corner]] != result.size())
+            {
+                vertexMeshlets[corners[corner]] = result.size();
+                ++vertexCount;
+            }
+        }
+    }
+    if (firstTriangle != triangleCount)
+    {
+        close(triangleCount);
+    }
+    return result;
+}
+
+
+MeshletCuller::MeshletCuller(const GLfloat (&aModelRows)[3][4],
+                             const math::Matrix<4, 4, GLfloat> & aViewProjection,
+                             const math::Position<3, GLfloat> & aCameraPosition)
+{
+    // Each clip coordinate is a linear form of the stored position (x, y, z, 1):
+    // the model rows give the world position, which is then multiplied by the view projection.
+    std::array<std::array<GLfloat, 4>, 4> clip;
+    for (std::size_t clipAxis = 0; clipAxis != 4; ++clipAxis)
+    {
+        for (std::size_t component = 0; component != 4; ++component)
+        {
+            GLfloat coefficient = component == 3 ? aViewProjection.at(3, clipAxis) : 0.f;
+            for (std::size_t row = 0; row != 3; ++row)
+            {
+                coefficient += aModelRows[row][component] * aViewProjection.at(row, clipAxis);
+            }
+            clip[clipAxis][component] = coefficient;
+        }
+    }
+
+    // A point is inside the view volume iff -w <= x, y, z <= w, each bound is a plane.
+    for (std::size_t axis = 0; axis != 3; ++axis)
+    {
+        for (std::size_t component = 0; component != 4; ++component)
+        {
+            mPlanes[2 * axis][component] = clip[3][component] + clip[axis][component];
+            mPlanes[2 * axis + 1][component] = clip[3][component] - clip[axis][component];
+        }
+    }
+    for (std::size_t plane = 0; plane != mPlanes.size(); ++plane)
+    {
+        const std::array<GLfloat, 4> & p = mPlanes[plane];
+        mPlaneNorms[plane] = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    }
+
+    // The inverse of the linear part has the cross products of its rows as columns, over the determinant.
+    auto row = [&](std::size_t aRow)
+    {
+        return math::Vec<3, GLfloat>{aModelRows[aRow][0], aModelRows[aRow][1], aModelRows[aRow][2]};
+    };
+    const std::array<math::Vec<3, GLfloat>, 3> rows{row(0), row(1), row(2)};
+    const GLfloat determinant = rows[0].dot(rows[1].cross(rows[2]));
+    if (determinant > 0.f)
+    {
+        math::Vec<3, GLfloat> position{0.f, 0.f, 0.f};
+        for (std::size_t axis = 0; axis != 3; ++axis)
+        {
+            const GLfloat translated = aCameraPosition[axis] - aModelRows[axis][3];
+            position += rows[(axis + 1) % 3].cross(rows[(axis + 2) % 3]) * (translated / determinant);
+        }
+        mCameraPosition = position.as<math::Position>();
+        mTestFacing = true;
+    }
+}
+
+
+MeshletTest MeshletCuller::test(const Meshlet & aMeshlet, bool aBackFaceCulling) const
+{
+    for (std::size_t plane = 0; plane != mPlanes.size(); ++plane)
+    {
+        const std::array<GLfloat, 4> & p = mPlanes[plane];
+        const GLfloat distance =
+            p[0] * aMeshlet.center.x() + p[1] * aMeshlet.center.y() + p[2] * aMeshlet.center.z() + p[3];
+        if (distance < -aMeshlet.radius * mPlaneNorms[plane])
+        {
+            return MeshletTest::OutsideFrustum;
+        }
+    }
+
+    // The camera is behind the cone of normals, whichever point of the bounding sphere the cone starts from.
+    if (aBackFaceCulling && mTestFacing && aMeshlet.coneCutoff < 1.f)
+    {
+        const math::Vec<3, GLfloat> toCenter = aMeshlet.center - mCameraPosition;
+        if (toCenter.dot(aMeshlet.coneAxis) >= aMeshlet.coneCutoff * toCenter.getNorm() + aMeshlet.radius)
+        {
+            return MeshletTest::BackFacing;
+        }
+    }
+    return MeshletTest::Visible;
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
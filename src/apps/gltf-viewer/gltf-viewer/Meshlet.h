@@ -0,0 +1,100 @@
+#pragma once
+
+
+#include <math/Homogeneous.h>
+#include <math/Vector.h>
+
+#include <renderer/GL_Loader.h>
+
+#include <array>
+#include <span>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Limits of a meshlet, so its vertices and triangles would fit a mesh shader workgroup.
+constexpr std::size_t gMeshletMaxVertices = 64;
+constexpr std::size_t gMeshletMaxTriangles = 124;
+
+/// \brief Primitives which would be split in fewer meshlets are drawn whole.
+constexpr std::size_t gMinMeshletsPerPrimitive = 8;
+
+/// \brief Each meshlet is tested against all the instances of its mesh,
+/// past this count the meshes are drawn whole.
+constexpr std::size_t gMaxMeshletCulledInstances = 8;
+
+
+/// \brief A cluster of consecutive triangles of a primitive, with the bounds to cull it.
+///
+/// The bounds are in the space of the stored positions, where the instance transformations apply.
+struct Meshlet
+{
+    // In elements, from the first index of the primitive.
+    GLuint indexOffset;
+    GLsizei indexCount;
+    // The bounding sphere.
+    math::Position<3, GLfloat> center;
+    GLfloat radius;
+    // The normal cone: the meshlet faces away from the points behind the cone, see MeshletCuller.
+    math::Vec<3, GLfloat> coneAxis;
+    // The sine of the cone aperture, 1 if the normals are too spread to ever cull the meshlet.
+    GLfloat coneCutoff;
+};
+
+
+/// \brief Split the triangle list in runs of consecutive triangles, within the limits of a meshlet.
+///
+/// The triangles are not reordered: the vertex cache ordering already keeps them local,
+/// and each meshlet is then a range of the primitive indices.
+std::vector<Meshlet> buildMeshlets(std::span<const GLuint> aIndices,
+                                   std::span<const math::Position<3, GLfloat>> aPositions);
+
+
+enum class MeshletTest
+{
+    Visible,
+    OutsideFrustum,
+    BackFacing,
+};
+
+
+struct MeshletStatistics
+{
+    std::size_t visibleMeshlets{0};
+    std::size_t frustumCulledMeshlets{0};
+    std::size_t backFacingMeshlets{0};
+};
+
+
+/// \brief Tests the meshlets of one instance against the view frustum and camera position.
+///
+/// The frustum planes and the camera are brought to the space of the stored positions once,
+/// so the meshlet bounds are tested without being transformed.
+class MeshletCuller
+{
+public:
+    /// \param aModelRows The rows of the instance transformation, see InstanceList::Instance.
+    MeshletCuller(const GLfloat (&aModelRows)[3][4],
+                  const math::Matrix<4, 4, GLfloat> & aViewProjection,
+                  const math::Position<3, GLfloat> & aCameraPosition);
+
+    /// \param aBackFaceCulling Whether the back faces of the meshlet are culled when drawn.
+    MeshletTest test(const Meshlet & aMeshlet, bool aBackFaceCulling) const;
+
+private:
+    // The (a, b, c, d) coefficients of the clipping planes, positive inside the frustum.
+    std::array<std::array<GLfloat, 4>, 6> mPlanes;
+    // The length of each plane normal, which is not unit once transformed.
+    std::array<GLfloat, 6> mPlaneNorms;
+    math::Position<3, GLfloat> mCameraPosition{0.f, 0.f, 0.f};
+    // Mirroring transformations flip the winding order (the front face is not changed by the renderer),
+    // and degenerate ones have no camera position, the facing is not tested for both.
+    bool mTestFacing{false};
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,136 @@
+#include "PreSkinning.h"
+
+#include "Logging.h"
+#include "ShadersSkinning.h"
+#include "ViewerProgram.h"
+
+#include <algorithm>
+#include <array>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+SkinnedVertices::SkinnedVertices()
+{
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+
+PreSkinning::PreSkinning() :
+    mProgram{graphics::makeLinkedProgram({
+        {GL_VERTEX_SHADER, gPreSkinningVertexShader.c_str()},
+    })}
+{
+    // The captured varyings are only effective at link time, so the program is linked again.
+    const std::array<const GLchar *, 2> varyings{"tf_position_world", "tf_normal_world"};
+    glTransformFeedbackVaryings(mProgram, static_cast<GLsizei>(varyings.size()), varyings.data(),
+                                GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(mProgram);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(mProgram, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE)
+    {
+        throw std::logic_error{"Pre-skinning program could not be linked with its captured varyings."};
+    }
+
+    mPaletteFirstLocation = glGetUniformLocation(mProgram, "u_paletteFirst");
+    mPaletteStrideLocation = glGetUniformLocation(mProgram, "u_paletteStride");
+    setUniformInt(mProgram, glGetUniformLocation(mProgram, "u_jointMatrices"), gPaletteTextureUnit);
+}
+
+
+bool PreSkinning::fitsTextureBuffer(const Mesh & aMesh, std::size_t aInstanceCount)
+{
+    static const GLint gMaxTexels = []()
+    {
+        GLint result = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &result);
+        return result;
+    }();
+
+    std::size_t vertexTotal = 0;
+    for (const MeshPrimitive & primitive : aMesh.primitives)
+    {
+        vertexTotal += primitive.vertexCount * aInstanceCount;
+    }
+    // Position and normal are one texel each.
+    return vertexTotal * 2 <= static_cast<std::size_t>(gMaxTexels);
+}
+
+
+bool PreSkinning::skin(const Mesh & aMesh,
+                       std::span<const arte::gltf::Index<arte::gltf::Skin>> aSkins,
+                       const PaletteRange & aPalettes,
+                       bool aPoseChanged,
+                       const PaletteBuffer & aPaletteBuffer,
+                       SkinnedVertices & aVertices)
+{
+    if (aVertices.valid && !aPoseChanged && std::ranges::equal(aSkins, aVertices.skins))
+    {
+        return false;
+    }
+
+    // Each primitive is followed by its vertices for the other instances.
+    const auto instanceCount = static_cast<GLsizei>(aSkins.size());
+    GLint vertexTotal = 0;
+    aVertices.primitiveFirst.clear();
+    for (const MeshPrimitive & primitive : aMesh.primitives)
+    {
+        aVertices.primitiveFirst.push_back(vertexTotal);
+        vertexTotal += primitive.vertexCount * instanceCount;
+    }
+
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, aVertices.buffer);
+    glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, vertexTotal * gSkinnedVertexSize, nullptr, GL_DYNAMIC_COPY);
+
+    glUseProgram(mProgram);
+    setUniformInt(mProgram, mPaletteFirstLocation, aPalettes.first);
+    setUniformInt(mProgram, mPaletteStrideLocation, aPalettes.stride);
+    aPaletteBuffer.bind(gPaletteTextureUnit);
+
+    // Only the captured vertices are of interest.
+    glEnable(GL_RASTERIZER_DISCARD);
+    for (std::size_t primitiveId = 0; primitiveId != aMesh.primitives.size(); ++primitiveId)
+    {
+        const MeshPrimitive & primitive = aMesh.primitives[primitiveId];
+        if (primitive.vertexCount == 0)
+        {
+            continue;
+        }
+
+        glBindVertexArray(primitive.vertexArray);
+        glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER,
+                          0,
+                          aVertices.buffer,
+                          aVertices.primitiveFirst[primitiveId] * gSkinnedVertexSize,
+                          primitive.vertexCount * instanceCount * gSkinnedVertexSize);
+        // Each vertex is captured once per instance, regardless of the primitive indices.
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArraysInstanced(GL_POINTS, primitive.baseVertex, primitive.vertexCount, instanceCount);
+        glEndTransformFeedback();
+    }
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glActiveTexture(GL_TEXTURE0 + gPaletteTextureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    aVertices.instanceCount = instanceCount;
+    aVertices.skins.assign(aSkins.begin(), aSkins.end());
+    aVertices.valid = true;
+
+    ADLOG(gDrawLogger, trace)
+         ("Pre-skinned {} instance(s) of mesh '{}', {} vertices.", instanceCount, aMesh, vertexTotal);
+    return true;
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,83 @@
+#pragma once
+
+
+#include "Mesh.h"
+#include "SkeletalAnimation.h"
+
+#include <arte/gltf/Gltf.h>
+
+#include <renderer/GL_Loader.h>
+#include <renderer/Shading.h>
+#include <renderer/Texture.h>
+#include <renderer/VertexSpecification.h>
+
+#include <span>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief World space vertices of the skinned instances of a mesh, written by PreSkinning.
+struct SkinnedVertices
+{
+    SkinnedVertices();
+
+    // Position and normal of each vertex (2 texels), for each primitive, instance after instance.
+    // Captured by transform feedback, then read through the texture.
+    graphics::VertexBufferObject buffer;
+    graphics::Texture texture{GL_TEXTURE_BUFFER};
+    // The skinned vertex of the first vertex of each primitive, for the first instance.
+    std::vector<GLint> primitiveFirst;
+    GLsizei instanceCount{0};
+    // The skins of the instances when the vertices were written, in instance order.
+    std::vector<arte::gltf::Index<arte::gltf::Skin>> skins;
+    // Reset when the vertices do not follow the poses anymore.
+    bool valid{false};
+    // Set while the instances are too many for the texture buffer, see PreSkinning::fitsTextureBuffer().
+    bool exceedsTextureBuffer{false};
+};
+
+
+/// \brief Skins the vertices of each animated mesh once per frame, captured by transform feedback.
+///
+/// All passes drawing the skinned instances then read the skinned vertices, see gPreSkinnedVertexShader.
+/// The meshes whose skin instances kept the same pose since they were last skinned are skipped.
+class PreSkinning
+{
+public:
+    PreSkinning();
+
+    /// \brief Whether the skinned vertices of `aInstanceCount` instances of the mesh can be read
+    /// from a single texture buffer (GL_MAX_TEXTURE_BUFFER_SIZE).
+    ///
+    /// Otherwise the instances are drawn with the per-vertex skinning.
+    static bool fitsTextureBuffer(const Mesh & aMesh, std::size_t aInstanceCount);
+
+    /// \brief Skin the vertices of all skinned instances of the mesh, unless the cached ones are current.
+    /// \param aSkins The skin of each instance, its palette being in `aPalettes`.
+    /// \param aPoseChanged Whether any of the skeletons changed its pose this frame.
+    /// \return True if the vertices were skinned, false if the cached vertices were current.
+    /// \pre The palettes are uploaded to the PaletteBuffer.
+    /// \pre The vertices fit the texture buffer, see fitsTextureBuffer().
+    bool skin(const Mesh & aMesh,
+              std::span<const arte::gltf::Index<arte::gltf::Skin>> aSkins,
+              const PaletteRange & aPalettes,
+              bool aPoseChanged,
+              const PaletteBuffer & aPaletteBuffer,
+              SkinnedVertices & aVertices);
+
+    // Position and normal, as vec4.
+    static constexpr GLsizeiptr gSkinnedVertexSize = 2 * 4 * sizeof(GLfloat);
+    static constexpr GLint gPaletteTextureUnit{0};
+
+private:
+    graphics::Program mProgram;
+    GLint mPaletteFirstLocation;
+    GLint mPaletteStrideLocation;
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
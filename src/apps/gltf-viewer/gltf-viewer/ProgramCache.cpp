@@ -0,0 +1,235 @@
+#include "ProgramCache.h"
+
+#include "Capabilities.h"
+#include "Logging.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    // Not provided by all loaders, the entry point is resolved at runtime.
+    using MaxShaderCompilerThreadsFunction = void (*)(GLuint aCount);
+
+    /// \brief Let the driver compile on as many threads as it sees fit, if it supports parallel compilation.
+    /// \return Whether parallel compilation is available.
+    bool enableParallelCompilation()
+    {
+        const GpuCapabilities & capabilities = getGpuCapabilities();
+        const char * entryPoint = nullptr;
+        if (capabilities.hasExtension("GL_KHR_parallel_shader_compile"))
+        {
+            entryPoint = "glMaxShaderCompilerThreadsKHR";
+        }
+        else if (capabilities.hasExtension("GL_ARB_parallel_shader_compile"))
+        {
+            entryPoint = "glMaxShaderCompilerThreadsARB";
+        }
+
+        if (entryPoint == nullptr)
+        {
+            return false;
+        }
+        if (auto maxThreads = reinterpret_cast<MaxShaderCompilerThreadsFunction>(glfwGetProcAddress(entryPoint)))
+        {
+            // 0xFFFFFFFF requests the implementation maximum.
+            maxThreads(0xFFFFFFFF);
+            return true;
+        }
+        return false;
+    }
+
+
+    std::string getShaderLog(GLuint aShader)
+    {
+        GLint length = 0;
+        glGetShaderiv(aShader, GL_INFO_LOG_LENGTH, &length);
+        std::string log(std::max(length, 1), '\0');
+        glGetShaderInfoLog(aShader, length, nullptr, log.data());
+        return log.c_str();
+    }
+
+
+    std::string getProgramLog(GLuint aProgram)
+    {
+        GLint length = 0;
+        glGetProgramiv(aProgram, GL_INFO_LOG_LENGTH, &length);
+        std::string log(std::max(length, 1), '\0');
+        glGetProgramInfoLog(aProgram, length, nullptr, log.data());
+        return log.c_str();
+    }
+
+
+    bool isLinked(GLuint aProgram)
+    {
+        GLint status = GL_FALSE;
+        glGetProgramiv(aProgram, GL_LINK_STATUS, &status);
+        return status == GL_TRUE;
+    }
+
+} // anonymous namespace
+
+
+ProgramCache::ProgramCache()
+{
+    const GpuCapabilities & capabilities = getGpuCapabilities();
+    mDriverHash = hashString(capabilities.vendor);
+    mDriverHash = hashString(capabilities.renderer, mDriverHash);
+    mDriverHash = hashString(capabilities.version, mDriverHash);
+
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    mBinariesSupported = formatCount > 0 && mDisk.isEnabled();
+
+    mParallel = enableParallelCompilation();
+    ADLOG(gPrepareLogger, info)
+         ("Program binary cache {}, parallel shader compilation {}.",
+          mBinariesSupported ? "enabled" : "disabled",
+          mParallel ? "enabled" : "not supported");
+}
+
+
+ProgramBuild ProgramCache::begin(const graphics::Program & aProgram,
+                                 std::initializer_list<std::pair<const GLenum, const GLchar *>> aShaders)
+{
+    ProgramBuild build{
+        .key = mDriverHash,
+        .start = ProgramBuild::Clock::now(),
+    };
+    for (const auto & [stage, source] : aShaders)
+    {
+        build.key = hashBytes(std::as_bytes(std::span{&stage, 1}), build.key);
+        build.key = hashString(source, build.key);
+    }
+
+    if (mBinariesSupported && loadBinary(aProgram, build.key))
+    {
+        return build;
+    }
+
+    for (const auto & [stage, source] : aShaders)
+    {
+        GLuint shader = glCreateShader(stage);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        glAttachShader(aProgram, shader);
+        build.shaders.push_back(shader);
+    }
+    glProgramParameteri(aProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    // The status is not queried here, so the driver can compile and link in the background.
+    glLinkProgram(aProgram);
+    return build;
+}
+
+
+bool ProgramCache::isReady(const graphics::Program & aProgram, const ProgramBuild & aBuild) const
+{
+    if (aBuild.shaders.empty() || !mParallel)
+    {
+        return true;
+    }
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(aProgram, GL_COMPLETION_STATUS_KHR, &status);
+    return status == GL_TRUE;
+}
+
+
+void ProgramCache::complete(const graphics::Program & aProgram, ProgramBuild aBuild)
+{
+    if (aBuild.shaders.empty())
+    {
+        // Loaded from the cache, the link status was already checked.
+        return;
+    }
+
+    // Blocks until the driver is done.
+    const bool linked = isLinked(aProgram);
+    const auto buildTime = std::chrono::duration_cast<std::chrono::microseconds>(
+        ProgramBuild::Clock::now() - aBuild.start);
+
+    std::string errors;
+    for (GLuint shader : aBuild.shaders)
+    {
+        if (!linked)
+        {
+            errors += getShaderLog(shader);
+        }
+        glDetachShader(aProgram, shader);
+        glDeleteShader(shader);
+    }
+    if (!linked)
+    {
+        throw std::logic_error{"Program link failed:\n" + errors + getProgramLog(aProgram)};
+    }
+
+    ++mStatistics.compiledPrograms;
+    if (mBinariesSupported)
+    {
+        storeBinary(aProgram, aBuild.key, buildTime);
+    }
+}
+
+
+bool ProgramCache::loadBinary(const graphics::Program & aProgram, std::uint64_t aKey)
+{
+    const auto start = ProgramBuild::Clock::now();
+    std::optional<std::vector<std::byte>> blob = mDisk.load(aKey);
+    if (!blob || blob->size() <= sizeof(BinaryHeader))
+    {
+        return false;
+    }
+
+    BinaryHeader header;
+    std::memcpy(&header, blob->data(), sizeof(BinaryHeader));
+    glProgramBinary(aProgram,
+                    header.format,
+                    blob->data() + sizeof(BinaryHeader),
+                    static_cast<GLsizei>(blob->size() - sizeof(BinaryHeader)));
+    // The driver may reject a binary it produced, the program is then compiled from sources.
+    if (!isLinked(aProgram))
+    {
+        ADLOG(gDrawLogger, debug)("Cached program binary {:016x} rejected by the driver.", aKey);
+        return false;
+    }
+
+    const auto loadTime = std::chrono::duration_cast<std::chrono::microseconds>(
+        ProgramBuild::Clock::now() - start);
+    ++mStatistics.cachedPrograms;
+    mStatistics.savedTime +=
+        std::max(std::chrono::microseconds{header.buildMicroseconds} - loadTime, std::chrono::microseconds{0});
+    return true;
+}
+
+
+void ProgramCache::storeBinary(const graphics::Program & aProgram,
+                               std::uint64_t aKey,
+                               std::chrono::microseconds aBuildTime)
+{
+    GLint length = 0;
+    glGetProgramiv(aProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length == 0)
+    {
+        return;
+    }
+
+    std::vector<std::byte> blob(sizeof(BinaryHeader) + length);
+    BinaryHeader header{
+        .buildMicroseconds = static_cast<std::uint32_t>(aBuildTime.count()),
+    };
+    glGetProgramBinary(aProgram, length, nullptr, &header.format, blob.data() + sizeof(BinaryHeader));
+    std::memcpy(blob.data(), &header, sizeof(BinaryHeader));
+    mDisk.store(aKey, blob);
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,105 @@
+#pragma once
+
+
+#include "DiskCache.h"
+
+#include <renderer/GL_Loader.h>
+#include <renderer/Shading.h>
+
+#include <chrono>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+
+// Not defined by all OpenGL headers, it is used from KHR_parallel_shader_compile only.
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief A program being built, from begin() until complete().
+struct ProgramBuild
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::uint64_t key;
+    // Empty if the program was loaded from a cached binary.
+    std::vector<GLuint> shaders;
+    Clock::time_point start;
+};
+
+
+/// \brief Counters of the programs built through a ProgramCache, since its construction.
+struct ProgramCacheStatistics
+{
+    std::size_t compiledPrograms{0};
+    std::size_t cachedPrograms{0};
+    // Build time recorded when the cached programs were compiled, minus the time to load them.
+    std::chrono::microseconds savedTime{0};
+};
+
+
+/// \brief Links programs from the binaries saved by previous runs, or compiles and saves them.
+///
+/// A binary is keyed by the hash of the shader sources (which include the permutation defines)
+/// and of the driver, so a driver update or a shader edit never loads a stale binary.
+///
+/// A build is split in two steps: begin() only issues the commands, and complete() checks the result.
+/// When the driver supports parallel compilation (KHR_parallel_shader_compile), all programs begun
+/// before the first complete() are compiled concurrently, and isReady() tells without blocking
+/// whether complete() would have to wait.
+class ProgramCache
+{
+public:
+    /// \attention Requires a current OpenGL context.
+    ProgramCache();
+
+    /// \brief Start building `aProgram` from the shader sources, by stage.
+    ProgramBuild begin(const graphics::Program & aProgram,
+                       std::initializer_list<std::pair<const GLenum, const GLchar *>> aShaders);
+
+    /// \brief Whether the build finished, so complete() would not block.
+    ///
+    /// Always true if the driver cannot compile asynchronously, see isAsynchronous().
+    bool isReady(const graphics::Program & aProgram, const ProgramBuild & aBuild) const;
+
+    /// \brief Wait for the build to finish, throwing on link failure, and save the binary if it was compiled.
+    void complete(const graphics::Program & aProgram, ProgramBuild aBuild);
+
+    /// \brief Whether the builds progress in the background, so they can be polled with isReady().
+    bool isAsynchronous() const
+    { return mParallel; }
+
+    const ProgramCacheStatistics & getStatistics() const
+    { return mStatistics; }
+
+private:
+    // Prefixes the driver binary in the DiskCache entries.
+    struct BinaryHeader
+    {
+        GLenum format;
+        std::uint32_t buildMicroseconds;
+    };
+
+    bool loadBinary(const graphics::Program & aProgram, std::uint64_t aKey);
+    void storeBinary(const graphics::Program & aProgram,
+                     std::uint64_t aKey,
+                     std::chrono::microseconds aBuildTime);
+
+    DiskCache mDisk{"programs"};
+    // Hash of the vendor, renderer and version strings, seeding the program keys.
+    std::uint64_t mDriverHash;
+    // Binaries are only loaded and saved if the driver supports at least one format.
+    bool mBinariesSupported;
+    bool mParallel;
+    ProgramCacheStatistics mStatistics;
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,63 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <bit>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    constexpr std::uint64_t gBlendBit = std::uint64_t{1} << 63;
+
+    /// \brief Keep the `aBits` low bits of `aValue`, shifted to `aPosition`.
+    constexpr std::uint64_t field(std::uint64_t aValue, unsigned int aBits, unsigned int aPosition)
+    {
+        return (aValue & ((std::uint64_t{1} << aBits) - 1)) << aPosition;
+    }
+
+} // anonymous namespace
+
+
+void RenderQueue::pushOpaque(GLuint aProgramId, DrawPacket aPacket)
+{
+    const Material & material = aPacket.primitive->material;
+    aPacket.key = 
+        field(aProgramId, 8, 55)
+        | field(material.doubleSided ? 1 : 0, 1, 54)
+        | field(material.baseColorTexture.array, 16, 38)
+        | field(material.metallicRoughnessTexture.array, 16, 22)
+        | field(aPacket.primitive->vertexArray, 22, 0);
+    mPackets.push_back(aPacket);
+}
+
+
+void RenderQueue::pushTransparent(GLuint aProgramId, GLfloat aViewDepth, DrawPacket aPacket)
+{
+    // The bit pattern of positive floats is ordered as their value:
+    // complementing it sorts the farthest packets first.
+    const std::uint32_t depthBits = ~std::bit_cast<std::uint32_t>(std::max(aViewDepth, 0.f));
+    aPacket.key = 
+        gBlendBit
+        | field(depthBits, 32, 31)
+        | field(aProgramId, 8, 23)
+        | field(aPacket.primitive->vertexArray, 23, 0);
+    mPackets.push_back(aPacket);
+}
+
+
+void RenderQueue::sort()
+{
+    // Stable, so packets with equal keys keep their submission order.
+    std::stable_sort(mPackets.begin(), mPackets.end(),
+                     [](const DrawPacket & aLhs, const DrawPacket & aRhs)
+                     {
+                         return aLhs.key < aRhs.key;
+                     });
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
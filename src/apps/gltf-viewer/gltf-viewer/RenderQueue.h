@@ -0,0 +1,144 @@
+#pragma once
+
+
+#include "Mesh.h"
+#include "PreSkinning.h"
+#include "SkeletalAnimation.h"
+#include "ViewerProgram.h"
+
+#include <cstdint>
+#include <span>
+#include <variant>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Instanced draw of a range of instances, at a given level of detail.
+struct LevelOfDetailDraw
+{
+    std::size_t level;
+    InstanceList::Range range;
+    // Multiplies the material base color, to visualize the levels. Null for no tint.
+    const math::hdr::Rgba_f * tint{nullptr};
+};
+
+
+/// \brief Instanced draw of an indexed primitive, merged with the following batched packets
+/// sharing its state into a single multi-draw indirect call.
+struct BatchedDraw
+{
+    std::size_t level;
+    // Range in the instance list of the packet, applied as the command base instance.
+    InstanceList::Range range;
+    const math::hdr::Rgba_f * tint{nullptr};
+    // The runs of visible meshlets at full resolution, each emitting its own command.
+    // Empty to draw all the indices of the level.
+    std::span<const GeometryArena::IndexRange> meshlets;
+};
+
+
+/// \brief Instanced draw with parameters sourced from the mesh indirect commands, written by GpuCulling.
+///
+/// The commands of consecutive primitives are consecutive, so the following indirect packets
+/// of the same mesh sharing its state are merged into a single multi-draw indirect call.
+struct IndirectDraw
+{
+    // Whether the packet is drawn by the batched program, reading its material from the draw records.
+    // Otherwise, each primitive is drawn by its own indirect call.
+    bool multiDraw{false};
+};
+
+
+/// \brief Instanced draw of a primitive deformed by skeletons, each instance with its own palette.
+struct SkinnedDraw
+{
+    PaletteRange palettes;
+};
+
+
+/// \brief Instanced draw of a primitive from the vertices skinned by PreSkinning.
+struct PreSkinnedDraw
+{
+    const SkinnedVertices * vertices;
+    // Skinned vertex of the primitive first vertex, for the first instance.
+    GLint first;
+};
+
+
+using DrawParameters = std::variant<LevelOfDetailDraw, BatchedDraw, IndirectDraw, SkinnedDraw, PreSkinnedDraw>;
+
+
+/// \brief A draw of one mesh primitive, with all the state it requires.
+struct DrawPacket
+{
+    std::uint64_t key;
+    const Mesh * mesh;
+    const MeshPrimitive * primitive;
+    const ViewerProgram * program;
+    // Sources the instance attributes, usually the mesh own list.
+    const InstanceList * instances;
+    DrawParameters parameters;
+};
+
+
+/// \brief Number of draw calls and state changes emitted while flushing a RenderQueue.
+struct RenderStatistics
+{
+    std::size_t packets{0};
+    std::size_t drawCalls{0};
+    // Number of multi-draw calls, and of the commands they are made of.
+    std::size_t multiDraws{0};
+    std::size_t multiDrawCommands{0};
+    std::size_t programChanges{0};
+    // Count of program permutations built so far, see Renderer.
+    std::size_t programPermutations{0};
+    // Among them, the ones loaded from the binary cache, and the build time it saved (see ProgramCache).
+    std::size_t cachedPermutations{0};
+    double permutationTimeSavedMs{0.};
+    // Permutations still building after the flush, and packets drawn with the fallback shading meanwhile.
+    std::size_t pendingPermutations{0};
+    std::size_t fallbackPackets{0};
+    std::size_t blendChanges{0};
+    std::size_t cullFaceChanges{0};
+    std::size_t textureChanges{0};
+    std::size_t vertexArrayChanges{0};
+};
+
+
+/// \brief Collect the draw packets of a frame, to be emitted in an order minimizing state changes.
+///
+/// The 64 bits sort key is made of, from the most significant bits:
+/// * opaque packets: blend (0), program, double-sidedness, texture set, vertex array.
+/// * transparent packets: blend (1), decreasing view depth, program, vertex array.
+/// So the opaque packets are grouped by state, and the transparent ones come last, back to front.
+/// \note The key only orders the packets, the actual state is compared on emission.
+class RenderQueue
+{
+public:
+    /// \brief Queue the packet of an opaque primitive.
+    /// \param aProgramId Small identifier of the program, only its 8 low bits are ordered.
+    void pushOpaque(GLuint aProgramId, DrawPacket aPacket);
+
+    /// \brief Queue the packet of a blended primitive.
+    /// \param aViewDepth The distance along the view direction, ordering the transparent packets.
+    void pushTransparent(GLuint aProgramId, GLfloat aViewDepth, DrawPacket aPacket);
+
+    /// \brief Sort the queued packets by increasing keys.
+    void sort();
+
+    std::span<const DrawPacket> getPackets() const
+    { return mPackets; }
+
+    void clear()
+    { mPackets.clear(); }
+
+private:
+    std::vector<DrawPacket> mPackets;
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -2,14 +2,21 @@
 
 
 #include "Camera.h"
+#include "Capabilities.h"
+#include "Culling.h"
 #include "DebugDrawer.h"
+#include "FrameArena.h"
 #include "GltfAnimation.h"
 #include "GltfRendering.h"
+#include "GpuCulling.h"
 #include "ImguiUi.h"
+#include "LevelOfDetail.h"
 #include "Logging.h"
 #include "Mesh.h"
 #include "Polar.h"
+#include "PreSkinning.h"
 #include "SkeletalAnimation.h"
+#include "Statistics.h"
 #include "UserOptions.h"
 
 #include <graphics/AppInterface.h>
@@ -19,6 +26,9 @@
 
 #include <math/Box.h>
 
+#include <algorithm>
+#include <ranges>
+
 
 namespace ad {
 namespace gltfviewer {
@@ -28,7 +38,19 @@ struct MeshInstances
 {
     Mesh mesh;
     std::vector<InstanceList::Instance> instances; 
+    // Whether any of the instances has a non-uniform scale, selecting the program permutation.
+    bool nonUniformScale{false};
+    // Level of detail of each instance, only populated when the levels of detail are enabled.
+    std::vector<std::uint8_t> instanceLevels;
     std::vector<arte::gltf::Index<arte::gltf::Skin>> skinInstances;
+    // The palettes of the skinned instances in the renderer palette buffer, in skinInstances order.
+    PaletteRange skinPalettes;
+    SkinnedVertices skinnedVertices;
+    // Range of each level of detail in the batched instance list, when batching.
+    std::array<InstanceList::Range, gMaxLevelsOfDetail> batchedLevelRanges;
+    // The runs of visible meshlets of each primitive, only valid if meshletsCulled.
+    std::vector<std::vector<GeometryArena::IndexRange>> visibleMeshlets;
+    bool meshletsCulled{false};
 };
 
 // Associates a mesh index to a mesh loaded on the Gpu
@@ -39,12 +61,19 @@ using SkeletonRepository = std::map<arte::gltf::Index<arte::gltf::Skin>, Skeleto
 using AnimationRepository = std::vector<Animation>;
 
 
+/// \brief Empty the instance lists, while keeping their capacity.
+///
+/// The lists persist from frame to frame, so they stop allocating once they reached
+/// the scene instance count (unlike frame arena storage, which would have to be reacquired each frame).
 inline void clearInstances(MeshRepository & aRepository)
 {
     for(auto & [index, mesh] : aRepository)
     {
         mesh.instances.clear();
+        mesh.nonUniformScale = false;
+        mesh.instanceLevels.clear();
         mesh.skinInstances.clear();
+        mesh.meshletsCulled = false;
     }
 }
 
@@ -53,6 +82,8 @@ inline void clearInstances(MeshRepository & aRepository)
 template <class T_nodeRange>
 void populateMeshRepository(MeshRepository & aRepository,
                             SkeletonRepository & aSkeletonRepo,
+                            MaterialRepository & aMaterials,
+                            GeometryArena & aGeometry,
                             const T_nodeRange & aNodes)
 {
     for (arte::Owned<arte::gltf::Node> node : aNodes)
@@ -63,17 +94,19 @@ void populateMeshRepository(MeshRepository & aRepository,
             {
                 auto [it, didInsert] = aRepository.emplace(
                     *node->mesh,
-                    prepare(node.get(&arte::gltf::Node::mesh)));
+                    prepare(node.get(&arte::gltf::Node::mesh), aMaterials, aGeometry));
                 ADLOG(gPrepareLogger, info)("Completed GPU loading for mesh '{}'.", it->second.mesh);
             }
             // Only populates skins that are actually present in this scene.
             if(node->skin && !aSkeletonRepo.contains(*node->skin))
             {
                 aSkeletonRepo.emplace(*node->skin, Skeleton{node.get(&arte::gltf::Node::skin)});
-                ADLOG(gPrepareLogger, debug)("Loaded skeleton for skin #{}.", *node->skin);
+                ADLOG(gPrepareLogger, debug)
+                     ("Loaded skeleton for skin #{} with {} joint(s).",
+                      *node->skin, aSkeletonRepo.at(*node->skin).joints.size());
             }
         }
-        populateMeshRepository(aRepository, aSkeletonRepo, node.iterate(&arte::gltf::Node::children));
+        populateMeshRepository(aRepository, aSkeletonRepo, aMaterials, aGeometry, node.iterate(&arte::gltf::Node::children));
     }
 }
 
@@ -91,12 +124,14 @@ void populateAnimationRepository(AnimationRepository & aRepository, const T_anim
 
 struct JointDrawer
 {
+    using JointStack = std::pmr::vector<std::pair<math::Position<3, GLfloat>, bool/*draw occurred*/>>;
+
     void pushJoint(const math::AffineMatrix<4, float> & aTransform);
     void popJoint(const math::AffineMatrix<4, float> & aTransform);
 
     DebugDrawer & debugDrawer;
     UserOptions & options;
-    std::vector<std::pair<math::Position<3, GLfloat>, bool/*draw occurred*/>> jointStack;
+    JointStack jointStack;
 };
 
 
@@ -106,17 +141,26 @@ struct Scene
     Scene(arte::Gltf aGltf,
           arte::gltf::Index<arte::gltf::Scene> aSceneIndex,
           std::shared_ptr<graphics::AppInterface> aAppInterface,
-          ImguiUi & aImgui) :
+          ImguiUi & aImgui,
+          const GeometryArena::Options & aGeometryOptions = {},
+          const UserOptions & aOptions = {}) :
         gltf{std::move(aGltf)},
         scene{gltf.get(aSceneIndex)},
         appInterface{std::move(aAppInterface)},
         cameraSystem{appInterface},
+        options{aOptions},
         debugDrawer{appInterface},
         imgui{aImgui}
     {
+        renderer.getGeometry().setOptions(aGeometryOptions);
+        renderer.getMaterials().getTextures().setCompression(options.compressTextures);
         populateMeshRepository(indexToMesh, 
                                indexToSkeleton,
+                               renderer.getMaterials(),
+                               renderer.getGeometry(),
                                scene.iterate(&arte::gltf::Scene::nodes));
+        renderer.getMaterials().upload();
+        renderer.getGeometry().upload();
         populateAnimationRepository(animations, gltf.getAnimations());
         if (!animations.empty())
         {
@@ -130,6 +174,11 @@ struct Scene
         }
         cameraSystem.setViewedBox(*sceneBounds);
 
+        if (getGpuCapabilities().supportsGpuCulling())
+        {
+            gpuCulling.emplace();
+        }
+
         using namespace std::placeholders;
         appInterface->registerKeyCallback(
             std::bind(&Scene::callbackKeyboard, this, _1, _2, _3, _4));
@@ -160,9 +209,34 @@ struct Scene
         updateAnimation(aTimer);
         updatesInstances();
 
-        setView(cameraSystem.getViewTransform());
+        math::AffineMatrix<4, float> viewTransform = cameraSystem.getViewTransform();
         // This is a bit greedy, as the projection transform rarely changes compared to the view.
-        setProjection(cameraSystem.getProjectionTransform(appInterface));
+        math::Matrix<4, 4, float> projectionTransform = cameraSystem.getProjectionTransform(appInterface);
+        setView(viewTransform);
+        setProjection(projectionTransform);
+
+        // The glTF cameras are collected by the traversal, so culling can only happen after it.
+        cullInstances(viewTransform, projectionTransform);
+        if (isBatching() && options.meshletCulling)
+        {
+            cullMeshlets(viewTransform, viewTransform * projectionTransform);
+        }
+        uploadInstances(viewTransform * projectionTransform);
+    }
+
+
+    bool isCullingOnGpu() const
+    {
+        return gpuCulling && options.gpuCulling;
+    }
+
+    /// \brief Whether the static instances are drawn by multi-draw indirect calls.
+    /// \note The GPU culling path keeps its per-mesh indirect commands.
+    bool isBatching() const
+    {
+        return !isCullingOnGpu()
+            && options.multiDrawIndirect
+            && getGpuCapabilities().supportsMultiDrawIndirect();
     }
 
     Animation & currentAnimation()
@@ -170,6 +244,15 @@ struct Scene
         return animations.at(*activeAnimation);
     }
 
+    /// \brief Draw the full resolution indices of all meshes in `aOrder`, see Mesh::setIndexOrder().
+    void setIndexOrder(IndexOrder aOrder)
+    {
+        for(auto & [index, mesh] : indexToMesh)
+        {
+            mesh.mesh.setIndexOrder(aOrder);
+        }
+    }
+
     /// \brief Modify gltf Nodes with the updated local transforms.
     void updateAnimation(const graphics::Timer & aTimer)
     {
@@ -184,22 +267,458 @@ struct Scene
     {
         cameraSystem.clearGltfCameras();
         clearInstances(indexToMesh);
-        JointDrawer jointDrawer{.debugDrawer = debugDrawer, .options = options};
+        instanceHierarchy.beginUpdate();
+        JointDrawer jointDrawer{
+            .debugDrawer = debugDrawer,
+            .options = options,
+            .jointStack = JointDrawer::JointStack(frameArena.resource()),
+        };
         for (auto node : scene.iterate(&arte::gltf::Scene::nodes))
         {
             updatesInstances(node, jointDrawer);
         }
+        instanceHierarchy.endUpdate();
+    }
+
+
+    /// \brief Populate the mesh instance lists with the static instances to be drawn.
+    void cullInstances(const math::AffineMatrix<4, float> & aViewTransform,
+                       const math::Matrix<4, 4, float> & aProjectionTransform)
+    {
+        const math::Matrix<4, 4, float> viewProjection = aViewTransform * aProjectionTransform;
+
+        auto pushInstance = [](const InstanceHierarchy::Leaf & aLeaf)
+        {
+            aLeaf.meshInstances->instances.push_back(aLeaf.instance);
+            aLeaf.meshInstances->nonUniformScale |= !aLeaf.instance.hasUniformScale();
+        };
+
+        if (isCullingOnGpu())
+        {
+            // All instances are candidates, the actual culling is dispatched by uploadInstances().
+            // Note: The levels of detail are not selected on this path.
+            instanceHierarchy.forEach(pushInstance);
+            // The GPU counters are only read back a few frames later, see GpuCulling::getPreviousFrameStatistics().
+            gpuCulling->beginFrame();
+            const GpuCulling::Statistics & gpuStatistics = gpuCulling->getPreviousFrameStatistics();
+            statistics.culling = CullingStatistics{
+                .visibleInstances = gpuStatistics.visibleInstances,
+                .culledInstances = gpuStatistics.frustumCulledInstances,
+                .occludedInstances = gpuStatistics.occlusionCulledInstances,
+            };
+            return;
+        }
+
+        if (gpuCulling)
+        {
+            gpuCulling->invalidatePreviousFrame();
+        }
+
+        statistics.levelOfDetailInstances = {};
+        auto pushInstanceWithLevel = [&, this](const InstanceHierarchy::Leaf & aLeaf)
+        {
+            std::uint8_t level = selectLevelOfDetail(
+                getScreenCoverage(aLeaf.worldBox, aViewTransform, aProjectionTransform),
+                options.levelOfDetailCoverage);
+            ++statistics.levelOfDetailInstances[level];
+            aLeaf.meshInstances->instances.push_back(aLeaf.instance);
+            aLeaf.meshInstances->instanceLevels.push_back(level);
+            aLeaf.meshInstances->nonUniformScale |= !aLeaf.instance.hasUniformScale();
+        };
+
+        if (options.frustumCulling)
+        {
+            statistics.culling = options.levelOfDetail ?
+                instanceHierarchy.forEachVisible(viewProjection, pushInstanceWithLevel)
+                : instanceHierarchy.forEachVisible(viewProjection, pushInstance);
+        }
+        else
+        {
+            if (options.levelOfDetail)
+            {
+                instanceHierarchy.forEach(pushInstanceWithLevel);
+            }
+            else
+            {
+                instanceHierarchy.forEach(pushInstance);
+            }
+            statistics.culling = CullingStatistics{.visibleInstances = instanceHierarchy.size()};
+        }
+    }
 
+
+    /// \brief Select the visible meshlets of the meshes whose instances are at full resolution.
+    ///
+    /// The batched instances of a mesh are drawn by the same commands,
+    /// so a meshlet is drawn for all instances if it is visible from any of them.
+    void cullMeshlets(const math::AffineMatrix<4, float> & aViewTransform,
+                      const math::Matrix<4, 4, float> & aViewProjection)
+    {
+        statistics.meshlets = {};
+
+        // The view transformation is rigid, the camera position is its inverse translation.
+        math::Position<3, GLfloat> camera{0.f, 0.f, 0.f};
+        for (std::size_t axis = 0; axis != 3; ++axis)
+        {
+            for (std::size_t column = 0; column != 3; ++column)
+            {
+                camera[axis] -= aViewTransform.at(3, column) * aViewTransform.at(axis, column);
+            }
+        }
+
+        std::pmr::vector<MeshletCuller> cullers{frameArena.resource()};
         for(auto & [_index, mesh] : indexToMesh)
         {
-            // Update the VBO containing instance data with the client vector of instance data
-            mesh.mesh.gpuInstances.update(mesh.instances);
+            // The meshlets partition the optimized order of the indices.
+            if (mesh.mesh.indexOrder != IndexOrder::Optimized
+                || std::ranges::all_of(mesh.mesh.primitives,
+                                       [](const MeshPrimitive & aPrimitive) { return aPrimitive.meshlets.empty(); }))
+            {
+                continue;
+            }
+
+            cullers.clear();
+            for (std::size_t instanceId = 0; instanceId != mesh.instances.size(); ++instanceId)
+            {
+                if (mesh.instanceLevels.empty() || mesh.instanceLevels[instanceId] == 0)
+                {
+                    cullers.emplace_back(mesh.instances[instanceId].aModelRows, aViewProjection, camera);
+                }
+            }
+            if (cullers.empty() || cullers.size() > gMaxMeshletCulledInstances)
+            {
+                continue;
+            }
+
+            mesh.visibleMeshlets.resize(mesh.mesh.primitives.size());
+            for (std::size_t primitiveId = 0; primitiveId != mesh.mesh.primitives.size(); ++primitiveId)
+            {
+                const MeshPrimitive & primitive = mesh.mesh.primitives[primitiveId];
+                std::vector<GeometryArena::IndexRange> & runs = mesh.visibleMeshlets[primitiveId];
+                runs.clear();
+
+                for (const Meshlet & meshlet : primitive.meshlets)
+                {
+                    // Visible if any instance sees it, otherwise counted by the reason it was culled for.
+                    MeshletTest result = MeshletTest::OutsideFrustum;
+                    for (const MeshletCuller & culler : cullers)
+                    {
+                        MeshletTest test = culler.test(meshlet, !primitive.material.doubleSided);
+                        if (test == MeshletTest::Visible || test == MeshletTest::BackFacing)
+                        {
+                            result = test;
+                        }
+                        if (result == MeshletTest::Visible)
+                        {
+                            break;
+                        }
+                    }
+
+                    switch (result)
+                    {
+                    case MeshletTest::OutsideFrustum:
+                        ++statistics.meshlets.frustumCulledMeshlets;
+                        continue;
+                    case MeshletTest::BackFacing:
+                        ++statistics.meshlets.backFacingMeshlets;
+                        continue;
+                    case MeshletTest::Visible:
+                        ++statistics.meshlets.visibleMeshlets;
+                        break;
+                    }
+
+                    // Consecutive visible meshlets are drawn by a single command.
+                    const GLuint first = *primitive.firstIndex + meshlet.indexOffset;
+                    if (!runs.empty() && runs.back().firstIndex + runs.back().count == first)
+                    {
+                        runs.back().count += meshlet.indexCount;
+                    }
+                    else
+                    {
+                        runs.push_back({.type = primitive.indexType, .firstIndex = first, .count = meshlet.indexCount});
+                    }
+                }
+            }
+            mesh.meshletsCulled = true;
+        }
+    }
+
+
+    /// \brief Write the instances of a mesh sorted by level of detail, via a counting sort.
+    /// \param aDestination Receives all the instances of the mesh.
+    /// \return The count of instances at each level.
+    static std::array<GLsizei, gMaxLevelsOfDetail>
+    writeByLevel(const MeshInstances & aMeshInstances, std::span<InstanceList::Instance> aDestination)
+    {
+        std::array<GLsizei, gMaxLevelsOfDetail> levelCounts{};
+        if (aMeshInstances.instanceLevels.empty())
+        {
+            // Levels of detail are disabled, all instances are at full resolution.
+            levelCounts[0] = static_cast<GLsizei>(aMeshInstances.instances.size());
+            std::copy(aMeshInstances.instances.begin(), aMeshInstances.instances.end(), aDestination.begin());
+            return levelCounts;
+        }
+
+        for (std::uint8_t level : aMeshInstances.instanceLevels)
+        {
+            ++levelCounts[level];
+        }
+
+        std::array<std::size_t, gMaxLevelsOfDetail> nextSlot{0};
+        for (std::size_t level = 1; level != gMaxLevelsOfDetail; ++level)
+        {
+            nextSlot[level] = nextSlot[level - 1] + levelCounts[level - 1];
+        }
+
+        for (std::size_t instanceId = 0; instanceId != aMeshInstances.instances.size(); ++instanceId)
+        {
+            aDestination[nextSlot[aMeshInstances.instanceLevels[instanceId]]++] = aMeshInstances.instances[instanceId];
+        }
+        return levelCounts;
+    }
+
+
+    /// \brief The stream buffer receiving the per-frame data, null if it is not available or disabled.
+    StreamBuffer * getStream()
+    {
+        return options.persistentMapping ? renderer.getStream() : nullptr;
+    }
+
+
+    /// \brief Fill the instance list with `aCount` instances written by `aWrite`, returning their level counts.
+    ///
+    /// The instances are written directly in the stream buffer if possible,
+    /// otherwise they are staged in the frame arena and uploaded.
+    template <class F_write>
+    void writeInstances(InstanceList & aList, std::size_t aCount, F_write && aWrite)
+    {
+        if (StreamBuffer * stream = getStream())
+        {
+            if (auto mapped = aList.stream(*stream, static_cast<GLsizei>(aCount)))
+            {
+                aList.setLevelCounts(aWrite(*mapped));
+                return;
+            }
+        }
+
+        std::pmr::vector<InstanceList::Instance> staged(aCount, frameArena.resource());
+        std::array<GLsizei, gMaxLevelsOfDetail> levelCounts = aWrite(std::span{staged});
+        aList.update(staged, levelCounts);
+    }
+
+
+    /// \brief Upload the instances of a mesh sorted by level of detail.
+    void uploadInstancesByLevel(MeshInstances & aMeshInstances)
+    {
+        writeInstances(aMeshInstances.mesh.gpuInstances,
+                       aMeshInstances.instances.size(),
+                       [&aMeshInstances](std::span<InstanceList::Instance> aDestination)
+                       {
+                           return writeByLevel(aMeshInstances, aDestination);
+                       });
+    }
+
+
+    /// \brief Upload the instances of all meshes to the batched instances, recording the level ranges of each mesh.
+    void uploadBatchedInstances()
+    {
+        std::size_t total = 0;
+        for(auto & [_index, mesh] : indexToMesh)
+        {
+            total += mesh.instances.size();
+        }
+
+        writeInstances(batchedInstances,
+                       total,
+                       [this](std::span<InstanceList::Instance> aDestination)
+                       {
+                           GLsizei first = 0;
+                           for(auto & [_index, mesh] : indexToMesh)
+                           {
+                               std::array<GLsizei, gMaxLevelsOfDetail> levelCounts =
+                                   writeByLevel(mesh, aDestination.subspan(first, mesh.instances.size()));
+                               for (std::size_t level = 0; level != gMaxLevelsOfDetail; ++level)
+                               {
+                                   mesh.batchedLevelRanges[level] = {.first = first, .count = levelCounts[level]};
+                                   first += levelCounts[level];
+                               }
+                           }
+                           // The batched list is not split by level, each mesh records its own ranges.
+                           return std::array<GLsizei, gMaxLevelsOfDetail>{first};
+                       });
+    }
+
+
+    void uploadInstances(const math::Matrix<4, 4, float> & aViewProjection)
+    {
+        statistics.skinnedInstances = 0;
+        if (StreamBuffer * stream = getStream())
+        {
+            stream->beginFrame();
+        }
+
+        if (isCullingOnGpu() && options.occlusionCulling)
+        {
+            // Must happen before the candidates replace the previous frame results in the instance buffers.
+            gpuCulling->prepareOcclusion(
+                indexToMesh | std::views::values
+                            | std::views::transform([](const MeshInstances & aMesh) -> const Mesh &
+                                                    { return aMesh.mesh; }),
+                appInterface->getFramebufferSize(),
+                aViewProjection);
+        }
+
+        for(auto & [_index, mesh] : indexToMesh)
+        {
+            if (isCullingOnGpu())
+            {
+                mesh.mesh.gpuInstances.updateCandidates(mesh.instances);
+                gpuCulling->cull(mesh.mesh, aViewProjection, options.frustumCulling);
+            }
+            else if (!isBatching())
+            {
+                if (getStream() == nullptr && mesh.instanceLevels.empty())
+                {
+                    // Update the VBO containing instance data with the client vector of instance data
+                    mesh.mesh.gpuInstances.update(mesh.instances);
+                }
+                else
+                {
+                    uploadInstancesByLevel(mesh);
+                }
+            }
+            statistics.skinnedInstances += mesh.skinInstances.size();
+        }
+        if (isCullingOnGpu())
+        {
+            gpuCulling->endFrame();
+        }
+        else if (isBatching())
+        {
+            // All meshes share a single instance list when batching, so they can be drawn by the same calls.
+            uploadBatchedInstances();
         }
 
         for (auto & [_index, skeleton] : indexToSkeleton)
         {
             skeleton.updatePalette(nodeToJoint);
         }
+        uploadPalettes();
+
+        if (StreamBuffer * stream = getStream())
+        {
+            statistics.streamedBytes = stream->getFrameSize();
+            statistics.streamStalls = stream->getStallCount();
+        }
+        else
+        {
+            statistics.streamedBytes = 0;
+        }
+    }
+
+
+    /// \brief Pack the palettes of the skinned instances of each mesh, so each mesh is drawn by a single instanced call.
+    void uploadPalettes()
+    {
+        PaletteBuffer & palettes = renderer.getPalettes();
+
+        auto collectSkeletons = [this](const MeshInstances & aMesh, std::pmr::vector<const Skeleton *> & aSkeletons)
+        {
+            aSkeletons.clear();
+            for (auto skinId : aMesh.skinInstances)
+            {
+                aSkeletons.push_back(&indexToSkeleton.at(skinId));
+            }
+        };
+
+        // The total is required first, so the palettes are written in place.
+        // The skinned instances past the texture buffer size are not drawn this frame.
+        std::pmr::vector<const Skeleton *> skeletons{frameArena.resource()};
+        const std::size_t maxMatrixCount = PaletteBuffer::getMaxMatrixCount();
+        std::size_t matrixCount = 0;
+        std::size_t droppedInstances = 0;
+        for(auto & [_index, mesh] : indexToMesh)
+        {
+            collectSkeletons(mesh, skeletons);
+            if (const std::size_t stride = PaletteBuffer::getStride(skeletons);
+                matrixCount + stride * skeletons.size() > maxMatrixCount)
+            {
+                const std::size_t kept = (maxMatrixCount - matrixCount) / stride;
+                droppedInstances += mesh.skinInstances.size() - kept;
+                mesh.skinInstances.resize(kept);
+                collectSkeletons(mesh, skeletons);
+            }
+            matrixCount += PaletteBuffer::getStride(skeletons) * skeletons.size();
+        }
+
+        if (droppedInstances != 0 && !paletteBufferExceeded)
+        {
+            ADLOG(gDrawLogger, warn)
+                 ("The joint matrices exceed the texture buffer limit of {}, "
+                  "{} skinned instance(s) are not drawn.",
+                  maxMatrixCount, droppedInstances);
+        }
+        paletteBufferExceeded = (droppedInstances != 0);
+
+        palettes.begin(matrixCount, getStream());
+        for(auto & [_index, mesh] : indexToMesh)
+        {
+            if (!mesh.skinInstances.empty())
+            {
+                collectSkeletons(mesh, skeletons);
+                mesh.skinPalettes = palettes.append(skeletons);
+            }
+        }
+        palettes.upload();
+
+        preSkin();
+    }
+
+
+    /// \brief Skin the vertices of the meshes whose skinned instances are not current.
+    void preSkin()
+    {
+        statistics.preSkinnedMeshes = 0;
+        statistics.cachedSkinnedMeshes = 0;
+
+        for(auto & [_index, mesh] : indexToMesh)
+        {
+            if (!options.preSkinning)
+            {
+                // The poses are not followed while disabled.
+                mesh.skinnedVertices.valid = false;
+            }
+            else if (!mesh.skinInstances.empty()
+                     && !PreSkinning::fitsTextureBuffer(mesh.mesh, mesh.skinInstances.size()))
+            {
+                if (!mesh.skinnedVertices.exceedsTextureBuffer)
+                {
+                    ADLOG(gDrawLogger, warn)
+                         ("The {} skinned instance(s) of mesh '{}' exceed the texture buffer size, "
+                          "they are not pre-skinned.",
+                          mesh.skinInstances.size(), mesh.mesh);
+                }
+                mesh.skinnedVertices.valid = false;
+                mesh.skinnedVertices.exceedsTextureBuffer = true;
+            }
+            else if (!mesh.skinInstances.empty())
+            {
+                mesh.skinnedVertices.exceedsTextureBuffer = false;
+                const bool poseChanged = std::ranges::any_of(
+                    mesh.skinInstances,
+                    [this](auto aSkinId){ return indexToSkeleton.at(aSkinId).poseChanged; });
+
+                if (preSkinning.skin(mesh.mesh, mesh.skinInstances, mesh.skinPalettes, poseChanged,
+                                     renderer.getPalettes(), mesh.skinnedVertices))
+                {
+                    ++statistics.preSkinnedMeshes;
+                }
+                else
+                {
+                    ++statistics.cachedSkinnedMeshes;
+                }
+            }
+        }
     }
 
 
@@ -225,11 +744,17 @@ struct Scene
         {
             if(aNode->skin)
             {
+                // Skinned instances are not culled: their bounds depend on the joints.
                 indexToMesh.at(*aNode->mesh).skinInstances.push_back(*aNode->skin);
             }
             else
             {
-                indexToMesh.at(*aNode->mesh).instances.push_back({modelTransform});
+                MeshInstances & meshInstances = indexToMesh.at(*aNode->mesh);
+                // The positions may be quantized, their dequantization is folded into the instance transformation.
+                // The node index identifies the instance, see InstanceList::Instance.
+                const InstanceList::Instance instance{meshInstances.mesh.dequantization * modelTransform,
+                                                      static_cast<GLuint>(aNode.id())};
+                instanceHierarchy.updateLeaf(meshInstances, instance, meshInstances.mesh.boundingBox, modelTransform);
             }
         }
 
@@ -251,22 +776,88 @@ struct Scene
     }
 
 
-    void render() const
+    /// \brief Distance along the view direction of the farthest static instance, ordering the blended primitives.
+    static GLfloat getViewDepth(const MeshInstances & aMesh, const math::AffineMatrix<4, float> & aViewTransform)
     {
+        if (std::none_of(aMesh.mesh.primitives.begin(), aMesh.mesh.primitives.end(),
+                         [](const MeshPrimitive & aPrimitive)
+                         { return aPrimitive.material.alphaMode == arte::gltf::Material::AlphaMode::Blend; }))
+        {
+            return 0.f;
+        }
+
+        // The instance transformations apply to the stored positions, which may be quantized.
+        const math::Position<3, GLfloat> center = aMesh.mesh.storedBoundingBox.center();
+        GLfloat depth = 0.f;
+        for (const InstanceList::Instance & instance : aMesh.instances)
+        {
+            const math::Position<3, GLfloat> world = instance.transformPosition(center);
+            math::Position<4, GLfloat> view = 
+                math::Position<4, GLfloat>{world.x(), world.y(), world.z(), 1.f} * aViewTransform;
+            // The camera looks down the negative Z axis.
+            depth = std::max(depth, -view.z());
+        }
+        return depth;
+    }
+
+
+    void render()
+    {
+        const math::AffineMatrix<4, float> viewTransform = cameraSystem.getViewTransform();
+
         for(const auto & [index, mesh] : indexToMesh)
         {
             // Render "static" instances
             if(mesh.instances.size() != 0)
             {
-                renderer.render(mesh.mesh);
+                if (isCullingOnGpu())
+                {
+                    renderer.submitIndirect(mesh.mesh, getViewDepth(mesh, viewTransform), mesh.nonUniformScale);
+                }
+                else if (isBatching())
+                {
+                    renderer.submitBatched(mesh.mesh,
+                                           batchedInstances,
+                                           mesh.batchedLevelRanges,
+                                           mesh.meshletsCulled ?
+                                               std::span{mesh.visibleMeshlets}
+                                               : std::span<const std::vector<GeometryArena::IndexRange>>{},
+                                           getViewDepth(mesh, viewTransform),
+                                           mesh.nonUniformScale);
+                }
+                else
+                {
+                    renderer.submit(mesh.mesh, getViewDepth(mesh, viewTransform), mesh.nonUniformScale);
+                }
             }
 
             // Render skinned instances
-            for (auto skinId : mesh.skinInstances)
+            if (!mesh.skinInstances.empty())
             {
-                renderer.render(mesh.mesh, indexToSkeleton.at(skinId));
+                // The skinned bounds are not known, order by the farthest root joint.
+                GLfloat depth = 0.f;
+                bool nonUniformScale = false;
+                for (auto skinId : mesh.skinInstances)
+                {
+                    const Skeleton & skeleton = indexToSkeleton.at(skinId);
+                    nonUniformScale |= !skeleton.uniformScale;
+                    math::Position<4, GLfloat> root = 
+                        math::Position<4, GLfloat>{0.f, 0.f, 0.f, 1.f}
+                        * nodeToJoint.at(skeleton.joints.front()).worldTransform * viewTransform;
+                    depth = std::max(depth, -root.z());
+                }
+                // The vertices are not pre-skinned while disabled, or past the texture buffer size.
+                if (options.preSkinning && mesh.skinnedVertices.valid)
+                {
+                    renderer.submit(mesh.mesh, mesh.skinnedVertices, depth);
+                }
+                else
+                {
+                    renderer.submit(mesh.mesh, mesh.skinPalettes, depth, nonUniformScale);
+                }
             }
         }
+        statistics.rendering = renderer.flush();
 
         debugDrawer.render();
     }
@@ -323,12 +914,24 @@ struct Scene
     std::optional<std::size_t> activeAnimation;
     JointRepository nodeToJoint;
     Renderer renderer;
+    PreSkinning preSkinning;
     std::shared_ptr<graphics::AppInterface> appInterface;
     CameraSystem cameraSystem;
 
     UserOptions options;
+    FrameStatistics statistics;
+    // Set while the skinned instances are too many for the palette buffer, see uploadPalettes().
+    bool paletteBufferExceeded{false};
+    InstanceHierarchy instanceHierarchy;
+    // Only constructed if the OpenGL context supports it.
+    std::optional<GpuCulling> gpuCulling;
+    // The static instances of all meshes, see isBatching().
+    InstanceList batchedInstances;
     DebugDrawer debugDrawer;
     ImguiUi & imgui;
+
+    // Transient per-frame storage, reset once the frame is complete.
+    FrameArena frameArena;
 };
 
 } // namespace gltfviewer
@@ -0,0 +1,72 @@
+#pragma once
+
+
+#include <cstdint>
+#include <string>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Bitmask of the features a program permutation is specialized for.
+///
+/// Each feature is a preprocessor definition inserted in the shader sources,
+/// so the shaders do not branch on what the primitive provides, see definePermutation().
+using ShaderFeatures = std::uint32_t;
+
+
+//
+// Provided by the primitive.
+//
+constexpr ShaderFeatures gFeatureVertexColors             = 1 << 0;
+constexpr ShaderFeatures gFeatureBaseColorTexture         = 1 << 1;
+constexpr ShaderFeatures gFeatureMetallicRoughnessTexture = 1 << 2;
+constexpr ShaderFeatures gFeatureAlphaBlend               = 1 << 3;
+// The normals are octahedral encoded, see gQuantizedFormat.
+constexpr ShaderFeatures gFeatureOctahedralNormals        = 1 << 5;
+
+//
+// Provided by the instances.
+//
+// At least one instance has a non-uniform scale, its normals require a normal matrix.
+constexpr ShaderFeatures gFeatureNonUniformScale          = 1 << 4;
+
+//
+// Provided by the renderer.
+//
+// The debug color output value (see DebugColor) is stored on the 4 bits from this position.
+constexpr unsigned int gFeatureDebugOutputShift = 8;
+constexpr ShaderFeatures gFeatureDebugOutputMask = ShaderFeatures{0xF} << gFeatureDebugOutputShift;
+
+
+/// \brief Return the source with the definitions of the features inserted after its version directive.
+inline std::string definePermutation(const std::string & aSource, ShaderFeatures aFeatures)
+{
+    std::string definitions;
+    auto define = [&](ShaderFeatures aFeature, const char * aName)
+    {
+        if (aFeatures & aFeature)
+        {
+            definitions += std::string{"    #define "} + aName + "\n";
+        }
+    };
+
+    define(gFeatureVertexColors, "VERTEX_COLORS");
+    define(gFeatureBaseColorTexture, "BASE_COLOR_TEXTURE");
+    define(gFeatureMetallicRoughnessTexture, "METALLIC_ROUGHNESS_TEXTURE");
+    define(gFeatureAlphaBlend, "ALPHA_BLEND");
+    define(gFeatureNonUniformScale, "NON_UNIFORM_SCALE");
+    define(gFeatureOctahedralNormals, "OCTAHEDRAL_NORMALS");
+    definitions += "    #define DEBUG_OUTPUT "
+        + std::to_string((aFeatures & gFeatureDebugOutputMask) >> gFeatureDebugOutputShift) + "\n";
+
+    // The version directive must come first.
+    std::string result = aSource;
+    result.insert(result.find('\n', result.find("#version")) + 1, definitions);
+    return result;
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
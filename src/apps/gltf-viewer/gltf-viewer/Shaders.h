@@ -1,48 +1,155 @@
 #pragma once
 
 
+#include "ShadersMaterial.h"
+#include "ShadersSkinning.h"
+
+#include <string>
+
+
 namespace ad {
 namespace gltfviewer {
 
 
+//
+// Attributes of the static instances, see InstanceList::Instance.
+// Requires the u_camera uniform to be declared.
+//
+inline const std::string gInstanceAttributes = R"#(
+    // The first 3 rows of the affine model transformation, with the positions dequantization folded in.
+    layout(location=8) in vec4 in_modelRows[3];
+    #ifdef NON_UNIFORM_SCALE
+    layout(location=11) in mat3 in_normalTransform;
+    #endif
+    // Not read by the shading, available for picking and per-instance overrides.
+    layout(location=14) in uint in_instanceId;
+
+    mat4 getModelTransform()
+    {
+        return transpose(mat4(in_modelRows[0], in_modelRows[1], in_modelRows[2], vec4(0., 0., 0., 1.)));
+    }
+
+    // See gCofactor for the transformation of the normals.
+    vec3 transformNormal(mat4 aModelViewTransform, vec3 aNormal)
+    {
+    #ifdef NON_UNIFORM_SCALE
+        return normalize(mat3(u_camera) * (in_normalTransform * aNormal));
+    #else
+        return normalize(mat3(aModelViewTransform) * aNormal);
+    #endif
+    }
+)#";
+
+
+//
+// Decoding of the normal attribute, which is stored on 2 components if octahedral encoded.
+// Requires the ve_normal attribute to be declared.
+//
+inline const std::string gVertexNormal = R"#(
+    vec3 getVertexNormal()
+    {
+    #ifdef OCTAHEDRAL_NORMALS
+        // Fold back the lower half of the octahedron, see GeometryArena.
+        vec3 normal = vec3(ve_normal.xy, 1. - abs(ve_normal.x) - abs(ve_normal.y));
+        float folded = max(-normal.z, 0.);
+        normal.xy += vec2(normal.x >= 0. ? -folded : folded, normal.y >= 0. ? -folded : folded);
+        return normalize(normal);
+    #else
+        return ve_normal;
+    #endif
+    }
+)#";
+
+
 //
 // Phong shading(ambient, diffuse, specular)
 //
-inline const GLchar* gStaticVertexShader = R"#(
+inline const std::string gStaticVertexShader = R"#(
     #version 400
 
     layout(location=0) in vec4 ve_position;
     layout(location=1) in vec3 ve_normal;
     layout(location=2) in vec2 ve_baseColorUv;
     layout(location=3) in vec4 ve_color;
+    // Constant for each draw, see MaterialRepository.
+    layout(location=6) in uint in_materialIndex;
+
+    uniform mat4 u_camera;
+    uniform mat4 u_projection;
+)#" + gInstanceAttributes + gVertexNormal + R"#(
+
+    out vec4 ex_position_view;
+    out vec4 ex_normal_view;
+    out vec2 ex_baseColorUv;
+    out vec4 ex_color;
+    flat out uint ex_materialIndex;
+
+    void main(void)
+    {
+        mat4 modelViewTransform = u_camera * getModelTransform();
+        ex_position_view = modelViewTransform * ve_position;
+        ex_normal_view = vec4(transformNormal(modelViewTransform, getVertexNormal()), 0.);
+        ex_baseColorUv = ve_baseColorUv;
+    #ifdef VERTEX_COLORS
+        ex_color = ve_color;
+    #endif
+        ex_materialIndex = in_materialIndex;
+
+        gl_Position = u_projection * ex_position_view;
+    }
+)#";
 
-    layout(location=8) in mat4 in_modelTransform;
+
+/// \brief Static vertex shader for the multi-draw indirect calls, see BatchedDraw.
+///
+/// The material index cannot be a constant attribute for all the draws of a single call,
+/// it is read from the draw records indexed by the draw ID.
+inline const std::string gBatchedVertexShader = R"#(
+    #version 430
+    #extension GL_ARB_shader_draw_parameters : require
+
+    layout(location=0) in vec4 ve_position;
+    layout(location=1) in vec3 ve_normal;
+    layout(location=2) in vec2 ve_baseColorUv;
+    layout(location=3) in vec4 ve_color;
 
     uniform mat4 u_camera;
     uniform mat4 u_projection;
-    uniform vec4 u_vertexColorOffset;
+    // The base instance of each command offsets the instance attributes.
+)#" + gInstanceAttributes + gVertexNormal + R"#(
+    // Record of the first draw of the current multi-draw call.
+    uniform int u_firstDrawRecord;
+
+    layout(std430) readonly buffer DrawRecords
+    {
+        uint drawMaterialIndices[];
+    };
 
     out vec4 ex_position_view;
     out vec4 ex_normal_view;
     out vec2 ex_baseColorUv;
     out vec4 ex_color;
+    flat out uint ex_materialIndex;
 
     void main(void)
     {
-        mat4 modelViewTransform = u_camera * in_modelTransform;
+        uint materialIndex = drawMaterialIndices[u_firstDrawRecord + gl_DrawIDARB];
+
+        mat4 modelViewTransform = u_camera * getModelTransform();
         ex_position_view = modelViewTransform * ve_position;
-        ex_normal_view = vec4(
-            normalize(transpose(inverse(mat3(modelViewTransform))) * ve_normal),
-            0.);
+        ex_normal_view = vec4(transformNormal(modelViewTransform, getVertexNormal()), 0.);
         ex_baseColorUv = ve_baseColorUv;
-        ex_color = ve_color + u_vertexColorOffset;
+    #ifdef VERTEX_COLORS
+        ex_color = ve_color;
+    #endif
+        ex_materialIndex = materialIndex;
 
         gl_Position = u_projection * ex_position_view;
     }
 )#";
 
 
-inline const GLchar* gSkeletalVertexShader = R"#(
+inline const std::string gSkeletalVertexShader = R"#(
     #version 400
 
     layout(location=0) in vec4 ve_position;
@@ -51,51 +158,91 @@ inline const GLchar* gSkeletalVertexShader = R"#(
     layout(location=3) in vec4 ve_color;
     layout(location=4) in vec4 ve_joints; //TODO ivec4
     layout(location=5) in vec4 ve_weights;
+    // Constant for each draw, see MaterialRepository.
+    layout(location=6) in uint in_materialIndex;
 
-    // The client submit skinned geomatry via non-instanced draw calls,
-    // so the instance buffer is empty (attempting to access does crash).
-    // Also, the whole model to world transformation must be in the palette:
+    // The whole model to world transformation must be in the palette:
     // > Only the joint transforms are applied to the skinned mesh;
     // > the transform of the skinned mesh node MUST be ignored.
-    //layout(location=8) in mat4 in_modelTransform;
+    // So the skinned instances only differ by their palette, there is no instance attribute.
 
     uniform mat4 u_camera;
     uniform mat4 u_projection;
-    uniform vec4 u_vertexColorOffset;
-
-    layout(std140) uniform MatrixPalette
-    {
-        mat4 joints[64];
-    };
+)#" + gJointPalette + gSkinnedNormalTransform + R"#(
 
     out vec4 ex_position_view;
     out vec4 ex_normal_view;
     out vec2 ex_baseColorUv;
     out vec4 ex_color;
+    flat out uint ex_materialIndex;
 
     void main(void)
     {
-        mat4 skinningMatrix = 
-              joints[int(ve_joints.x)] * ve_weights.x
-            + joints[int(ve_joints.y)] * ve_weights.y
-            + joints[int(ve_joints.z)] * ve_weights.z
-            + joints[int(ve_joints.w)] * ve_weights.w;
+        mat4 skinningMatrix = getSkinningMatrix(ve_joints, ve_weights);
 
         mat4 modelViewTransform = u_camera * skinningMatrix;
         ex_position_view = modelViewTransform * ve_position;
-        ex_normal_view = vec4(
-            normalize(transpose(inverse(mat3(modelViewTransform))) * ve_normal),
-            0.);
+        ex_normal_view = vec4(transformNormal(modelViewTransform, ve_normal), 0.);
+        ex_baseColorUv = ve_baseColorUv;
+    #ifdef VERTEX_COLORS
+        ex_color = ve_color;
+    #endif
+        ex_materialIndex = in_materialIndex;
+
+        gl_Position = u_projection * ex_position_view;
+    }
+)#";
+
+
+/// \brief Draws the skinned instances from the vertices skinned by PreSkinning.
+inline const std::string gPreSkinnedVertexShader = R"#(
+    #version 400
+
+    // Position and normal are read from the skinned vertices.
+    layout(location=2) in vec2 ve_baseColorUv;
+    layout(location=3) in vec4 ve_color;
+    // Constant for each draw, see MaterialRepository.
+    layout(location=6) in uint in_materialIndex;
+
+    uniform mat4 u_camera;
+    uniform mat4 u_projection;
+
+    // World space position and normal of each skinned vertex (2 texels), instance after instance.
+    uniform samplerBuffer u_skinnedVertices;
+    // Skinned vertex of the primitive first vertex, for the first instance.
+    uniform int u_skinnedFirst;
+    uniform int u_baseVertex;
+    uniform int u_vertexCount;
+
+    out vec4 ex_position_view;
+    out vec4 ex_normal_view;
+    out vec2 ex_baseColorUv;
+    out vec4 ex_color;
+    flat out uint ex_materialIndex;
+
+    void main(void)
+    {
+        // gl_VertexID includes the base vertex.
+        int vertex = u_skinnedFirst + gl_InstanceID * u_vertexCount + (gl_VertexID - u_baseVertex);
+        vec4 position_world = texelFetch(u_skinnedVertices, 2 * vertex);
+        vec3 normal_world = texelFetch(u_skinnedVertices, 2 * vertex + 1).xyz;
+
+        ex_position_view = u_camera * position_world;
+        ex_normal_view = vec4(normalize(mat3(u_camera) * normal_world), 0.);
         ex_baseColorUv = ve_baseColorUv;
-        ex_color = ve_color + u_vertexColorOffset;
+    #ifdef VERTEX_COLORS
+        ex_color = ve_color;
+    #endif
+        ex_materialIndex = in_materialIndex;
 
         gl_Position = u_projection * ex_position_view;
     }
 )#";
 
 
-inline const GLchar* gPhongFragmentShader = R"#(
+inline const std::string gPhongFragmentShader = R"#(
     #version 400
+)#" + gMaterialBlock + R"#(
 
     struct Light
     {
@@ -111,11 +258,11 @@ inline const GLchar* gPhongFragmentShader = R"#(
     in vec4 ex_normal_view;
     in vec2 ex_baseColorUv;
     in vec4 ex_color;
+    flat in uint ex_materialIndex;
 
-    uniform vec4 u_baseColorFactor;
     uniform Light u_light;
     uniform mat4 u_camera;
-    uniform sampler2D u_baseColorTex;
+)#" + gMaterialSampling + R"#(
 
     out vec4 out_color;
 
@@ -127,10 +274,7 @@ inline const GLchar* gPhongFragmentShader = R"#(
 
     void main(void)
     {
-        vec4 materialColor = 
-            u_baseColorFactor * texture(u_baseColorTex, ex_baseColorUv)
-            * ex_color
-            ;
+        vec4 materialColor = getBaseColor(materials[ex_materialIndex]);
 
         vec4 n = normalize(ex_normal_view); // linear interpolation might shorten the normal
         vec4 lightDirection_view = normalize(u_camera * u_light.position_world - ex_position_view);
@@ -145,8 +289,7 @@ inline const GLchar* gPhongFragmentShader = R"#(
                     + u_light.ambient // ambient
                    )
             ,
-            materialColor.w);
-            //1.);
+            getOutputAlpha(materialColor));
 
         //out_color = n;
         //out_color = materialColor;
@@ -0,0 +1,244 @@
+#pragma once
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+//
+// GPU culling
+//
+inline const GLchar* gInstanceCullingComputeShader = R"#(
+    #version 430
+
+    layout(local_size_x = 64) in;
+
+    struct DrawCommand
+    {
+        uint count;
+        uint instanceCount;
+        uint first;
+        int baseVertex;
+        uint baseInstance;
+    };
+
+    // Matches InstanceList::Instance.
+    struct Instance
+    {
+        vec4 modelRows[3];
+        // Half floats, copied as is.
+        uvec2 normalTransform[3];
+        uint instanceId;
+        uint flags;
+    };
+
+    layout(std430, binding = 0) readonly buffer CandidateBlock
+    {
+        Instance candidates[];
+    };
+
+    layout(std430, binding = 1) writeonly buffer VisibleBlock
+    {
+        Instance visibles[];
+    };
+
+    layout(std430, binding = 2) buffer CommandBlock
+    {
+        DrawCommand commands[];
+    };
+
+    layout(std430, binding = 3) buffer StatisticsBlock
+    {
+        uint visibleCount;
+        uint frustumCulledCount;
+        uint occlusionCulledCount;
+    };
+
+    uniform mat4 u_viewProjection;
+    // Bounding box of the mesh, in model space.
+    uniform vec3 u_boxCenter;
+    uniform vec3 u_boxHalfExtent;
+    uniform int u_candidateCount;
+    uniform int u_primitiveCount;
+
+    uniform bool u_frustumCulling;
+    // Max-depth pyramid of the occluders, see HierarchicalDepth.
+    uniform bool u_occlusionCulling;
+    uniform sampler2D u_hiZ;
+
+    // Conservative test, the box is only outside if all its corners are outside the same plane.
+    bool isOutsideFrustum(mat4 modelViewProjection)
+    {
+        // Count of corners outside of each plane, in order: -x, +x, -y, +y, -z, +z.
+        int outside[6] = int[6](0, 0, 0, 0, 0, 0);
+        for (int corner = 0; corner != 8; ++corner)
+        {
+            vec3 direction = vec3(
+                (corner & 1) != 0 ? 1. : -1.,
+                (corner & 2) != 0 ? 1. : -1.,
+                (corner & 4) != 0 ? 1. : -1.);
+            vec4 clip = modelViewProjection * vec4(u_boxCenter + direction * u_boxHalfExtent, 1.);
+
+            outside[0] += int(clip.x < -clip.w);
+            outside[1] += int(clip.x >  clip.w);
+            outside[2] += int(clip.y < -clip.w);
+            outside[3] += int(clip.y >  clip.w);
+            outside[4] += int(clip.z < -clip.w);
+            outside[5] += int(clip.z >  clip.w);
+        }
+
+        for (int plane = 0; plane != 6; ++plane)
+        {
+            if (outside[plane] == 8)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Conservative test against the max depth of the occluders covering the box screen rectangle.
+    bool isOccluded(mat4 modelViewProjection)
+    {
+        vec3 ndcMin = vec3(1.);
+        vec3 ndcMax = vec3(-1.);
+        for (int corner = 0; corner != 8; ++corner)
+        {
+            vec3 direction = vec3(
+                (corner & 1) != 0 ? 1. : -1.,
+                (corner & 2) != 0 ? 1. : -1.,
+                (corner & 4) != 0 ? 1. : -1.);
+            vec4 clip = modelViewProjection * vec4(u_boxCenter + direction * u_boxHalfExtent, 1.);
+            // The box crosses the camera plane, its projection is unbounded.
+            if (clip.w <= 0.)
+            {
+                return false;
+            }
+            ndcMin = min(ndcMin, clip.xyz / clip.w);
+            ndcMax = max(ndcMax, clip.xyz / clip.w);
+        }
+
+        vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0., 1.);
+        vec2 uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0., 1.);
+
+        // Select the level where the rectangle spans at most 2x2 texels.
+        vec2 extent = (uvMax - uvMin) * vec2(textureSize(u_hiZ, 0));
+        int level = int(ceil(log2(max(max(extent.x, extent.y), 1.))));
+        level = min(level, textureQueryLevels(u_hiZ) - 1);
+
+        ivec2 levelSize = textureSize(u_hiZ, level);
+        ivec2 texelMin = min(ivec2(uvMin * vec2(levelSize)), levelSize - 1);
+        ivec2 texelMax = min(ivec2(uvMax * vec2(levelSize)), levelSize - 1);
+
+        float occluderDepth = max(
+            max(texelFetch(u_hiZ, texelMin, level).r,
+                texelFetch(u_hiZ, ivec2(texelMax.x, texelMin.y), level).r),
+            max(texelFetch(u_hiZ, ivec2(texelMin.x, texelMax.y), level).r,
+                texelFetch(u_hiZ, texelMax, level).r));
+
+        // Window depth of the closest point of the box, with the default depth range.
+        return (ndcMin.z * 0.5 + 0.5) > occluderDepth;
+    }
+
+    void main(void)
+    {
+        int candidateId = int(gl_GlobalInvocationID.x);
+        if (candidateId >= u_candidateCount)
+        {
+            return;
+        }
+
+        vec4 modelRows[3] = candidates[candidateId].modelRows;
+        mat4 modelTransform = transpose(mat4(modelRows[0], modelRows[1], modelRows[2], vec4(0., 0., 0., 1.)));
+        if (u_frustumCulling && isOutsideFrustum(u_viewProjection * modelTransform))
+        {
+            atomicAdd(frustumCulledCount, 1u);
+            return;
+        }
+        if (u_occlusionCulling && isOccluded(u_viewProjection * modelTransform))
+        {
+            atomicAdd(occlusionCulledCount, 1u);
+            return;
+        }
+
+        // All the primitives of the mesh are drawn with the same instances.
+        uint slot = atomicAdd(commands[0].instanceCount, 1u);
+        for (int primitiveId = 1; primitiveId < u_primitiveCount; ++primitiveId)
+        {
+            atomicAdd(commands[primitiveId].instanceCount, 1u);
+        }
+        atomicAdd(visibleCount, 1u);
+
+        visibles[slot] = candidates[candidateId];
+    }
+)#";
+
+
+//
+// Hierarchical depth
+//
+inline const GLchar* gDepthOnlyVertexShader = R"#(
+    #version 400
+
+    layout(location=0) in vec4 ve_position;
+
+    // The first 3 rows of the instance model transformation, see InstanceList::Instance.
+    layout(location=8) in vec4 in_modelRows[3];
+
+    uniform mat4 u_viewProjection;
+
+    void main(void)
+    {
+        mat4 modelTransform = transpose(mat4(in_modelRows[0], in_modelRows[1], in_modelRows[2], vec4(0., 0., 0., 1.)));
+        gl_Position = u_viewProjection * modelTransform * ve_position;
+    }
+)#";
+
+
+inline const GLchar* gDepthOnlyFragmentShader = R"#(
+    #version 400
+
+    void main(void)
+    {}
+)#";
+
+
+// Each destination texel receives the max of the source texels it covers.
+// Levels with odd dimensions make some destination texels cover 3 source texels on an axis.
+inline const GLchar* gDepthReductionComputeShader = R"#(
+    #version 430
+
+    layout(local_size_x = 8, local_size_y = 8) in;
+
+    uniform sampler2D u_source;
+    uniform int u_sourceLevel;
+    layout(r32f) uniform writeonly image2D u_destination;
+
+    void main(void)
+    {
+        ivec2 destinationSize = imageSize(u_destination);
+        ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+        if (any(greaterThanEqual(texel, destinationSize)))
+        {
+            return;
+        }
+
+        ivec2 sourceSize = textureSize(u_source, u_sourceLevel);
+        ivec2 first = (texel * sourceSize) / destinationSize;
+        ivec2 last = ((texel + 1) * sourceSize + destinationSize - 1) / destinationSize;
+
+        float depth = 0.;
+        for (int y = first.y; y != last.y; ++y)
+        {
+            for (int x = first.x; x != last.x; ++x)
+            {
+                depth = max(depth, texelFetch(u_source, ivec2(x, y), u_sourceLevel).r);
+            }
+        }
+        imageStore(u_destination, texel, vec4(depth));
+    }
+)#";
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,80 @@
+#pragma once
+
+
+#include <string>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+//
+// Material factors, see MaterialRepository.
+// The array size must match MaterialRepository::gMaterialsPerPage.
+//
+inline const std::string gMaterialBlock = R"#(
+    struct MaterialData
+    {
+        vec4 baseColorFactor;
+        float metallicFactor;
+        float roughnessFactor;
+        // Layers in the texture arrays, see TextureRepository.
+        uint baseColorLayer;
+        uint metallicRoughnessLayer;
+    };
+
+    layout(std140) uniform MaterialBlock
+    {
+        MaterialData materials[256];
+    };
+)#";
+
+
+//
+// Material sampling of the fragment shaders, specialized by the permutation features (see ShaderFeatures.h).
+// Requires the material block and the interpolated vertex attributes to be declared.
+//
+inline const std::string gMaterialSampling = R"#(
+    // Multiplies the material base color, e.g. to visualize the levels of detail.
+    uniform vec4 u_baseColorTint;
+    // The material entry provides the layers, see TextureRepository.
+    uniform sampler2DArray u_baseColorTex;
+    uniform sampler2DArray u_metallicRoughnessTex;
+
+    vec4 getBaseColor(MaterialData aMaterial)
+    {
+        vec4 color = aMaterial.baseColorFactor * u_baseColorTint;
+    #ifdef BASE_COLOR_TEXTURE
+        color *= texture(u_baseColorTex, vec3(ex_baseColorUv, aMaterial.baseColorLayer));
+    #endif
+    #ifdef VERTEX_COLORS
+        color *= ex_color;
+    #endif
+        return color;
+    }
+
+    // Returns metallic then roughness, clamped factors multiplied by the texture.
+    vec2 getMetallicRoughness(MaterialData aMaterial)
+    {
+        vec2 metallicRoughness = clamp(vec2(aMaterial.metallicFactor, aMaterial.roughnessFactor), 0.0, 1.0);
+    #ifdef METALLIC_ROUGHNESS_TEXTURE
+        metallicRoughness *=
+            texture(u_metallicRoughnessTex, vec3(ex_baseColorUv, aMaterial.metallicRoughnessLayer)).bg;
+    #endif
+        return metallicRoughness;
+    }
+
+    // The opaque primitives are drawn without blending, their alpha is irrelevant.
+    float getOutputAlpha(vec4 aMaterialColor)
+    {
+    #ifdef ALPHA_BLEND
+        return aMaterialColor.a;
+    #else
+        return 1.0;
+    #endif
+    }
+)#";
+
+
+} // namespace gltfviewer
+} // namespace ad
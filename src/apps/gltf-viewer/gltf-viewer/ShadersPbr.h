@@ -1,6 +1,9 @@
 #pragma once
 
 
+#include "ShadersMaterial.h"
+
+
 namespace ad {
 namespace gltfviewer {
 
@@ -80,12 +83,11 @@ in vec4 ex_position_view;
 in vec4 ex_normal_view;
 in vec2 ex_baseColorUv;
 in vec4 ex_color;
+flat in uint ex_materialIndex;
+
+)#" + gMaterialBlock + R"#(
 
-uniform vec4 u_baseColorFactor;
-uniform sampler2D u_baseColorTex;
-uniform float u_metallicFactor;
-uniform float u_roughnessFactor;
-uniform sampler2D u_metallicRoughnessTex;
+)#" + gMaterialSampling + R"#(
 
 out vec4 out_color;
 
@@ -93,17 +95,14 @@ out vec4 out_color;
 
 void main()
 {
-    vec4 materialColor = 
-        u_baseColorFactor * texture(u_baseColorTex, ex_baseColorUv)
-        * ex_color
-        ;
+    MaterialData material = materials[ex_materialIndex];
+    vec4 materialColor = getBaseColor(material);
 
     float specularWeight = 1.0;
     vec3 f90 = vec3(1.0); // see: https://www.khronos.org/registry/glTF/specs/2.0/glTF-2.0.html#metals
-    float metallic = clamp(u_metallicFactor, 0.0, 1.0);
-    float roughness = clamp(u_roughnessFactor, 0.0, 1.0);
-    metallic = metallic * texture(u_metallicRoughnessTex, ex_baseColorUv).b;
-    roughness = roughness * texture(u_metallicRoughnessTex, ex_baseColorUv).g;
+    vec2 metallicRoughness = getMetallicRoughness(material);
+    float metallic = metallicRoughness.x;
+    float roughness = metallicRoughness.y;
     
     vec3 c_diff = mix(materialColor.rgb, vec3(0), metallic);
     vec3 f0 = mix(vec3(0.04), materialColor.rgb, metallic);
@@ -129,7 +128,7 @@ void main()
         vec3 f_diffuse = intensity * NdotL *  BRDF_lambertian(f0, f90, c_diff, specularWeight, VdotH);
         vec3 f_specular = intensity * NdotL * BRDF_specularGGX(f0, f90, alphaRoughness, specularWeight, VdotH, NdotL, NdotV, NdotH);
 
-        out_color = vec4(f_diffuse + f_specular, materialColor.a);
+        out_color = vec4(f_diffuse + f_specular, getOutputAlpha(materialColor));
     //}
     //vec3 lamb = BRDF_lambertian(f0, f90, c_diff, specularWeight, VdotH);
     //vec3 spec = BRDF_specularGGX(f0, f90, alphaRoughness, specularWeight, VdotH, NdotL, NdotV, NdotH);
@@ -140,7 +139,7 @@ void main()
     //out_color = vec4(vec3(NdotL), materialColor.a);
     //out_color = vec4(vec3(NdotV), materialColor.a);
     //out_color = vec4(vec3(NdotH), materialColor.a);
-    //out_color = vec4(vec3(texture(u_metallicRoughnessTex, ex_baseColorUv)), materialColor.a);
+    //out_color = vec4(vec3(texture(u_metallicRoughnessTex, vec3(ex_baseColorUv, material.metallicRoughnessLayer))), materialColor.a);
     //out_color = vec4(vec3(roughness), materialColor.a);
     //out_color = vec4(vec3(metallic), materialColor.a);
 }
@@ -1,6 +1,9 @@
 #pragma once
 
 
+#include "ShadersMaterial.h"
+
+
 namespace ad {
 namespace gltfviewer {
 
@@ -63,17 +66,11 @@ in vec4 ex_position_view;
 in vec4 ex_normal_view;
 in vec2 ex_baseColorUv;
 in vec4 ex_color;
+flat in uint ex_materialIndex;
 
-uniform vec4 u_baseColorFactor;
-uniform sampler2D u_baseColorTex;
-uniform float u_metallicFactor;
-uniform float u_roughnessFactor;
-uniform sampler2D u_metallicRoughnessTex;
-
-uniform int u_debugOutput;
+)#" + gMaterialBlock + R"#(
 
-// Cannot use for switch case labels apparently
-#define METALLIC 1;
+)#" + gMaterialSampling + R"#(
 
 out vec4 out_color;
 
@@ -82,15 +79,12 @@ void main()
     vec3 n = normalize(vec3(ex_normal_view));
     vec3 v = normalize(-vec3(ex_position_view));
 
-    vec4 materialColor = 
-        u_baseColorFactor * texture(u_baseColorTex, ex_baseColorUv)
-        * ex_color
-        ;
+    MaterialData material = materials[ex_materialIndex];
+    vec4 materialColor = getBaseColor(material);
 
-    float metallic = clamp(u_metallicFactor, 0.0, 1.0);
-    float roughness = clamp(u_roughnessFactor, 0.0, 1.0);
-    metallic = metallic * texture(u_metallicRoughnessTex, ex_baseColorUv).b;
-    roughness = roughness * texture(u_metallicRoughnessTex, ex_baseColorUv).g;
+    vec2 metallicRoughness = getMetallicRoughness(material);
+    float metallic = metallicRoughness.x;
+    float roughness = metallicRoughness.y;
     
     // Implements a tinted reflection for metals, and a hardcoded "monochrome" reflection for dielectrics
     vec3 F0 = mix(vec3(0.04), materialColor.rgb, metallic);
@@ -126,9 +120,9 @@ void main()
 
     vec3 L0 = (diffuse + specular) * intensity * NdotL; 
 
-    switch(u_debugOutput)
+    // Defined by the permutation (see DebugColor), the switch is resolved at compile time.
+    switch(DEBUG_OUTPUT)
     {
-    //case METALLIC:
     case 1:
         out_color = vec4(vec3(metallic), 1.0);
         break;
@@ -169,7 +163,7 @@ void main()
         out_color = vec4(specular, 1.0);
         break;
     default:
-        out_color = vec4(L0, materialColor.a);
+        out_color = vec4(L0, getOutputAlpha(materialColor));
         break;
     }
 } 
@@ -0,0 +1,108 @@
+#pragma once
+
+
+#include <string>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+//
+// Joint matrices of the skinned instances, see PaletteBuffer.
+// The palette of an instance is found from gl_InstanceID.
+//
+inline const std::string gJointPalette = R"#(
+    // The joint matrices of all skinned instances, a matrix is 3 texels (its rows).
+    uniform samplerBuffer u_jointMatrices;
+    // First matrix of the palette of the first instance, and the count of matrices between two palettes.
+    uniform int u_paletteFirst;
+    uniform int u_paletteStride;
+
+    mat4 getJoint(float aJoint)
+    {
+        int texel = (u_paletteFirst + gl_InstanceID * u_paletteStride + int(aJoint)) * 3;
+        // The last row of the affine joint matrix is not stored.
+        return transpose(mat4(
+            texelFetch(u_jointMatrices, texel),
+            texelFetch(u_jointMatrices, texel + 1),
+            texelFetch(u_jointMatrices, texel + 2),
+            vec4(0., 0., 0., 1.)));
+    }
+
+    mat4 getSkinningMatrix(vec4 aJoints, vec4 aWeights)
+    {
+        return getJoint(aJoints.x) * aWeights.x
+             + getJoint(aJoints.y) * aWeights.y
+             + getJoint(aJoints.z) * aWeights.z
+             + getJoint(aJoints.w) * aWeights.w;
+    }
+)#";
+
+
+//
+// Normal transformation of the skinned vertices.
+// The skinning matrix is blended per vertex, so its normal matrix cannot be provided by the CPU.
+//
+// The normals are transformed by the inverse transpose of the linear part of a transformation.
+// All the shaders normalize the transformed normals, so any matrix proportional to it is enough:
+// * Without shear (rigid transformations such as the camera, or uniform scales), this is
+//   the linear part itself.
+// * Otherwise, this is the cofactor matrix, the inverse transpose scaled by the determinant.
+//   Its sign is that of the determinant, which is removed so mirroring transformations do not
+//   flip the normals.
+// The instance normal transformations are computed the same way on the CPU, see InstanceList::Instance.
+//
+inline const std::string gCofactor = R"#(
+    // Its columns are the cross products of the columns, which is much cheaper than an inverse.
+    mat3 getCofactor(mat3 aLinear)
+    {
+        mat3 cofactor = mat3(
+            cross(aLinear[1], aLinear[2]),
+            cross(aLinear[2], aLinear[0]),
+            cross(aLinear[0], aLinear[1]));
+        return dot(aLinear[0], cofactor[0]) < 0. ? -cofactor : cofactor;
+    }
+)#";
+
+
+inline const std::string gSkinnedNormalTransform = gCofactor + R"#(
+    vec3 transformNormal(mat4 aModelViewTransform, vec3 aNormal)
+    {
+    #ifdef NON_UNIFORM_SCALE
+        return normalize(getCofactor(mat3(aModelViewTransform)) * aNormal);
+    #else
+        return normalize(mat3(aModelViewTransform) * aNormal);
+    #endif
+    }
+)#";
+
+
+//
+// Pre-skinning, captured by transform feedback, see PreSkinning.
+//
+inline const std::string gPreSkinningVertexShader = R"#(
+    #version 400
+
+    layout(location=0) in vec4 ve_position;
+    layout(location=1) in vec3 ve_normal;
+    layout(location=4) in vec4 ve_joints;
+    layout(location=5) in vec4 ve_weights;
+)#" + gJointPalette + gCofactor + R"#(
+
+    // Captured interleaved, each a texel of the skinned vertices buffer.
+    out vec4 tf_position_world;
+    out vec4 tf_normal_world;
+
+    void main(void)
+    {
+        mat4 skinningMatrix = getSkinningMatrix(ve_joints, ve_weights);
+        tf_position_world = skinningMatrix * ve_position;
+        // Skinned once per frame, the single program handles any scale.
+        tf_normal_world = vec4(normalize(getCofactor(mat3(skinningMatrix)) * ve_normal), 0.);
+    }
+)#";
+
+
+} // namespace gltfviewer
+} // namespace ad
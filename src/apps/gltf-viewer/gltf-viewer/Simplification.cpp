@@ -0,0 +1,379 @@
+#include "Simplification.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    struct Vec3d
+    {
+        double x, y, z;
+    };
+
+    Vec3d toVec3d(const math::Position<3, GLfloat> & aPosition)
+    {
+        return {aPosition.x(), aPosition.y(), aPosition.z()};
+    }
+
+    Vec3d operator-(const Vec3d & aLhs, const Vec3d & aRhs)
+    {
+        return {aLhs.x - aRhs.x, aLhs.y - aRhs.y, aLhs.z - aRhs.z};
+    }
+
+    Vec3d cross(const Vec3d & aLhs, const Vec3d & aRhs)
+    {
+        return {
+            aLhs.y * aRhs.z - aLhs.z * aRhs.y,
+            aLhs.z * aRhs.x - aLhs.x * aRhs.z,
+            aLhs.x * aRhs.y - aLhs.y * aRhs.x,
+        };
+    }
+
+    double dot(const Vec3d & aLhs, const Vec3d & aRhs)
+    {
+        return aLhs.x * aRhs.x + aLhs.y * aRhs.y + aLhs.z * aRhs.z;
+    }
+
+
+    /// \brief Symmetric 4x4 matrix measuring the squared distance to a set of weighted planes.
+    struct Quadric
+    {
+        static Quadric FromPlane(const Vec3d & aNormal, double aDistance, double aWeight)
+        {
+            const double a = aNormal.x, b = aNormal.y, c = aNormal.z, d = aDistance;
+            Quadric result;
+            result.m = {a*a, a*b, a*c, a*d,
+                                 b*b, b*c, b*d,
+                                      c*c, c*d,
+                                           d*d};
+            for (double & value : result.m)
+            {
+                value *= aWeight;
+            }
+            result.weight = aWeight;
+            return result;
+        }
+
+        Quadric & operator+=(const Quadric & aRhs)
+        {
+            for (std::size_t id = 0; id != m.size(); ++id)
+            {
+                m[id] += aRhs.m[id];
+            }
+            weight += aRhs.weight;
+            return *this;
+        }
+
+        double error(const Vec3d & aV) const
+        {
+            const double x = aV.x, y = aV.y, z = aV.z;
+            return m[0]*x*x + 2*m[1]*x*y + 2*m[2]*x*z + 2*m[3]*x
+                 + m[4]*y*y + 2*m[5]*y*z + 2*m[6]*y
+                 + m[7]*z*z + 2*m[8]*z
+                 + m[9];
+        }
+
+        /// \brief The weighted mean of the squared distances, which does not depend on the weights scale.
+        double meanError(const Vec3d & aV) const
+        {
+            return weight > 0. ? error(aV) / weight : error(aV);
+        }
+
+        // Upper triangle, row major.
+        std::array<double, 10> m{};
+        // Sum of the planes weights.
+        double weight{0.};
+    };
+
+
+    struct Collapse
+    {
+        bool operator>(const Collapse & aRhs) const
+        { return cost > aRhs.cost; }
+
+        double cost;
+        GLuint from;
+        GLuint to;
+        std::uint32_t fromVersion;
+        std::uint32_t toVersion;
+    };
+
+
+    std::uint64_t edgeKey(GLuint aA, GLuint aB)
+    {
+        return aA < aB ? (std::uint64_t{aA} << 32 | aB) : (std::uint64_t{aB} << 32 | aA);
+    }
+
+
+    class Simplifier
+    {
+    public:
+        Simplifier(std::span<const math::Position<3, GLfloat>> aPositions,
+                   std::span<const GLuint> aIndices);
+
+        std::vector<GLuint> run(std::size_t aTargetIndexCount, double aMaxError);
+
+    private:
+        bool contains(std::size_t aTriangle, GLuint aVertex) const
+        {
+            const GLuint * triangle = &mTriangles[3 * aTriangle];
+            return triangle[0] == aVertex || triangle[1] == aVertex || triangle[2] == aVertex;
+        }
+
+        Vec3d normal(std::size_t aTriangle, GLuint aReplaced, const Vec3d & aReplacement) const;
+        void pushCandidate(GLuint aA, GLuint aB);
+        bool wouldFlip(GLuint aFrom, GLuint aTo) const;
+        void collapse(GLuint aFrom, GLuint aTo);
+
+        std::vector<Vec3d> mPositions;
+        std::vector<GLuint> mTriangles;
+        std::vector<bool> mRemovedTriangles;
+        std::size_t mLiveTriangles{0};
+
+        std::vector<Quadric> mQuadrics;
+        std::vector<std::vector<std::uint32_t>> mVertexTriangles;
+        std::vector<bool> mLocked;
+        std::vector<bool> mCollapsed;
+        std::vector<std::uint32_t> mVersions;
+
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> mCandidates;
+    };
+
+
+    Simplifier::Simplifier(std::span<const math::Position<3, GLfloat>> aPositions,
+                           std::span<const GLuint> aIndices) :
+        mTriangles{aIndices.begin(), aIndices.end()},
+        mRemovedTriangles(aIndices.size() / 3, false),
+        mQuadrics(aPositions.size()),
+        mVertexTriangles(aPositions.size()),
+        mLocked(aPositions.size(), false),
+        mCollapsed(aPositions.size(), false),
+        mVersions(aPositions.size(), 0)
+    {
+        mPositions.reserve(aPositions.size());
+        for (const auto & position : aPositions)
+        {
+            mPositions.push_back(toVec3d(position));
+        }
+
+        // Count the triangles sharing each edge.
+        std::unordered_map<std::uint64_t, std::uint32_t> edgeUses;
+        edgeUses.reserve(mTriangles.size());
+
+        for (std::size_t triangle = 0; triangle != mRemovedTriangles.size(); ++triangle)
+        {
+            const GLuint * v = &mTriangles[3 * triangle];
+            if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0])
+            {
+                mRemovedTriangles[triangle] = true;
+                continue;
+            }
+            ++mLiveTriangles;
+
+            Vec3d n = cross(mPositions[v[1]] - mPositions[v[0]], mPositions[v[2]] - mPositions[v[0]]);
+            const double doubleArea = std::sqrt(dot(n, n));
+            if (doubleArea > 0.)
+            {
+                n = {n.x / doubleArea, n.y / doubleArea, n.z / doubleArea};
+                // Area weighting, so large faces constrain their vertices more.
+                Quadric plane = Quadric::FromPlane(n, -dot(n, mPositions[v[0]]), doubleArea / 2.);
+                for (std::size_t corner = 0; corner != 3; ++corner)
+                {
+                    mQuadrics[v[corner]] += plane;
+                }
+            }
+
+            for (std::size_t corner = 0; corner != 3; ++corner)
+            {
+                mVertexTriangles[v[corner]].push_back(static_cast<std::uint32_t>(triangle));
+                ++edgeUses[edgeKey(v[corner], v[(corner + 1) % 3])];
+            }
+        }
+
+        // Border (single use) and non-manifold edges lock their vertices.
+        for (const auto & [key, uses] : edgeUses)
+        {
+            if (uses != 2)
+            {
+                mLocked[key >> 32] = true;
+                mLocked[key & 0xFFFFFFFF] = true;
+            }
+        }
+
+        for (const auto & [key, uses] : edgeUses)
+        {
+            pushCandidate(static_cast<GLuint>(key >> 32), static_cast<GLuint>(key & 0xFFFFFFFF));
+        }
+    }
+
+
+    Vec3d Simplifier::normal(std::size_t aTriangle, GLuint aReplaced, const Vec3d & aReplacement) const
+    {
+        std::array<Vec3d, 3> corners;
+        for (std::size_t corner = 0; corner != 3; ++corner)
+        {
+            GLuint vertex = mTriangles[3 * aTriangle + corner];
+            corners[corner] = (vertex == aReplaced) ? aReplacement : mPositions[vertex];
+        }
+        return cross(corners[1] - corners[0], corners[2] - corners[0]);
+    }
+
+
+    void Simplifier::pushCandidate(GLuint aA, GLuint aB)
+    {
+        if (mLocked[aA] && mLocked[aB])
+        {
+            return;
+        }
+
+        Quadric quadric = mQuadrics[aA];
+        quadric += mQuadrics[aB];
+
+        // Collapse onto the endpoint with the lowest error, as long as the other one can move.
+        constexpr double gForbidden = std::numeric_limits<double>::infinity();
+        const double costToB = mLocked[aA] ? gForbidden : quadric.meanError(mPositions[aB]);
+        const double costToA = mLocked[aB] ? gForbidden : quadric.meanError(mPositions[aA]);
+        const GLuint from = costToB <= costToA ? aA : aB;
+        const GLuint to = costToB <= costToA ? aB : aA;
+
+        mCandidates.push({
+            .cost = std::max(0., std::min(costToA, costToB)),
+            .from = from,
+            .to = to,
+            .fromVersion = mVersions[from],
+            .toVersion = mVersions[to],
+        });
+    }
+
+
+    bool Simplifier::wouldFlip(GLuint aFrom, GLuint aTo) const
+    {
+        for (std::uint32_t triangle : mVertexTriangles[aFrom])
+        {
+            if (mRemovedTriangles[triangle] || contains(triangle, aTo))
+            {
+                continue;
+            }
+            if (dot(normal(triangle, aFrom, mPositions[aFrom]), normal(triangle, aFrom, mPositions[aTo])) <= 0.)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    void Simplifier::collapse(GLuint aFrom, GLuint aTo)
+    {
+        for (std::uint32_t triangle : mVertexTriangles[aFrom])
+        {
+            if (mRemovedTriangles[triangle])
+            {
+                continue;
+            }
+
+            if (contains(triangle, aTo))
+            {
+                mRemovedTriangles[triangle] = true;
+                --mLiveTriangles;
+            }
+            else
+            {
+                for (std::size_t corner = 0; corner != 3; ++corner)
+                {
+                    if (mTriangles[3 * triangle + corner] == aFrom)
+                    {
+                        mTriangles[3 * triangle + corner] = aTo;
+                    }
+                }
+                mVertexTriangles[aTo].push_back(triangle);
+            }
+        }
+        mVertexTriangles[aFrom].clear();
+        mCollapsed[aFrom] = true;
+        mQuadrics[aTo] += mQuadrics[aFrom];
+
+        // Invalidate all candidates involving the target, then evaluate its new edges.
+        ++mVersions[aTo];
+        std::vector<GLuint> neighbours;
+        for (std::uint32_t triangle : mVertexTriangles[aTo])
+        {
+            if (mRemovedTriangles[triangle])
+            {
+                continue;
+            }
+            for (std::size_t corner = 0; corner != 3; ++corner)
+            {
+                GLuint vertex = mTriangles[3 * triangle + corner];
+                if (vertex != aTo && std::find(neighbours.begin(), neighbours.end(), vertex) == neighbours.end())
+                {
+                    neighbours.push_back(vertex);
+                }
+            }
+        }
+        for (GLuint neighbour : neighbours)
+        {
+            pushCandidate(aTo, neighbour);
+        }
+    }
+
+
+    std::vector<GLuint> Simplifier::run(std::size_t aTargetIndexCount, double aMaxError)
+    {
+        while (!mCandidates.empty() && 3 * mLiveTriangles > aTargetIndexCount)
+        {
+            Collapse candidate = mCandidates.top();
+            mCandidates.pop();
+
+            if (candidate.cost > aMaxError)
+            {
+                break;
+            }
+            if (mCollapsed[candidate.from] || mCollapsed[candidate.to]
+                || mVersions[candidate.from] != candidate.fromVersion
+                || mVersions[candidate.to] != candidate.toVersion
+                || wouldFlip(candidate.from, candidate.to))
+            {
+                continue;
+            }
+
+            collapse(candidate.from, candidate.to);
+        }
+
+        std::vector<GLuint> result;
+        result.reserve(3 * mLiveTriangles);
+        for (std::size_t triangle = 0; triangle != mRemovedTriangles.size(); ++triangle)
+        {
+            if (!mRemovedTriangles[triangle])
+            {
+                result.insert(result.end(), &mTriangles[3 * triangle], &mTriangles[3 * triangle] + 3);
+            }
+        }
+        return result;
+    }
+
+} // anonymous namespace
+
+
+std::vector<GLuint> simplify(std::span<const math::Position<3, GLfloat>> aPositions,
+                             std::span<const GLuint> aIndices,
+                             std::size_t aTargetIndexCount,
+                             GLfloat aMaxError)
+{
+    return Simplifier{aPositions, aIndices}.run(aTargetIndexCount, aMaxError);
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
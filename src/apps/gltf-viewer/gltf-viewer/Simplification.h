@@ -0,0 +1,33 @@
+#pragma once
+
+
+#include <math/Vector.h>
+
+#include <renderer/GL_Loader.h>
+
+#include <span>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Simplify an indexed triangle list by quadric error edge collapses (Garland & Heckbert).
+///
+/// Vertices are only collapsed onto existing vertices, so the result indexes the same vertex
+/// buffers as the input. The vertices on borders are locked, which also preserves the attribute
+/// seams (where vertices are split).
+///
+/// \param aTargetIndexCount Simplification stops once the index count is at most this value.
+/// \param aMaxError Collapses introducing a larger error are never performed. The error is the mean
+/// squared distance to the planes of the collapsed triangles, weighted by their areas,
+/// so it is in the squared unit of the positions whatever the size of the triangles.
+std::vector<GLuint> simplify(std::span<const math::Position<3, GLfloat>> aPositions,
+                             std::span<const GLuint> aIndices,
+                             std::size_t aTargetIndexCount,
+                             GLfloat aMaxError);
+
+
+} // namespace gltfviewer
+} // namespace ad
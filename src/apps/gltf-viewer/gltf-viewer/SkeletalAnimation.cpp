@@ -1,38 +1,21 @@
 #include "SkeletalAnimation.h"
 
 #include "LoadBuffer.h"
+#include "Logging.h"
+#include "Mesh.h"
 #include "Shaders.h"
 
+#include <algorithm>
+
 
 namespace ad {
 namespace gltfviewer {
 
 using Matrix = math::AffineMatrix<4, GLfloat>;
 
-JointMatrixPalette::JointMatrixPalette(std::size_t aMatrixCount)
-{
-    graphics::bind_guard bound{uniformBuffer};
-    glBufferData(GL_UNIFORM_BUFFER,
-        sizeof(Matrix) * aMatrixCount, 
-        nullptr,
-        GL_DYNAMIC_DRAW);
-}
-
-
-void JointMatrixPalette::update(std::span<Matrix> aMatrices)
-{
-    graphics::bind_guard bound{uniformBuffer};
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Matrix) * aMatrices.size(), aMatrices.data());
-}
-
-
 Skeleton::Skeleton(arte::Const_Owned<arte::gltf::Skin> aSkin) :
-    joints{aSkin->joints},
-    matrixPalette{aSkin->joints.size()}
+    joints{aSkin->joints}
 {
-    // The palette size upper limit is hardcoded in the vertex shader
-    assert(joints.size() <= 64);
-
     // TODO Ad 2022/04/01 Get rid of the useless copy.
     auto inverseBindAccessor = aSkin.get(&arte::gltf::Skin::inverseBindMatrices);
     // TODO Implement conversion for component types other than GL_FLOAT.
@@ -49,14 +32,155 @@ Skeleton::Skeleton(arte::Const_Owned<arte::gltf::Skin> aSkin) :
 
 void Skeleton::updatePalette(const JointRepository & aJoints)
 {
-    std::vector<Matrix> paletteData;
-    paletteData.reserve(joints.size());
-
+    poseChanged = (palette.size() != joints.size());
+    uniformScale = true;
+    palette.resize(joints.size());
     for (std::size_t jointId = 0; jointId != joints.size(); ++jointId)
     {
-        paletteData.push_back(inverseBindMatrices.at(jointId) * aJoints.at(joints.at(jointId)).worldTransform); 
+        Matrix joint = inverseBindMatrices.at(jointId) * aJoints.at(joints.at(jointId)).worldTransform; 
+        if (!poseChanged)
+        {
+            poseChanged = !std::equal(joint.data(), joint.data() + 16, palette[jointId].data());
+        }
+        palette[jointId] = joint;
+        uniformScale = uniformScale && hasUniformScale(joint);
     }
-    matrixPalette.update(paletteData);
+}
+
+
+PaletteBuffer::PaletteBuffer()
+{
+    // The buffer store can be reallocated, the texture keeps referencing the buffer object.
+    glBindTexture(GL_TEXTURE_BUFFER, mTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+
+PaletteBuffer::JointRows PaletteBuffer::pack(const Matrix & aMatrix)
+{
+    // The shaders read the matrix memory as column-major (it is not transposed on upload),
+    // so a row as seen by the shaders takes one element in each group of 4.
+    const GLfloat * data = aMatrix.data();
+    JointRows result;
+    for (std::size_t row = 0; row != 3; ++row)
+    {
+        for (std::size_t column = 0; column != 4; ++column)
+        {
+            result.rows[row][column] = data[column * 4 + row];
+        }
+    }
+    return result;
+}
+
+
+GLsizei PaletteBuffer::getStride(std::span<const Skeleton * const> aSkeletons)
+{
+    GLsizei stride = 0;
+    for (const Skeleton * skeleton : aSkeletons)
+    {
+        stride = std::max(stride, static_cast<GLsizei>(skeleton->palette.size()));
+    }
+    return stride;
+}
+
+
+std::size_t PaletteBuffer::getMaxMatrixCount()
+{
+    static const GLint gMaxTexels = []()
+    {
+        GLint result = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &result);
+        return result;
+    }();
+    // Each matrix is 3 texels.
+    return static_cast<std::size_t>(gMaxTexels) / 3;
+}
+
+
+void PaletteBuffer::begin(std::size_t aMatrixCount, StreamBuffer * aStream)
+{
+    if (aMatrixCount > getMaxMatrixCount())
+    {
+        throw std::logic_error{"Joint matrices exceed the texture buffer size."};
+    }
+
+    mSize = 0;
+    mStreamed.reset();
+    if (aStream != nullptr && aMatrixCount != 0)
+    {
+        // GL 4.3 enum, only queried on the streaming path (GL 4.4).
+        static const GLint gOffsetAlignment = []()
+        {
+            GLint result = 0;
+            glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &result);
+            return result;
+        }();
+
+        if (auto allocation = aStream->allocate<JointRows>(aMatrixCount, gOffsetAlignment))
+        {
+            mMatrices = allocation->values;
+            mStreamed = std::make_pair(aStream->getBuffer(), allocation->offset);
+            return;
+        }
+    }
+    mStaging.resize(aMatrixCount);
+    mMatrices = mStaging;
+}
+
+
+PaletteRange PaletteBuffer::append(std::span<const Skeleton * const> aSkeletons)
+{
+    PaletteRange range{
+        .first = static_cast<GLint>(mSize),
+        .stride = getStride(aSkeletons),
+        .count = static_cast<GLsizei>(aSkeletons.size()),
+    };
+
+    mSize += range.stride * aSkeletons.size();
+    if (mSize > mMatrices.size())
+    {
+        throw std::logic_error{"Palettes appended beyond the count reserved by begin()."};
+    }
+
+    auto destination = mMatrices.begin() + range.first;
+    for (const Skeleton * skeleton : aSkeletons)
+    {
+        std::transform(skeleton->palette.begin(), skeleton->palette.end(), destination, &PaletteBuffer::pack);
+        // The padding of the shorter palettes is never read, but is kept defined.
+        std::fill(destination + skeleton->palette.size(), destination + range.stride, pack(Matrix::Identity()));
+        destination += range.stride;
+    }
+    return range;
+}
+
+
+void PaletteBuffer::upload()
+{
+    if (mStreamed)
+    {
+        // Already in place, the texture views the range of this frame.
+        glBindTexture(GL_TEXTURE_BUFFER, mTexture);
+        glTexBufferRange(GL_TEXTURE_BUFFER, GL_RGBA32F,
+                         mStreamed->first, mStreamed->second, mSize * sizeof(JointRows));
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        return;
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, mBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, mSize * sizeof(JointRows), mStaging.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    // The texture might view the stream buffer, from a previous frame.
+    glBindTexture(GL_TEXTURE_BUFFER, mTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+
+void PaletteBuffer::bind(GLint aTextureUnit) const
+{
+    glActiveTexture(GL_TEXTURE0 + aTextureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, mTexture);
 }
 
 
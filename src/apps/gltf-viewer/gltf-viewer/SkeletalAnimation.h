@@ -1,15 +1,21 @@
 #pragma once
 
+#include "StreamBuffer.h"
+
 #include <arte/gltf/Gltf.h>
 
 #include <math/Homogeneous.h>
 
 #include <renderer/GL_Loader.h>
 #include <renderer/Shading.h>
-#include <renderer/UniformBuffer.h>
+#include <renderer/Texture.h>
+#include <renderer/VertexSpecification.h>
 
 #include <map>
+#include <optional>
 #include <span>
+#include <utility>
+#include <vector>
 
 
 namespace ad {
@@ -25,25 +31,89 @@ struct Joint
 using JointRepository = std::map<arte::gltf::Index<arte::gltf::Node>, Joint>;
 
 
-struct JointMatrixPalette
+struct Skeleton
 {
-    JointMatrixPalette(std::size_t aMatrixCount);
+    Skeleton(arte::Const_Owned<arte::gltf::Skin> aSkin);
 
-    void update(std::span<math::AffineMatrix<4, GLfloat>> aMatrices);
+    /// \brief Compute the joint matrices of the current pose, see PaletteBuffer for their upload.
+    /// Also records whether the pose changed since the previous update.
+    void updatePalette(const JointRepository & aJoints);
 
-    graphics::UniformBufferObject uniformBuffer;
+    std::vector<math::AffineMatrix<4, GLfloat>> inverseBindMatrices;
+    std::vector<arte::gltf::Index<arte::gltf::Node>> joints; // Another copy from gltf structs...
+    // The joint matrices, keeping their capacity from frame to frame.
+    std::vector<math::AffineMatrix<4, GLfloat>> palette;
+    bool poseChanged{true};
+    // Whether all the joint matrices scale uniformly, see hasUniformScale().
+    bool uniformScale{true};
 };
 
 
-struct Skeleton
+/// \brief Location of consecutive palettes in the PaletteBuffer, one per skinned instance.
+struct PaletteRange
 {
-    Skeleton(arte::Const_Owned<arte::gltf::Skin> aSkin);
+    // Index of the first matrix of the first palette.
+    GLint first{0};
+    // Count of matrices from a palette to the next.
+    GLsizei stride{0};
+    // Count of palettes, i.e. of instances.
+    GLsizei count{0};
+};
 
-    void updatePalette(const JointRepository & aJoints);
 
-    std::vector<math::AffineMatrix<4, GLfloat>> inverseBindMatrices;
-    std::vector<arte::gltf::Index<arte::gltf::Node>> joints; // Another copy from gltf structs...
-    JointMatrixPalette matrixPalette;
+/// \brief The joint matrices of all skinned instances of a frame, in a single texture buffer.
+///
+/// The palettes of the instances of a mesh are appended with a common stride,
+/// so the vertex shader finds the palette of an instance from gl_InstanceID.
+/// Joint matrices are affine, they are stored as their 3 non-constant rows (3 texels).
+/// There is no limit on the joint count per skeleton, only on the total count of joints
+/// per frame, see getMaxMatrixCount().
+///
+/// When a StreamBuffer is provided, the palettes are written directly in its mapped memory
+/// and the texture views this range. Otherwise they are staged and uploaded.
+class PaletteBuffer
+{
+public:
+    PaletteBuffer();
+
+    /// \brief Count of matrices from a palette to the next, when appending `aSkeletons`.
+    static GLsizei getStride(std::span<const Skeleton * const> aSkeletons);
+
+    /// \brief Count of matrices fitting the texture buffer (GL_MAX_TEXTURE_BUFFER_SIZE / 3).
+    static std::size_t getMaxMatrixCount();
+
+    /// \brief Discard the previous palettes, and reserve room for the matrices of a new frame.
+    /// \param aMatrixCount The total count of matrices appended in the frame, see getStride().
+    /// \param aStream If not null, the matrices are written in this stream buffer.
+    /// \pre `aMatrixCount` does not exceed getMaxMatrixCount().
+    void begin(std::size_t aMatrixCount, StreamBuffer * aStream);
+
+    /// \brief Append the palette of each skeleton, in order, padded to the largest of them.
+    PaletteRange append(std::span<const Skeleton * const> aSkeletons);
+
+    /// \brief Make the appended palettes available to the shaders, replacing the previous content.
+    void upload();
+
+    /// \brief Bind the texture buffer to `aTextureUnit`.
+    void bind(GLint aTextureUnit) const;
+
+private:
+    // The rows of an affine matrix as applied by the shaders, its last row being (0, 0, 0, 1).
+    struct JointRows
+    {
+        GLfloat rows[3][4];
+    };
+
+    static JointRows pack(const math::AffineMatrix<4, GLfloat> & aMatrix);
+
+    // The memory receiving the matrices of the frame, either streamed or mStaging.
+    std::span<JointRows> mMatrices;
+    std::size_t mSize{0};
+    // The buffer and offset of mMatrices, if streamed.
+    std::optional<std::pair<GLuint, GLintptr>> mStreamed;
+    std::vector<JointRows> mStaging;
+    graphics::VertexBufferObject mBuffer;
+    graphics::Texture mTexture{GL_TEXTURE_BUFFER};
 };
 
 
@@ -0,0 +1,36 @@
+#pragma once
+
+
+#include "Culling.h"
+#include "LevelOfDetail.h"
+#include "Meshlet.h"
+#include "RenderQueue.h"
+
+#include <array>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Counters collected while producing a frame, for display in the statistics overlay.
+struct FrameStatistics
+{
+    CullingStatistics culling;
+    std::size_t skinnedInstances{0};
+    // Meshes skinned by PreSkinning this frame, and those whose skinned vertices were still current.
+    std::size_t preSkinnedMeshes{0};
+    std::size_t cachedSkinnedMeshes{0};
+    // Bytes written in place in the StreamBuffer this frame, and the count of frames it waited for the GPU.
+    std::size_t streamedBytes{0};
+    std::size_t streamStalls{0};
+    // Static instances drawn at each level of detail, only counted when selecting levels.
+    std::array<std::size_t, gMaxLevelsOfDetail> levelOfDetailInstances{};
+    // Only counted when the meshlets are culled.
+    MeshletStatistics meshlets;
+    RenderStatistics rendering;
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,136 @@
+#include "StreamBuffer.h"
+
+#include "Logging.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    // Keeps the regions aligned for any offset alignment required by the implementation.
+    constexpr GLsizeiptr gRegionAlignment = 256;
+
+    GLsizeiptr alignUp(GLsizeiptr aValue, GLsizeiptr aAlignment)
+    {
+        return (aValue + aAlignment - 1) & ~(aAlignment - 1);
+    }
+
+} // anonymous namespace
+
+
+StreamBuffer::StreamBuffer(GLsizeiptr aFrameCapacity)
+{
+    allocateStorage(aFrameCapacity);
+}
+
+
+StreamBuffer::~StreamBuffer()
+{
+    // The mapping is released with the buffer.
+    for (GLsync fence : mFences)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+        }
+    }
+}
+
+
+void StreamBuffer::allocateStorage(GLsizeiptr aFrameCapacity)
+{
+    mFrameCapacity = alignUp(aFrameCapacity, gRegionAlignment);
+    // Immutable storage, so a larger capacity requires a new buffer object.
+    mBuffer = graphics::VertexBufferObject{};
+
+    constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+    glBufferStorage(GL_ARRAY_BUFFER, mFrameCapacity * gFrameCount, nullptr, flags);
+    mMapping = static_cast<std::byte *>(
+        glMapBufferRange(GL_ARRAY_BUFFER, 0, mFrameCapacity * gFrameCount, flags));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (mMapping == nullptr)
+    {
+        throw std::logic_error{"Cannot persistently map the stream buffer."};
+    }
+}
+
+
+void StreamBuffer::wait(GLsync & aFence)
+{
+    GLenum status = glClientWaitSync(aFence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        ++mStalls;
+        do
+        {
+            // 1 second, then try again.
+            status = glClientWaitSync(aFence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000);
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+
+    if (status == GL_WAIT_FAILED)
+    {
+        throw std::logic_error{"Waiting on a stream buffer fence failed."};
+    }
+    glDeleteSync(aFence);
+    aFence = nullptr;
+}
+
+
+void StreamBuffer::beginFrame()
+{
+    // All the commands reading the region of the previous frame have been issued.
+    mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    if (mOverflow != 0)
+    {
+        const GLsizeiptr capacity = std::max(2 * mFrameCapacity, mCursor + mOverflow);
+        ADLOG(gDrawLogger, info)
+             ("A frame required {} bytes in the stream buffer, growing the frame capacity to {} bytes.",
+              mCursor + mOverflow, capacity);
+
+        for (GLsync & fence : mFences)
+        {
+            if (fence)
+            {
+                wait(fence);
+            }
+        }
+        allocateStorage(capacity);
+        mRegion = 0;
+        mCursor = 0;
+        mOverflow = 0;
+        return;
+    }
+
+    mRegion = (mRegion + 1) % gFrameCount;
+    if (mFences[mRegion])
+    {
+        wait(mFences[mRegion]);
+    }
+    mCursor = 0;
+}
+
+
+std::optional<GLintptr> StreamBuffer::allocateBytes(GLsizeiptr aSize, GLintptr aAlignment)
+{
+    const GLintptr offset = alignUp(mCursor, aAlignment);
+    if (offset + aSize > mFrameCapacity)
+    {
+        mOverflow += aSize + aAlignment;
+        return std::nullopt;
+    }
+    mCursor = offset + aSize;
+    return mRegion * mFrameCapacity + offset;
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
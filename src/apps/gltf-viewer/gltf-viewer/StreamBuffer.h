@@ -0,0 +1,107 @@
+#pragma once
+
+
+#include <renderer/GL_Loader.h>
+#include <renderer/VertexSpecification.h>
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <span>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Values written by the CPU in the StreamBuffer, at `offset` in its buffer object.
+template <class T_value>
+struct StreamSpan
+{
+    std::span<T_value> values;
+    GLintptr offset;
+};
+
+
+/// \brief A buffer persistently and coherently mapped, in which each frame writes its transient data.
+///
+/// The buffer is split in gFrameCount regions, used by consecutive frames in turn.
+/// A fence is inserted when a frame is done with its region, and waited on before the region is
+/// written again, so the CPU never overwrites data the GPU has still to read.
+/// Allocations are written in place: there is no client-side copy, no driver copy, and no orphaning.
+///
+/// If a frame exhausts its region, allocate() fails and the caller uploads by other means.
+/// The regions are grown on the next beginFrame() so following frames do not overflow again.
+///
+/// \attention Requires buffer storage (OpenGL 4.4), see GpuCapabilities::supportsPersistentMapping().
+class StreamBuffer
+{
+public:
+    explicit StreamBuffer(GLsizeiptr aFrameCapacity = gDefaultFrameCapacity);
+    ~StreamBuffer();
+
+    StreamBuffer(const StreamBuffer &) = delete;
+    StreamBuffer & operator=(const StreamBuffer &) = delete;
+
+    /// \brief Fence the region of the previous frame, and move to the next region, waiting until the GPU releases it.
+    /// \attention Invalidates all the spans previously allocated.
+    void beginFrame();
+
+    /// \brief Provide memory for `aCount` values, read by the GPU commands of the current frame.
+    /// \param aAlignment Alignment of the offset in the buffer, a power of two.
+    /// \return Empty if the region of the frame is exhausted.
+    template <class T_value>
+    std::optional<StreamSpan<T_value>> allocate(std::size_t aCount, GLintptr aAlignment = alignof(T_value));
+
+    GLuint getBuffer() const
+    { return mBuffer; }
+
+    /// \brief Bytes allocated in the current frame.
+    GLsizeiptr getFrameSize() const
+    { return mCursor; }
+
+    /// \brief Count of beginFrame() which had to wait for the GPU, since construction.
+    std::size_t getStallCount() const
+    { return mStalls; }
+
+    static constexpr std::size_t gFrameCount = 3;
+    static constexpr GLsizeiptr gDefaultFrameCapacity = 1024 * 1024;
+
+private:
+    std::optional<GLintptr> allocateBytes(GLsizeiptr aSize, GLintptr aAlignment);
+
+    /// \brief (Re)create the buffer storage and map it.
+    /// \pre The GPU is done with the previous storage.
+    void allocateStorage(GLsizeiptr aFrameCapacity);
+
+    /// \brief Block until the GPU passed the fence, then delete it.
+    void wait(GLsync & aFence);
+
+    graphics::VertexBufferObject mBuffer;
+    std::byte * mMapping{nullptr};
+    GLsizeiptr mFrameCapacity;
+    std::array<GLsync, gFrameCount> mFences{};
+    std::size_t mRegion{0};
+    GLsizeiptr mCursor{0};
+    // Bytes requested beyond the frame capacity, in the current frame.
+    GLsizeiptr mOverflow{0};
+    std::size_t mStalls{0};
+};
+
+
+template <class T_value>
+std::optional<StreamSpan<T_value>> StreamBuffer::allocate(std::size_t aCount, GLintptr aAlignment)
+{
+    if (std::optional<GLintptr> offset = allocateBytes(sizeof(T_value) * aCount, aAlignment))
+    {
+        return StreamSpan<T_value>{
+            .values = {reinterpret_cast<T_value *>(mMapping + *offset), aCount},
+            .offset = *offset,
+        };
+    }
+    return std::nullopt;
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
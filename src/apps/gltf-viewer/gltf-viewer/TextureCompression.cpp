@@ -0,0 +1,414 @@
+#include "TextureCompression.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    constexpr std::size_t gBlockSize = 4;
+    constexpr std::size_t gBlockTexels = gBlockSize * gBlockSize;
+
+    using Color = std::array<float, 3>;
+    // The RGBA texels of a block, row by row.
+    using Block = std::array<std::array<std::uint8_t, 4>, gBlockTexels>;
+
+
+    float dot(const Color & aLhs, const Color & aRhs)
+    {
+        return aLhs[0] * aRhs[0] + aLhs[1] * aRhs[1] + aLhs[2] * aRhs[2];
+    }
+
+
+    float getSquaredDistance(const Color & aLhs, const Color & aRhs)
+    {
+        const Color difference{aLhs[0] - aRhs[0], aLhs[1] - aRhs[1], aLhs[2] - aRhs[2]};
+        return dot(difference, difference);
+    }
+
+
+    Color getColor(const std::array<std::uint8_t, 4> & aTexel)
+    {
+        return {static_cast<float>(aTexel[0]), static_cast<float>(aTexel[1]), static_cast<float>(aTexel[2])};
+    }
+
+
+    std::uint16_t toRgb565(const Color & aColor)
+    {
+        auto quantize = [](float aValue, int aMax)
+        {
+            return static_cast<std::uint16_t>(std::lround(std::clamp(aValue, 0.f, 255.f) * aMax / 255.f));
+        };
+        return static_cast<std::uint16_t>(
+            (quantize(aColor[0], 31) << 11) | (quantize(aColor[1], 63) << 5) | quantize(aColor[2], 31));
+    }
+
+
+    /// \brief The color decoded by the GPU, the high bits being replicated in the low bits.
+    Color fromRgb565(std::uint16_t aColor)
+    {
+        const unsigned int red = (aColor >> 11) & 0x1F;
+        const unsigned int green = (aColor >> 5) & 0x3F;
+        const unsigned int blue = aColor & 0x1F;
+        return {static_cast<float>((red << 3) | (red >> 2)),
+                static_cast<float>((green << 2) | (green >> 4)),
+                static_cast<float>((blue << 3) | (blue >> 2))};
+    }
+
+
+    struct ColorEncoding
+    {
+        std::uint16_t color0;
+        std::uint16_t color1;
+        std::array<std::uint8_t, gBlockTexels> indices;
+        float error;
+    };
+
+
+    /// \brief Assign each texel to the nearest color of the 4 colors palette interpolated from the endpoints.
+    /// \note The endpoints are ordered so color0 > color1, which selects the 4 colors mode.
+    ColorEncoding encodeIndices(const Block & aBlock, std::uint16_t aColor0, std::uint16_t aColor1)
+    {
+        ColorEncoding result{
+            .color0 = std::max(aColor0, aColor1),
+            .color1 = std::min(aColor0, aColor1),
+            .indices{},
+            .error = 0.f,
+        };
+
+        const Color c0 = fromRgb565(result.color0);
+        const Color c1 = fromRgb565(result.color1);
+        // Palette by index: color0, color1, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1.
+        std::array<Color, 4> palette{c0, c1, c0, c0};
+        for (std::size_t channel = 0; channel != 3; ++channel)
+        {
+            palette[2][channel] = (2.f * c0[channel] + c1[channel]) / 3.f;
+            palette[3][channel] = (c0[channel] + 2.f * c1[channel]) / 3.f;
+        }
+        // Equal endpoints select the 3 colors mode, where the index 0 is still color0.
+        const std::size_t paletteSize = result.color0 == result.color1 ? 1 : 4;
+
+        for (std::size_t texel = 0; texel != gBlockTexels; ++texel)
+        {
+            const Color color = getColor(aBlock[texel]);
+            float best = std::numeric_limits<float>::max();
+            for (std::size_t index = 0; index != paletteSize; ++index)
+            {
+                if (const float distance = getSquaredDistance(color, palette[index]); distance < best)
+                {
+                    best = distance;
+                    result.indices[texel] = static_cast<std::uint8_t>(index);
+                }
+            }
+            result.error += best;
+        }
+        return result;
+    }
+
+
+    /// \brief The endpoints minimizing the squared error for the current indices.
+    /// \return False if the indices do not constrain both endpoints.
+    bool refineEndpoints(const Block & aBlock, const ColorEncoding & aEncoding, Color & aColor0, Color & aColor1)
+    {
+        // Weight of color0 for each index, color1 having the complement.
+        constexpr std::array<float, 4> weights{1.f, 0.f, 2.f / 3.f, 1.f / 3.f};
+
+        float a = 0.f, b = 0.f, c = 0.f;
+        Color rhs0{0.f, 0.f, 0.f};
+        Color rhs1{0.f, 0.f, 0.f};
+        for (std::size_t texel = 0; texel != gBlockTexels; ++texel)
+        {
+            const float w = weights[aEncoding.indices[texel]];
+            const Color color = getColor(aBlock[texel]);
+            a += w * w;
+            b += w * (1.f - w);
+            c += (1.f - w) * (1.f - w);
+            for (std::size_t channel = 0; channel != 3; ++channel)
+            {
+                rhs0[channel] += w * color[channel];
+                rhs1[channel] += (1.f - w) * color[channel];
+            }
+        }
+
+        const float determinant = a * c - b * b;
+        if (std::abs(determinant) < 1e-6f)
+        {
+            return false;
+        }
+        for (std::size_t channel = 0; channel != 3; ++channel)
+        {
+            aColor0[channel] = (c * rhs0[channel] - b * rhs1[channel]) / determinant;
+            aColor1[channel] = (a * rhs1[channel] - b * rhs0[channel]) / determinant;
+        }
+        return true;
+    }
+
+
+    ColorEncoding encodeColors(const Block & aBlock)
+    {
+        Color mean{0.f, 0.f, 0.f};
+        for (const auto & texel : aBlock)
+        {
+            const Color color = getColor(texel);
+            for (std::size_t channel = 0; channel != 3; ++channel)
+            {
+                mean[channel] += color[channel] / gBlockTexels;
+            }
+        }
+
+        std::array<std::array<float, 3>, 3> covariance{};
+        for (const auto & texel : aBlock)
+        {
+            const Color color = getColor(texel);
+            for (std::size_t row = 0; row != 3; ++row)
+            {
+                for (std::size_t column = 0; column != 3; ++column)
+                {
+                    covariance[row][column] += (color[row] - mean[row]) * (color[column] - mean[column]);
+                }
+            }
+        }
+
+        // The principal axis by power iteration, starting from the luminance direction.
+        Color axis{0.299f, 0.587f, 0.114f};
+        for (int iteration = 0; iteration != 8; ++iteration)
+        {
+            Color next{dot(covariance[0], axis), dot(covariance[1], axis), dot(covariance[2], axis)};
+            const float length = std::sqrt(dot(next, next));
+            if (length < 1e-6f)
+            {
+                break;
+            }
+            axis = {next[0] / length, next[1] / length, next[2] / length};
+        }
+
+        // The extreme texels along the axis are the initial endpoints.
+        float minProjection = std::numeric_limits<float>::max();
+        float maxProjection = std::numeric_limits<float>::lowest();
+        Color color0 = mean;
+        Color color1 = mean;
+        for (const auto & texel : aBlock)
+        {
+            const Color color = getColor(texel);
+            const float projection = dot(color, axis);
+            if (projection > maxProjection)
+            {
+                maxProjection = projection;
+                color0 = color;
+            }
+            if (projection < minProjection)
+            {
+                minProjection = projection;
+                color1 = color;
+            }
+        }
+
+        ColorEncoding result = encodeIndices(aBlock, toRgb565(color0), toRgb565(color1));
+        if (result.error > 0.f && refineEndpoints(aBlock, result, color0, color1))
+        {
+            if (ColorEncoding refined = encodeIndices(aBlock, toRgb565(color0), toRgb565(color1));
+                refined.error < result.error)
+            {
+                result = refined;
+            }
+        }
+        return result;
+    }
+
+
+    void writeColorBlock(const ColorEncoding & aEncoding, std::byte * aDestination)
+    {
+        std::uint32_t indices = 0;
+        for (std::size_t texel = 0; texel != gBlockTexels; ++texel)
+        {
+            indices |= std::uint32_t{aEncoding.indices[texel]} << (2 * texel);
+        }
+        // The block is little endian.
+        const std::array<std::uint8_t, 8> bytes{
+            static_cast<std::uint8_t>(aEncoding.color0), static_cast<std::uint8_t>(aEncoding.color0 >> 8),
+            static_cast<std::uint8_t>(aEncoding.color1), static_cast<std::uint8_t>(aEncoding.color1 >> 8),
+            static_cast<std::uint8_t>(indices), static_cast<std::uint8_t>(indices >> 8),
+            static_cast<std::uint8_t>(indices >> 16), static_cast<std::uint8_t>(indices >> 24),
+        };
+        std::memcpy(aDestination, bytes.data(), bytes.size());
+    }
+
+
+    /// \brief The 8 alphas mode: the endpoints are the extreme alphas, with 6 alphas interpolated between.
+    void writeAlphaBlock(const Block & aBlock, std::byte * aDestination)
+    {
+        std::uint8_t alpha0 = 0;
+        std::uint8_t alpha1 = 255;
+        for (const auto & texel : aBlock)
+        {
+            alpha0 = std::max(alpha0, texel[3]);
+            alpha1 = std::min(alpha1, texel[3]);
+        }
+
+        std::uint64_t indices = 0;
+        if (alpha0 != alpha1)
+        {
+            for (std::size_t texel = 0; texel != gBlockTexels; ++texel)
+            {
+                // Position from alpha0 (0) to alpha1 (7), the interpolated alphas have the indices 2 to 7.
+                const long position = std::lround(7.f * (alpha0 - aBlock[texel][3]) / (alpha0 - alpha1));
+                const std::uint64_t index = position == 0 ? 0 : (position == 7 ? 1 : position + 1);
+                indices |= index << (3 * texel);
+            }
+        }
+
+        std::array<std::uint8_t, 8> bytes{alpha0, alpha1};
+        for (std::size_t byte = 0; byte != 6; ++byte)
+        {
+            bytes[2 + byte] = static_cast<std::uint8_t>(indices >> (8 * byte));
+        }
+        std::memcpy(aDestination, bytes.data(), bytes.size());
+    }
+
+
+    std::size_t getBlockBytes(GLenum aInternalFormat)
+    {
+        switch (aInternalFormat)
+        {
+        case gCompressedRgbBc1:
+            return 8;
+        case gCompressedRgbaBc3:
+            return 16;
+        }
+        throw std::logic_error{"Unhandled compressed texture format."};
+    }
+
+
+    /// \return The end of the written blocks.
+    std::byte * compressLevel(std::span<const std::uint8_t> aPixels,
+                              GLsizei aWidth,
+                              GLsizei aHeight,
+                              GLenum aInternalFormat,
+                              std::byte * aDestination)
+    {
+        for (GLsizei blockY = 0; blockY < aHeight; blockY += gBlockSize)
+        {
+            for (GLsizei blockX = 0; blockX < aWidth; blockX += gBlockSize)
+            {
+                // The partial blocks at the edges repeat the last row and column.
+                Block block;
+                for (std::size_t texel = 0; texel != gBlockTexels; ++texel)
+                {
+                    const GLsizei x = std::min<GLsizei>(blockX + texel % gBlockSize, aWidth - 1);
+                    const GLsizei y = std::min<GLsizei>(blockY + texel / gBlockSize, aHeight - 1);
+                    std::memcpy(block[texel].data(), aPixels.data() + (std::size_t(y) * aWidth + x) * 4, 4);
+                }
+
+                if (aInternalFormat == gCompressedRgbaBc3)
+                {
+                    writeAlphaBlock(block, aDestination);
+                    aDestination += 8;
+                }
+                writeColorBlock(encodeColors(block), aDestination);
+                aDestination += 8;
+            }
+        }
+        return aDestination;
+    }
+
+
+    /// \brief Average each 2x2 texels, an odd last row or column being averaged with itself.
+    std::vector<std::uint8_t> downsample(std::span<const std::uint8_t> aPixels, GLsizei aWidth, GLsizei aHeight)
+    {
+        const GLsizei width = std::max<GLsizei>(1, aWidth / 2);
+        const GLsizei height = std::max<GLsizei>(1, aHeight / 2);
+        std::vector<std::uint8_t> result(std::size_t(width) * height * 4);
+        for (GLsizei y = 0; y != height; ++y)
+        {
+            const GLsizei y0 = std::min(2 * y, aHeight - 1);
+            const GLsizei y1 = std::min(2 * y + 1, aHeight - 1);
+            for (GLsizei x = 0; x != width; ++x)
+            {
+                const GLsizei x0 = std::min(2 * x, aWidth - 1);
+                const GLsizei x1 = std::min(2 * x + 1, aWidth - 1);
+                for (std::size_t channel = 0; channel != 4; ++channel)
+                {
+                    auto texel = [&](GLsizei aX, GLsizei aY)
+                    {
+                        return unsigned{aPixels[(std::size_t(aY) * aWidth + aX) * 4 + channel]};
+                    };
+                    result[(std::size_t(y) * width + x) * 4 + channel] = static_cast<std::uint8_t>(
+                        (texel(x0, y0) + texel(x1, y0) + texel(x0, y1) + texel(x1, y1) + 2) / 4);
+                }
+            }
+        }
+        return result;
+    }
+
+} // anonymous namespace
+
+
+std::size_t getCompressedSize(GLenum aInternalFormat, GLsizei aWidth, GLsizei aHeight)
+{
+    return ((aWidth + gBlockSize - 1) / gBlockSize) * ((aHeight + gBlockSize - 1) / gBlockSize)
+           * getBlockBytes(aInternalFormat);
+}
+
+
+std::size_t getCompressedSize(GLenum aInternalFormat, GLsizei aWidth, GLsizei aHeight, GLsizei aLevels)
+{
+    std::size_t result = 0;
+    for (GLsizei level = 0; level != aLevels; ++level)
+    {
+        result += getCompressedSize(aInternalFormat,
+                                    std::max<GLsizei>(1, aWidth >> level),
+                                    std::max<GLsizei>(1, aHeight >> level));
+    }
+    return result;
+}
+
+
+CompressedImage compressImage(std::span<const std::uint8_t> aPixels,
+                              GLsizei aWidth,
+                              GLsizei aHeight,
+                              GLsizei aLevels)
+{
+    bool translucent = false;
+    for (std::size_t alpha = 3; alpha < aPixels.size(); alpha += 4)
+    {
+        translucent |= aPixels[alpha] != 255;
+    }
+
+    CompressedImage result{
+        .internalFormat = translucent ? gCompressedRgbaBc3 : gCompressedRgbBc1,
+        .width = aWidth,
+        .height = aHeight,
+        .levels = aLevels,
+    };
+    result.blocks.resize(getCompressedSize(result.internalFormat, aWidth, aHeight, aLevels));
+
+    std::byte * destination = result.blocks.data();
+    std::vector<std::uint8_t> level;
+    std::span<const std::uint8_t> pixels = aPixels;
+    GLsizei width = aWidth;
+    GLsizei height = aHeight;
+    for (GLsizei levelId = 0; levelId != aLevels; ++levelId)
+    {
+        destination = compressLevel(pixels, width, height, result.internalFormat, destination);
+        if (levelId + 1 != aLevels)
+        {
+            level = downsample(pixels, width, height);
+            pixels = level;
+            width = std::max<GLsizei>(1, width / 2);
+            height = std::max<GLsizei>(1, height / 2);
+        }
+    }
+    return result;
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,54 @@
+#pragma once
+
+
+#include <renderer/GL_Loader.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+// The S3TC formats are defined by GL_EXT_texture_compression_s3tc, not by the core profile.
+/// \brief BC1: opaque RGB in 4x4 blocks of 8 bytes.
+constexpr GLenum gCompressedRgbBc1 = 0x83F0;  // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+/// \brief BC3: RGBA in 4x4 blocks of 16 bytes, a BC1 color block after an interpolated alpha block.
+constexpr GLenum gCompressedRgbaBc3 = 0x83F3; // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+
+
+/// \brief A mipmap chain compressed in a block format, its levels stored consecutively.
+struct CompressedImage
+{
+    GLenum internalFormat;
+    GLsizei width;
+    GLsizei height;
+    GLsizei levels;
+    std::vector<std::byte> blocks;
+};
+
+
+/// \brief Size in bytes of a level of `aWidth` x `aHeight` texels, the partial blocks being complete.
+std::size_t getCompressedSize(GLenum aInternalFormat, GLsizei aWidth, GLsizei aHeight);
+
+
+/// \brief Size in bytes of a whole mipmap chain.
+std::size_t getCompressedSize(GLenum aInternalFormat, GLsizei aWidth, GLsizei aHeight, GLsizei aLevels);
+
+
+/// \brief Generate the mipmap chain of the image (box filter), then compress each level.
+///
+/// Opaque images are compressed to BC1, the others to BC3.
+/// The block endpoints follow the principal axis of the block colors, then are refined by least squares.
+/// \param aPixels The texels as 4 bytes RGBA, row by row.
+CompressedImage compressImage(std::span<const std::uint8_t> aPixels,
+                              GLsizei aWidth,
+                              GLsizei aHeight,
+                              GLsizei aLevels);
+
+
+} // namespace gltfviewer
+} // namespace ad
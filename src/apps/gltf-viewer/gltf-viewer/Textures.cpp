@@ -0,0 +1,258 @@
+#include "Textures.h"
+
+#include "Capabilities.h"
+#include "LoadBuffer.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    /// \brief Number of levels for a complete mipmap chain.
+    GLsizei getMipMapLevels(GLsizei aWidth, GLsizei aHeight)
+    {
+        return std::bit_width(static_cast<unsigned int>(std::max(aWidth, aHeight)));
+    }
+
+    GLint getMaxLayers()
+    {
+        static const GLint maxLayers = []()
+        {
+            GLint result = 0;
+            glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &result);
+            return result;
+        }();
+        return maxLayers;
+    }
+
+    std::span<const std::uint8_t> getPixels(const arte::Image<math::sdr::Rgba> & aImage)
+    {
+        return {reinterpret_cast<const std::uint8_t *>(aImage.data()),
+                static_cast<std::size_t>(aImage.width()) * aImage.height() * 4};
+    }
+
+} // anonymous namespace
+
+
+TextureSlot TextureRepository::insert(arte::Const_Owned<arte::gltf::Texture> aTexture, TextureRole aRole)
+{
+    if (auto found = mSlots.find({aTexture.id(), aRole});
+        found != mSlots.end())
+    {
+        return found->second;
+    }
+
+    const arte::gltf::texture::Sampler & sampler = aTexture->sampler ?
+        aTexture.get(&arte::gltf::Texture::sampler)
+        : arte::gltf::texture::gDefaultSampler;
+
+    TextureSlot slot = insert(loadImageData(aTexture.get(&arte::gltf::Texture::source)),
+                              sampler,
+                              aRole == TextureRole::Color);
+    return mSlots.emplace(std::pair{aTexture.id(), aRole}, slot).first->second;
+}
+
+
+TextureSlot TextureRepository::insertDefault()
+{
+    if (!mDefault)
+    {
+        // Shared by all roles, and a single block would not save anything.
+        mDefault = insert(Image{{1, 1}, math::sdr::gWhite}, arte::gltf::texture::gDefaultSampler, false);
+    }
+    return *mDefault;
+}
+
+
+TextureSlot TextureRepository::insert(Image aImage,
+                                      const arte::gltf::texture::Sampler & aSampler,
+                                      bool aCompress)
+{
+    std::optional<CompressedImage> compressed;
+    if (aCompress && mCompress && getGpuCapabilities().supportsS3tc())
+    {
+        compressed = compress(aImage);
+    }
+
+    ArrayKey key{
+        compressed ? compressed->internalFormat : GL_RGBA8,
+        aImage.width(),
+        aImage.height(),
+        static_cast<GLint>(aSampler.wrapS),
+        static_cast<GLint>(aSampler.wrapT),
+        aSampler.magFilter ? static_cast<GLint>(*aSampler.magFilter) : gUnsetFilter,
+        aSampler.minFilter ? static_cast<GLint>(*aSampler.minFilter) : gUnsetFilter,
+    };
+
+    std::vector<Array> & arrays = mArrays[key];
+    if (arrays.empty() || arrays.back().getLayerCount() == static_cast<std::size_t>(getMaxLayers()))
+    {
+        arrays.emplace_back();
+    }
+
+    Array & array = arrays.back();
+    if (compressed)
+    {
+        array.compressedLayers.push_back(std::move(*compressed));
+    }
+    else
+    {
+        array.layers.push_back(std::move(aImage));
+    }
+    return TextureSlot{
+        .array = array.texture,
+        .layer = static_cast<GLuint>(array.getLayerCount() - 1),
+    };
+}
+
+
+CompressedImage TextureRepository::compress(const Image & aImage)
+{
+    // Bump the version when the compression changes, so the saved blocks are not reused.
+    constexpr std::string_view version = "bc-1";
+    const GLsizei width = aImage.width();
+    const GLsizei height = aImage.height();
+    const GLsizei levels = getMipMapLevels(width, height);
+
+    std::uint64_t key = hashString(version);
+    key = hashBytes(std::as_bytes(std::span{&width, 1}), key);
+    key = hashBytes(std::as_bytes(std::span{&height, 1}), key);
+    key = hashBytes(std::as_bytes(getPixels(aImage)), key);
+
+    // The blob is the internal format, followed by the blocks of all levels.
+    if (std::optional<std::vector<std::byte>> saved = mCompressionCache.load(key);
+        saved && saved->size() > sizeof(GLenum))
+    {
+        GLenum internalFormat;
+        std::memcpy(&internalFormat, saved->data(), sizeof(GLenum));
+        if ((internalFormat == gCompressedRgbBc1 || internalFormat == gCompressedRgbaBc3)
+            && saved->size() == sizeof(GLenum) + getCompressedSize(internalFormat, width, height, levels))
+        {
+            return CompressedImage{
+                .internalFormat = internalFormat,
+                .width = width,
+                .height = height,
+                .levels = levels,
+                .blocks{saved->begin() + sizeof(GLenum), saved->end()},
+            };
+        }
+    }
+
+    CompressedImage result = compressImage(getPixels(aImage), width, height, levels);
+    std::vector<std::byte> blob(sizeof(GLenum) + result.blocks.size());
+    std::memcpy(blob.data(), &result.internalFormat, sizeof(GLenum));
+    std::memcpy(blob.data() + sizeof(GLenum), result.blocks.data(), result.blocks.size());
+    mCompressionCache.store(key, blob);
+
+    ADLOG(gPrepareLogger, debug)
+         ("Compressed a {}x{} texture to {}: {} bytes instead of {}.",
+          width, height, result.internalFormat == gCompressedRgbBc1 ? "BC1" : "BC3",
+          result.blocks.size(), getPixels(aImage).size() * 4 / 3);
+
+    return result;
+}
+
+
+void TextureRepository::upload()
+{
+    std::size_t arrayCount = 0;
+    std::size_t compressedBytes = 0;
+    for (auto & [key, arrays] : mArrays)
+    {
+        const auto [internalFormat, width, height, wrapS, wrapT, magFilter, minFilter] = key;
+        const GLsizei levels = getMipMapLevels(width, height);
+
+        for (Array & array : arrays)
+        {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+
+            glTexStorage3D(
+                GL_TEXTURE_2D_ARRAY,
+                levels,
+                internalFormat, // TODO should it be SRGB8_ALPHA8 (resp. the SRGB S3TC formats)?
+                width,
+                height,
+                static_cast<GLsizei>(array.getLayerCount()));
+
+            if (array.compressedLayers.empty())
+            {
+                for (std::size_t layer = 0; layer != array.layers.size(); ++layer)
+                {
+                    glTexSubImage3D(
+                        GL_TEXTURE_2D_ARRAY,
+                        0,
+                        0, 0, static_cast<GLint>(layer),
+                        width, height, 1,
+                        GL_RGBA,
+                        GL_UNSIGNED_BYTE,
+                        array.layers[layer].data());
+                }
+
+                glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            }
+            else
+            {
+                // The mipmaps were compressed with the base level, each level is sent as is.
+                for (std::size_t layer = 0; layer != array.compressedLayers.size(); ++layer)
+                {
+                    const CompressedImage & image = array.compressedLayers[layer];
+                    std::size_t offset = 0;
+                    for (GLsizei level = 0; level != levels; ++level)
+                    {
+                        const GLsizei levelWidth = std::max<GLsizei>(1, width >> level);
+                        const GLsizei levelHeight = std::max<GLsizei>(1, height >> level);
+                        const std::size_t size = getCompressedSize(internalFormat, levelWidth, levelHeight);
+                        glCompressedTexSubImage3D(
+                            GL_TEXTURE_2D_ARRAY,
+                            level,
+                            0, 0, static_cast<GLint>(layer),
+                            levelWidth, levelHeight, 1,
+                            internalFormat,
+                            static_cast<GLsizei>(size),
+                            image.blocks.data() + offset);
+                        offset += size;
+                    }
+                    compressedBytes += image.blocks.size();
+                }
+            }
+
+            // Sampling parameters
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrapS);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrapT);
+            if (magFilter != gUnsetFilter)
+            {
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, magFilter);
+            }
+            if (minFilter != gUnsetFilter)
+            {
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, minFilter);
+            }
+
+            ADLOG(gPrepareLogger, debug)
+                 ("Uploaded texture array {} of {} layer(s) at {}x{}{}.",
+                  static_cast<GLuint>(array.texture), array.getLayerCount(), width, height,
+                  array.compressedLayers.empty() ? "" : " (compressed)");
+
+            // The images are now owned by OpenGL.
+            array.layers = {};
+            array.compressedLayers = {};
+            ++arrayCount;
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    ADLOG(gPrepareLogger, info)
+         ("Uploaded {} texture(s) to {} texture array(s), {} bytes of compressed blocks.",
+          size(), arrayCount, compressedBytes);
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
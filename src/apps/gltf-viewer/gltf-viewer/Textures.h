@@ -0,0 +1,109 @@
+#pragma once
+
+
+#include "DiskCache.h"
+#include "TextureCompression.h"
+
+#include <arte/Image.h>
+#include <arte/gltf/Gltf.h>
+
+#include <renderer/GL_Loader.h>
+#include <renderer/Texture.h>
+
+#include <map>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief How the shaders interpret the texels of a texture.
+enum class TextureRole
+{
+    // Colors, which tolerate the block compression.
+    Color,
+    // Values such as the metallic and roughness factors, or normals, which are not compressed:
+    // the BC1 palette is a line through the color space, which cannot follow independent channels.
+    Data,
+};
+
+
+/// \brief Position of a texture in the TextureRepository.
+struct TextureSlot
+{
+    // The texture array, to be bound to GL_TEXTURE_2D_ARRAY.
+    GLuint array{0};
+    // Layer of the texture in the array, provided to the shaders by the material entry.
+    GLuint layer{0};
+};
+
+
+/// \brief The material textures, packed as layers of texture arrays.
+///
+/// Textures with the same size and sampling parameters are layers of a single GL_TEXTURE_2D_ARRAY,
+/// so primitives with distinct textures sharing an array are drawn without any rebinding.
+/// The images are kept in main memory while loading, then sent at once by upload().
+///
+/// The color textures can be compressed to BC1/BC3 when inserted, if the context supports S3TC.
+/// The compression is slow, its result is kept in a DiskCache so the next loads only read the blocks.
+class TextureRepository
+{
+public:
+    /// \pre No texture was inserted yet.
+    void setCompression(bool aCompress)
+    { mCompress = aCompress; }
+
+    /// \brief Return the slot of the glTF texture, inserting it on first request for this role.
+    TextureSlot insert(arte::Const_Owned<arte::gltf::Texture> aTexture, TextureRole aRole);
+
+    /// \brief Return the slot of a single white texel, sampled by materials without a texture.
+    TextureSlot insertDefault();
+
+    /// \brief Send all inserted images to their arrays, to be called once loading is complete.
+    void upload();
+
+    std::size_t size() const
+    { return mSlots.size() + (mDefault ? 1 : 0); }
+
+private:
+    using Image = arte::Image<math::sdr::Rgba>;
+
+    // Textures are compatible if they have the same format, size and sampling parameters.
+    // The filters are gUnsetFilter when not specified.
+    using ArrayKey = std::tuple<GLenum /*internal format*/,
+                                GLsizei /*width*/, GLsizei /*height*/,
+                                GLint /*wrap S*/, GLint /*wrap T*/,
+                                GLint /*mag filter*/, GLint /*min filter*/>;
+
+    struct Array
+    {
+        graphics::Texture texture{GL_TEXTURE_2D_ARRAY};
+        // Only populated until upload, either of them depending on the internal format.
+        std::vector<Image> layers;
+        std::vector<CompressedImage> compressedLayers;
+
+        std::size_t getLayerCount() const
+        { return layers.size() + compressedLayers.size(); }
+    };
+
+    TextureSlot insert(Image aImage, const arte::gltf::texture::Sampler & aSampler, bool aCompress);
+
+    /// \brief Compress the image and its mipmaps, or load the blocks from a previous compression.
+    CompressedImage compress(const Image & aImage);
+
+    static constexpr GLint gUnsetFilter{-1};
+
+    // Several arrays for a given key if the layer count exceeds the implementation limit.
+    std::map<ArrayKey, std::vector<Array>> mArrays;
+    std::map<std::pair<arte::gltf::Index<arte::gltf::Texture>, TextureRole>, TextureSlot> mSlots;
+    std::optional<TextureSlot> mDefault;
+    bool mCompress{true};
+    DiskCache mCompressionCache{"textures"};
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -8,6 +8,25 @@ namespace gltfviewer {
 struct UserOptions
 {
     bool showSkeletons{false};
+    bool frustumCulling{true};
+    // Only effective if the context supports it, see GpuCapabilities::supportsGpuCulling().
+    bool gpuCulling{false};
+    // Hi-Z occlusion culling, only available with GPU culling.
+    bool occlusionCulling{false};
+    // Only effective if the context supports it, see GpuCapabilities::supportsMultiDrawIndirect().
+    bool multiDrawIndirect{true};
+    // Cull the meshlets of the dense meshes, only with multi-draw indirect, see MeshletCuller.
+    bool meshletCulling{true};
+    // Skin the animated meshes once per frame, instead of in each pass drawing them.
+    bool preSkinning{true};
+    // Only effective if the context supports it, see GpuCapabilities::supportsPersistentMapping().
+    bool persistentMapping{true};
+    // Compress the color textures, only read while loading, see TextureRepository.
+    // Only effective if the context supports it, see GpuCapabilities::supportsS3tc().
+    bool compressTextures{true};
+    bool levelOfDetail{true};
+    // Screen coverage (fraction of the viewport height) under which instances are simplified.
+    float levelOfDetailCoverage{0.25f};
     bool showImguiDemo{false};
 };
 
@@ -0,0 +1,373 @@
+#include "VertexCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <string_view>
+#include <unordered_map>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    // The LRU cache modelled by the scoring, larger than the simulated FIFO: it only ranks the candidates.
+    constexpr std::size_t gScoringCacheSize = 32;
+
+    constexpr std::uint32_t gNoTriangle = std::numeric_limits<std::uint32_t>::max();
+
+
+    /// \brief Forsyth's vertex score, see optimizeVertexCache().
+    float getVertexScore(int aCachePosition, std::uint32_t aRemainingTriangles)
+    {
+        if (aRemainingTriangles == 0)
+        {
+            return -1.f;
+        }
+
+        float score = 0.f;
+        if (aCachePosition >= 0)
+        {
+            // The vertices of the last triangle score the same, so the next triangle does not favour one of them.
+            score = aCachePosition < 3 ?
+                0.75f
+                : std::pow(1.f - static_cast<float>(aCachePosition - 3) / (gScoringCacheSize - 3), 1.5f);
+        }
+        // Vertices with few remaining triangles are boosted, so they are not left isolated.
+        return score + 2.f / std::sqrt(static_cast<float>(aRemainingTriangles));
+    }
+
+
+    /// \brief FIFO cache simulation by timestamps: a vertex is cached if it missed less than a cache size ago.
+    class FifoCache
+    {
+    public:
+        explicit FifoCache(std::size_t aVertexCount) :
+            mTimestamps(aVertexCount, 0)
+        {}
+
+        /// \return Whether the vertex missed, and was transformed.
+        bool access(GLuint aVertex)
+        {
+            if (mTime - mTimestamps[aVertex] > gSimulatedCacheSize)
+            {
+                mTimestamps[aVertex] = mTime++;
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        std::vector<std::size_t> mTimestamps;
+        // Starts past the cache size, so the zero timestamps are not cached.
+        std::size_t mTime{gSimulatedCacheSize + 1};
+    };
+
+} // anonymous namespace
+
+
+VertexCacheStatistics & VertexCacheStatistics::operator+=(const VertexCacheStatistics & aRhs)
+{
+    triangles += aRhs.triangles;
+    vertices += aRhs.vertices;
+    transformedVertices += aRhs.transformedVertices;
+    return *this;
+}
+
+
+VertexCacheStatistics analyzeVertexCache(std::span<const GLuint> aIndices, std::size_t aVertexCount)
+{
+    VertexCacheStatistics statistics{.triangles = aIndices.size() / 3};
+
+    FifoCache cache{aVertexCount};
+    std::vector<bool> referenced(aVertexCount, false);
+    for (GLuint index : aIndices)
+    {
+        statistics.transformedVertices += cache.access(index) ? 1 : 0;
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            ++statistics.vertices;
+        }
+    }
+    return statistics;
+}
+
+
+std::vector<GLuint> optimizeVertexCache(std::span<const GLuint> aIndices, std::size_t aVertexCount)
+{
+    const std::size_t triangleCount = aIndices.size() / 3;
+    if (triangleCount == 0)
+    {
+        return {aIndices.begin(), aIndices.end()};
+    }
+
+    // The triangles of each vertex, as consecutive ranges of a single array.
+    // The triangles remaining to emit are kept at the beginning of each range.
+    std::vector<std::uint32_t> triangleOffsets(aVertexCount + 1, 0);
+    for (GLuint index : aIndices)
+    {
+        ++triangleOffsets[index + 1];
+    }
+    std::partial_sum(triangleOffsets.begin(), triangleOffsets.end(), triangleOffsets.begin());
+
+    std::vector<std::uint32_t> vertexTriangles(triangleCount * 3);
+    std::vector<std::uint32_t> remaining(aVertexCount, 0);
+    for (std::uint32_t triangle = 0; triangle != triangleCount; ++triangle)
+    {
+        for (std::size_t corner = 0; corner != 3; ++corner)
+        {
+            const GLuint vertex = aIndices[triangle * 3 + corner];
+            vertexTriangles[triangleOffsets[vertex] + remaining[vertex]++] = triangle;
+        }
+    }
+
+    std::vector<int> cachePositions(aVertexCount, -1);
+    std::vector<float> vertexScores(aVertexCount);
+    for (std::size_t vertex = 0; vertex != aVertexCount; ++vertex)
+    {
+        vertexScores[vertex] = getVertexScore(-1, remaining[vertex]);
+    }
+
+    auto scoreTriangle = [&](std::uint32_t aTriangle)
+    {
+        return vertexScores[aIndices[aTriangle * 3]]
+             + vertexScores[aIndices[aTriangle * 3 + 1]]
+             + vertexScores[aIndices[aTriangle * 3 + 2]];
+    };
+    std::vector<float> triangleScores(triangleCount);
+    for (std::uint32_t triangle = 0; triangle != triangleCount; ++triangle)
+    {
+        triangleScores[triangle] = scoreTriangle(triangle);
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<GLuint> result;
+    result.reserve(triangleCount * 3);
+
+    std::vector<GLuint> cache;
+    std::vector<GLuint> nextCache;
+    cache.reserve(gScoringCacheSize + 3);
+    nextCache.reserve(gScoringCacheSize + 3);
+
+    std::uint32_t best = static_cast<std::uint32_t>(
+        std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+    // When no cached vertex has remaining triangles, the next triangle in input order starts again.
+    std::uint32_t scanCursor = 0;
+
+    while (best != gNoTriangle)
+    {
+        emitted[best] = true;
+        const GLuint * corners = aIndices.data() + best * 3;
+        result.insert(result.end(), corners, corners + 3);
+
+        // The emitted triangle moves to the end of the remaining range of its vertices, which shrinks.
+        for (std::size_t corner = 0; corner != 3; ++corner)
+        {
+            const GLuint vertex = corners[corner];
+            auto begin = vertexTriangles.begin() + triangleOffsets[vertex];
+            auto last = begin + (--remaining[vertex]);
+            std::iter_swap(std::find(begin, last + 1, best), last);
+        }
+
+        // LRU update: the triangle vertices move to the front, the vertices pushed past the size are evicted.
+        nextCache.assign(corners, corners + 3);
+        for (GLuint vertex : cache)
+        {
+            if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+            {
+                nextCache.push_back(vertex);
+            }
+        }
+        for (std::size_t position = 0; position != nextCache.size(); ++position)
+        {
+            const GLuint vertex = nextCache[position];
+            cachePositions[vertex] = position < gScoringCacheSize ? static_cast<int>(position) : -1;
+            vertexScores[vertex] = getVertexScore(cachePositions[vertex], remaining[vertex]);
+        }
+
+        // Only the triangles of the updated vertices changed score, the best of them is emitted next.
+        best = gNoTriangle;
+        float bestScore = -std::numeric_limits<float>::max();
+        for (GLuint vertex : nextCache)
+        {
+            const std::uint32_t first = triangleOffsets[vertex];
+            for (std::uint32_t triangle : std::span{vertexTriangles}.subspan(first, remaining[vertex]))
+            {
+                triangleScores[triangle] = scoreTriangle(triangle);
+                if (triangleScores[triangle] > bestScore)
+                {
+                    bestScore = triangleScores[triangle];
+                    best = triangle;
+                }
+            }
+        }
+
+        nextCache.resize(std::min(nextCache.size(), gScoringCacheSize));
+        std::swap(cache, nextCache);
+
+        if (best == gNoTriangle)
+        {
+            while (scanCursor != triangleCount && emitted[scanCursor])
+            {
+                ++scanCursor;
+            }
+            if (scanCursor != triangleCount)
+            {
+                best = scanCursor;
+            }
+        }
+    }
+
+    return result;
+}
+
+
+std::vector<GLuint> optimizeOverdraw(std::span<const GLuint> aIndices,
+                                     std::span<const math::Position<3, GLfloat>> aPositions)
+{
+    struct Cluster
+    {
+        std::size_t firstTriangle;
+        std::size_t triangleCount{0};
+        math::Vec<3, GLfloat> weightedCentroid{0.f, 0.f, 0.f};
+        math::Vec<3, GLfloat> normal{0.f, 0.f, 0.f};
+        GLfloat area{0.f};
+        GLfloat facing{0.f};
+    };
+
+    std::vector<Cluster> clusters;
+    math::Vec<3, GLfloat> meshCentroid{0.f, 0.f, 0.f};
+    GLfloat meshArea = 0.f;
+
+    FifoCache cache{aPositions.size()};
+    const std::size_t triangleCount = aIndices.size() / 3;
+    for (std::size_t triangle = 0; triangle != triangleCount; ++triangle)
+    {
+        const GLuint * corners = aIndices.data() + triangle * 3;
+        int misses = 0;
+        for (std::size_t corner = 0; corner != 3; ++corner)
+        {
+            misses += cache.access(corners[corner]) ? 1 : 0;
+        }
+        if (misses == 3 || clusters.empty())
+        {
+            clusters.push_back(Cluster{.firstTriangle = triangle});
+        }
+
+        const math::Position<3, GLfloat> & a = aPositions[corners[0]];
+        const math::Vec<3, GLfloat> normal = (aPositions[corners[1]] - a).cross(aPositions[corners[2]] - a);
+        const GLfloat area = normal.getNorm();
+        const math::Vec<3, GLfloat> centroid =
+            (a.as<math::Vec>() + aPositions[corners[1]].as<math::Vec>() + aPositions[corners[2]].as<math::Vec>())
+            / 3.f;
+
+        Cluster & cluster = clusters.back();
+        ++cluster.triangleCount;
+        cluster.weightedCentroid += centroid * area;
+        cluster.normal += normal;
+        cluster.area += area;
+        meshCentroid += centroid * area;
+        meshArea += area;
+    }
+
+    if (meshArea <= 0.f)
+    {
+        return {aIndices.begin(), aIndices.end()};
+    }
+    meshCentroid = meshCentroid / meshArea;
+
+    // How much the cluster faces away from the mesh center, the outer clusters being the best occluders.
+    for (Cluster & cluster : clusters)
+    {
+        const GLfloat normalLength = cluster.normal.getNorm();
+        if (cluster.area > 0.f && normalLength > 0.f)
+        {
+            cluster.facing = (cluster.weightedCentroid / cluster.area - meshCentroid).dot(cluster.normal / normalLength);
+        }
+    }
+    std::stable_sort(clusters.begin(), clusters.end(),
+                     [](const Cluster & aLhs, const Cluster & aRhs)
+                     {
+                         return aLhs.facing > aRhs.facing;
+                     });
+
+    std::vector<GLuint> result;
+    result.reserve(aIndices.size());
+    for (const Cluster & cluster : clusters)
+    {
+        auto first = aIndices.begin() + cluster.firstTriangle * 3;
+        result.insert(result.end(), first, first + cluster.triangleCount * 3);
+    }
+    return result;
+}
+
+
+WeldedVertices weldVertices(std::span<const GLfloat> aInterleaved, std::size_t aVertexCount)
+{
+    const std::size_t components = aVertexCount != 0 ? aInterleaved.size() / aVertexCount : 0;
+    auto getBytes = [&](std::size_t aVertexId)
+    {
+        const std::span<const std::byte> bytes =
+            std::as_bytes(aInterleaved.subspan(aVertexId * components, components));
+        return std::string_view{reinterpret_cast<const char *>(bytes.data()), bytes.size()};
+    };
+
+    WeldedVertices result;
+    result.indices.resize(aVertexCount);
+    std::unordered_multimap<std::size_t, GLuint> weldedByHash;
+    for (std::size_t vertexId = 0; vertexId != aVertexCount; ++vertexId)
+    {
+        const std::string_view bytes = getBytes(vertexId);
+        const std::size_t hash = std::hash<std::string_view>{}(bytes);
+        auto [first, last] = weldedByHash.equal_range(hash);
+        auto found = std::find_if(first, last, [&](const auto & aEntry)
+        {
+            return getBytes(result.representatives[aEntry.second]) == bytes;
+        });
+
+        if (found != last)
+        {
+            result.indices[vertexId] = found->second;
+        }
+        else
+        {
+            result.indices[vertexId] = static_cast<GLuint>(result.representatives.size());
+            weldedByHash.emplace(hash, result.indices[vertexId]);
+            result.representatives.push_back(vertexId);
+        }
+    }
+    return result;
+}
+
+
+std::vector<GLuint> getVertexFetchRemap(std::span<const GLuint> aIndices, std::size_t aVertexCount)
+{
+    constexpr GLuint unassigned = std::numeric_limits<GLuint>::max();
+    std::vector<GLuint> remap(aVertexCount, unassigned);
+
+    GLuint next = 0;
+    for (GLuint index : aIndices)
+    {
+        if (remap[index] == unassigned)
+        {
+            remap[index] = next++;
+        }
+    }
+    for (GLuint & position : remap)
+    {
+        if (position == unassigned)
+        {
+            position = next++;
+        }
+    }
+    return remap;
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,98 @@
+#pragma once
+
+
+#include <math/Vector.h>
+
+#include <renderer/GL_Loader.h>
+
+#include <span>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Size of the FIFO post-transform cache simulated by analyzeVertexCache().
+constexpr std::size_t gSimulatedCacheSize = 16;
+
+
+/// \brief Counts of a simulated draw, summed over primitives by operator+=.
+struct VertexCacheStatistics
+{
+    VertexCacheStatistics & operator+=(const VertexCacheStatistics & aRhs);
+
+    /// \brief Average cache miss ratio: transformed vertices per triangle, 0.5 at best, 3 at worst.
+    double getAcmr() const
+    { return triangles != 0 ? static_cast<double>(transformedVertices) / triangles : 0.; }
+
+    /// \brief Average transform to vertex ratio: transformed vertices per vertex, 1 at best.
+    double getAtvr() const
+    { return vertices != 0 ? static_cast<double>(transformedVertices) / vertices : 0.; }
+
+    std::size_t triangles{0};
+    std::size_t vertices{0};
+    // Cache misses.
+    std::size_t transformedVertices{0};
+};
+
+
+/// \brief Effect of the index reordering, summed over the primitives, see GeometryArena::Options.
+struct IndexOrderStatistics
+{
+    std::size_t optimizedPrimitives{0};
+    // Primitives whose order was loaded from the DiskCache.
+    std::size_t cachedPrimitives{0};
+    VertexCacheStatistics exported;
+    VertexCacheStatistics optimized;
+};
+
+
+/// \brief Simulate drawing the triangle list through a FIFO post-transform cache of gSimulatedCacheSize.
+VertexCacheStatistics analyzeVertexCache(std::span<const GLuint> aIndices, std::size_t aVertexCount);
+
+
+/// \brief Reorder the triangles so consecutive triangles reuse the same vertices (Forsyth).
+///
+/// Each step emits the triangle whose vertices score best, favouring the vertices recently
+/// emitted (still in a simulated LRU cache) and the vertices with few remaining triangles,
+/// so the emission does not leave isolated triangles behind.
+std::vector<GLuint> optimizeVertexCache(std::span<const GLuint> aIndices, std::size_t aVertexCount);
+
+
+/// \brief Reorder clusters of a cache optimized triangle list, so the outward facing clusters are drawn first.
+///
+/// The clusters are split where the cache optimization restarted (all vertices of a triangle missed),
+/// so the vertex reuse inside the clusters is kept (Sander et al., Tipsify).
+/// Drawing the outer surface first lets early depth testing reject more of the inner fragments.
+std::vector<GLuint> optimizeOverdraw(std::span<const GLuint> aIndices,
+                                     std::span<const math::Position<3, GLfloat>> aPositions);
+
+
+/// \brief The vertices of a triangle list once its identical vertices are merged, see weldVertices().
+struct WeldedVertices
+{
+    // The welded vertex of each input vertex, numbered by first occurrence.
+    // For a non-indexed triangle list, these are also its indices in the exported order.
+    std::vector<GLuint> indices;
+    // The first input vertex of each welded vertex.
+    std::vector<std::size_t> representatives;
+};
+
+
+/// \brief Merge the bitwise identical vertices.
+///
+/// Only identical vertices are merged, so the welding never alters the geometry.
+/// \param aInterleaved The attributes of all vertices, each vertex being a sequence of
+/// `aInterleaved.size() / aVertexCount` values.
+WeldedVertices weldVertices(std::span<const GLfloat> aInterleaved, std::size_t aVertexCount);
+
+
+/// \brief The new position of each vertex, ordered by first use in the indices.
+///
+/// Vertices not referenced by the indices follow, in their current order.
+std::vector<GLuint> getVertexFetchRemap(std::span<const GLuint> aIndices, std::size_t aVertexCount);
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,108 @@
+#include "VertexQuantization.h"
+
+#include <math/Transformations.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+namespace {
+
+    GLshort toSnorm16(GLfloat aValue)
+    {
+        return static_cast<GLshort>(std::lround(std::clamp(aValue, -1.f, 1.f) * 32767.f));
+    }
+
+} // anonymous namespace
+
+
+GLhalf toHalf(GLfloat aValue)
+{
+    const auto bits = std::bit_cast<std::uint32_t>(aValue);
+    const auto sign = static_cast<GLhalf>((bits >> 16) & 0x8000);
+    const std::int32_t exponent = static_cast<std::int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+    const std::uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent <= 0)
+    {
+        return sign;
+    }
+    else if (exponent >= 31)
+    {
+        return static_cast<GLhalf>(sign | 0x7C00);
+    }
+    // A carry of the rounding into the exponent is still the correctly rounded value.
+    return static_cast<GLhalf>(
+        (sign | (exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+}
+
+
+std::array<GLshort, 2> encodeOctahedral(std::span<const GLfloat> aNormal)
+{
+    const GLfloat norm = std::abs(aNormal[0]) + std::abs(aNormal[1]) + std::abs(aNormal[2]);
+    if (norm == 0.f)
+    {
+        return {0, 0};
+    }
+
+    GLfloat u = aNormal[0] / norm;
+    GLfloat v = aNormal[1] / norm;
+    if (aNormal[2] < 0.f)
+    {
+        const GLfloat foldedU = (1.f - std::abs(v)) * (u >= 0.f ? 1.f : -1.f);
+        v = (1.f - std::abs(u)) * (v >= 0.f ? 1.f : -1.f);
+        u = foldedU;
+    }
+    return {toSnorm16(u), toSnorm16(v)};
+}
+
+
+PositionQuantization::PositionQuantization(const math::Box<GLfloat> & aBoundingBox) :
+    extent{std::max({aBoundingBox.width(), aBoundingBox.height(), aBoundingBox.depth()})}
+{
+    const math::Vec<3, GLfloat> halfExtent{extent / 2.f, extent / 2.f, extent / 2.f};
+    origin = aBoundingBox.center() - halfExtent;
+    // A degenerate box still needs a valid scale.
+    if (extent <= 0.f)
+    {
+        extent = 1.f;
+    }
+}
+
+
+std::array<GLushort, 4> PositionQuantization::quantize(const math::Position<3, GLfloat> & aPosition) const
+{
+    auto quantized = [&](std::size_t aAxis)
+    {
+        const GLfloat normalized = (aPosition[aAxis] - origin[aAxis]) / extent;
+        return static_cast<GLushort>(std::lround(std::clamp(normalized, 0.f, 1.f) * 65535.f));
+    };
+    return {quantized(0), quantized(1), quantized(2), 65535};
+}
+
+
+math::AffineMatrix<4, GLfloat> PositionQuantization::getDequantization() const
+{
+    return math::trans3d::scale(extent, extent, extent) * math::trans3d::translate(origin.as<math::Vec>());
+}
+
+
+math::Box<GLfloat> PositionQuantization::quantize(const math::Box<GLfloat> & aBox) const
+{
+    const math::Vec<3, GLfloat> halfSize{aBox.width() / 2.f, aBox.height() / 2.f, aBox.depth() / 2.f};
+    const math::Position<3, GLfloat> min = aBox.center() - halfSize;
+    return {
+        ((min - origin) / extent).as<math::Position>(),
+        math::Size<3, GLfloat>{aBox.width() / extent, aBox.height() / extent, aBox.depth() / extent},
+    };
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,52 @@
+#pragma once
+
+
+#include <math/Box.h>
+#include <math/Homogeneous.h>
+
+#include <renderer/GL_Loader.h>
+
+#include <array>
+#include <span>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Convert to an IEEE half float, rounding to nearest.
+/// \note Values below the smallest normal half are flushed to zero.
+GLhalf toHalf(GLfloat aValue);
+
+
+/// \brief Project the unit normal on the octahedron, then unfold the lower half over the corners.
+///
+/// Stored as 2 x 16 bits signed normalized, decoded by the shaders, see gVertexNormal.
+std::array<GLshort, 2> encodeOctahedral(std::span<const GLfloat> aNormal);
+
+
+/// \brief Maps the positions of a mesh to 16 bits unsigned normalized integers.
+///
+/// The quantization grid is the cube enclosing the mesh bounding box, so the dequantization
+/// is a uniform scale and a translation: folded into the instance model transformations,
+/// it does not alter the transformation of the normals.
+struct PositionQuantization
+{
+    explicit PositionQuantization(const math::Box<GLfloat> & aBoundingBox);
+
+    /// \brief The fourth component is always the maximum, so the shaders read a w of 1.
+    std::array<GLushort, 4> quantize(const math::Position<3, GLfloat> & aPosition) const;
+
+    /// \brief The transformation from the normalized positions, in [0, 1], back to the mesh space.
+    math::AffineMatrix<4, GLfloat> getDequantization() const;
+
+    /// \brief The box in the normalized space, where the dequantized instances are transformed.
+    math::Box<GLfloat> quantize(const math::Box<GLfloat> & aBox) const;
+
+    math::Position<3, GLfloat> origin;
+    GLfloat extent;
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
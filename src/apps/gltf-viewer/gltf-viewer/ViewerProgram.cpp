@@ -0,0 +1,27 @@
+#include "ViewerProgram.h"
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+UniformLocations::UniformLocations(const graphics::Program & aProgram) :
+    camera{glGetUniformLocation(aProgram, "u_camera")},
+    projection{glGetUniformLocation(aProgram, "u_projection")},
+    baseColorTint{glGetUniformLocation(aProgram, "u_baseColorTint")},
+    baseColorTex{glGetUniformLocation(aProgram, "u_baseColorTex")},
+    metallicRoughnessTex{glGetUniformLocation(aProgram, "u_metallicRoughnessTex")},
+    firstDrawRecord{glGetUniformLocation(aProgram, "u_firstDrawRecord")},
+    jointMatrices{glGetUniformLocation(aProgram, "u_jointMatrices")},
+    paletteFirst{glGetUniformLocation(aProgram, "u_paletteFirst")},
+    paletteStride{glGetUniformLocation(aProgram, "u_paletteStride")},
+    skinnedVertices{glGetUniformLocation(aProgram, "u_skinnedVertices")},
+    skinnedFirst{glGetUniformLocation(aProgram, "u_skinnedFirst")},
+    baseVertex{glGetUniformLocation(aProgram, "u_baseVertex")},
+    vertexCount{glGetUniformLocation(aProgram, "u_vertexCount")},
+    materialBlock{glGetUniformBlockIndex(aProgram, "MaterialBlock")}
+{}
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -0,0 +1,100 @@
+#pragma once
+
+
+#include <math/Homogeneous.h>
+
+#include <renderer/GL_Loader.h>
+#include <renderer/Shading.h>
+#include <renderer/Uniforms.h>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief Locations of the uniforms and blocks of the viewer shading programs, resolved once after link.
+///
+/// A uniform absent from a given program has location -1, which OpenGL silently ignores when set.
+struct UniformLocations
+{
+    /// \brief All locations absent, until the program is linked.
+    UniformLocations() = default;
+    explicit UniformLocations(const graphics::Program & aProgram);
+
+    GLint camera{-1};
+    GLint projection{-1};
+    GLint baseColorTint{-1};
+    GLint baseColorTex{-1};
+    GLint metallicRoughnessTex{-1};
+    GLint firstDrawRecord{-1};
+    GLint jointMatrices{-1};
+    GLint paletteFirst{-1};
+    GLint paletteStride{-1};
+    GLint skinnedVertices{-1};
+    GLint skinnedFirst{-1};
+    GLint baseVertex{-1};
+    GLint vertexCount{-1};
+    // GL_INVALID_INDEX if the program does not have the block.
+    GLuint materialBlock{GL_INVALID_INDEX};
+};
+
+
+/// \brief A program along with its resolved uniform locations.
+///
+/// The program is created empty, so it can be built asynchronously (see ProgramCache),
+/// the locations are resolved once it is linked.
+struct ViewerProgram
+{
+    void resolveLocations()
+    { locations = UniformLocations{program}; }
+
+    graphics::Program program;
+    UniformLocations locations;
+};
+
+
+//
+// Setters by location, never querying the program.
+//
+inline void setUniform(const graphics::Program & aProgram, GLint aLocation,
+                       const math::Matrix<4, 4, GLfloat> & aValue)
+{
+    glProgramUniformMatrix4fv(aProgram, aLocation, 1, GL_FALSE, aValue.data());
+}
+
+
+inline void setUniform(const graphics::Program & aProgram, GLint aLocation,
+                       const math::AffineMatrix<4, GLfloat> & aValue)
+{
+    glProgramUniformMatrix4fv(aProgram, aLocation, 1, GL_FALSE, aValue.data());
+}
+
+
+inline void setUniform(const graphics::Program & aProgram, GLint aLocation,
+                       const math::Vec<3, GLfloat> & aValue)
+{
+    glProgramUniform3fv(aProgram, aLocation, 1, aValue.data());
+}
+
+
+inline void setUniform(const graphics::Program & aProgram, GLint aLocation,
+                       const math::hdr::Rgba<GLfloat> & aValue)
+{
+    glProgramUniform4fv(aProgram, aLocation, 1, aValue.data());
+}
+
+
+inline void setUniformFloat(const graphics::Program & aProgram, GLint aLocation, GLfloat aValue)
+{
+    glProgramUniform1f(aProgram, aLocation, aValue);
+}
+
+
+inline void setUniformInt(const graphics::Program & aProgram, GLint aLocation, GLint aValue)
+{
+    glProgramUniform1i(aProgram, aLocation, aValue);
+}
+
+
+} // namespace gltfviewer
+} // namespace ad
@@ -1,5 +1,6 @@
 #include "Logging.h"
 
+#include "Benchmark.h"
 #include "GltfRendering.h"
 #include "ImguiUi.h"
 #include "Scene.h"
@@ -27,7 +28,15 @@ po::variables_map handleCommandLineArguments(int argc, const char ** argv)
     po::options_description desc("Gltf viewer.");
     desc.add_options()
         ("help", "Produce help message.")
-        ("gltf-path", po::value<std::string>()->required(), "Path to a glTF file to be viewed.");
+        ("gltf-path", po::value<std::string>()->required(), "Path to a glTF file to be viewed.")
+        ("benchmark-frames", po::value<std::size_t>(),
+         "Render this number of frames (after a warmup), report their statistics, then exit.")
+        ("gpu-culling", "Cull the instances with a compute shader, and draw them indirectly.")
+        ("occlusion-culling", "With --gpu-culling, also cull the instances hidden by the previous frame visible set.")
+        ("no-index-optimization", "Keep the exported order of the triangles and vertices.")
+        ("no-texture-compression", "Upload the color textures uncompressed, instead of as BC1/BC3 blocks.")
+        ("compare-index-order",
+         "With --benchmark-frames, measure the exported order of the triangles, then the optimized order.")
     ;
 
     po::positional_options_description positional;
@@ -112,16 +121,55 @@ int main(int argc, const char * argv[])
 
         ImguiUi imgui{application};
 
+        const bool compareIndexOrders =
+            arguments.count("compare-index-order") && arguments.count("benchmark-frames");
+        const GeometryArena::Options geometryOptions{
+            .optimizeIndexOrder = arguments.count("no-index-optimization") == 0,
+            .keepExportedIndexOrder = compareIndexOrders,
+        };
+
+        const UserOptions options{
+            .compressTextures = arguments.count("no-texture-compression") == 0,
+        };
+
         // Requires OpenGL context to call gl functions
-        Scene viewerScene{gltf, gltfSceneIndex, application.getAppInterface(), imgui};
+        Scene viewerScene{gltf, gltfSceneIndex, application.getAppInterface(), imgui, geometryOptions, options};
+
+        if (arguments.count("gpu-culling"))
+        {
+            if (viewerScene.gpuCulling)
+            {
+                viewerScene.options.gpuCulling = true;
+                viewerScene.options.occlusionCulling = arguments.count("occlusion-culling") != 0;
+            }
+            else
+            {
+                ADLOG(gltfviewer::gPrepareLogger, warn)
+                     ("GPU culling requires OpenGL 4.3, the context is {}.{}.",
+                      getGpuCapabilities().major, getGpuCapabilities().minor);
+            }
+        }
 
         Timer timer{glfwGetTime(), 0.};
 
+        std::optional<Benchmark> benchmark;
+        if (arguments.count("benchmark-frames"))
+        {
+            benchmark.emplace(arguments["benchmark-frames"].as<std::size_t>(), compareIndexOrders ? 2 : 1);
+        }
+
         bool showDemo = true;
         while(application.nextFrame())
         {
+            if (benchmark) benchmark->beginFrame(glfwGetTime());
+            if (compareIndexOrders)
+            {
+                viewerScene.setIndexOrder(benchmark->getPass() == 0 ? IndexOrder::Exported : IndexOrder::Optimized);
+            }
+
             imgui.startFrame();
             showUserOptionsWindow(viewerScene.options);
+            showStatisticsWindow(viewerScene.statistics);
             viewerScene.showSceneControls();
             if(viewerScene.options.showImguiDemo)
             {
@@ -136,6 +184,17 @@ int main(int argc, const char * argv[])
             imgui.render();
 
             timer.mark(glfwGetTime());
+            viewerScene.frameArena.reset();
+
+            if (benchmark)
+            {
+                benchmark->endFrame(glfwGetTime());
+                if (benchmark->isComplete())
+                {
+                    benchmark->report(viewerScene.renderer.getGeometry().getIndexOrderStatistics());
+                    break;
+                }
+            }
         }
     }
     catch(const std::exception & e)
@@ -0,0 +1,179 @@
+#include "catch.hpp"
+
+#include "Grid.h"
+
+#include <Culling.h>
+#include <Logging.h>
+
+#include <math/Transformations.h>
+
+#include <algorithm>
+
+
+using namespace ad;
+using namespace ad::gltfviewer;
+
+
+namespace ad {
+namespace gltfviewer {
+
+    // The hierarchy only stores the address of the mesh instances, the scene definition is not needed.
+    struct MeshInstances
+    {};
+
+} // namespace gltfviewer
+} // namespace ad
+
+
+namespace {
+
+    const math::Box<GLfloat> gUnitBox{{0.f, 0.f, 0.f}, {1.f, 1.f, 1.f}};
+
+
+    /// \brief Provide one instance of the unit box at each position, in order.
+    void updateHierarchy(InstanceHierarchy & aHierarchy,
+                         MeshInstances & aMeshInstances,
+                         const std::vector<math::Position<3, GLfloat>> & aPositions)
+    {
+        aHierarchy.beginUpdate();
+        for (std::size_t id = 0; id != aPositions.size(); ++id)
+        {
+            // Only the translation is relevant to the hierarchy, which detects moves on the instance data.
+            InstanceList::Instance instance;
+            instance.aInstanceId = static_cast<GLuint>(id);
+            for (std::size_t row = 0; row != 3; ++row)
+            {
+                instance.aModelRows[row][3] = aPositions[id][row];
+            }
+            aHierarchy.updateLeaf(aMeshInstances,
+                                  instance,
+                                  gUnitBox,
+                                  math::trans3d::translate(aPositions[id].as<math::Vec>()));
+        }
+        aHierarchy.endUpdate();
+    }
+
+
+    /// \brief The sorted ids of the instances reported visible by the hierarchy.
+    std::vector<GLuint> queryVisible(const InstanceHierarchy & aHierarchy,
+                                     const math::Matrix<4, 4, GLfloat> & aViewProjection)
+    {
+        std::vector<GLuint> result;
+        CullingStatistics statistics = aHierarchy.forEachVisible(
+            aViewProjection,
+            [&result](const InstanceHierarchy::Leaf & aLeaf)
+            {
+                result.push_back(aLeaf.instance.aInstanceId);
+            });
+        CHECK(statistics.visibleInstances == result.size());
+        CHECK(statistics.visibleInstances + statistics.culledInstances == aHierarchy.size());
+        std::ranges::sort(result);
+        return result;
+    }
+
+
+    /// \brief The sorted ids of the instances whose box is not outside the frustum, testing each one.
+    std::vector<GLuint> testEachBox(const std::vector<math::Position<3, GLfloat>> & aPositions,
+                                    const math::Matrix<4, 4, GLfloat> & aViewProjection)
+    {
+        std::vector<GLuint> result;
+        for (std::size_t id = 0; id != aPositions.size(); ++id)
+        {
+            const math::Box<GLfloat> box{aPositions[id], {1.f, 1.f, 1.f}};
+            if (testFrustum(box, aViewProjection) != FrustumTest::Outside)
+            {
+                result.push_back(static_cast<GLuint>(id));
+            }
+        }
+        return result;
+    }
+
+} // anonymous namespace
+
+
+SCENARIO("Frustum culling with the instance hierarchy.")
+{
+    initializeLogging();
+
+    GIVEN("Unit boxes on a grid layout, partially seen by a perspective camera.")
+    {
+        // One box on each vertex of the grid.
+        std::vector<math::Position<3, GLfloat>> positions = Grid{23}.positions;
+
+        // Looking down -Z from above the grid, with a 90 degrees vertical field of view.
+        math::Matrix<4, 4, GLfloat> projection = math::Matrix<4, 4, GLfloat>::Identity();
+        projection.at(2, 2) = -1.f;
+        projection.at(2, 3) = -1.f;
+        projection.at(3, 2) = -0.2f;
+        projection.at(3, 3) = 0.f;
+        const math::Matrix<4, 4, GLfloat> viewProjection =
+            math::trans3d::translate(math::Vec<3, GLfloat>{-6.f, -6.f, -6.f}) * projection;
+
+        MeshInstances meshInstances;
+        InstanceHierarchy hierarchy;
+        updateHierarchy(hierarchy, meshInstances, positions);
+        REQUIRE(hierarchy.size() == positions.size());
+
+        THEN("The visible instances are the boxes not outside the frustum.")
+        {
+            const std::vector<GLuint> expected = testEachBox(positions, viewProjection);
+            REQUIRE(!expected.empty());
+            REQUIRE(expected.size() < positions.size() / 2);
+            CHECK(queryVisible(hierarchy, viewProjection) == expected);
+        }
+
+        THEN("The culled subtrees are not traversed.")
+        {
+            CullingStatistics statistics =
+                hierarchy.forEachVisible(viewProjection, [](const InstanceHierarchy::Leaf &){});
+            CHECK(statistics.testedNodes < positions.size() / 2);
+        }
+
+        WHEN("Some instances move, in and out of the frustum.")
+        {
+            for (std::size_t id = 0; id < positions.size(); id += 7)
+            {
+                // Swap the visible and culled areas of the grid, so the tree bounds must grow.
+                positions[id][0] = 23.f - positions[id][0];
+                positions[id][1] = 23.f - positions[id][1];
+            }
+            for (std::size_t id = 3; id < positions.size(); id += 11)
+            {
+                // Behind the camera.
+                positions[id][2] = 10.f;
+            }
+            updateHierarchy(hierarchy, meshInstances, positions);
+
+            THEN("The refitted hierarchy still matches the boxes not outside the frustum.")
+            {
+                CHECK(queryVisible(hierarchy, viewProjection) == testEachBox(positions, viewProjection));
+            }
+        }
+
+        WHEN("An instance is added.")
+        {
+            positions.push_back({6.f, 6.f, 0.f});
+            updateHierarchy(hierarchy, meshInstances, positions);
+
+            THEN("The rebuilt hierarchy matches the boxes not outside the frustum.")
+            {
+                CHECK(hierarchy.size() == positions.size());
+                const std::vector<GLuint> visible = queryVisible(hierarchy, viewProjection);
+                CHECK(visible == testEachBox(positions, viewProjection));
+                CHECK(visible.back() == positions.size() - 1);
+            }
+        }
+    }
+
+    GIVEN("An empty hierarchy.")
+    {
+        InstanceHierarchy hierarchy;
+        hierarchy.beginUpdate();
+        hierarchy.endUpdate();
+
+        THEN("Nothing is visible.")
+        {
+            CHECK(queryVisible(hierarchy, math::Matrix<4, 4, GLfloat>::Identity()).empty());
+        }
+    }
+}
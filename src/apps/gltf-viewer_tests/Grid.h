@@ -0,0 +1,89 @@
+#pragma once
+
+
+#include <math/Vector.h>
+
+#include <renderer/GL_Loader.h>
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <vector>
+
+
+namespace ad {
+namespace gltfviewer {
+
+
+/// \brief A flat square of `aSide` x `aSide` quads in the XY plane, facing +Z.
+struct Grid
+{
+    explicit Grid(std::size_t aSide) :
+        side{aSide}
+    {
+        for (std::size_t y = 0; y != side + 1; ++y)
+        {
+            for (std::size_t x = 0; x != side + 1; ++x)
+            {
+                positions.push_back({static_cast<GLfloat>(x), static_cast<GLfloat>(y), 0.f});
+            }
+        }
+
+        auto vertex = [this](std::size_t aX, std::size_t aY)
+        {
+            return static_cast<GLuint>(aY * (side + 1) + aX);
+        };
+        for (std::size_t y = 0; y != side; ++y)
+        {
+            for (std::size_t x = 0; x != side; ++x)
+            {
+                indices.insert(indices.end(), {vertex(x, y), vertex(x + 1, y), vertex(x + 1, y + 1)});
+                indices.insert(indices.end(), {vertex(x, y), vertex(x + 1, y + 1), vertex(x, y + 1)});
+            }
+        }
+    }
+
+    /// \brief Reorder the triangles randomly, keeping the winding of each.
+    void shuffleTriangles(unsigned int aSeed = 5489u)
+    {
+        std::vector<std::array<GLuint, 3>> triangles = getTriangles(indices);
+        std::shuffle(triangles.begin(), triangles.end(), std::mt19937{aSeed});
+        indices.clear();
+        for (const auto & triangle : triangles)
+        {
+            indices.insert(indices.end(), triangle.begin(), triangle.end());
+        }
+    }
+
+    /// \brief The triangles of the list, each rotated to start with its lowest index, then sorted.
+    ///
+    /// Two lists with the same triangles, in any order and with any starting corner, compare equal.
+    static std::vector<std::array<GLuint, 3>> getSortedTriangles(const std::vector<GLuint> & aIndices)
+    {
+        std::vector<std::array<GLuint, 3>> triangles = getTriangles(aIndices);
+        for (auto & triangle : triangles)
+        {
+            std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+
+    static std::vector<std::array<GLuint, 3>> getTriangles(const std::vector<GLuint> & aIndices)
+    {
+        std::vector<std::array<GLuint, 3>> triangles;
+        for (std::size_t corner = 0; corner + 2 < aIndices.size(); corner += 3)
+        {
+            triangles.push_back({aIndices[corner], aIndices[corner + 1], aIndices[corner + 2]});
+        }
+        return triangles;
+    }
+
+    std::size_t side;
+    std::vector<math::Position<3, GLfloat>> positions;
+    std::vector<GLuint> indices;
+};
+
+
+} // namespace gltfviewer
+} // namespace ad
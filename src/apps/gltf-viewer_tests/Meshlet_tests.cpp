@@ -0,0 +1,118 @@
+#include "catch.hpp"
+
+#include "Grid.h"
+
+#include <Meshlet.h>
+
+#include <cmath>
+#include <set>
+
+
+using namespace ad;
+using namespace ad::gltfviewer;
+
+
+namespace {
+
+    GLfloat getDistance(const math::Position<3, GLfloat> & aLhs, const math::Position<3, GLfloat> & aRhs)
+    {
+        const GLfloat x = aLhs[0] - aRhs[0];
+        const GLfloat y = aLhs[1] - aRhs[1];
+        const GLfloat z = aLhs[2] - aRhs[2];
+        return std::sqrt(x * x + y * y + z * z);
+    }
+
+} // anonymous namespace
+
+
+SCENARIO("Meshlet building.")
+{
+    GIVEN("A grid, too large for a single meshlet.")
+    {
+        Grid grid{32};
+
+        WHEN("It is split in meshlets.")
+        {
+            const std::vector<Meshlet> meshlets = buildMeshlets(grid.indices, grid.positions);
+
+            THEN("The meshlets are consecutive ranges of whole triangles, covering all the indices.")
+            {
+                REQUIRE(meshlets.size() > 1);
+                GLuint expectedOffset = 0;
+                for (const Meshlet & meshlet : meshlets)
+                {
+                    CHECK(meshlet.indexOffset == expectedOffset);
+                    CHECK(meshlet.indexCount > 0);
+                    CHECK(meshlet.indexCount % 3 == 0);
+                    expectedOffset += meshlet.indexCount;
+                }
+                CHECK(expectedOffset == grid.indices.size());
+            }
+
+            THEN("Each meshlet holds the limits on its vertices and triangles.")
+            {
+                for (const Meshlet & meshlet : meshlets)
+                {
+                    const std::set<GLuint> vertices{grid.indices.begin() + meshlet.indexOffset,
+                                                    grid.indices.begin() + meshlet.indexOffset + meshlet.indexCount};
+                    CHECK(vertices.size() <= gMeshletMaxVertices);
+                    CHECK(static_cast<std::size_t>(meshlet.indexCount / 3) <= gMeshletMaxTriangles);
+                }
+            }
+
+            THEN("The bounding sphere of each meshlet contains its vertices.")
+            {
+                for (const Meshlet & meshlet : meshlets)
+                {
+                    for (GLsizei corner = 0; corner != meshlet.indexCount; ++corner)
+                    {
+                        const GLuint index = grid.indices[meshlet.indexOffset + corner];
+                        CHECK(getDistance(grid.positions[index], meshlet.center) <= meshlet.radius * 1.0001f);
+                    }
+                }
+            }
+
+            THEN("The normal cone of the flat grid is its normal, and allows culling.")
+            {
+                for (const Meshlet & meshlet : meshlets)
+                {
+                    CHECK(meshlet.coneAxis[0] == Approx(0.f).margin(1e-5));
+                    CHECK(meshlet.coneAxis[1] == Approx(0.f).margin(1e-5));
+                    CHECK(meshlet.coneAxis[2] == Approx(1.f));
+                    CHECK(meshlet.coneCutoff < 1.f);
+                }
+            }
+        }
+    }
+
+    GIVEN("Triangles all reusing the same vertices.")
+    {
+        const std::vector<math::Position<3, GLfloat>> positions{
+            {0.f, 0.f, 0.f},
+            {1.f, 0.f, 0.f},
+            {0.f, 1.f, 0.f},
+        };
+        std::vector<GLuint> indices;
+        for (std::size_t triangle = 0; triangle != 2 * gMeshletMaxTriangles + 1; ++triangle)
+        {
+            indices.insert(indices.end(), {0, 1, 2});
+        }
+
+        THEN("The meshlets are split on the triangle limit.")
+        {
+            const std::vector<Meshlet> meshlets = buildMeshlets(indices, positions);
+            REQUIRE(meshlets.size() == 3);
+            CHECK(meshlets[0].indexCount == 3 * gMeshletMaxTriangles);
+            CHECK(meshlets[1].indexCount == 3 * gMeshletMaxTriangles);
+            CHECK(meshlets[2].indexCount == 3);
+        }
+    }
+
+    GIVEN("An empty triangle list.")
+    {
+        THEN("There is no meshlet.")
+        {
+            CHECK(buildMeshlets({}, {}).empty());
+        }
+    }
+}
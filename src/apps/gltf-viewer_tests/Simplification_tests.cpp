@@ -0,0 +1,197 @@
+#include "catch.hpp"
+
+#include "Grid.h"
+
+#include <LevelOfDetail.h>
+#include <Simplification.h>
+
+#include <math/Transformations.h>
+
+#include <algorithm>
+#include <limits>
+
+
+using namespace ad;
+using namespace ad::gltfviewer;
+
+
+namespace {
+
+    constexpr GLfloat gNoMaxError = std::numeric_limits<GLfloat>::max();
+
+
+    /// \brief The grid bent into a bowl, so no collapse is free of error.
+    Grid makeBowl(std::size_t aSide)
+    {
+        Grid grid{aSide};
+        const GLfloat center = aSide / 2.f;
+        for (auto & position : grid.positions)
+        {
+            const GLfloat x = position[0] - center;
+            const GLfloat y = position[1] - center;
+            position[2] = 0.05f * (x * x + y * y);
+        }
+        return grid;
+    }
+
+
+    /// \brief The z component of the (non-unit) normal of each triangle.
+    std::vector<GLfloat> getNormalsZ(const Grid & aGrid, const std::vector<GLuint> & aIndices)
+    {
+        std::vector<GLfloat> result;
+        for (const auto & triangle : Grid::getTriangles(aIndices))
+        {
+            const auto & a = aGrid.positions[triangle[0]];
+            const auto & b = aGrid.positions[triangle[1]];
+            const auto & c = aGrid.positions[triangle[2]];
+            result.push_back((b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]));
+        }
+        return result;
+    }
+
+
+    bool isBorder(const Grid & aGrid, GLuint aVertex)
+    {
+        const std::size_t x = aVertex % (aGrid.side + 1);
+        const std::size_t y = aVertex / (aGrid.side + 1);
+        return x == 0 || y == 0 || x == aGrid.side || y == aGrid.side;
+    }
+
+} // anonymous namespace
+
+
+SCENARIO("Quadric error simplification.")
+{
+    GIVEN("A flat grid.")
+    {
+        Grid grid{16};
+
+        WHEN("It is simplified to less than half its indices.")
+        {
+            const std::size_t target = grid.indices.size() * 2 / 5;
+            const std::vector<GLuint> simplified = simplify(grid.positions, grid.indices, target, gNoMaxError);
+
+            THEN("The target index count is reached.")
+            {
+                CHECK(simplified.size() <= target);
+                CHECK(simplified.size() % 3 == 0);
+                // Each collapse removes two triangles, the simplification stops right at the target.
+                CHECK(simplified.size() + 6 > target);
+            }
+
+            THEN("The border vertices are locked, all still being used.")
+            {
+                for (GLuint vertex = 0; vertex != grid.positions.size(); ++vertex)
+                {
+                    if (isBorder(grid, vertex))
+                    {
+                        CHECK(std::ranges::find(simplified, vertex) != simplified.end());
+                    }
+                }
+            }
+
+            THEN("The triangles still face up.")
+            {
+                for (GLfloat normalZ : getNormalsZ(grid, simplified))
+                {
+                    CHECK(normalZ > 0.f);
+                }
+            }
+        }
+    }
+
+    GIVEN("A curved grid.")
+    {
+        Grid bowl = makeBowl(16);
+
+        THEN("No collapse is performed without an error budget.")
+        {
+            CHECK(simplify(bowl.positions, bowl.indices, 0, 0.f).size() == bowl.indices.size());
+        }
+
+        THEN("Simplifying as much as possible flips no triangle.")
+        {
+            const std::vector<GLuint> simplified = simplify(bowl.positions, bowl.indices, 0, gNoMaxError);
+            CHECK(simplified.size() < bowl.indices.size() / 4);
+            for (GLfloat normalZ : getNormalsZ(bowl, simplified))
+            {
+                CHECK(normalZ > 0.f);
+            }
+        }
+    }
+}
+
+
+SCENARIO("Levels of detail.")
+{
+    GIVEN("A flat grid.")
+    {
+        Grid grid{32};
+        const math::Box<GLfloat> box{{0.f, 0.f, 0.f}, {32.f, 32.f, 0.f}};
+
+        THEN("Each level significantly reduces the previous one, indexing the same vertices.")
+        {
+            const std::vector<std::vector<GLuint>> levels = generateLevelsOfDetail(grid.positions, grid.indices, box);
+            REQUIRE(!levels.empty());
+            CHECK(levels.size() <= gMaxLevelsOfDetail - 1);
+
+            std::size_t previous = grid.indices.size();
+            for (const std::vector<GLuint> & level : levels)
+            {
+                CHECK(level.size() <= previous * 3 / 4);
+                CHECK(*std::ranges::max_element(level) < grid.positions.size());
+                previous = level.size();
+            }
+        }
+    }
+
+    GIVEN("A box moving away from a perspective camera.")
+    {
+        const math::Box<GLfloat> box{{-1.f, -1.f, -1.f}, {2.f, 2.f, 2.f}};
+        // Looking down -Z, with a 90 degrees vertical field of view.
+        math::Matrix<4, 4, GLfloat> projection = math::Matrix<4, 4, GLfloat>::Identity();
+        projection.at(2, 2) = -1.f;
+        projection.at(2, 3) = -1.f;
+        projection.at(3, 2) = -0.2f;
+        projection.at(3, 3) = 0.f;
+        const GLfloat fullDetailCoverage = 0.5f;
+
+        THEN("The coverage decreases, and the selected level never decreases, with distance.")
+        {
+            GLfloat previousCoverage = std::numeric_limits<GLfloat>::infinity();
+            std::uint8_t previousLevel = 0;
+            for (GLfloat distance = 2.f; distance < 500.f; distance *= 1.25f)
+            {
+                const GLfloat coverage = getScreenCoverage(
+                    box, math::trans3d::translate(math::Vec<3, GLfloat>{0.f, 0.f, -distance}), projection);
+                const std::uint8_t level = selectLevelOfDetail(coverage, fullDetailCoverage);
+
+                CHECK(coverage < previousCoverage);
+                CHECK(level >= previousLevel);
+                previousCoverage = coverage;
+                previousLevel = level;
+            }
+            CHECK(previousLevel == gMaxLevelsOfDetail - 1);
+        }
+
+        THEN("The full detail is selected when the camera is inside the box bounds.")
+        {
+            const GLfloat coverage = getScreenCoverage(box, math::AffineMatrix<4, GLfloat>::Identity(), projection);
+            CHECK(selectLevelOfDetail(coverage, fullDetailCoverage) == 0);
+        }
+    }
+
+    GIVEN("A coverage halving repeatedly.")
+    {
+        THEN("One more level is selected each time, up to the coarsest.")
+        {
+            CHECK(selectLevelOfDetail(1.f, 0.5f) == 0);
+            CHECK(selectLevelOfDetail(0.5f, 0.5f) == 0);
+            CHECK(selectLevelOfDetail(0.3f, 0.5f) == 0);
+            CHECK(selectLevelOfDetail(0.2f, 0.5f) == 1);
+            CHECK(selectLevelOfDetail(0.1f, 0.5f) == 2);
+            CHECK(selectLevelOfDetail(0.05f, 0.5f) == 3);
+            CHECK(selectLevelOfDetail(0.001f, 0.5f) == gMaxLevelsOfDetail - 1);
+        }
+    }
+}
@@ -0,0 +1,244 @@
+#include "catch.hpp"
+
+#include <TextureCompression.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+
+
+using namespace ad;
+using namespace ad::gltfviewer;
+
+
+namespace {
+
+    using Texel = std::array<int, 4>;
+
+
+    unsigned int readBytes(const std::byte * aSource, std::size_t aCount)
+    {
+        unsigned int result = 0;
+        for (std::size_t byte = 0; byte != aCount; ++byte)
+        {
+            result |= std::to_integer<unsigned int>(aSource[byte]) << (8 * byte);
+        }
+        return result;
+    }
+
+
+    Texel fromRgb565(unsigned int aColor)
+    {
+        const int red = (aColor >> 11) & 0x1F;
+        const int green = (aColor >> 5) & 0x3F;
+        const int blue = aColor & 0x1F;
+        return {(red << 3) | (red >> 2), (green << 2) | (green >> 4), (blue << 3) | (blue >> 2), 255};
+    }
+
+
+    /// \brief Decode a BC1 color block, as specified by EXT_texture_compression_s3tc.
+    std::array<Texel, 16> decodeColorBlock(const std::byte * aBlock)
+    {
+        const unsigned int color0 = readBytes(aBlock, 2);
+        const unsigned int color1 = readBytes(aBlock + 2, 2);
+        const unsigned int indices = readBytes(aBlock + 4, 4);
+
+        const Texel c0 = fromRgb565(color0);
+        const Texel c1 = fromRgb565(color1);
+        std::array<Texel, 4> palette{c0, c1, c0, c0};
+        for (std::size_t channel = 0; channel != 3; ++channel)
+        {
+            if (color0 > color1)
+            {
+                palette[2][channel] = (2 * c0[channel] + c1[channel]) / 3;
+                palette[3][channel] = (c0[channel] + 2 * c1[channel]) / 3;
+            }
+            else
+            {
+                palette[2][channel] = (c0[channel] + c1[channel]) / 2;
+                palette[3][channel] = 0;
+            }
+        }
+
+        std::array<Texel, 16> result;
+        for (std::size_t texel = 0; texel != 16; ++texel)
+        {
+            result[texel] = palette[(indices >> (2 * texel)) & 0x3];
+        }
+        return result;
+    }
+
+
+    /// \brief Decode a BC3 alpha block into the alpha of the texels.
+    void decodeAlphaBlock(const std::byte * aBlock, std::array<Texel, 16> & aTexels)
+    {
+        const int alpha0 = std::to_integer<int>(aBlock[0]);
+        const int alpha1 = std::to_integer<int>(aBlock[1]);
+        std::array<int, 8> palette{alpha0, alpha1};
+        if (alpha0 > alpha1)
+        {
+            for (int index = 1; index != 7; ++index)
+            {
+                palette[index + 1] = ((7 - index) * alpha0 + index * alpha1) / 7;
+            }
+        }
+        else
+        {
+            for (int index = 1; index != 5; ++index)
+            {
+                palette[index + 1] = ((5 - index) * alpha0 + index * alpha1) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        const std::uint64_t indices = std::uint64_t{readBytes(aBlock + 2, 3)}
+                                      | (std::uint64_t{readBytes(aBlock + 5, 3)} << 24);
+        for (std::size_t texel = 0; texel != 16; ++texel)
+        {
+            aTexels[texel][3] = palette[(indices >> (3 * texel)) & 0x7];
+        }
+    }
+
+
+    /// \brief Decode the first level of the image, as RGBA texels row by row.
+    std::vector<Texel> decodeImage(const CompressedImage & aImage)
+    {
+        const bool hasAlpha = aImage.internalFormat == gCompressedRgbaBc3;
+        std::vector<Texel> result(std::size_t(aImage.width) * aImage.height);
+        const std::byte * block = aImage.blocks.data();
+        for (GLsizei blockY = 0; blockY < aImage.height; blockY += 4)
+        {
+            for (GLsizei blockX = 0; blockX < aImage.width; blockX += 4)
+            {
+                std::array<Texel, 16> texels = decodeColorBlock(block + (hasAlpha ? 8 : 0));
+                if (hasAlpha)
+                {
+                    decodeAlphaBlock(block, texels);
+                }
+                block += hasAlpha ? 16 : 8;
+
+                for (GLsizei y = blockY; y < std::min(blockY + 4, aImage.height); ++y)
+                {
+                    for (GLsizei x = blockX; x < std::min(blockX + 4, aImage.width); ++x)
+                    {
+                        result[std::size_t(y) * aImage.width + x] = texels[(y - blockY) * 4 + (x - blockX)];
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+
+    std::vector<std::uint8_t> makeImage(GLsizei aWidth, GLsizei aHeight, auto aTexel)
+    {
+        std::vector<std::uint8_t> result;
+        for (GLsizei y = 0; y != aHeight; ++y)
+        {
+            for (GLsizei x = 0; x != aWidth; ++x)
+            {
+                const Texel texel = aTexel(x, y);
+                result.insert(result.end(), texel.begin(), texel.end());
+            }
+        }
+        return result;
+    }
+
+
+    /// \brief The largest difference on any channel between the decoded texels and the source.
+    int getMaxError(const std::vector<Texel> & aDecoded, const std::vector<std::uint8_t> & aSource)
+    {
+        int result = 0;
+        for (std::size_t texel = 0; texel != aDecoded.size(); ++texel)
+        {
+            for (std::size_t channel = 0; channel != 4; ++channel)
+            {
+                result = std::max(result, std::abs(aDecoded[texel][channel] - aSource[texel * 4 + channel]));
+            }
+        }
+        return result;
+    }
+
+} // anonymous namespace
+
+
+SCENARIO("Block compression of the textures.")
+{
+    GIVEN("An opaque image of a single color.")
+    {
+        const std::vector<std::uint8_t> pixels =
+            makeImage(8, 8, [](GLsizei, GLsizei) { return Texel{200, 100, 50, 255}; });
+
+        WHEN("It is compressed.")
+        {
+            const CompressedImage image = compressImage(pixels, 8, 8, 1);
+
+            THEN("It is compressed to BC1, and decodes to the color within the RGB565 precision.")
+            {
+                CHECK(image.internalFormat == gCompressedRgbBc1);
+                REQUIRE(image.blocks.size() == 4 * 8);
+                // 5 bits channels are precise to 255 / 31 / 2, the 6 bits green to 255 / 63 / 2.
+                for (const Texel & texel : decodeImage(image))
+                {
+                    CHECK(std::abs(texel[0] - 200) <= 4);
+                    CHECK(std::abs(texel[1] - 100) <= 2);
+                    CHECK(std::abs(texel[2] - 50) <= 4);
+                    CHECK(texel[3] == 255);
+                }
+            }
+        }
+    }
+
+    GIVEN("An opaque image with a gradient in each block.")
+    {
+        const std::vector<std::uint8_t> pixels = makeImage(8, 8, [](GLsizei x, GLsizei y)
+        {
+            return Texel{16 + 28 * x, 240 - 20 * x, 64 + 8 * y, 255};
+        });
+
+        THEN("It decodes close to the source.")
+        {
+            const CompressedImage image = compressImage(pixels, 8, 8, 1);
+            CHECK(image.internalFormat == gCompressedRgbBc1);
+            CHECK(getMaxError(decodeImage(image), pixels) <= 16);
+        }
+    }
+
+    GIVEN("A translucent image, with a gradient of alpha.")
+    {
+        const std::vector<std::uint8_t> pixels = makeImage(4, 4, [](GLsizei x, GLsizei y)
+        {
+            return Texel{255, 128, 0, 255 - 16 * (y * 4 + x)};
+        });
+
+        THEN("It is compressed to BC3, its alpha decoding within the 8 alphas precision.")
+        {
+            const CompressedImage image = compressImage(pixels, 4, 4, 1);
+            CHECK(image.internalFormat == gCompressedRgbaBc3);
+            REQUIRE(image.blocks.size() == 16);
+            // The alphas are interpolated in 7 steps between the extremes.
+            const std::vector<Texel> decoded = decodeImage(image);
+            for (std::size_t texel = 0; texel != decoded.size(); ++texel)
+            {
+                CHECK(std::abs(decoded[texel][3] - pixels[texel * 4 + 3]) <= 240 / 14 + 1);
+            }
+        }
+    }
+
+    GIVEN("An image whose size is not a multiple of the blocks.")
+    {
+        const std::vector<std::uint8_t> pixels =
+            makeImage(5, 3, [](GLsizei, GLsizei) { return Texel{10, 20, 30, 255}; });
+
+        THEN("The mipmap chain is stored whole, each level rounded up to complete blocks.")
+        {
+            const CompressedImage image = compressImage(pixels, 5, 3, 3);
+            // Levels of 5x3 (2 blocks), 2x1 and 1x1 (1 block each).
+            CHECK(getCompressedSize(gCompressedRgbBc1, 5, 3) == 2 * 8);
+            CHECK(image.blocks.size() == 4 * 8);
+            CHECK(image.blocks.size() == getCompressedSize(image.internalFormat, 5, 3, 3));
+            CHECK(getMaxError(decodeImage(image), pixels) <= 4);
+        }
+    }
+}
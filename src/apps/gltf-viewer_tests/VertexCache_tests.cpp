@@ -0,0 +1,159 @@
+#include "catch.hpp"
+
+#include "Grid.h"
+
+#include <VertexCache.h>
+
+
+using namespace ad;
+using namespace ad::gltfviewer;
+
+
+SCENARIO("Vertex cache simulation.")
+{
+    GIVEN("Two triangles sharing an edge.")
+    {
+        const std::vector<GLuint> indices{0, 1, 2,  2, 1, 3};
+
+        THEN("Only the 4 distinct vertices are transformed.")
+        {
+            VertexCacheStatistics statistics = analyzeVertexCache(indices, 4);
+            CHECK(statistics.triangles == 2);
+            CHECK(statistics.vertices == 4);
+            CHECK(statistics.transformedVertices == 4);
+            CHECK(statistics.getAcmr() == 2.);
+            CHECK(statistics.getAtvr() == 1.);
+        }
+    }
+
+    GIVEN("A triangle list reusing a vertex after it was evicted.")
+    {
+        // Each triangle uses 3 new vertices, so vertex 0 leaves the FIFO before being reused.
+        std::vector<GLuint> indices;
+        for (GLuint vertex = 0; vertex != gSimulatedCacheSize + 3; ++vertex)
+        {
+            indices.push_back(vertex);
+        }
+        indices.resize(indices.size() / 3 * 3);
+        const std::size_t vertexCount = indices.size();
+        indices.insert(indices.end(), {0, 1, 2});
+
+        THEN("The reused vertices are transformed again.")
+        {
+            VertexCacheStatistics statistics = analyzeVertexCache(indices, vertexCount);
+            CHECK(statistics.transformedVertices == vertexCount + 3);
+        }
+    }
+}
+
+
+SCENARIO("Triangle reordering for the post-transform cache.")
+{
+    GIVEN("A grid whose triangles are in random order.")
+    {
+        Grid grid{32};
+        grid.shuffleTriangles();
+        const VertexCacheStatistics shuffled = analyzeVertexCache(grid.indices, grid.positions.size());
+
+        WHEN("The triangles are reordered.")
+        {
+            const std::vector<GLuint> optimized = optimizeVertexCache(grid.indices, grid.positions.size());
+            const VertexCacheStatistics statistics = analyzeVertexCache(optimized, grid.positions.size());
+
+            THEN("The same triangles are drawn, with their winding.")
+            {
+                CHECK(Grid::getSortedTriangles(optimized) == Grid::getSortedTriangles(grid.indices));
+            }
+
+            THEN("The cache miss ratio drops well below the random order.")
+            {
+                CHECK(shuffled.getAcmr() > 2.);
+                CHECK(statistics.getAcmr() < 0.8);
+                CHECK(statistics.getAcmr() < shuffled.getAcmr() / 2.);
+            }
+
+            THEN("Reordering for overdraw keeps the triangles and most of the vertex reuse.")
+            {
+                const std::vector<GLuint> overdraw = optimizeOverdraw(optimized, grid.positions);
+                CHECK(Grid::getSortedTriangles(overdraw) == Grid::getSortedTriangles(grid.indices));
+                CHECK(analyzeVertexCache(overdraw, grid.positions.size()).getAcmr() < 1.);
+            }
+        }
+    }
+
+    GIVEN("An empty triangle list.")
+    {
+        THEN("The result is empty.")
+        {
+            CHECK(optimizeVertexCache({}, 0).empty());
+        }
+    }
+}
+
+
+SCENARIO("Vertex fetch remapping.")
+{
+    GIVEN("Indices using the vertices out of order, and a vertex never used.")
+    {
+        const std::vector<GLuint> indices{3, 1, 4,  4, 1, 0};
+
+        THEN("The vertices are numbered by first use, the unused one last.")
+        {
+            CHECK(getVertexFetchRemap(indices, 5) == std::vector<GLuint>{3, 1, 4, 0, 2});
+        }
+    }
+}
+
+
+SCENARIO("Vertex welding.")
+{
+    GIVEN("A non-indexed quad, its two triangles repeating the vertices of the diagonal.")
+    {
+        // Position and texture coordinates.
+        const std::vector<GLfloat> interleaved{
+            0.f, 0.f, 0.f,  0.f, 0.f,
+            1.f, 0.f, 0.f,  1.f, 0.f,
+            1.f, 1.f, 0.f,  1.f, 1.f,
+            0.f, 0.f, 0.f,  0.f, 0.f,
+            1.f, 1.f, 0.f,  1.f, 1.f,
+            0.f, 1.f, 0.f,  0.f, 1.f,
+        };
+
+        WHEN("The vertices are welded.")
+        {
+            WeldedVertices welded = weldVertices(interleaved, 6);
+
+            THEN("The identical vertices are merged, numbered by first occurrence.")
+            {
+                CHECK(welded.indices == std::vector<GLuint>{0, 1, 2,  0, 2, 3});
+                CHECK(welded.representatives == std::vector<std::size_t>{0, 1, 2, 5});
+            }
+        }
+    }
+
+    GIVEN("Vertices with the same position, but differing in another attribute or in bits only.")
+    {
+        const std::vector<GLfloat> interleaved{
+            0.f, 0.f, 0.f,  0.f, 0.f,
+            0.f, 0.f, 0.f,  1.f, 0.f,
+            -0.f, 0.f, 0.f,  0.f, 0.f,
+        };
+
+        THEN("No vertex is merged.")
+        {
+            WeldedVertices welded = weldVertices(interleaved, 3);
+            CHECK(welded.indices == std::vector<GLuint>{0, 1, 2});
+            CHECK(welded.representatives == std::vector<std::size_t>{0, 1, 2});
+        }
+    }
+
+    GIVEN("No vertex.")
+    {
+        THEN("The result is empty.")
+        {
+            WeldedVertices welded = weldVertices({}, 0);
+            CHECK(welded.indices.empty());
+            CHECK(welded.representatives.empty());
+        }
+    }
+}
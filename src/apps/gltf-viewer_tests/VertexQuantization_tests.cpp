@@ -0,0 +1,265 @@
+#include "catch.hpp"
+
+#include <VertexQuantization.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <random>
+
+
+using namespace ad;
+using namespace ad::gltfviewer;
+
+
+namespace {
+
+    /// \brief Decode an IEEE half float, as done by the GPU.
+    GLfloat fromHalf(GLhalf aHalf)
+    {
+        const GLfloat sign = (aHalf & 0x8000) ? -1.f : 1.f;
+        const int exponent = (aHalf >> 10) & 0x1F;
+        const int mantissa = aHalf & 0x3FF;
+        if (exponent == 0)
+        {
+            return sign * std::ldexp(static_cast<GLfloat>(mantissa), -24);
+        }
+        else if (exponent == 31)
+        {
+            return sign * std::numeric_limits<GLfloat>::infinity();
+        }
+        return sign * std::ldexp(static_cast<GLfloat>(mantissa | 0x400), exponent - 25);
+    }
+
+
+    GLfloat fromSnorm16(GLshort aValue)
+    {
+        return std::max(aValue / 32767.f, -1.f);
+    }
+
+
+    /// \brief Decode the octahedral normal the same way as the shaders, see gVertexNormal.
+    std::array<GLfloat, 3> decodeOctahedral(const std::array<GLshort, 2> & aEncoded)
+    {
+        std::array<GLfloat, 3> normal{fromSnorm16(aEncoded[0]), fromSnorm16(aEncoded[1]), 0.f};
+        normal[2] = 1.f - std::abs(normal[0]) - std::abs(normal[1]);
+        const GLfloat folded = std::max(-normal[2], 0.f);
+        normal[0] += normal[0] >= 0.f ? -folded : folded;
+        normal[1] += normal[1] >= 0.f ? -folded : folded;
+        const GLfloat length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        return {normal[0] / length, normal[1] / length, normal[2] / length};
+    }
+
+
+    /// \brief The distance between the unit normal and its encoding round trip,
+    /// which is the angle between them for small errors (without the imprecision of acos close to 1).
+    GLfloat getRoundTripError(const std::array<GLfloat, 3> & aNormal)
+    {
+        const std::array<GLfloat, 3> decoded = decodeOctahedral(encodeOctahedral(aNormal));
+        const GLfloat x = decoded[0] - aNormal[0];
+        const GLfloat y = decoded[1] - aNormal[1];
+        const GLfloat z = decoded[2] - aNormal[2];
+        return std::sqrt(x * x + y * y + z * z);
+    }
+
+} // anonymous namespace
+
+
+SCENARIO("Half float conversion.")
+{
+    GIVEN("Values exactly represented as half floats.")
+    {
+        THEN("They are converted exactly, including the signed zeros.")
+        {
+            CHECK(toHalf(0.f) == 0x0000);
+            CHECK(toHalf(-0.f) == 0x8000);
+            CHECK(toHalf(1.f) == 0x3C00);
+            CHECK(toHalf(-2.f) == 0xC000);
+            CHECK(toHalf(0.5f) == 0x3800);
+            CHECK(toHalf(65504.f) == 0x7BFF);
+            CHECK(toHalf(std::ldexp(1.f, -14)) == 0x0400);
+        }
+    }
+
+    GIVEN("Values outside of the normal half range.")
+    {
+        THEN("The large values become infinities, the tiny values signed zeros.")
+        {
+            CHECK(toHalf(1e6f) == 0x7C00);
+            CHECK(toHalf(-1e6f) == 0xFC00);
+            CHECK(toHalf(std::numeric_limits<GLfloat>::infinity()) == 0x7C00);
+            CHECK(toHalf(1e-8f) == 0x0000);
+            CHECK(toHalf(-1e-8f) == 0x8000);
+        }
+    }
+
+    GIVEN("Values over the whole normal half range.")
+    {
+        THEN("The round trip is within half an ulp, the relative error below 2^-11.")
+        {
+            const GLfloat maxRelativeError = std::ldexp(1.f, -11);
+            for (GLfloat value = std::ldexp(1.f, -14); value < 65504.f; value *= 1.0137f)
+            {
+                CHECK(std::abs(fromHalf(toHalf(value)) - value) <= value * maxRelativeError);
+                CHECK(fromHalf(toHalf(-value)) == -fromHalf(toHalf(value)));
+            }
+        }
+
+        THEN("A value rounding up past the largest mantissa carries into the exponent.")
+        {
+            CHECK(toHalf(std::nextafter(2.f, 0.f)) == 0x4000);
+        }
+    }
+}
+
+
+SCENARIO("Octahedral encoding of the normals.")
+{
+    GIVEN("The normals along the axes.")
+    {
+        const std::array<std::array<GLfloat, 3>, 6> axes{{
+            {1.f, 0.f, 0.f}, {-1.f, 0.f, 0.f},
+            {0.f, 1.f, 0.f}, {0.f, -1.f, 0.f},
+            {0.f, 0.f, 1.f}, {0.f, 0.f, -1.f},
+        }};
+
+        THEN("They decode exactly.")
+        {
+            for (const auto & axis : axes)
+            {
+                const std::array<GLfloat, 3> decoded = decodeOctahedral(encodeOctahedral(axis));
+                CHECK(decoded == axis);
+            }
+        }
+
+        THEN("The signed zeros of the other components do not alter the encoding.")
+        {
+            CHECK(encodeOctahedral(std::array<GLfloat, 3>{-0.f, -0.f, 1.f})
+                  == encodeOctahedral(std::array<GLfloat, 3>{0.f, 0.f, 1.f}));
+            CHECK(encodeOctahedral(std::array<GLfloat, 3>{1.f, -0.f, 0.f})
+                  == encodeOctahedral(std::array<GLfloat, 3>{1.f, 0.f, 0.f}));
+            CHECK(decodeOctahedral(encodeOctahedral(std::array<GLfloat, 3>{0.f, -0.f, -1.f}))
+                  == std::array<GLfloat, 3>{0.f, 0.f, -1.f});
+        }
+    }
+
+    GIVEN("Unit normals spread over the sphere.")
+    {
+        std::mt19937 generator{7};
+        std::normal_distribution<GLfloat> distribution;
+
+        THEN("The round trip error is within the 16 bits precision.")
+        {
+            GLfloat maxError = 0.f;
+            for (int sample = 0; sample != 10000; ++sample)
+            {
+                std::array<GLfloat, 3> normal{distribution(generator), distribution(generator), distribution(generator)};
+                const GLfloat length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+                for (GLfloat & component : normal)
+                {
+                    component /= length;
+                }
+                maxError = std::max(maxError, getRoundTripError(normal));
+            }
+            // Half a quantization step on the octahedron, stretched at most by a factor 2 on the sphere.
+            CHECK(maxError < 2.f * 2.f / 32767.f);
+        }
+    }
+
+    GIVEN("A null normal.")
+    {
+        THEN("It is encoded as zeros.")
+        {
+            CHECK(encodeOctahedral(std::array<GLfloat, 3>{0.f, 0.f, 0.f}) == std::array<GLshort, 2>{0, 0});
+        }
+    }
+}
+
+
+SCENARIO("Quantization of the positions.")
+{
+    GIVEN("The bounding box of a mesh, longer along Y.")
+    {
+        const math::Position<3, GLfloat> boxMin{-3.f, 1.f, 2.f};
+        const math::Box<GLfloat> box{boxMin, {4.f, 10.f, 2.f}};
+        const PositionQuantization quantization{box};
+
+        THEN("The quantization grid is the cube enclosing the box.")
+        {
+            CHECK(quantization.extent == 10.f);
+            CHECK(quantization.origin[0] == -6.f);
+            CHECK(quantization.origin[1] == 1.f);
+            CHECK(quantization.origin[2] == -2.f);
+        }
+
+        THEN("The dequantization matrix maps the quantized positions back, within half a grid step.")
+        {
+            const GLfloat maxError = quantization.extent / 65535.f / 2.f * 1.01f;
+            std::mt19937 generator{11};
+            std::uniform_real_distribution<GLfloat> unit{0.f, 1.f};
+            const math::AffineMatrix<4, GLfloat> dequantization = quantization.getDequantization();
+
+            for (int sample = 0; sample != 1000; ++sample)
+            {
+                const math::Position<3, GLfloat> position{
+                    boxMin[0] + unit(generator) * box.width(),
+                    boxMin[1] + unit(generator) * box.height(),
+                    boxMin[2] + unit(generator) * box.depth(),
+                };
+                const std::array<GLushort, 4> quantized = quantization.quantize(position);
+                REQUIRE(quantized[3] == 65535);
+
+                // As read by the shaders, unsigned normalized.
+                const math::Position<4, GLfloat> dequantized =
+                    math::Position<4, GLfloat>{quantized[0] / 65535.f,
+                                               quantized[1] / 65535.f,
+                                               quantized[2] / 65535.f,
+                                               quantized[3] / 65535.f}
+                    * dequantization;
+                CHECK(dequantized[3] == Approx(1.f));
+                for (std::size_t axis = 0; axis != 3; ++axis)
+                {
+                    CHECK(std::abs(dequantized[axis] - position[axis]) <= maxError);
+                }
+            }
+        }
+
+        THEN("The quantized box is dequantized back to the original box.")
+        {
+            const math::Box<GLfloat> normalized = quantization.quantize(box);
+            const math::Position<3, GLfloat> center = normalized.center();
+            const math::Position<4, GLfloat> normalizedMin{center[0] - normalized.width() / 2.f,
+                                                           center[1] - normalized.height() / 2.f,
+                                                           center[2] - normalized.depth() / 2.f,
+                                                           1.f};
+            CHECK(normalizedMin[0] == Approx(0.3f));
+            CHECK(normalizedMin[1] == Approx(0.f).margin(1e-6));
+            CHECK(normalizedMin[2] == Approx(0.4f));
+            CHECK(normalized.height() == Approx(1.f));
+
+            const math::Position<4, GLfloat> min = normalizedMin * quantization.getDequantization();
+            for (std::size_t axis = 0; axis != 3; ++axis)
+            {
+                CHECK(min[axis] == Approx(boxMin[axis]));
+            }
+        }
+    }
+
+    GIVEN("A degenerate bounding box, a single point.")
+    {
+        const PositionQuantization quantization{math::Box<GLfloat>{{1.f, 2.f, 3.f}, {0.f, 0.f, 0.f}}};
+
+        THEN("The dequantization is still valid, mapping back to the point.")
+        {
+            CHECK(quantization.extent == 1.f);
+            const std::array<GLushort, 4> quantized = quantization.quantize({1.f, 2.f, 3.f});
+            const math::Position<4, GLfloat> dequantized =
+                math::Position<4, GLfloat>{quantized[0] / 65535.f, quantized[1] / 65535.f, quantized[2] / 65535.f, 1.f}
+                * quantization.getDequantization();
+            CHECK(dequantized[0] == 1.f);
+            CHECK(dequantized[1] == 2.f);
+            CHECK(dequantized[2] == 3.f);
+        }
+    }
+}